@@ -96,4 +96,12 @@ IF(ROS_FOUND)
   LIST(APPEND KLAMPT_DEFINITIONS "-DHAVE_ROS=1")
 ENDIF(ROS_FOUND)
 
+#zlib is optional, used to compress simulation logs
+FIND_PACKAGE(ZLIB)
+IF(ZLIB_FOUND)
+  LIST(APPEND KLAMPT_INCLUDE_DIRS ${ZLIB_INCLUDE_DIRS})
+  LIST(APPEND KLAMPT_LIBRARIES ${ZLIB_LIBRARIES})
+  LIST(APPEND KLAMPT_DEFINITIONS "-DHAVE_ZLIB=1")
+ENDIF(ZLIB_FOUND)
+
 LIST(REMOVE_DUPLICATES KLAMPT_INCLUDE_DIRS)
\ No newline at end of file
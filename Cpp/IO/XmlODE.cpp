@@ -163,6 +163,12 @@ bool XmlODESettings::GetSettings(ODESimulator& sim)
       int maxContacts;
       if(c->QueryValueAttribute("maxContacts",&maxContacts)==TIXML_SUCCESS)
         sim.GetSettings().maxContacts = maxContacts;
+      int contactBudget;
+      if(c->QueryValueAttribute("contactBudget",&contactBudget)==TIXML_SUCCESS)
+        sim.GetSettings().contactBudget = contactBudget;
+      int deterministic;
+      if(c->QueryValueAttribute("deterministic",&deterministic)==TIXML_SUCCESS)
+        sim.GetSettings().deterministic = (bool)deterministic;
       int boundaryLayer,adaptiveTimeStepping,rigidObjectCollisions,robotSelfCollisions,robotRobotCollisions;
       if(c->QueryValueAttribute("boundaryLayer",&boundaryLayer)==TIXML_SUCCESS) {
         LOG4CXX_WARN(GET_LOGGER(XmlParser),"Boundary layer settings don't have an effect after world is loaded");
@@ -1,10 +1,12 @@
 #include "XmlWorld.h"
 #include "View/Texturizer.h"
+#include <Klampt/Modeling/ThreadPool.h>
 #include <KrisLibrary/utils/stringutils.h>
 #include <KrisLibrary/utils/fileutils.h>
 #include <KrisLibrary/utils/ioutils.h>
 #include <KrisLibrary/Logger.h>
 #include <fstream>
+#include <set>
 
 DECLARE_LOGGER(XmlParser);
 
@@ -613,6 +615,62 @@ bool XmlWorld::Load(TiXmlElement* e,string _path)
   return true;
 }
 
+//Loads the geometry files of the world's rigid objects and terrains in
+//parallel, so that the elements find them in the ManagedGeometry cache when
+//they are parsed.  The loaded objects hold the cache entries, so they must
+//be kept until then.  Robots load their own link geometries in parallel.
+static void PrefetchGeometries(TiXmlElement* elem,const string& path,vector<shared_ptr<RigidObject> >& objects,vector<shared_ptr<Terrain> >& terrains)
+{
+  set<string> objectFiles,terrainFiles;
+  for(TiXmlElement* e=elem->FirstChildElement("rigidObject");e;e=e->NextSiblingElement("rigidObject")) {
+    const char* fn = e->Attribute("file");
+    TiXmlElement* geom = e->FirstChildElement("geometry");
+    if(geom) {
+      if(geom->Attribute("file")) fn = geom->Attribute("file");
+      else if(geom->Attribute("mesh")) fn = geom->Attribute("mesh");
+    }
+    if(!fn) continue;
+    const char* ext = FileExtension(fn);
+    //.obj files are object files, not meshes
+    if(ext && 0!=strcmp(ext,"obj") && Geometry::AnyGeometry3D::CanLoadExt(ext))
+      objectFiles.insert(ResolveFileReference(path,fn));
+  }
+  for(TiXmlElement* e=elem->FirstChildElement("terrain");e;e=e->NextSiblingElement("terrain")) {
+    const char* fn = e->Attribute("file");
+    if(!fn) continue;
+    const char* ext = FileExtension(fn);
+    if(ext && Geometry::AnyGeometry3D::CanLoadExt(ext))
+      terrainFiles.insert(ResolveFileReference(path,fn));
+  }
+  objectFiles.erase("");
+  terrainFiles.erase("");
+  vector<string> files(objectFiles.begin(),objectFiles.end());
+  files.insert(files.end(),terrainFiles.begin(),terrainFiles.end());
+  if(files.size() <= 1) return;
+  objects.resize(objectFiles.size());
+  terrains.resize(terrainFiles.size());
+  ThreadPool pool(ManagedGeometry::loadThreads);
+  if(pool.NumThreads() <= 1) return;
+  //load through the objects themselves so that the cached appearances get
+  //the same defaults as a serial load
+  pool.ParallelFor((int)files.size(),[&](int k,int thread) {
+    ManagedGeometry* geom;
+    if(k < (int)objects.size()) {
+      objects[k] = make_shared<RigidObject>();
+      if(!objects[k]->LoadGeometry(files[k].c_str())) return;
+      geom = &objects[k]->geometry;
+    }
+    else {
+      int t = k-(int)objects.size();
+      terrains[t] = make_shared<Terrain>();
+      if(!terrains[t]->LoadGeometry(files[k].c_str())) return;
+      geom = &terrains[t]->geometry;
+    }
+    if(!geom->IsDynamicGeometry() && !(*geom)->CollisionDataInitialized())
+      (*geom)->InitCollisionData();
+  });
+}
+
 bool XmlWorld::GetWorld(RobotWorld& world)
 {
   if(!elem) return false;
@@ -641,6 +699,10 @@ bool XmlWorld::GetWorld(RobotWorld& world)
                   goalCount++;
           e=e->NextSiblingElement(goal);
   }
+  vector<shared_ptr<RigidObject> > prefetchedObjects;
+  vector<shared_ptr<Terrain> > prefetchedTerrains;
+  PrefetchGeometries(elem,path,prefetchedObjects,prefetchedTerrains);
+
   //parse robots
   e = GetElement(robot);
   while(e) {
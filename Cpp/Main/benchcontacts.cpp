@@ -0,0 +1,284 @@
+#include "Simulation/ODESimulator.h"
+#include "Simulation/ODECustomGeometry.h"
+#include <KrisLibrary/geometry/ConvexHull2D.h>
+#include <KrisLibrary/meshing/MeshPrimitives.h>
+#include <KrisLibrary/math/random.h>
+#include <KrisLibrary/Timer.h>
+#include <ode/ode.h>
+#include <string.h>
+using namespace Math;
+using namespace Math3D;
+
+//defined in ODESimulator.cpp
+void ClusterContacts(vector<dContactGeom>& contacts,int maxClusters,Real clusterNormalScale,ODEContactScratch& scratch);
+void ClusterContactsVoxelGrid(vector<dContactGeom>& contacts,int maxClusters,Real clusterNormalScale,ODEContactScratch& scratch);
+
+#define OPTIONS_STRING "Options:\n\
+\t-n [num]: the number of raw contacts per scene (default 2000)\n\
+\t-k [num]: the maximum number of contacts after reduction (default 20)\n\
+\t-trials [num]: number of timing trials per scene (default 20)\n\
+\t-normalScale [scale]: the clustering normal scale (default 0.1)\n\
+\t-margin [m]: the collision margin of the mesh-mesh scenes (default 0.0025)\n\
+"
+
+void MakeContact(const Vector3& x,const Vector3& n,Real depth,dContactGeom& c)
+{
+  memset(&c,0,sizeof(dContactGeom));
+  x.get(c.pos);
+  Vector3 nn = n; nn.inplaceNormalize();
+  nn.get(c.normal);
+  c.depth = depth;
+}
+
+//a box face resting on a plane, with noisy normals
+void MakePlanarScene(int n,vector<dContactGeom>& contacts)
+{
+  contacts.resize(n);
+  for(int i=0;i<n;i++) {
+    Vector3 x(Rand(0,0.2),Rand(0,0.3),Rand(-0.001,0.001));
+    Vector3 normal(Rand(-0.02,0.02),Rand(-0.02,0.02),1);
+    MakeContact(x,normal,Rand(0,0.002),contacts[i]);
+  }
+}
+
+//a sphere of radius 0.1 resting on a plane
+void MakeCurvedScene(int n,vector<dContactGeom>& contacts)
+{
+  contacts.resize(n);
+  for(int i=0;i<n;i++) {
+    Real theta = Rand(0,TwoPi), phi = Rand(0,0.4);
+    Vector3 normal(Sin(phi)*Cos(theta),Sin(phi)*Sin(theta),Cos(phi));
+    Vector3 x = Vector3(0,0,0.1) - 0.1*normal;
+    MakeContact(x,normal,0.002*Cos(phi),contacts[i]);
+  }
+}
+
+//an object wedged into a corner: two patches with different normals
+void MakeCornerScene(int n,vector<dContactGeom>& contacts)
+{
+  contacts.resize(n);
+  for(int i=0;i<n;i++) {
+    if(i%2 == 0)
+      MakeContact(Vector3(Rand(0,0.2),Rand(0,0.2),0),Vector3(0,0,1),Rand(0,0.002),contacts[i]);
+    else
+      MakeContact(Vector3(0,Rand(0,0.2),Rand(0,0.1)),Vector3(1,0,0),Rand(0,0.002),contacts[i]);
+  }
+}
+
+//a square grid mesh in the z=0 plane, centered at the origin, with
+//sinusoidal bumps of the given height
+void MakeGridMesh(Real size,int res,Real bumpHeight,Meshing::TriMesh& mesh)
+{
+  mesh.verts.resize((res+1)*(res+1));
+  mesh.tris.resize(res*res*2);
+  Real h = size/res;
+  for(int i=0;i<=res;i++)
+    for(int j=0;j<=res;j++) {
+      Real x = -0.5*size + i*h, y = -0.5*size + j*h;
+      mesh.verts[i*(res+1)+j].set(x,y,bumpHeight*Sin(40.0*x)*Cos(30.0*y));
+    }
+  for(int i=0;i<res;i++)
+    for(int j=0;j<res;j++) {
+      int v00 = i*(res+1)+j, v10 = v00+res+1;
+      mesh.tris[(i*res+j)*2].set(v00,v10,v10+1);
+      mesh.tris[(i*res+j)*2+1].set(v00,v10+1,v00+1);
+    }
+}
+
+//Two meshes placed in contact, tested with dCollide as the simulator does
+struct MeshPairScene
+{
+  MeshPairScene() : g1(NULL),g2(NULL) {}
+  ~MeshPairScene() { if(g1) dGeomDestroy(g1); if(g2) dGeomDestroy(g2); }
+  void Init(const Meshing::TriMesh& m1,const Meshing::TriMesh& m2,const Vector3& t2,Real margin) {
+    geom1 = AnyCollisionGeometry3D(m1);
+    geom2 = AnyCollisionGeometry3D(m2);
+    geom1.InitCollisionData();
+    geom2.InitCollisionData();
+    g1 = dCreateCustomGeometry(&geom1,margin);
+    g2 = dCreateCustomGeometry(&geom2,margin);
+    dGeomSetPosition(g2,t2.x,t2.y,t2.z);
+  }
+  //all contacts, as generated for clustering
+  void Collide(vector<dContactGeom>& contacts,int budget,Real normalScale) {
+    contacts.resize(10000);
+    SetCustomGeometryContactBudget(budget,normalScale);
+    int n = dCollide(g1,g2,(int)contacts.size(),&contacts[0],sizeof(dContactGeom));
+    SetCustomGeometryContactBudget(0);
+    contacts.resize(n);
+  }
+
+  AnyCollisionGeometry3D geom1,geom2;
+  dGeomID g1,g2;
+};
+
+//a plate resting on a larger plate
+void MakePlanarMeshScene(Real margin,MeshPairScene& scene)
+{
+  Meshing::TriMesh floor,plate;
+  MakeGridMesh(1.0,40,0,floor);
+  MakeGridMesh(0.3,20,0,plate);
+  scene.Init(floor,plate,Vector3(0.01,0.02,0.5*margin),margin);
+}
+
+//a sphere mesh of radius 0.1 resting on a plate
+void MakeCurvedMeshScene(Real margin,MeshPairScene& scene)
+{
+  Meshing::TriMesh floor,ball;
+  MakeGridMesh(1.0,40,0,floor);
+  Sphere3D s;
+  s.center.setZero();
+  s.radius = 0.1;
+  Meshing::MakeTriMesh(s,30,60,ball);
+  scene.Init(floor,ball,Vector3(0,0,0.1+0.5*margin),margin);
+}
+
+//a plate resting on a bumpy plate
+void MakeBumpyMeshScene(Real margin,MeshPairScene& scene)
+{
+  Meshing::TriMesh floor,plate;
+  MakeGridMesh(1.0,80,0.002,floor);
+  MakeGridMesh(0.3,20,0,plate);
+  scene.Init(floor,plate,Vector3(0,0,0.002+0.5*margin),margin);
+}
+
+//area of the convex hull of the contact points projected orthogonally to
+//the mean normal
+Real SupportArea(const vector<dContactGeom>& contacts)
+{
+  if(contacts.size() < 3) return 0;
+  Vector3 n(Zero);
+  for(size_t i=0;i<contacts.size();i++)
+    n += Vector3(contacts[i].normal[0],contacts[i].normal[1],contacts[i].normal[2]);
+  if(n.norm() < 1e-8) n.set(0,0,1);
+  n.inplaceNormalize();
+  Vector3 x,y;
+  n.getOrthogonalBasis(x,y);
+  vector<Vector2> pt2d(contacts.size());
+  for(size_t i=0;i<contacts.size();i++) {
+    Vector3 p(contacts[i].pos[0],contacts[i].pos[1],contacts[i].pos[2]);
+    pt2d[i].set(x.dot(p),y.dot(p));
+  }
+  vector<Vector2> ch(contacts.size()+1);
+  vector<int> mapping(contacts.size()+1);
+  int num = Geometry::ConvexHull2D_Chain_Unsorted(&pt2d[0],pt2d.size(),&ch[0],&mapping[0]);
+  Real area = 0;
+  for(int i=0;i<num;i++) {
+    const Vector2& a=ch[i];
+    const Vector2& b=ch[(i+1)%num];
+    area += a.x*b.y - a.y*b.x;
+  }
+  return Abs(area)*0.5;
+}
+
+Real MaxDepth(const vector<dContactGeom>& contacts)
+{
+  Real d = 0;
+  for(size_t i=0;i<contacts.size();i++)
+    d = Max(d,(Real)contacts[i].depth);
+  return d;
+}
+
+//mean distance from each original contact to the nearest reduced contact,
+//in the clustering metric
+Real CoverageError(const vector<dContactGeom>& original,const vector<dContactGeom>& reduced,Real normalScale)
+{
+  if(reduced.empty()) return Inf;
+  Real sum = 0;
+  for(size_t i=0;i<original.size();i++) {
+    Real dmin = Inf;
+    for(size_t j=0;j<reduced.size();j++) {
+      Real d2 = 0;
+      for(int k=0;k<3;k++) {
+        d2 += Sqr(original[i].pos[k]-reduced[j].pos[k]);
+        d2 += Sqr(normalScale*(original[i].normal[k]-reduced[j].normal[k]));
+      }
+      dmin = Min(dmin,d2);
+    }
+    sum += Sqrt(dmin);
+  }
+  return sum/original.size();
+}
+
+int main(int argc,const char** argv)
+{
+  int n = 2000, k = 20, trials = 20;
+  Real normalScale = 0.1, margin = 0.0025;
+  for(int i=1;i<argc;i++) {
+    if(0==strcmp(argv[i],"-n") && i+1<argc) n = atoi(argv[++i]);
+    else if(0==strcmp(argv[i],"-k") && i+1<argc) k = atoi(argv[++i]);
+    else if(0==strcmp(argv[i],"-trials") && i+1<argc) trials = atoi(argv[++i]);
+    else if(0==strcmp(argv[i],"-normalScale") && i+1<argc) normalScale = atof(argv[++i]);
+    else if(0==strcmp(argv[i],"-margin") && i+1<argc) margin = atof(argv[++i]);
+    else {
+      printf("USAGE: BenchContacts [options]\n");
+      printf(OPTIONS_STRING);
+      return 1;
+    }
+  }
+  if(trials < 1) trials = 1;
+
+  const char* scenes[3] = {"planar","curved","corner"};
+  const char* methods[2] = {"kmeans","voxelgrid"};
+  printf("scene,method,contacts,max_contacts,time_us,reduced,support_ratio,depth_ratio,coverage_error\n");
+  //reused across calls, as in the simulator
+  ODEContactScratch scratch;
+  for(int s=0;s<3;s++) {
+    Srand(s);
+    vector<dContactGeom> contacts;
+    if(s==0) MakePlanarScene(n,contacts);
+    else if(s==1) MakeCurvedScene(n,contacts);
+    else MakeCornerScene(n,contacts);
+    Real area = SupportArea(contacts);
+    Real depth = MaxDepth(contacts);
+    for(int m=0;m<2;m++) {
+      vector<dContactGeom> reduced;
+      Timer timer;
+      for(int t=0;t<trials;t++) {
+        reduced = contacts;
+        if(m==0) ClusterContacts(reduced,k,normalScale,scratch);
+        else ClusterContactsVoxelGrid(reduced,k,normalScale,scratch);
+      }
+      double time = timer.ElapsedTime()/trials;
+      printf("%s,%s,%d,%d,%g,%d,%g,%g,%g\n",scenes[s],methods[m],n,k,time*1e6,(int)reduced.size(),
+             (area > 0 ? SupportArea(reduced)/area : 1.0),
+             (depth > 0 ? MaxDepth(reduced)/depth : 1.0),
+             CoverageError(contacts,reduced,normalScale));
+    }
+  }
+
+  //mesh-mesh pairs: generating all contacts then clustering them, versus
+  //reducing them with the contact budget in the collider.  Times include
+  //dCollide, which collects all contacts in every case; "collect" times it
+  //alone, so the cost of each reduction is its time minus that one.
+  dInitODE();
+  InitODECustomGeometry();
+  const char* meshScenes[3] = {"mesh_planar","mesh_curved","mesh_bumpy"};
+  const char* meshMethods[4] = {"kmeans","voxelgrid","budget","collect"};
+  for(int s=0;s<3;s++) {
+    MeshPairScene scene;
+    if(s==0) MakePlanarMeshScene(margin,scene);
+    else if(s==1) MakeCurvedMeshScene(margin,scene);
+    else MakeBumpyMeshScene(margin,scene);
+    vector<dContactGeom> contacts;
+    scene.Collide(contacts,0,normalScale);
+    Real area = SupportArea(contacts);
+    Real depth = MaxDepth(contacts);
+    for(int m=0;m<4;m++) {
+      vector<dContactGeom> reduced;
+      Timer timer;
+      for(int t=0;t<trials;t++) {
+        scene.Collide(reduced,(m==2 ? k : 0),normalScale);
+        if(m==0) ClusterContacts(reduced,k,normalScale,scratch);
+        else if(m==1) ClusterContactsVoxelGrid(reduced,k,normalScale,scratch);
+      }
+      double time = timer.ElapsedTime()/trials;
+      printf("%s,%s,%d,%d,%g,%d,%g,%g,%g\n",meshScenes[s],meshMethods[m],(int)contacts.size(),k,time*1e6,(int)reduced.size(),
+             (area > 0 ? SupportArea(reduced)/area : 1.0),
+             (depth > 0 ? MaxDepth(reduced)/depth : 1.0),
+             CoverageError(contacts,reduced,normalScale));
+    }
+  }
+  dCloseODE();
+  return 0;
+}
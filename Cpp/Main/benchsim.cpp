@@ -0,0 +1,315 @@
+#include "Simulation/WorldSimulation.h"
+#include "IO/XmlWorld.h"
+#include <KrisLibrary/meshing/MeshPrimitives.h>
+#include <KrisLibrary/math/random.h>
+#include <KrisLibrary/Timer.h>
+#include <sstream>
+#include <string.h>
+using namespace Math;
+using namespace Math3D;
+
+#define OPTIONS_STRING "Options:\n\
+\t-data [dir]: the directory containing the Klampt example worlds (default data)\n\
+\t-scenes [list]: comma-separated scenes to run (default pile,humanoid,grasp,multirobot)\n\
+\t-duration [t]: simulated time per scene, in s (default 5)\n\
+\t-warmup [t]: simulated time before measurement starts, in s (default 0.5)\n\
+\t-dt [t]: the Advance() time step, in s (default 0.01)\n\
+\t-step [t]: the internal simulation step, in s (default 0.001)\n\
+\t-threads [n]: narrowphase collision threads, 0 for all (default 1)\n\
+\t-contactBudget [n]: per-pair contact budget, 0 to cluster all contacts (default 0)\n\
+\t-caching [0/1]: reuse the narrowphase results of pairs that have not moved (default 0)\n\
+\t-objects [n]: number of objects in the pile scene (default 20)\n\
+\t-robots [n]: number of robots in the multirobot scene (default 2)\n\
+\t-humanoid [file]: humanoid world (default [data]/hubo_plane.xml)\n\
+\t-grasp [file]: manipulator world (default [data]/tx90cuptable.xml)\n\
+\t-gripperDofs [n]: number of trailing DOFs closed in the grasp scene (default 2)\n\
+\t-multirobot [file]: world whose first robot is duplicated (default [data]/athlete_plane.xml)\n\
+"
+
+struct BenchOptions
+{
+  string dataDir;
+  Real duration,warmup,dt,simStep;
+  int threads,contactBudget,numObjects,numRobots,gripperDofs;
+  bool caching;
+  string humanoidFile,graspFile,multirobotFile;
+};
+
+//Statistics accumulated over the measured Advance() calls
+struct BenchResult
+{
+  SimulationProfile total;
+  double wallTime;
+  Real simTime;
+  size_t maxContacts;
+};
+
+//A square grid mesh centered at the origin with sinusoidal bumps of the
+//given height
+void MakeGroundMesh(Real size,int res,Real bumpHeight,Meshing::TriMesh& mesh)
+{
+  mesh.verts.resize((res+1)*(res+1));
+  mesh.tris.resize(res*res*2);
+  Real h = size/res;
+  for(int i=0;i<=res;i++)
+    for(int j=0;j<=res;j++) {
+      Real x = -0.5*size + i*h, y = -0.5*size + j*h;
+      mesh.verts[i*(res+1)+j].set(x,y,bumpHeight*Sin(7.0*x)*Cos(5.0*y));
+    }
+  for(int i=0;i<res;i++)
+    for(int j=0;j<res;j++) {
+      int v00 = i*(res+1)+j, v10 = v00+res+1;
+      mesh.tris[(i*res+j)*2].set(v00,v10,v10+1);
+      mesh.tris[(i*res+j)*2+1].set(v00,v10+1,v00+1);
+    }
+}
+
+void AddGround(RobotWorld& world,Real size,int res,Real bumpHeight)
+{
+  Meshing::TriMesh mesh;
+  MakeGroundMesh(size,res,bumpHeight,mesh);
+  int index = world.AddTerrain("ground",new Terrain());
+  Terrain* terrain = world.terrains[index].get();
+  *terrain->geometry.CreateEmpty() = Geometry::AnyCollisionGeometry3D(mesh);
+  terrain->SetUniformFriction(0.5);
+  terrain->InitCollisions();
+}
+
+bool LoadWorld(const string& fn,RobotWorld& world)
+{
+  XmlWorld xmlWorld;
+  if(!xmlWorld.Load(fn)) return false;
+  return xmlWorld.GetWorld(world);
+}
+
+//a pile of boxes dropped on a flat mesh
+bool MakePileScene(const BenchOptions& opts,RobotWorld& world)
+{
+  AddGround(world,4.0,20,0);
+  Srand(0);
+  int layer = Max(1,(int)Ceil(Sqrt(Real(opts.numObjects)/3)));
+  for(int i=0;i<opts.numObjects;i++) {
+    Meshing::TriMesh mesh;
+    Box3D box;
+    box.dims.set(Rand(0.08,0.15),Rand(0.08,0.15),Rand(0.05,0.1));
+    box.origin.set(-0.5*box.dims.x,-0.5*box.dims.y,-0.5*box.dims.z);
+    box.xbasis.set(1,0,0);
+    box.ybasis.set(0,1,0);
+    box.zbasis.set(0,0,1);
+    Meshing::MakeTriMesh(box,mesh);
+    char buf[64];
+    snprintf(buf,64,"box%d",i);
+    int index = world.AddRigidObject(buf,new RigidObject());
+    RigidObject* obj = world.rigidObjects[index].get();
+    *obj->geometry.CreateEmpty() = Geometry::AnyCollisionGeometry3D(mesh);
+    obj->SetMassFromGeometry(0.5);
+    //stack in a loose column so the boxes land on one another
+    int k = i % (layer*layer), level = i / (layer*layer);
+    obj->T.R.setRotateZ(Rand(0,Pi));
+    obj->T.t.set(0.12*(k%layer - 0.5*layer)+Rand(-0.02,0.02),0.12*(k/layer - 0.5*layer)+Rand(-0.02,0.02),0.1+0.15*level);
+    obj->InitCollisions();
+  }
+  return true;
+}
+
+//the humanoid of a world file standing on a bumpy mesh
+bool MakeHumanoidScene(const BenchOptions& opts,RobotWorld& world)
+{
+  if(!LoadWorld(opts.humanoidFile,world) || world.robots.empty()) return false;
+  world.terrains.clear();
+  AddGround(world,4.0,60,0.01);
+  return true;
+}
+
+//the manipulator of a world file closing its gripper on an object
+bool MakeGraspScene(const BenchOptions& opts,RobotWorld& world)
+{
+  if(!LoadWorld(opts.graspFile,world) || world.robots.empty()) return false;
+  return true;
+}
+
+//several copies of the first robot in a world file, packed close enough to
+//touch
+bool MakeMultirobotScene(const BenchOptions& opts,RobotWorld& world)
+{
+  if(!LoadWorld(opts.multirobotFile,world) || world.robots.empty()) return false;
+  Robot* base = world.robots[0].get();
+  base->UpdateConfig(base->q);
+  AABB3D bb;
+  bb.minimize();
+  for(size_t i=0;i<base->links.size();i++) {
+    if(base->IsGeometryEmpty(i)) continue;
+    bb.expand(base->geometry[i]->GetAABB());
+  }
+  Real spacing = 0.9*(bb.bmax.x-bb.bmin.x);
+  for(int i=1;i<opts.numRobots;i++) {
+    Robot* robot = new Robot(*base);
+    //copies get their own collision geometry, as in CopyWorldUnique, so
+    //that they don't force a serial narrowphase
+    for(size_t j=0;j<robot->geomManagers.size();j++) {
+      if(robot->geomManagers[j].Empty()) continue;
+      robot->geomManagers[j].SetUniqueGeometry();
+      robot->geometry[j] = robot->geomManagers[j];
+    }
+    robot->links[0].T0_Parent.t.x += i*spacing;
+    char buf[64];
+    snprintf(buf,64,"%s%d",base->name.c_str(),i);
+    world.AddRobot(buf,robot);
+    robot->UpdateConfig(robot->q);
+    robot->UpdateGeometry();
+  }
+  return true;
+}
+
+void Accumulate(const SimulationProfile& p,SimulationProfile& total)
+{
+  total.numSteps += p.numSteps;
+  total.numRollbacks += p.numRollbacks;
+  total.numCollisionChecks += p.numCollisionChecks;
+  total.numCollisionPairs += p.numCollisionPairs;
+  total.numCachedCollisionPairs += p.numCachedCollisionPairs;
+  total.numPreclusterContacts += p.numPreclusterContacts;
+  total.numContacts += p.numContacts;
+  total.numAllocations += p.numAllocations;
+  total.totalTime += p.totalTime;
+  total.collisionTime += p.collisionTime;
+  total.clusterTime += p.clusterTime;
+  total.dynamicsTime += p.dynamicsTime;
+  total.controllerTime += p.controllerTime;
+  total.sensorTime += p.sensorTime;
+  total.hookTime += p.hookTime;
+}
+
+void RunScene(const string& name,const BenchOptions& opts,RobotWorld& world,BenchResult& res)
+{
+  WorldSimulation sim;
+  sim.simStep = opts.simStep;
+  sim.odesim.GetSettings().collisionThreads = opts.threads;
+  sim.odesim.GetSettings().contactBudget = opts.contactBudget;
+  sim.odesim.GetSettings().collisionCaching = opts.caching;
+  if(name == "multirobot") sim.odesim.GetSettings().robotRobotCollisions = true;
+  sim.Init(&world);
+  sim.robotControllers.resize(world.robots.size());
+  for(size_t i=0;i<world.robots.size();i++) {
+    Robot* robot = world.robots[i].get();
+    sim.SetController(i,MakeDefaultController(robot));
+    sim.controlSimulators[i].sensors.MakeDefault(robot);
+  }
+  sim.profiling = true;
+
+  Real t = 0;
+  bool gripperCommanded = (name != "grasp");
+  int numWarmup = (int)Ceil(opts.warmup/opts.dt);
+  for(int i=0;i<numWarmup;i++) {
+    sim.Advance(opts.dt);
+    if(!gripperCommanded) {
+      //the controller's motion queue is set up after the first step
+      Robot* robot = world.robots[0].get();
+      Config q = robot->q;
+      for(int j=Max(0,q.n-opts.gripperDofs);j<q.n;j++)
+        q(j) = robot->qMax(j);
+      stringstream ss;
+      ss<<q;
+      if(!sim.robotControllers[0]->SendCommand("append_q_linear",ss.str()))
+        fprintf(stderr,"Warning, could not send the gripper command to %s\n",robot->name.c_str());
+      gripperCommanded = true;
+    }
+  }
+  res.total.Clear();
+  res.maxContacts = 0;
+  int numSteps = Max(1,(int)Ceil(opts.duration/opts.dt));
+  Timer timer;
+  for(int i=0;i<numSteps;i++) {
+    sim.Advance(opts.dt);
+    Accumulate(sim.profile,res.total);
+    if(sim.profile.numCollisionChecks > 0)
+      res.maxContacts = Max(res.maxContacts,sim.profile.numContacts/sim.profile.numCollisionChecks);
+    t += opts.dt;
+  }
+  res.wallTime = timer.ElapsedTime();
+  res.simTime = t;
+}
+
+int main(int argc,const char** argv)
+{
+  BenchOptions opts;
+  opts.dataDir = "data";
+  opts.duration = 5;
+  opts.warmup = 0.5;
+  opts.dt = 0.01;
+  opts.simStep = 0.001;
+  opts.threads = 1;
+  opts.contactBudget = 0;
+  opts.caching = false;
+  opts.numObjects = 20;
+  opts.numRobots = 2;
+  opts.gripperDofs = 2;
+  string scenes = "pile,humanoid,grasp,multirobot";
+  for(int i=1;i<argc;i++) {
+    if(0==strcmp(argv[i],"-data") && i+1<argc) opts.dataDir = argv[++i];
+    else if(0==strcmp(argv[i],"-scenes") && i+1<argc) scenes = argv[++i];
+    else if(0==strcmp(argv[i],"-duration") && i+1<argc) opts.duration = atof(argv[++i]);
+    else if(0==strcmp(argv[i],"-warmup") && i+1<argc) opts.warmup = atof(argv[++i]);
+    else if(0==strcmp(argv[i],"-dt") && i+1<argc) opts.dt = atof(argv[++i]);
+    else if(0==strcmp(argv[i],"-step") && i+1<argc) opts.simStep = atof(argv[++i]);
+    else if(0==strcmp(argv[i],"-threads") && i+1<argc) opts.threads = atoi(argv[++i]);
+    else if(0==strcmp(argv[i],"-contactBudget") && i+1<argc) opts.contactBudget = atoi(argv[++i]);
+    else if(0==strcmp(argv[i],"-caching") && i+1<argc) opts.caching = (atoi(argv[++i]) != 0);
+    else if(0==strcmp(argv[i],"-objects") && i+1<argc) opts.numObjects = atoi(argv[++i]);
+    else if(0==strcmp(argv[i],"-robots") && i+1<argc) opts.numRobots = atoi(argv[++i]);
+    else if(0==strcmp(argv[i],"-humanoid") && i+1<argc) opts.humanoidFile = argv[++i];
+    else if(0==strcmp(argv[i],"-grasp") && i+1<argc) opts.graspFile = argv[++i];
+    else if(0==strcmp(argv[i],"-gripperDofs") && i+1<argc) opts.gripperDofs = atoi(argv[++i]);
+    else if(0==strcmp(argv[i],"-multirobot") && i+1<argc) opts.multirobotFile = argv[++i];
+    else {
+      printf("USAGE: klampt_bench_sim [options]\n");
+      printf(OPTIONS_STRING);
+      return 1;
+    }
+  }
+  if(opts.dt <= 0) opts.dt = 0.01;
+  if(opts.humanoidFile.empty()) opts.humanoidFile = opts.dataDir + "/hubo_plane.xml";
+  if(opts.graspFile.empty()) opts.graspFile = opts.dataDir + "/tx90cuptable.xml";
+  if(opts.multirobotFile.empty()) opts.multirobotFile = opts.dataDir + "/athlete_plane.xml";
+
+  vector<string> sceneList;
+  stringstream ss(scenes);
+  string item;
+  while(getline(ss,item,','))
+    if(!item.empty()) sceneList.push_back(item);
+  printf("scene,robots,objects,steps,sim_time,wall_time,steps_per_sec,realtime_factor,collision_ms,cluster_ms,dynamics_ms,controller_ms,sensor_ms,hook_ms,rollbacks,collision_checks,collision_pairs,cached_pairs,precluster_contacts,mean_contacts,max_contacts,allocations\n");
+  int numFailed = 0;
+  for(size_t s=0;s<sceneList.size();s++) {
+    const string& name = sceneList[s];
+    RobotWorld world;
+    bool loaded;
+    if(name == "pile") loaded = MakePileScene(opts,world);
+    else if(name == "humanoid") loaded = MakeHumanoidScene(opts,world);
+    else if(name == "grasp") loaded = MakeGraspScene(opts,world);
+    else if(name == "multirobot") loaded = MakeMultirobotScene(opts,world);
+    else {
+      fprintf(stderr,"Unknown scene %s\n",name.c_str());
+      numFailed++;
+      continue;
+    }
+    if(!loaded) {
+      fprintf(stderr,"Skipping scene %s, could not load its world (see -data)\n",name.c_str());
+      numFailed++;
+      continue;
+    }
+    BenchResult res;
+    RunScene(name,opts,world,res);
+    const SimulationProfile& p = res.total;
+    int n = Max(1,p.numSteps);
+    int checks = Max(1,p.numCollisionChecks);
+    printf("%s,%d,%d,%d,%g,%g,%g,%g,%g,%g,%g,%g,%g,%g,%d,%d,%d,%d,%d,%g,%d,%d\n",name.c_str(),
+           (int)world.robots.size(),(int)world.rigidObjects.size(),p.numSteps,res.simTime,res.wallTime,
+           p.numSteps/res.wallTime,res.simTime/res.wallTime,
+           p.collisionTime*1000/n,p.clusterTime*1000/n,p.dynamicsTime*1000/n,
+           p.controllerTime*1000/n,p.sensorTime*1000/n,p.hookTime*1000/n,
+           p.numRollbacks,p.numCollisionChecks,(int)p.numCollisionPairs,(int)p.numCachedCollisionPairs,
+           (int)p.numPreclusterContacts,double(p.numContacts)/checks,(int)res.maxContacts,(int)p.numAllocations);
+    fflush(stdout);
+  }
+  return (numFailed > 0 ? 1 : 0);
+}
@@ -0,0 +1,253 @@
+#include "GeometryDiskCache.h"
+#include <KrisLibrary/geometry/CollisionMesh.h>
+#include <KrisLibrary/geometry/PQP/src/PQP.h>
+#include <KrisLibrary/utils/fileutils.h>
+#include <KrisLibrary/utils/stringutils.h>
+#include <KrisLibrary/Logger.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <sstream>
+#include <iomanip>
+#include <thread>
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#define getpid _getpid
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+using namespace Geometry;
+using namespace std;
+
+const static char kMagic[8] = {'K','L','M','E','S','H','B','V'};
+const static uint32_t kVersion = 1;
+
+struct CacheHeader
+{
+  char magic[8];
+  uint32_t version,realSize,triSize,bvSize;
+  uint64_t numVerts,numTris,numBVTris,numBVs;
+};
+
+static void HashBytes(uint64_t& h,const void* data,size_t n)
+{
+  const unsigned char* p = (const unsigned char*)data;
+  for(size_t i=0;i<n;i++) {
+    h ^= p[i];
+    h *= 1099511628211ull;
+  }
+}
+
+static string HashString(uint64_t h)
+{
+  stringstream ss;
+  ss<<std::hex<<std::setw(16)<<std::setfill('0')<<h;
+  return ss.str();
+}
+
+static size_t Align8(size_t n) { return (n+7)&~size_t(7); }
+
+static string EntryPath(const string& directory,const string& key)
+{
+  return JoinPath(directory,key+".kgc");
+}
+
+//A read-only memory map of a whole file
+struct MappedFile
+{
+  MappedFile(const char* fn)
+    :data(NULL),size(0)
+  {
+#ifdef _WIN32
+    fileHandle = mappingHandle = NULL;
+    HANDLE f = CreateFileA(fn,GENERIC_READ,FILE_SHARE_READ,NULL,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,NULL);
+    if(f == INVALID_HANDLE_VALUE) return;
+    fileHandle = f;
+    LARGE_INTEGER len;
+    GetFileSizeEx(f,&len);
+    size = (size_t)len.QuadPart;
+    if(size > 0) {
+      mappingHandle = CreateFileMapping(f,NULL,PAGE_READONLY,0,0,NULL);
+      if(mappingHandle) data = (const unsigned char*)MapViewOfFile(mappingHandle,FILE_MAP_READ,0,0,0);
+    }
+#else
+    int fd = open(fn,O_RDONLY);
+    if(fd < 0) return;
+    struct stat st;
+    if(fstat(fd,&st) == 0 && st.st_size > 0) {
+      size = (size_t)st.st_size;
+      void* p = mmap(NULL,size,PROT_READ,MAP_SHARED,fd,0);
+      if(p != MAP_FAILED) data = (const unsigned char*)p;
+    }
+    close(fd);
+#endif
+  }
+  ~MappedFile()
+  {
+#ifdef _WIN32
+    if(data) UnmapViewOfFile(data);
+    if(mappingHandle) CloseHandle(mappingHandle);
+    if(fileHandle) CloseHandle(fileHandle);
+#else
+    if(data) munmap((void*)data,size);
+#endif
+  }
+
+  const unsigned char* data;
+  size_t size;
+#ifdef _WIN32
+  void* fileHandle,*mappingHandle;
+#endif
+};
+
+string GeometryDiskCache::FileKey(const string& filename)
+{
+  FILE* f = fopen(filename.c_str(),"rb");
+  if(!f) return "";
+  uint64_t h = 14695981039346656037ull;
+  //files with the same bytes but different formats are parsed differently
+  const char* ext = FileExtension(filename.c_str());
+  if(ext) HashBytes(h,ext,strlen(ext));
+  vector<unsigned char> buf(1<<20);
+  uint64_t total = 0;
+  size_t n;
+  while((n = fread(&buf[0],1,buf.size(),f)) > 0) {
+    HashBytes(h,&buf[0],n);
+    total += n;
+  }
+  bool ok = !ferror(f);
+  fclose(f);
+  if(!ok) return "";
+  HashBytes(h,&total,sizeof(total));
+  return HashString(h);
+}
+
+string GeometryDiskCache::TransformKey(const string& key,const Math3D::Matrix4& xform)
+{
+  uint64_t h = 14695981039346656037ull;
+  HashBytes(h,key.c_str(),key.length());
+  for(int i=0;i<4;i++)
+    for(int j=0;j<4;j++) {
+      double v = xform(i,j);
+      HashBytes(h,&v,sizeof(v));
+    }
+  return HashString(h);
+}
+
+bool GeometryDiskCache::Load(const string& directory,const string& key,AnyCollisionGeometry3D& geom)
+{
+  if(directory.empty() || key.empty()) return false;
+  string fn = EntryPath(directory,key);
+  MappedFile file(fn.c_str());
+  if(!file.data) return false;
+  if(file.size < sizeof(CacheHeader)) return false;
+  CacheHeader header;
+  memcpy(&header,file.data,sizeof(header));
+  if(memcmp(header.magic,kMagic,8) != 0 || header.version != kVersion) return false;
+  if(header.realSize != sizeof(PQP_REAL) || header.triSize != sizeof(Tri) || header.bvSize != sizeof(BV)) {
+    LOG4CXX_WARN(KrisLibrary::logger(),"GeometryDiskCache: "<<fn<<" was written with different PQP types, ignoring");
+    return false;
+  }
+  size_t vertOffset = sizeof(CacheHeader);
+  size_t triOffset = vertOffset + header.numVerts*3*sizeof(double);
+  size_t bvTriOffset = Align8(triOffset + header.numTris*3*sizeof(int32_t));
+  size_t bvOffset = bvTriOffset + header.numBVTris*sizeof(Tri);
+  if(bvOffset + header.numBVs*sizeof(BV) != file.size) {
+    LOG4CXX_WARN(KrisLibrary::logger(),"GeometryDiskCache: "<<fn<<" is corrupt, ignoring");
+    return false;
+  }
+
+  Meshing::TriMesh mesh;
+  mesh.verts.resize(header.numVerts);
+  const double* v = (const double*)(file.data+vertOffset);
+  for(size_t i=0;i<mesh.verts.size();i++,v+=3)
+    mesh.verts[i].set(v[0],v[1],v[2]);
+  mesh.tris.resize(header.numTris);
+  const int32_t* t = (const int32_t*)(file.data+triOffset);
+  for(size_t i=0;i<mesh.tris.size();i++,t+=3)
+    mesh.tris[i].set(t[0],t[1],t[2]);
+
+  //the PQP model frees its arrays with delete[]
+  shared_ptr<PQP_Model> model = make_shared<PQP_Model>();
+  model->num_tris = model->num_tris_alloced = (int)header.numBVTris;
+  model->tris = new Tri[header.numBVTris];
+  memcpy(model->tris,file.data+bvTriOffset,header.numBVTris*sizeof(Tri));
+  model->num_bvs = model->num_bvs_alloced = (int)header.numBVs;
+  model->b = new BV[header.numBVs];
+  memcpy(model->b,file.data+bvOffset,header.numBVs*sizeof(BV));
+  model->last_tri = model->tris;
+  model->build_state = PQP_BUILD_STATE_PROCESSED;
+
+  geom = AnyCollisionGeometry3D(mesh);
+  geom.collisionData = CollisionMesh(mesh);
+  CollisionMesh& cm = geom.TriangleMeshCollisionData();
+  cm.CalcIncidentTris();
+  cm.CalcTriNeighbors();
+  cm.pqpModel = model;
+  return true;
+}
+
+bool GeometryDiskCache::Save(const string& directory,const string& key,AnyCollisionGeometry3D& geom)
+{
+  if(directory.empty() || key.empty()) return false;
+  if(geom.type != AnyGeometry3D::TriangleMesh) return false;
+  if(!geom.CollisionDataInitialized()) geom.InitCollisionData();
+  const Meshing::TriMesh& mesh = geom.AsTriangleMesh();
+  const CollisionMesh& cm = geom.TriangleMeshCollisionData();
+  if(!cm.pqpModel) return false;
+  const PQP_Model& model = *cm.pqpModel;
+
+  CacheHeader header;
+  memcpy(header.magic,kMagic,8);
+  header.version = kVersion;
+  header.realSize = sizeof(PQP_REAL);
+  header.triSize = sizeof(Tri);
+  header.bvSize = sizeof(BV);
+  header.numVerts = mesh.verts.size();
+  header.numTris = mesh.tris.size();
+  header.numBVTris = model.num_tris;
+  header.numBVs = model.num_bvs;
+  size_t triOffset = sizeof(CacheHeader) + header.numVerts*3*sizeof(double);
+  size_t bvTriOffset = Align8(triOffset + header.numTris*3*sizeof(int32_t));
+  vector<unsigned char> buf(bvTriOffset,0);
+  memcpy(&buf[0],&header,sizeof(header));
+  double* v = (double*)&buf[sizeof(CacheHeader)];
+  for(size_t i=0;i<mesh.verts.size();i++,v+=3) {
+    v[0] = mesh.verts[i].x;
+    v[1] = mesh.verts[i].y;
+    v[2] = mesh.verts[i].z;
+  }
+  int32_t* t = (int32_t*)&buf[triOffset];
+  for(size_t i=0;i<mesh.tris.size();i++,t+=3) {
+    t[0] = mesh.tris[i].a;
+    t[1] = mesh.tris[i].b;
+    t[2] = mesh.tris[i].c;
+  }
+
+  FileUtils::MakeDirectory(directory.c_str());
+  string fn = EntryPath(directory,key);
+  //write to a temporary file first, so readers never see a partial entry.
+  //The name is unique to the process and thread.
+  stringstream ss;
+  ss<<fn<<".tmp"<<getpid()<<"_"<<std::this_thread::get_id();
+  string tempfn = ss.str();
+  FILE* f = fopen(tempfn.c_str(),"wb");
+  if(!f) {
+    LOG4CXX_WARN(KrisLibrary::logger(),"GeometryDiskCache: could not write to "<<directory);
+    return false;
+  }
+  bool ok = (fwrite(&buf[0],1,buf.size(),f) == buf.size());
+  if(ok && model.num_tris > 0) ok = (fwrite(model.tris,sizeof(Tri),model.num_tris,f) == (size_t)model.num_tris);
+  if(ok && model.num_bvs > 0) ok = (fwrite(model.b,sizeof(BV),model.num_bvs,f) == (size_t)model.num_bvs);
+  if(fclose(f) != 0) ok = false;
+  if(!ok || rename(tempfn.c_str(),fn.c_str()) != 0) {
+    //another process may have renamed the same entry into place first
+    remove(tempfn.c_str());
+    return ok && FileUtils::Exists(fn.c_str());
+  }
+  return true;
+}
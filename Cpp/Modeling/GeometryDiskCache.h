@@ -0,0 +1,56 @@
+#ifndef MODELING_GEOMETRY_DISK_CACHE_H
+#define MODELING_GEOMETRY_DISK_CACHE_H
+
+#include <KrisLibrary/geometry/AnyGeometry.h>
+#include <KrisLibrary/math3d/primitives.h>
+#include <string>
+
+/** @file GeometryDiskCache.h
+ * @ingroup Modeling
+ * @brief An on-disk cache of triangle meshes and their collision
+ * hierarchies.
+ *
+ * Each entry is a file [key].kgc in the cache directory, which holds a
+ * header, the mesh vertices and triangles, and the triangles and bounding
+ * volumes of the mesh's PQP model, all in native byte order:
+ *
+ * "KLMESHBV", uint32 version (1), uint32 sizeof(PQP_REAL), uint32
+ * sizeof(Tri), uint32 sizeof(BV), uint64 numVerts, uint64 numTris, uint64
+ * numBVTris, uint64 numBVs, then 3 doubles per vertex, 3 int32 per
+ * triangle, padding to a multiple of 8 bytes, then the raw PQP Tri and BV
+ * arrays.  Entries written by a build with different PQP types are
+ * ignored.
+ */
+
+/** @ingroup Modeling
+ * @brief Stores triangle meshes with prebuilt collision data on disk, so
+ * that later processes skip parsing and BVH construction.
+ *
+ * Keys are content addresses: FileKey hashes the bytes of a geometry file,
+ * and TransformKey derives the key of a transformed copy.  So an edited file
+ * gets a new entry, and stale entries are never read.  Entries are written
+ * to a temporary file and renamed into place, so processes and threads may
+ * share a cache directory.  Loading copies an entry from a memory map
+ * straight into the mesh and PQP arrays, so each process holds its own
+ * copy of the data; the savings come from skipping the parsing and BVH
+ * construction.
+ *
+ * Used by ManagedGeometry when ManagedGeometry::diskCacheDirectory is set.
+ */
+class GeometryDiskCache
+{
+public:
+  ///Returns the key of the contents of a geometry file, or "" if it can't
+  ///be read.  The file extension is part of the key.
+  static std::string FileKey(const std::string& filename);
+  ///Returns the key of the geometry with the given key, transformed by xform
+  static std::string TransformKey(const std::string& key,const Math3D::Matrix4& xform);
+  ///Loads the entry with the given key into geom, with its collision data.
+  ///Returns false if there is no valid entry.
+  static bool Load(const std::string& directory,const std::string& key,Geometry::AnyCollisionGeometry3D& geom);
+  ///Saves geom, which must be a triangle mesh, under the given key.  Its
+  ///collision data is built if it hasn't been yet.
+  static bool Save(const std::string& directory,const std::string& key,Geometry::AnyCollisionGeometry3D& geom);
+};
+
+#endif
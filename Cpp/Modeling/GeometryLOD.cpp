@@ -0,0 +1,162 @@
+#include "GeometryLOD.h"
+#include <KrisLibrary/geometry/CollisionMesh.h>
+#include <KrisLibrary/math3d/AABB3D.h>
+#include <KrisLibrary/math3d/Box3D.h>
+#include <KrisLibrary/Logger.h>
+#include <unordered_map>
+#include <set>
+#include <tuple>
+#include <algorithm>
+#include <stdint.h>
+#include <string.h>
+using namespace Geometry;
+using namespace Math3D;
+using namespace std;
+
+int GeometryLOD::simplifiedTris = 1000;
+
+//Merges the vertices of mesh in each cell of a grid of width h
+static void ClusterVertices(const Meshing::TriMesh& mesh,const Vector3& origin,Real h,Meshing::TriMesh& out)
+{
+  unordered_map<uint64_t,int> cells;
+  vector<int> vmap(mesh.verts.size());
+  vector<int> counts;
+  out.verts.resize(0);
+  out.tris.resize(0);
+  for(size_t i=0;i<mesh.verts.size();i++) {
+    const Vector3& v = mesh.verts[i];
+    uint64_t ix = (uint64_t)Floor((v.x-origin.x)/h);
+    uint64_t iy = (uint64_t)Floor((v.y-origin.y)/h);
+    uint64_t iz = (uint64_t)Floor((v.z-origin.z)/h);
+    uint64_t key = (ix<<42) | (iy<<21) | iz;
+    auto c = cells.find(key);
+    if(c == cells.end()) {
+      c = cells.insert(make_pair(key,(int)out.verts.size())).first;
+      out.verts.push_back(Vector3(Zero));
+      counts.push_back(0);
+    }
+    vmap[i] = c->second;
+    out.verts[c->second] += v;
+    counts[c->second]++;
+  }
+  //each cell is represented by the mean of its vertices
+  for(size_t i=0;i<out.verts.size();i++)
+    out.verts[i] /= Real(counts[i]);
+  set<tuple<int,int,int> > used;
+  for(size_t i=0;i<mesh.tris.size();i++) {
+    int a=vmap[mesh.tris[i].a], b=vmap[mesh.tris[i].b], c=vmap[mesh.tris[i].c];
+    if(a==b || b==c || a==c) continue;
+    int s[3] = {a,b,c};
+    sort(s,s+3);
+    if(!used.insert(make_tuple(s[0],s[1],s[2])).second) continue;
+    out.tris.push_back(IntTriple(a,b,c));
+  }
+}
+
+GeometryLOD::GeometryLOD()
+{}
+
+void GeometryLOD::Clear()
+{
+  source.reset();
+  for(int i=0;i<NumLevels;i++)
+    levels[i].reset();
+}
+
+void GeometryLOD::Build(const shared_ptr<AnyCollisionGeometry3D>& geom)
+{
+  if(IsBuilt(geom)) return;
+  Clear();
+  source = geom;
+  if(!geom || geom->Empty()) return;
+  levels[Original] = geom;
+  if(geom->type == AnyGeometry3D::Primitive) return;
+
+  if(geom->type == AnyGeometry3D::TriangleMesh) {
+    Meshing::TriMesh simplified;
+    if(Simplify(geom->AsTriangleMesh(),simplifiedTris,simplified)) {
+      levels[Simplified] = make_shared<AnyCollisionGeometry3D>(simplified);
+      levels[Simplified]->margin = geom->margin;
+      levels[Simplified]->InitCollisionData();
+    }
+  }
+  if(geom->type != AnyGeometry3D::ConvexHull) {
+    AnyGeometry3D hull;
+    if(((const AnyGeometry3D&)*geom).Convert(AnyGeometry3D::ConvexHull,hull)) {
+      levels[ConvexHull] = make_shared<AnyCollisionGeometry3D>(hull);
+      levels[ConvexHull]->margin = geom->margin;
+      levels[ConvexHull]->InitCollisionData();
+    }
+    else
+      LOG4CXX_INFO(KrisLibrary::logger(),"GeometryLOD: could not compute the convex hull of a "<<geom->TypeName()<<" geometry");
+  }
+  //the base class gives the bounds in the local frame
+  AABB3D bb = geom->AnyGeometry3D::GetAABB();
+  if(bb.bmin.x <= bb.bmax.x) {
+    Box3D box;
+    box.set(bb);
+    levels[BoundingBox] = make_shared<AnyCollisionGeometry3D>(GeometricPrimitive3D(box));
+    levels[BoundingBox]->margin = geom->margin;
+    levels[BoundingBox]->InitCollisionData();
+  }
+}
+
+AnyCollisionGeometry3D* GeometryLOD::Get(int level)
+{
+  if(!source) return NULL;
+  if(level >= NumLevels) level = NumLevels-1;
+  while(level > Original && !levels[level]) level--;
+  if(level <= Original) return source.get();
+  //only written if the original moved, so that threads querying an
+  //unmoved geometry don't write to it
+  const RigidTransform& T = source->GetTransform();
+  const RigidTransform& Tlevel = levels[level]->GetTransform();
+  if(!Tlevel.R.isEqual(T.R) || !Tlevel.t.isEqual(T.t))
+    levels[level]->SetTransform(T);
+  return levels[level].get();
+}
+
+void GeometryLOD::UpdateTransform()
+{
+  if(!source) return;
+  for(int i=Original+1;i<NumLevels;i++)
+    if(levels[i]) levels[i]->SetTransform(source->GetTransform());
+}
+
+int GeometryLOD::LevelFromName(const char* name)
+{
+  if(0==strcmp(name,"original")) return Original;
+  else if(0==strcmp(name,"simplified")) return Simplified;
+  else if(0==strcmp(name,"convex_hull")) return ConvexHull;
+  else if(0==strcmp(name,"bounding_box")) return BoundingBox;
+  return -1;
+}
+
+bool GeometryLOD::Simplify(const Meshing::TriMesh& mesh,int targetTris,Meshing::TriMesh& out)
+{
+  if(targetTris <= 0 || (int)mesh.tris.size() <= targetTris) return false;
+  AABB3D bb;
+  bb.minimize();
+  for(size_t i=0;i<mesh.verts.size();i++)
+    bb.expand(mesh.verts[i]);
+  Real area = 0;
+  Vector3 n;
+  for(size_t i=0;i<mesh.tris.size();i++) {
+    const Vector3& a = mesh.verts[mesh.tris[i].a];
+    n.setCross(mesh.verts[mesh.tris[i].b]-a,mesh.verts[mesh.tris[i].c]-a);
+    area += n.norm()*0.5;
+  }
+  Vector3 dims = bb.bmax-bb.bmin;
+  Real extent = Max(dims.x,Max(dims.y,dims.z));
+  if(extent <= 0) return false;
+  //a surface of area A crosses about A/h^2 cells of width h, so simplifies
+  //to about 2A/h^2 triangles.  Cell indices must fit in 21 bits.
+  Real hmin = extent/Real(1<<20);
+  Real h = Max(Sqrt(2.0*area/targetTris),hmin);
+  for(int iter=0;iter<8;iter++) {
+    ClusterVertices(mesh,bb.bmin,h,out);
+    if((int)out.tris.size() <= targetTris+targetTris/5) break;
+    h *= Sqrt(Real(out.tris.size())/Real(targetTris));
+  }
+  return true;
+}
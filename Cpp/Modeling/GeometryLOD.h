@@ -0,0 +1,62 @@
+#ifndef MODELING_GEOMETRY_LOD_H
+#define MODELING_GEOMETRY_LOD_H
+
+#include <KrisLibrary/geometry/AnyGeometry.h>
+#include <memory>
+
+/** @file GeometryLOD.h
+ * @ingroup Modeling
+ * @brief Coarser versions of a collision geometry, for consumers that don't
+ * need the full resolution mesh.
+ */
+
+/** @ingroup Modeling
+ * @brief A set of levels of detail of one collision geometry.
+ *
+ * The levels are, from finest to coarsest:
+ * - Original: the geometry itself.
+ * - Simplified: a triangle mesh simplified by vertex clustering to about
+ *   simplifiedTris triangles.  Only built for meshes larger than that.
+ * - ConvexHull: the convex hull of the geometry.
+ * - BoundingBox: a box primitive bounding the geometry in its local frame.
+ *
+ * A level that can't be built for the geometry's type falls back to the
+ * next finer one.  The levels are in the local frame of the original and
+ * have its collision margin; Get and UpdateTransform copy the original's
+ * current transform onto them.
+ */
+class GeometryLOD
+{
+public:
+  enum Level { Original=0, Simplified=1, ConvexHull=2, BoundingBox=3, NumLevels=4 };
+
+  GeometryLOD();
+  ///Builds the coarser levels of geom.  Does nothing if they've already been
+  ///built from geom.
+  void Build(const std::shared_ptr<Geometry::AnyCollisionGeometry3D>& geom);
+  ///Returns true if the levels were built from geom
+  bool IsBuilt(const std::shared_ptr<Geometry::AnyCollisionGeometry3D>& geom) const { return source == geom; }
+  void Clear();
+  ///Returns the given level, or the nearest finer level that exists, with
+  ///the transform of the original.  The level's transform is only set if
+  ///it differs.  Returns NULL if nothing was built.
+  Geometry::AnyCollisionGeometry3D* Get(int level);
+  ///Copies the transform of the original onto the coarser levels
+  void UpdateTransform();
+  ///Returns the level of a name ("original", "simplified", "convex_hull", or
+  ///"bounding_box"), or -1 if it isn't recognized
+  static int LevelFromName(const char* name);
+
+  ///Simplifies a mesh to about targetTris triangles by merging the vertices
+  ///in each cell of a grid.  Returns false if mesh already has no more than
+  ///targetTris triangles.
+  static bool Simplify(const Meshing::TriMesh& mesh,int targetTris,Meshing::TriMesh& out);
+
+  ///Target triangle count of the Simplified level (default 1000)
+  static int simplifiedTris;
+
+  std::shared_ptr<Geometry::AnyCollisionGeometry3D> source;
+  std::shared_ptr<Geometry::AnyCollisionGeometry3D> levels[NumLevels];
+};
+
+#endif
@@ -1,7 +1,10 @@
 #include "ManagedGeometry.h"
+#include "ThreadPool.h"
+#include "GeometryDiskCache.h"
 #include "IO/ROS.h"
 #include <KrisLibrary/meshing/PointCloud.h>
 #include <string.h>
+#include <stdlib.h>
 #include <KrisLibrary/Timer.h>
 #include <KrisLibrary/utils/stringutils.h>
 #include <KrisLibrary/utils/ioutils.h>
@@ -40,6 +43,7 @@ GeometryManager::~GeometryManager()
 
 void GeometryManager::Clear()
 {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
   for(map<string,GeometryList>::iterator i=cache.begin();i!=cache.end();i++) {
     for(size_t j=0;j<i->second.geoms.size();j++)
       i->second.geoms[j]->cacheKey.clear();
@@ -121,6 +125,7 @@ bool ManagedGeometry::Load(const string& filename)
     return LoadNoCache(filename);
   }
 
+  std::unique_lock<std::recursive_mutex> lock(manager.mutex);
   ManagedGeometry* prev = ManagedGeometry::IsCached(filename);
   if(prev) {
     //these lines are sort of like Clear(), but the appearance is kept
@@ -143,17 +148,21 @@ bool ManagedGeometry::Load(const string& filename)
     //geometry = prev->geometry;
     appearance = prev->appearance;
     appearance->geom = geometry.get();
+    diskCacheKey = prev->diskCacheKey;
     manager.cache[filename].geoms.push_back(this);
 #if CACHE_DEBUG
     LOG4CXX_WARN(KrisLibrary::logger(),"ManagedGeometry: adding a duplicate of "<<filename<<" to cache");
 #endif
     return true;
   }
+  //parse without holding the lock, so other files can load meanwhile
+  lock.unlock();
 
   if(LoadNoCache(filename)) {  
 #if CACHE_DEBUG
     LOG4CXX_INFO(KrisLibrary::logger(),"ManagedGeometry: adding "<<filename<<" to cache");
 #endif
+    lock.lock();
     cacheKey = filename;
     manager.cache[filename].geoms.push_back(this);
     return true;
@@ -226,6 +235,16 @@ bool ManagedGeometry::LoadNoCache(const string& filename)
         geometry = NULL;
         return false;
       }
+      string diskKey;
+      if(!diskCacheDirectory.empty()) {
+        diskKey = GeometryDiskCache::FileKey(localfile);
+        if(LoadDiskCached(diskKey)) {
+          double t = timer.ElapsedTime();
+          if(t > 0.2) 
+            LOG4CXX_INFO(KrisLibrary::logger(),"ManagedGeometry: loaded "<<filename<<" from the disk cache in time "<<t<<"s");
+          return true;
+        }
+      }
       if(!geometry->Load(localfile.c_str())) {
         LOG4CXX_WARN(KrisLibrary::logger(),"ManagedGeometry: Error loading geometry file "<<fn);
         geometry = NULL;
@@ -247,6 +266,9 @@ bool ManagedGeometry::LoadNoCache(const string& filename)
       else {
         appearance->Set(*geometry);
       }
+      //the disk cache doesn't store appearance data
+      if(!diskKey.empty() && geometry->type == Geometry::AnyGeometry3D::TriangleMesh && geometry->TriangleMeshAppearanceData() == NULL)
+        SaveDiskCached(diskKey);
       return true;
     }
     else {
@@ -260,8 +282,78 @@ bool ManagedGeometry::LoadNoCache(const string& filename)
   }
 }
 
+bool ManagedGeometry::LoadDiskCached(const string& key)
+{
+  GeometryPtr g = make_shared<Geometry::AnyCollisionGeometry3D>();
+  if(!GeometryDiskCache::Load(diskCacheDirectory,key,*g)) return false;
+  geometry = g;
+  appearance->Set(*geometry);
+  diskCacheKey = key;
+  return true;
+}
+
+void ManagedGeometry::SaveDiskCached(const string& key)
+{
+  if(GeometryDiskCache::Save(diskCacheDirectory,key,*geometry))
+    diskCacheKey = key;
+}
+
+int ManagedGeometry::LoadMultiple(const vector<ManagedGeometry*>& geoms,const vector<string>& files,vector<bool>& loaded)
+{
+  Assert(geoms.size() == files.size());
+  loaded.resize(0);
+  loaded.resize(geoms.size(),false);
+  int numThreads = (loadThreads <= 0 ? ThreadPool::DefaultNumThreads() : loadThreads);
+  //the first geometry with each file is loaded in parallel, and the
+  //repeats copy it from the cache afterwards
+  vector<int> firsts,repeats;
+  map<string,int> seen;
+  for(size_t i=0;i<files.size();i++) {
+    if(numThreads > 1 && seen.count(files[i]) == 0) {
+      seen[files[i]] = (int)i;
+      firsts.push_back((int)i);
+    }
+    else
+      repeats.push_back((int)i);
+  }
+  if(!firsts.empty()) {
+    //vector<bool> packs bits, so threads can't write it concurrently
+    vector<char> ok(firsts.size(),0);
+    static shared_ptr<ThreadPool> pool;
+    static std::mutex poolMutex;
+    shared_ptr<ThreadPool> p;
+    {
+      std::lock_guard<std::mutex> lock(poolMutex);
+      if(!pool || pool->NumThreads() != numThreads)
+        pool = make_shared<ThreadPool>(numThreads);
+      p = pool;
+    }
+    Timer timer;
+    p->ParallelFor((int)firsts.size(),[&](int k,int thread) {
+      ManagedGeometry* g = geoms[firsts[k]];
+      if(!g->Load(files[firsts[k]])) return;
+      //build the collision data here rather than serially on first use
+      if(!g->IsDynamicGeometry() && !g->geometry->CollisionDataInitialized())
+        g->geometry->InitCollisionData();
+      ok[k] = 1;
+    });
+    for(size_t k=0;k<firsts.size();k++)
+      loaded[firsts[k]] = (ok[k] != 0);
+    double t = timer.ElapsedTime();
+    if(t > 0.2)
+      LOG4CXX_INFO(KrisLibrary::logger(),"ManagedGeometry: loaded "<<firsts.size()<<" files on "<<p->NumThreads()<<" threads in time "<<t<<"s");
+  }
+  for(size_t k=0;k<repeats.size();k++)
+    loaded[repeats[k]] = geoms[repeats[k]]->Load(files[repeats[k]]);
+  int numLoaded = 0;
+  for(size_t i=0;i<loaded.size();i++)
+    if(loaded[i]) numLoaded++;
+  return numLoaded;
+}
+
 ManagedGeometry* ManagedGeometry::IsCached(const string& filename)
 {
+  std::lock_guard<std::recursive_mutex> lock(manager.mutex);
   map<string,GeometryManager::GeometryList>::const_iterator i=manager.cache.find(filename);
   if(i==manager.cache.end()) return NULL;
   if(i->second.geoms.empty()) return NULL;
@@ -289,6 +381,7 @@ const string& ManagedGeometry::CachedFilename() const
 
 void ManagedGeometry::AddToCache(const string& filename)
 {
+  std::lock_guard<std::recursive_mutex> lock(manager.mutex);
   if(!cacheKey.empty()) {
     if(cacheKey != filename)
       LOG4CXX_WARN(KrisLibrary::logger(),"ManagedGeometry::AddToCache(): warning, item was previously cached as "<<cacheKey<<", now being asked to be cached as "<<filename<<"?");
@@ -303,9 +396,11 @@ void ManagedGeometry::AddToCache(const string& filename)
 
 void ManagedGeometry::RemoveFromCache()
 {
+  diskCacheKey.clear();
   if(cacheKey.empty()) {
     return;
   }
+  std::lock_guard<std::recursive_mutex> lock(manager.mutex);
   map<string,GeometryManager::GeometryList>::iterator i=manager.cache.find(cacheKey);
   if(i==manager.cache.end()) {
     LOG4CXX_WARN(KrisLibrary::logger(),"ManagedGeometry::RemoveFromCache(): warning, item "<<cacheKey<<" was not previously cached?");
@@ -339,6 +434,7 @@ void ManagedGeometry::RemoveFromCache()
 void ManagedGeometry::SetUnique()
 {
   if(cacheKey.empty()) return;
+  std::lock_guard<std::recursive_mutex> lock(manager.mutex);
   SetUniqueAppearance();
   map<string,GeometryManager::GeometryList>::iterator i=manager.cache.find(cacheKey);
   if(i==manager.cache.end()) {
@@ -362,16 +458,20 @@ void ManagedGeometry::SetUnique()
 void ManagedGeometry::TransformGeometry(const Math3D::Matrix4& xform)
 {
   if(geometry) {
+    std::lock_guard<std::recursive_mutex> lock(manager.mutex);
     string newCacheKey;
 #if CACHE_DEBUG
     if(!cacheKey.empty()) {
       LOG4CXX_INFO(KrisLibrary::logger(),"ManagedGeometry: transforming geometry "<<cacheKey);
     }
 #endif
+    string newDiskCacheKey;
     if(!cacheKey.empty()) {
       stringstream ss;
       ss<<cacheKey<<"[ transform "<<xform<<"]";
       newCacheKey = ss.str();
+      if(!diskCacheKey.empty())
+        newDiskCacheKey = GeometryDiskCache::TransformKey(diskCacheKey,xform);
       ManagedGeometry* prev = ManagedGeometry::IsCached(newCacheKey);
       if(prev) {
         RemoveFromCache();
@@ -381,6 +481,7 @@ void ManagedGeometry::TransformGeometry(const Math3D::Matrix4& xform)
           appearance = make_shared<GLDraw::GeometryAppearance>(*appearance);
         appearance->geom = geometry.get();
         cacheKey = newCacheKey;
+        diskCacheKey = prev->diskCacheKey;
 #if CACHE_DEBUG
         LOG4CXX_INFO(KrisLibrary::logger(),"ManagedGeometry: transformed version of "<<cacheKey<<" was in cache.");
 #endif
@@ -396,8 +497,16 @@ void ManagedGeometry::TransformGeometry(const Math3D::Matrix4& xform)
     }
     SetUnique();
     RemoveFromCache();
-    geometry->Transform(xform);
-    geometry->ClearCollisionData();
+    Real margin = geometry->margin;
+    if(!newDiskCacheKey.empty() && LoadDiskCached(newDiskCacheKey)) {
+      geometry->margin = margin;
+    }
+    else {
+      geometry->Transform(xform);
+      geometry->ClearCollisionData();
+      if(!newDiskCacheKey.empty())
+        SaveDiskCached(newDiskCacheKey);
+    }
     if(!newCacheKey.empty()) {
       cacheKey = newCacheKey;
       manager.cache[newCacheKey].geoms.push_back(this);
@@ -421,6 +530,7 @@ ManagedGeometry::AppearancePtr ManagedGeometry::Appearance() const
 bool ManagedGeometry::IsAppearanceShared() const
 { 
   if(cacheKey.empty()) return false;
+  std::lock_guard<std::recursive_mutex> lock(manager.mutex);
   map<string,GeometryManager::GeometryList>::const_iterator i=manager.cache.find(cacheKey);
   if(i==manager.cache.end()) 
     return false;
@@ -434,6 +544,7 @@ bool ManagedGeometry::IsAppearanceShared() const
 
 void ManagedGeometry::SetUniqueAppearance()
 {
+  std::lock_guard<std::recursive_mutex> lock(manager.mutex);
   if(appearance && appearance.use_count() > 1) {
     appearance = make_shared<GLDraw::GeometryAppearance>(*appearance);
     if(!cacheKey.empty()) {
@@ -448,14 +559,29 @@ void ManagedGeometry::SetUniqueAppearance()
   }
 }
 
+void ManagedGeometry::SetUniqueGeometry()
+{
+  if(!geometry) return;
+  //build the collision data once, in the shared geometry, rather than
+  //lazily in every copy
+  if(!geometry->Empty() && !geometry->CollisionDataInitialized())
+    geometry->InitCollisionData();
+  //CollisionMesh holds its BVH in a shared_ptr (GeometryDiskCache relies
+  //on this too), so the copy shares it.  The BVH is immutable once built
+  //and mesh queries take the transform of each copy.
+  geometry = make_shared<Geometry::AnyCollisionGeometry3D>(*geometry);
+}
+
 const ManagedGeometry& ManagedGeometry::operator = (const ManagedGeometry& rhs)
 {
+  std::lock_guard<std::recursive_mutex> lock(manager.mutex);
   RemoveFromCache();
 
   geometry = rhs.geometry;
   appearance = rhs.appearance;
   appearance->geom = geometry.get();
   cacheKey = rhs.cacheKey;
+  diskCacheKey = rhs.diskCacheKey;
   if(!cacheKey.empty()) {
     manager.cache[cacheKey].geoms.push_back(this);
   }
@@ -503,3 +629,5 @@ bool ManagedGeometry::DynamicGeometryUpdate()
 
 
 GeometryManager ManagedGeometry::manager;
+int ManagedGeometry::loadThreads = 0;
+string ManagedGeometry::diskCacheDirectory = (getenv("KLAMPT_GEOMETRY_CACHE") ? getenv("KLAMPT_GEOMETRY_CACHE") : "");
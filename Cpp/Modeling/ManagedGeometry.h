@@ -5,7 +5,9 @@
 #include <KrisLibrary/GLdraw/GeometryAppearance.h>
 #include <memory>
 #include <map>
+#include <mutex>
 #include <string>
+#include <vector>
 
 class GeometryManager;
 
@@ -56,6 +58,18 @@ class GeometryManager;
  *       0 0 0  1}"
  * 
  *      would load a sphere with center 0,0,0 and radius 1
+ *
+ * Disk cache: if diskCacheDirectory is set, triangle meshes loaded from files
+ * are also stored on disk with their collision data (see GeometryDiskCache),
+ * so later processes skip parsing and BVH construction.  Entries are keyed by
+ * the file contents and by the transforms applied with TransformGeometry.
+ * Meshes with appearance data in the file, e.g., colored vertices, are not
+ * stored.
+ *
+ * Threading: the cache is protected by a lock, so different ManagedGeometry
+ * objects may be loaded on different threads.  A single object, and the
+ * appearance it may share with others, must not be used from several
+ * threads at once.  LoadMultiple loads many files on a thread pool.
  */
 class ManagedGeometry
 {
@@ -77,6 +91,12 @@ class ManagedGeometry
   bool Load(const std::string& filename);
   ///Loads a geometry, without caching
   bool LoadNoCache(const std::string& filename);
+  ///Loads geoms[i] from files[i] for all i, with caching.  Distinct files
+  ///are parsed and their collision data structures built on loadThreads
+  ///threads; geometries whose file is repeated are then shared through the
+  ///cache.  loaded[i] is set to whether geoms[i] was loaded.  Returns the
+  ///number of geometries loaded.
+  static int LoadMultiple(const std::vector<ManagedGeometry*>& geoms,const std::vector<std::string>& files,std::vector<bool>& loaded);
   ///Returns NULL if the file hasn't been cached.  Otherwise, returns
   ///a prior instance of the geometry.
   static ManagedGeometry* IsCached(const std::string& filename);
@@ -104,6 +124,14 @@ class ManagedGeometry
   ///Makes this item have its own appearance data separate from all other
   ///instances of this object.
   void SetUniqueAppearance();
+  ///Gives this item its own geometry, so it can be transformed and queried
+  ///independently of shallow copies made by operator =.  The collision
+  ///data is built first if needed, and triangle meshes keep sharing their
+  ///BVH, which KrisLibrary's CollisionMesh holds in a shared_ptr, so only
+  ///the vertex and triangle arrays are copied.  Unlike
+  ///SetUnique, the item stays in the cache and keeps sharing its
+  ///appearance, since the data is unchanged.
+  void SetUniqueGeometry();
   ///If the geometry is changed, call this to update the appearance
   void OnGeometryChange();
   ///Renders the object using OpenGL
@@ -130,9 +158,20 @@ class ManagedGeometry
 
   friend class GeometryManager;
   static GeometryManager manager;
+  ///Number of threads used by LoadMultiple.  0 uses all hardware threads,
+  ///and 1 loads serially (default 0)
+  static int loadThreads;
+  ///If nonempty, the directory of the on-disk geometry cache (default: the
+  ///KLAMPT_GEOMETRY_CACHE environment variable, or empty)
+  static std::string diskCacheDirectory;
 
  private:
+  bool LoadDiskCached(const std::string& key);
+  void SaveDiskCached(const std::string& key);
+
   std::string cacheKey,dynamicGeometrySource;
+  ///Key of the geometry in the disk cache, valid while cacheKey is set
+  std::string diskCacheKey;
   GeometryPtr geometry;
   AppearancePtr appearance;
 };
@@ -150,6 +189,8 @@ public:
     std::vector<ManagedGeometry*> geoms;
   };
   std::map<std::string,GeometryList> cache;
+  ///Protects cache.  Recursive, since the cache operations call each other.
+  std::recursive_mutex mutex;
 };
 
 #endif
@@ -1,7 +1,16 @@
 #include "RandomizedSelfCollisions.h"
+#include "ThreadPool.h"
 #include <KrisLibrary/math/random.h>
 #include <KrisLibrary/utils/ProgressPrinter.h>
 #include "Planning/DistanceQuery.h"
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+
+RandomizedSelfCollisionSettings::RandomizedSelfCollisionSettings()
+  :numThreads(0),confidence(0.99),minCollisionProbability(0),seed(0)
+{}
 
 void SampleRobot(RobotWithGeometry& robot)
 {
@@ -13,24 +22,147 @@ void SampleRobot(RobotWithGeometry& robot)
   robot.UpdateGeometry();
 }
 
+//the probability of at most hits collisions in trials samples
+static Real BinomialCDF(int hits,int trials,Real p)
+{
+  if(p <= 0) return 1;
+  if(p >= 1) return (hits >= trials ? 1 : 0);
+  Real sum = 0;
+  for(int i=0;i<=hits;i++)
+    sum += Exp(std::lgamma(trials+1.0)-std::lgamma(i+1.0)-std::lgamma(trials-i+1.0)+i*Log(p)+(trials-i)*Log(1.0-p));
+  return sum;
+}
+
+Real SelfCollisionProbabilityBound(int hits,int trials,Real confidence)
+{
+  if(trials <= 0 || hits >= trials) return 1;
+  Real a = 1.0-confidence;
+  if(hits <= 0) return 1.0-Pow(a,1.0/trials);
+  //the CDF decreases in p, so bisect for the p where it drops to a
+  Real lo = Real(hits)/trials, hi = 1;
+  for(int iters=0;iters<100;iters++) {
+    Real mid = 0.5*(lo+hi);
+    if(BinomialCDF(hits,trials,mid) > a) lo = mid;
+    else hi = mid;
+  }
+  return hi;
+}
+
+//Returns the seed of the given sample, so that consecutive samples get
+//unrelated random streams
+static unsigned int SampleSeed(unsigned int seed,int sample)
+{
+  uint64_t z = (uint64_t(seed)<<32) + uint64_t(sample) + 0x9e3779b97f4a7c15ull;
+  z = (z ^ (z>>30))*0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z>>27))*0x94d049bb133111ebull;
+  return (unsigned int)(z ^ (z>>31));
+}
+
+//A copy of a robot's kinematics and of the geometry of some links, so that
+//each thread can pose its own copy
+struct SamplingRobot
+{
+  void Init(RobotWithGeometry& robot,const vector<pair<int,int> >& pairs)
+  {
+    kinematics = robot;
+    geometry.resize(robot.links.size());
+    queries.resize(pairs.size());
+    for(size_t k=0;k<pairs.size();k++) {
+      int i=pairs[k].first, j=pairs[k].second;
+      //the copies share the collision hierarchies of robot
+      if(!geometry[i]) geometry[i] = make_shared<RobotWithGeometry::CollisionGeometry>(*robot.geometry[i]);
+      if(!geometry[j]) geometry[j] = make_shared<RobotWithGeometry::CollisionGeometry>(*robot.geometry[j]);
+      queries[k] = make_shared<RobotWithGeometry::CollisionQuery>(*geometry[i],*geometry[j]);
+    }
+  }
+
+  //poses the links with a non-zero entry in links at the given sample
+  void Sample(unsigned int seed,int sample,const vector<char>& links)
+  {
+    std::mt19937 rng(SampleSeed(seed,sample));
+    std::uniform_real_distribution<double> u(0.0,1.0);
+    for(int i=0;i<kinematics.q.n;i++) {
+      if(!IsInf(kinematics.qMin(i)) && !IsInf(kinematics.qMax(i)))
+        kinematics.q(i) = kinematics.qMin(i) + u(rng)*(kinematics.qMax(i)-kinematics.qMin(i));
+    }
+    kinematics.UpdateFrames();
+    for(size_t i=0;i<geometry.size();i++)
+      if(geometry[i] && links[i]) geometry[i]->SetTransform(kinematics.links[i].T_World);
+  }
+
+  RobotKinematics3D kinematics;
+  vector<shared_ptr<RobotWithGeometry::CollisionGeometry> > geometry;
+  vector<shared_ptr<RobotWithGeometry::CollisionQuery> > queries;
+};
+
 //adds potentially colliding pairs to canCollide
 //NOTE: tests only those in robot's collision pairs
-void TestCollisions(RobotWithGeometry& robot,Array2D<bool>& canCollide,int numSamples)
+void TestCollisions(RobotWithGeometry& robot,Array2D<bool>& canCollide,int numSamples,const RandomizedSelfCollisionSettings& settings)
 {
-  cout<<"Randomly calculating new collisions..."<<endl;
+  vector<pair<int,int> > pairs;
+  for(int i=0;i<robot.q.n;i++)
+    for(int j=0;j<robot.q.n;j++)
+      if(!canCollide(i,j) && robot.selfCollisions(i,j) != NULL)
+        pairs.push_back(pair<int,int>(i,j));
+  bool earlyStopping = (settings.minCollisionProbability > 0 && settings.confidence < 1);
+  if(earlyStopping)
+    cout<<"Retiring pairs with collision probability < "<<settings.minCollisionProbability<<" with confidence "<<settings.confidence<<endl;
+
+  cout<<"Randomly calculating new collisions on "<<pairs.size()<<" pairs..."<<endl;
+  robot.InitCollisions();
+  ThreadPool pool(settings.numThreads);
+  vector<SamplingRobot> copies(pool.NumThreads());
+  for(size_t t=0;t<copies.size();t++)
+    copies[t].Init(robot,pairs);
+  vector<vector<char> > hits(copies.size());
+  vector<char> links(robot.links.size());
+  vector<int> active(pairs.size());
+  for(size_t k=0;k<pairs.size();k++) active[k] = (int)k;
+  //samples of each pair.  Pairs are retired once they collide, so the
+  //active ones have no hits.
+  vector<int> trials(pairs.size(),0);
+  //the active pairs are updated between rounds of samples
+  int roundSize = 16*pool.NumThreads();
+  int numSampled = 0;
   ProgressPrinter progress(numSamples);
-  for(int k=0;k<numSamples;k++) {
-    progress.Update();
-    SampleRobot(robot);
-    for(int i=0;i<robot.q.n;i++)
-      for(int j=0;j<robot.q.n;j++) {
-        if(!canCollide(i,j)) {
-          if(robot.SelfCollision(i,j))
-            canCollide(i,j) = true;
-        }
+  while(!active.empty() && numSampled < numSamples) {
+    int n = Min(roundSize,numSamples-numSampled);
+    //end the round when the next pair can be retired
+    if(earlyStopping) {
+      for(auto k:active) {
+        int m = 1;
+        while(m < n && SelfCollisionProbabilityBound(0,trials[k]+m,settings.confidence) >= settings.minCollisionProbability) m++;
+        n = m;
       }
+    }
+    fill(links.begin(),links.end(),0);
+    for(auto k:active)
+      links[pairs[k].first] = links[pairs[k].second] = 1;
+    for(size_t t=0;t<hits.size();t++)
+      hits[t].assign(pairs.size(),0);
+    pool.ParallelFor(n,[&](int sample,int thread) {
+        SamplingRobot& copy = copies[thread];
+        copy.Sample(settings.seed,numSampled+sample,links);
+        for(auto k:active)
+          if(!hits[thread][k] && copy.queries[k]->Collide())
+            hits[thread][k] = 1;
+      });
+    numSampled += n;
+    for(int k=0;k<n;k++) progress.Update();
+    size_t numActive = 0;
+    for(auto k:active) {
+      bool hit = false;
+      for(size_t t=0;t<hits.size();t++)
+        if(hits[t][k]) hit = true;
+      trials[k] += n;
+      if(hit) canCollide(pairs[k].first,pairs[k].second) = true;
+      else if(earlyStopping && SelfCollisionProbabilityBound(0,trials[k],settings.confidence) < settings.minCollisionProbability) continue;
+      else active[numActive++] = k;
+    }
+    active.resize(numActive);
   }
   progress.Done();
+  cout<<"Stopped after "<<numSampled<<" samples"<<endl;
 }
 
 //of the collision pairs in canCollide, finds the ones that have independent
@@ -78,7 +210,7 @@ void TestIndependentCollisions(RobotWithGeometry& robot,Array2D<bool>& canCollid
 
 
 
-void RandomizedSelfCollisionPairs(RobotWithGeometry& robot,Array2D<bool>& collision,int numSamples)
+void RandomizedSelfCollisionPairs(RobotWithGeometry& robot,Array2D<bool>& collision,int numSamples,const RandomizedSelfCollisionSettings& settings)
 {
   Array2D<bool> oldCollisions(robot.q.n,robot.q.n);
   for(int i=0;i<robot.q.n;i++)
@@ -88,7 +220,7 @@ void RandomizedSelfCollisionPairs(RobotWithGeometry& robot,Array2D<bool>& collis
   robot.CleanupSelfCollisions();
   robot.InitAllSelfCollisions();
   collision.resize(robot.q.n,robot.q.n,false);
-  TestCollisions(robot,collision,numSamples);
+  TestCollisions(robot,collision,numSamples,settings);
 
   //restore self collisions
   robot.InitSelfCollisionPairs(oldCollisions);
@@ -105,7 +237,7 @@ void RandomizedSelfCollisionPairs(RobotWithGeometry& robot,Array2D<bool>& collis
   cout<<numNewPairs<<" new pairs, "<<numPairs<<" total"<<endl;
 }
 
-void RandomizedIndependentSelfCollisionPairs(RobotWithGeometry& robot,Array2D<bool>& collision,int numSamples)
+void RandomizedIndependentSelfCollisionPairs(RobotWithGeometry& robot,Array2D<bool>& collision,int numSamples,const RandomizedSelfCollisionSettings& settings)
 {
   Array2D<bool> oldCollisions(robot.q.n,robot.q.n);
   for(int i=0;i<robot.q.n;i++)
@@ -115,7 +247,7 @@ void RandomizedIndependentSelfCollisionPairs(RobotWithGeometry& robot,Array2D<bo
   robot.CleanupSelfCollisions();
   robot.InitAllSelfCollisions();
   collision.resize(robot.q.n,robot.q.n,false);
-  TestCollisions(robot,collision,numSamples);
+  TestCollisions(robot,collision,numSamples,settings);
   Array2D<bool> independent;
   independent.resize(robot.q.n,robot.q.n,false);
   TestIndependentCollisions(robot,collision,independent,numSamples);
@@ -136,36 +268,47 @@ void RandomizedIndependentSelfCollisionPairs(RobotWithGeometry& robot,Array2D<bo
 
 
 
-void RandomizedSelfCollisionDistances(RobotWithGeometry& robot,Array2D<Real>& minDistance,Array2D<Real>& maxDistance,int numSamples)
+void RandomizedSelfCollisionDistances(RobotWithGeometry& robot,Array2D<Real>& minDistance,Array2D<Real>& maxDistance,int numSamples,const RandomizedSelfCollisionSettings& settings)
 {
   minDistance.resize(robot.q.n,robot.q.n,Inf);
   maxDistance.resize(robot.q.n,robot.q.n,-Inf);
-  Array2D<shared_ptr<RobotWithGeometry::CollisionQuery> > queries(robot.q.n,robot.q.n);
+  vector<pair<int,int> > pairs;
   for(int i=0;i<robot.q.n;i++) {
     if(robot.IsGeometryEmpty(i)) continue;
     for(int j=i+1;j<robot.q.n;j++) {
       if(!robot.IsGeometryEmpty(j))
-        queries(i,j).reset(new RobotWithGeometry::CollisionQuery(*robot.geometry[i],*robot.geometry[j]));
+        pairs.push_back(pair<int,int>(i,j));
     }
   }
 
+  robot.InitCollisions();
+  ThreadPool pool(settings.numThreads);
+  vector<SamplingRobot> copies(pool.NumThreads());
+  for(size_t t=0;t<copies.size();t++)
+    copies[t].Init(robot,pairs);
+  vector<vector<Real> > dmin(copies.size(),vector<Real>(pairs.size(),Inf));
+  vector<vector<Real> > dmax(copies.size(),vector<Real>(pairs.size(),-Inf));
+  vector<char> links(robot.links.size(),1);
+
   //TODO: configure these
   Real absErr = 0.001;
   Real relErr = 0.01;
-  for(int iters=0;iters<numSamples;iters++) {
-    if(iters*100 % numSamples == 0) {
-      cout<<iters*100/numSamples<<"..."; cout.flush();
-    }
-    SampleRobot(robot);
-    for(int i=0;i<robot.q.n;i++) {
-      for(int j=i+1;j<robot.q.n;j++) {
-        if(!queries(i,j)) continue;
-        Real d=queries(i,j)->Distance(absErr,relErr);
-        minDistance(i,j) = Min(minDistance(i,j),d);
-        maxDistance(i,j) = Max(maxDistance(i,j),d);
+  pool.ParallelFor(numSamples,[&](int sample,int thread) {
+      SamplingRobot& copy = copies[thread];
+      copy.Sample(settings.seed,sample,links);
+      for(size_t k=0;k<pairs.size();k++) {
+        Real d=copy.queries[k]->Distance(absErr,relErr);
+        dmin[thread][k] = Min(dmin[thread][k],d);
+        dmax[thread][k] = Max(dmax[thread][k],d);
       }
+    });
+  for(size_t t=0;t<copies.size();t++) {
+    for(size_t k=0;k<pairs.size();k++) {
+      int i=pairs[k].first, j=pairs[k].second;
+      minDistance(i,j) = Min(minDistance(i,j),dmin[t][k]);
+      maxDistance(i,j) = Max(maxDistance(i,j),dmax[t][k]);
     }
-  }  
+  }
   //fill out the lower triangle  
   for(int i=0;i<robot.q.n;i++) {
     for(int j=0;j<i;j++) {
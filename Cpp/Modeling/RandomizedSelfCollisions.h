@@ -13,29 +13,66 @@
 /** @addtogroup Modeling */
 /*@{*/
 
+/** @brief Settings for the randomized self-collision functions.
+ *
+ * Configurations are sampled on a thread pool, and each thread checks them
+ * on its own copy of the robot's kinematics and collision geometry.  The
+ * samples depend only on seed, so results don't depend on numThreads.
+ *
+ * A pair stops being checked once it has collided.  If
+ * minCollisionProbability > 0, a pair also stops being checked once the
+ * upper confidence bound on its collision probability, computed from its
+ * own hits and samples by SelfCollisionProbabilityBound, is below
+ * minCollisionProbability.  The confidence holds for each pair separately.
+ * Sampling ends after numSamples samples, or when no pair is left.
+ */
+struct RandomizedSelfCollisionSettings
+{
+  RandomizedSelfCollisionSettings();
+  ///Number of threads.  If <= 0, uses ThreadPool::DefaultNumThreads()
+  ///(default 0)
+  int numThreads;
+  ///The optional early stopping rule for pairs that haven't collided.  0
+  ///checks the remaining pairs on all samples (default 0.99 and 0)
+  Real confidence,minCollisionProbability;
+  ///Seed of the sampled configurations (default 0)
+  unsigned int seed;
+};
+
+/** @brief Returns the Clopper-Pearson upper bound, with the given
+ * confidence, on the collision probability of a pair that collided in hits
+ * of trials independent samples.
+ *
+ * With no hits this is 1-(1-confidence)^(1/trials).
+ */
+Real SelfCollisionProbabilityBound(int hits,int trials,Real confidence);
+
 /** @brief Calculates a bit-matrix of potential collision pairs using random
  * sampling.
  *
  * Sets collision(i,j) = true iff a collision between link i and j has been
- * detected within numSamples samples.
+ * detected within numSamples samples, or within the fewer samples taken if
+ * early stopping is enabled in settings.
  */
-void RandomizedSelfCollisionPairs(RobotWithGeometry& robot,Array2D<bool>& collision,int numSamples);
+void RandomizedSelfCollisionPairs(RobotWithGeometry& robot,Array2D<bool>& collision,int numSamples,const RandomizedSelfCollisionSettings& settings=RandomizedSelfCollisionSettings());
 
 
 /** @brief Calculates the bit-matrix of potential independent collision pairs.
  *
  * Sets collision(i,j) = true iff a collision between link i and j has been
  * detected within numSamples samples.  And independent means they have been
- * detected to occur independently of any other pair.
+ * detected to occur independently of any other pair.  Early stopping in
+ * settings only applies to finding the colliding pairs.
  */
-void RandomizedIndependentSelfCollisionPairs(RobotWithGeometry& robot,Array2D<bool>& collision,int numSamples);
+void RandomizedIndependentSelfCollisionPairs(RobotWithGeometry& robot,Array2D<bool>& collision,int numSamples,const RandomizedSelfCollisionSettings& settings=RandomizedSelfCollisionSettings());
 
 /** @brief Calculates the min/max distance matrix of collision pairs.
  *
  * Sets min/maxDistance(i,j) to the min/max distance between bodies i and j
- * within numSamples samples.
+ * within numSamples samples.  Every pair is checked on all samples; only
+ * numThreads and seed of settings are used.
  */
-void RandomizedSelfCollisionDistances(RobotWithGeometry& robot,Array2D<Real>& minDistance,Array2D<Real>& maxDistance,int numSamples);
+void RandomizedSelfCollisionDistances(RobotWithGeometry& robot,Array2D<Real>& minDistance,Array2D<Real>& maxDistance,int numSamples,const RandomizedSelfCollisionSettings& settings=RandomizedSelfCollisionSettings());
 
 /*@}*/
 
@@ -1,5 +1,6 @@
 #include "Robot.h"
 #include "Mass.h"
+#include "ThreadPool.h"
 #include <KrisLibrary/utils/stringutils.h>
 #include <KrisLibrary/utils/arrayutils.h>
 #include <string.h>
@@ -18,6 +19,7 @@
 #include <KrisLibrary/Timer.h>
 #include "IO/urdf_parser.h"
 #include <memory>
+#include <mutex>
 #include "IO/URDFConverter.h"
 #include <map>
 //using namespace urdf;
@@ -1009,6 +1011,7 @@ bool Robot::LoadRob(const char* fn) {
   geomManagers.resize(n);
   geomFiles.resize(n);
   Timer timer;
+  vector<int> loadLinks;
   for (size_t i = 0; i < geomFn.size(); i++) {
     if (geomFn[i].empty()) {
       continue;
@@ -1016,7 +1019,13 @@ bool Robot::LoadRob(const char* fn) {
     geomFiles[i] = geomFn[i];
     geomFn[i] = ResolveFileReference(path,geomFn[i]);
     if(Robot::disableGeometryLoading) continue;
-    if (!LoadGeometry(i, geomFn[i].c_str())) {
+    loadLinks.push_back((int)i);
+  }
+  vector<bool> loaded;
+  LoadGeometries(loadLinks,geomFn,loaded);
+  for (size_t k = 0; k < loadLinks.size(); k++) {
+    size_t i = loadLinks[k];
+    if (!loaded[k]) {
       LOG4CXX_ERROR(GET_LOGGER(RobParser),"   Unable to load link "<<i<<" geometry file "<<geomFn[i]);
       return false;
     }
@@ -1412,6 +1421,7 @@ bool Robot::LoadGeometry(int i,const char* file)
   if(i >= (int)geomManagers.size())
     geomManagers.resize(geometry.size());
   //make the default appearance be grey, so that loader may override it
+  if(i < (int)geomLODs.size()) geomLODs[i].Clear();
   if(geomManagers[i].Load(file)) {
     geometry[i] = geomManagers[i];
     SetDefaultAppearance(geomManagers[i].Appearance());
@@ -1420,6 +1430,53 @@ bool Robot::LoadGeometry(int i,const char* file)
   return false;
 }
 
+int Robot::LoadGeometries(const vector<int>& linkIndices,const vector<string>& files,vector<bool>& loaded)
+{
+  if(geomManagers.size() < geometry.size())
+    geomManagers.resize(geometry.size());
+  vector<ManagedGeometry*> geoms(linkIndices.size());
+  vector<string> linkFiles(linkIndices.size());
+  for(size_t k=0;k<linkIndices.size();k++) {
+    geoms[k] = &geomManagers[linkIndices[k]];
+    linkFiles[k] = files[linkIndices[k]];
+  }
+  int numLoaded = ManagedGeometry::LoadMultiple(geoms,linkFiles,loaded);
+  //appearances may be shared between links, so set them up serially
+  for(size_t k=0;k<linkIndices.size();k++) {
+    if(!loaded[k]) continue;
+    if(linkIndices[k] < (int)geomLODs.size()) geomLODs[linkIndices[k]].Clear();
+    geometry[linkIndices[k]] = geomManagers[linkIndices[k]];
+    SetDefaultAppearance(geomManagers[linkIndices[k]].Appearance());
+  }
+  return numLoaded;
+}
+
+//GetGeometryLOD is called from lookups that callers treat as read-only,
+//e.g., ray casts and collision checks on several threads, so the levels
+//are built and posed under a lock
+static std::mutex gGeometryLODMutex;
+
+void Robot::BuildGeometryLODs()
+{
+  std::lock_guard<std::mutex> lock(gGeometryLODMutex);
+  geomLODs.resize(geometry.size());
+  //links are simplified independently
+  ThreadPool pool;
+  pool.ParallelFor((int)geometry.size(),[&](int i,int thread) {
+      geomLODs[i].Build(geometry[i]);
+    });
+}
+
+Geometry::AnyCollisionGeometry3D* Robot::GetGeometryLOD(int i,int level)
+{
+  if(level <= GeometryLOD::Original) return geometry[i].get();
+  std::lock_guard<std::mutex> lock(gGeometryLODMutex);
+  if(geomLODs.size() < geometry.size())
+    geomLODs.resize(geometry.size());
+  geomLODs[i].Build(geometry[i]);
+  return geomLODs[i].Get(level);
+}
+
 bool Robot::SaveGeometry(const char* prefix) {
   for (size_t i = 0; i < links.size(); i++) {
     if (!IsGeometryEmpty(i)) {
@@ -3184,33 +3241,23 @@ bool Robot::LoadURDF(const char* fn)
   }
   
   UpdateFrames();
+  //find the geometry files, then load them all at once
+  vector<string> loadFiles(links.size());
+  vector<int> loadLinks;
   for (size_t i = start; i < linkNodes.size(); i++) {
     URDFLinkNode* linkNode = &linkNodes[i];
     int link_index = linkNode->index;
     if(floating) link_index += 5;
     else link_index -= 1;
 
-    //geometry
     if (!linkNode->geomName.empty() && !Robot::disableGeometryLoading) {
       string fn;
       geomFiles[link_index] = linkNode->geomName;
       fn = ResolveFileReference(path,linkNode->geomName);
-      if(FileUtils::Exists(fn.c_str())) {
-        if (!LoadGeometry(link_index, fn.c_str())) {
-          LOG4CXX_ERROR(GET_LOGGER(URDFParser), "Failed loading geometry " << linkNode->geomName << " for link " << link_index << "");
-          //LOG4CXX_INFO
-          LOG4CXX_ERROR(GET_LOGGER(URDFParser), "Temporarily ignoring error...");
-          //return false;
-        }
-      }
-      else if(FileUtils::Exists(geomFiles[link_index].c_str())) {
-        if (!LoadGeometry(link_index, geomFiles[link_index].c_str())) {
-          LOG4CXX_ERROR(GET_LOGGER(URDFParser), "Failed loading geometry " << linkNode->geomName  << " for link " << link_index << "");
-          //TEMP
-          LOG4CXX_INFO(GET_LOGGER(URDFParser), "Temporarily ignoring error...");
-          //return false;
-        }
-      }
+      if(FileUtils::Exists(fn.c_str()))
+        loadFiles[link_index] = fn;
+      else if(FileUtils::Exists(geomFiles[link_index].c_str()))
+        loadFiles[link_index] = geomFiles[link_index];
       else {
         localfile = MakeURLLocal(fn);
         if(localfile == fn) {
@@ -3220,15 +3267,31 @@ bool Robot::LoadURDF(const char* fn)
           //return false;
         }
         else {
-          //try loiading from url
-          if(!LoadGeometry(link_index,fn.c_str())) {
-            LOG4CXX_ERROR(GET_LOGGER(URDFParser), "Failed loading geometry " << linkNode->geomName << " for link " << link_index << "");
-            //TEMP
-            LOG4CXX_INFO(GET_LOGGER(URDFParser), "Temporarily ignoring error...");
-          }
+          //try loading from url
+          loadFiles[link_index] = fn;
         }
       }
+      if(!loadFiles[link_index].empty())
+        loadLinks.push_back(link_index);
+    }
+  }
+  vector<bool> loaded;
+  LoadGeometries(loadLinks,loadFiles,loaded);
+  for (size_t k = 0; k < loadLinks.size(); k++) {
+    if (!loaded[k]) {
+      LOG4CXX_ERROR(GET_LOGGER(URDFParser), "Failed loading geometry " << geomFiles[loadLinks[k]] << " for link " << loadLinks[k] << "");
+      //TEMP
+      LOG4CXX_INFO(GET_LOGGER(URDFParser), "Temporarily ignoring error...");
+      //return false;
     }
+  }
+
+  for (size_t i = start; i < linkNodes.size(); i++) {
+    URDFLinkNode* linkNode = &linkNodes[i];
+    int link_index = linkNode->index;
+    if(floating) link_index += 5;
+    else link_index -= 1;
+
     if(!linkNode->geomData.Empty()) {
       if(link_index >= (int)geomManagers.size())
         geomManagers.resize(geometry.size());
@@ -4,6 +4,7 @@
 #include <KrisLibrary/robotics/RobotWithGeometry.h>
 #include <KrisLibrary/utils/PropertyMap.h>
 #include "ManagedGeometry.h"
+#include "GeometryLOD.h"
 
 using namespace std;
 
@@ -86,9 +87,22 @@ public:
   bool LoadURDF(const char* fn);
   bool Save(const char* fn);
   bool LoadGeometry(int i,const char* file);
+  ///Loads the geometry of each link in linkIndices from files[link] on a
+  ///thread pool (see ManagedGeometry::LoadMultiple).  loaded[k] is set to
+  ///whether linkIndices[k] was loaded.  Returns the number loaded.
+  int LoadGeometries(const vector<int>& linkIndices,const vector<string>& files,vector<bool>& loaded);
   void SetGeomFiles(const char* geomPrefix="",const char* geomExt="off");  ///< Sets the geometry file names to geomPrefix+[linkName].[geomExt]
   void SetGeomFiles(const vector<string>& geomFiles);
   bool SaveGeometry(const char* prefix="");  
+  ///Builds the levels of detail of every link's geometry (see GeometryLOD)
+  void BuildGeometryLODs();
+  ///Returns the collision geometry of link i at the given level of detail (a
+  ///GeometryLOD::Level), with the current transform of geometry[i], so
+  ///UpdateGeometry needs no extra work for the levels.  Level 0 returns
+  ///geometry[i].  A link's levels are built the first time one is requested,
+  ///under a lock, so several threads may query the same robot as long as
+  ///none of them moves it.  BuildGeometryLODs builds them all up front.
+  Geometry::AnyCollisionGeometry3D* GetGeometryLOD(int i,int level);
   void InitStandardJoints();
   bool CheckValid() const;
   //adds a geometry to the geometry of the given link
@@ -133,6 +147,7 @@ public:
   string name;
   vector<string> geomFiles;   ///< geometry file names (used in saving)
   vector<ManagedGeometry> geomManagers; ///< geometry loaders (speeds up loading)
+  vector<GeometryLOD> geomLODs; ///< coarser collision geometries, built on demand
   Vector accMax;   ///< conservative acceleration limits, used by DynamicPath
   vector<RobotJoint> joints;
   vector<RobotJointDriver> drivers;
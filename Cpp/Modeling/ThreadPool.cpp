@@ -0,0 +1,88 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+//true while the current thread is executing a ParallelFor body
+static thread_local bool gInParallelFor = false;
+
+ThreadPool::ThreadPool(int numThreads)
+  :job(NULL),jobSize(0),jobGrain(1),nextIndex(0),numBusy(0),generation(0),quit(false)
+{
+  if(numThreads <= 0) numThreads = DefaultNumThreads();
+  for(int i=1;i<numThreads;i++)
+    workers.push_back(std::thread(&ThreadPool::WorkerLoop,this,i));
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    quit = true;
+  }
+  wakeCondition.notify_all();
+  for(size_t i=0;i<workers.size();i++)
+    workers[i].join();
+}
+
+int ThreadPool::DefaultNumThreads()
+{
+  unsigned int n = std::thread::hardware_concurrency();
+  if(n == 0) return 1;
+  return (int)n;
+}
+
+void ThreadPool::ParallelFor(int n,const std::function<void(int,int)>& f,int grainSize)
+{
+  if(n <= 0) return;
+  if(grainSize < 1) grainSize = 1;
+  if(workers.empty() || gInParallelFor || n <= grainSize) {
+    for(int i=0;i<n;i++) f(i,0);
+    return;
+  }
+  std::lock_guard<std::mutex> jobLock(jobMutex);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    job = &f;
+    jobSize = n;
+    jobGrain = grainSize;
+    nextIndex = 0;
+    numBusy = (int)workers.size();
+    generation++;
+  }
+  wakeCondition.notify_all();
+  RunJob(0);
+  std::unique_lock<std::mutex> lock(mutex);
+  doneCondition.wait(lock,[this]() { return numBusy == 0; });
+  job = NULL;
+}
+
+void ThreadPool::RunJob(int thread)
+{
+  gInParallelFor = true;
+  while(true) {
+    int start = nextIndex.fetch_add(jobGrain);
+    if(start >= jobSize) break;
+    int end = std::min(start+jobGrain,jobSize);
+    for(int i=start;i<end;i++)
+      (*job)(i,thread);
+  }
+  gInParallelFor = false;
+}
+
+void ThreadPool::WorkerLoop(int thread)
+{
+  unsigned int lastGeneration = 0;
+  while(true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wakeCondition.wait(lock,[&]() { return quit || generation != lastGeneration; });
+      if(quit) return;
+      lastGeneration = generation;
+    }
+    RunJob(thread);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      numBusy--;
+      if(numBusy == 0) doneCondition.notify_one();
+    }
+  }
+}
@@ -0,0 +1,58 @@
+#ifndef MODELING_THREAD_POOL_H
+#define MODELING_THREAD_POOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+/** @file ThreadPool.h
+ * @ingroup Modeling
+ * @brief A minimal persistent thread pool for data-parallel loops.
+ */
+
+/** @ingroup Modeling
+ * @brief A fixed set of worker threads that execute ParallelFor loops.
+ *
+ * Indices are handed out dynamically in chunks of grainSize, so uneven
+ * per-item costs are balanced across threads.  The calling thread
+ * participates as thread 0, so a pool of N threads spawns N-1 workers.
+ *
+ * ParallelFor calls made from inside a running loop (nested calls) and pools
+ * with a single thread run serially on the calling thread.  Calls on the
+ * same pool from different threads are serialized.
+ */
+class ThreadPool
+{
+public:
+  ///Creates a pool with numThreads threads.  If numThreads <= 0, uses
+  ///DefaultNumThreads().
+  ThreadPool(int numThreads=0);
+  ~ThreadPool();
+  int NumThreads() const { return (int)workers.size()+1; }
+  ///Calls f(index,thread) for every index in [0,n).  thread is in the range
+  ///[0,NumThreads()) and can be used to index per-thread scratch data.
+  ///Returns when all calls have completed.
+  void ParallelFor(int n,const std::function<void(int,int)>& f,int grainSize=1);
+  ///Returns the number of hardware threads, or 1 if unknown
+  static int DefaultNumThreads();
+
+private:
+  void WorkerLoop(int thread);
+  void RunJob(int thread);
+
+  std::vector<std::thread> workers;
+  std::mutex jobMutex;
+  std::mutex mutex;
+  std::condition_variable wakeCondition,doneCondition;
+  const std::function<void(int,int)>* job;
+  int jobSize,jobGrain;
+  std::atomic<int> nextIndex;
+  int numBusy;
+  unsigned int generation;
+  bool quit;
+};
+
+#endif
@@ -7,6 +7,7 @@
 #include "IO/XmlWorld.h"
 
 RobotWorld::RobotWorld()
+  :rayCastGeometryLOD(0)
 {
   background.set(0.4f,0.4f,1,0);
 }
@@ -443,7 +444,7 @@ int RobotWorld::RayCast(const Ray3D& r,Vector3& worldpt)
     for(size_t i=0;i<robot->links.size();i++) {
       if(robot->IsGeometryEmpty(i)) continue;
       Real dist;
-      if(robot->geometry[i]->RayCast(r,&dist)) {
+      if(robot->GetGeometryLOD(i,rayCastGeometryLOD)->RayCast(r,&dist)) {
         if(dist < closestDist) {
           closestDist = dist;
           closestPoint = r.source + dist*r.direction;
@@ -511,7 +512,7 @@ int RobotWorld::RayCastIgnore(const Ray3D& r,const vector<int>& ignoreIDList,Vec
       if(ignoreIDs[idBase+(int)i]) continue;
       if(robot->IsGeometryEmpty(i)) continue;
       Real dist;
-      if(robot->geometry[i]->RayCast(r,&dist)) {
+      if(robot->GetGeometryLOD(i,rayCastGeometryLOD)->RayCast(r,&dist)) {
         if(dist < closestDist) {
           closestDist = dist;
           closestPoint = r.source + dist*r.direction;
@@ -583,7 +584,7 @@ int RobotWorld::RayCastSelected(const Ray3D& r,const vector<int>& selectIDList,V
       if(ignoreIDs[idBase+(int)i]) continue;
       if(robot->IsGeometryEmpty(i)) continue;
       Real dist;
-      if(robot->geometry[i]->RayCast(r,&dist)) {
+      if(robot->GetGeometryLOD(i,rayCastGeometryLOD)->RayCast(r,&dist)) {
         if(dist < closestDist) {
           closestDist = dist;
           closestPoint = r.source + dist*r.direction;
@@ -642,7 +643,7 @@ Robot* RobotWorld::RayCastRobot(const Ray3D& r,int& body,Vector3& localpt)
     for(size_t i=0;i<robot->links.size();i++) {
       if(robot->IsGeometryEmpty(i)) continue;
       Real dist;
-      if(robot->geometry[i]->RayCast(r,&dist)) {
+      if(robot->GetGeometryLOD(i,rayCastGeometryLOD)->RayCast(r,&dist)) {
 	if(dist < closestDist) {
 	  closestDist = dist;
 	  closestPoint = r.source + dist*r.direction;
@@ -692,6 +693,8 @@ void CopyWorld(const RobotWorld& a,RobotWorld& b)
   b.camera=a.camera;
   b.viewport=a.viewport;
   b.lights=a.lights;
+  b.background=a.background;
+  b.rayCastGeometryLOD=a.rayCastGeometryLOD;
 
   b.robots.resize(a.robots.size());
   b.robotViews.resize(a.robots.size());
@@ -714,6 +717,29 @@ void CopyWorld(const RobotWorld& a,RobotWorld& b)
 
 }
 
+void CopyWorldUnique(const RobotWorld& a,RobotWorld& b)
+{
+  CopyWorld(a,b);
+  for(size_t i=0;i<b.robots.size();i++) {
+    Robot& robot = *b.robots[i];
+    for(size_t j=0;j<robot.geomManagers.size();j++) {
+      if(robot.geomManagers[j].Empty()) continue;
+      robot.geomManagers[j].SetUniqueGeometry();
+      robot.geometry[j] = robot.geomManagers[j];
+    }
+  }
+  for(size_t i=0;i<b.rigidObjects.size();i++)
+    if(!b.rigidObjects[i]->geometry.Empty())
+      b.rigidObjects[i]->geometry.SetUniqueGeometry();
+  //terrains never move, so the copies only read their geometry.  Build the
+  //collision data now so that it isn't built lazily by several threads.
+  for(size_t i=0;i<a.terrains.size();i++) {
+    ManagedGeometry& geom = a.terrains[i]->geometry;
+    if(!geom.Empty() && !geom.IsDynamicGeometry() && !geom->CollisionDataInitialized())
+      geom->InitCollisionData();
+  }
+}
+
 int RobotWorld::LoadElement(const string& sfn)
 {
   const char* fn = sfn.c_str();
@@ -76,6 +76,7 @@ class RobotWorld
   RigidObject* GetRigidObject(const string& name);
 
   ///Returns the ID of the entity the ray hits, or -1 if nothing was hit.  Returns hit point *in world frame*.
+  ///To cast many rays against the same world state, use WorldRayCaster.
   int RayCast(const Ray3D& r,Vector3& worldpt);
   ///Same as RayCast but ignores some IDs (see TerrainID, RigidObjectID, RobotID, RobotLinkID)
   int RayCastIgnore(const Ray3D& r,const vector<int>& ignoreIDs,Vector3& worldpt);
@@ -99,6 +100,11 @@ class RobotWorld
   vector<GLDraw::GLLight> lights;
   GLDraw::GLColor background;
 
+  ///The level of detail of the robot link geometries hit by the RayCast
+  ///functions and WorldRayCaster, a GeometryLOD::Level (default 0, the
+  ///original geometry)
+  int rayCastGeometryLOD;
+
   //world occupants
   vector<shared_ptr<Robot> > robots;
   vector<shared_ptr<Terrain> > terrains;
@@ -110,7 +116,27 @@ class RobotWorld
 /** @ingroup Modeling
  * @brief Performs a shallow copy of a RobotWorld.  Since it does not copy geometry,
  * this operation is very fast.
+ *
+ * b gets its own robots, objects, and terrains, so their configurations,
+ * velocities, and transforms are independent of a's.  Geometry, collision
+ * data, and appearances are shared through reference counts.  Since a
+ * collision geometry stores the transform of its last update, call
+ * UpdateGeometry on a world before querying its collisions if the other
+ * one has been queried since.
  */
 void CopyWorld(const RobotWorld& a,RobotWorld& b);
 
+/** @ingroup Modeling
+ * @brief Copies a RobotWorld, giving the robots and rigid objects of the
+ * copy their own collision geometry.  Slower than CopyWorld, but the copy
+ * can be moved and queried independently of a, e.g., on another thread.
+ * Their meshes keep sharing a's BVHs, which are built once here if needed,
+ * so each copy only owns its vertex and triangle arrays and transforms.
+ *
+ * Terrains don't move, so their geometry and collision data stay shared
+ * with a, as do all appearances.  Don't modify a's terrain geometry while
+ * copies are in use.
+ */
+void CopyWorldUnique(const RobotWorld& a,RobotWorld& b);
+
 #endif
@@ -0,0 +1,180 @@
+#include "WorldRayCaster.h"
+#include "ThreadPool.h"
+#include <algorithm>
+
+using namespace Geometry;
+
+//bodies per BVH leaf
+const static int kLeafSize = 2;
+
+//Slab test.  Returns the parameter at which r enters bb, or Inf if it
+//misses bb or enters it after tmax.
+static Real RayBoxEntry(const Ray3D& r,const Vector3& invDir,const AABB3D& bb,Real tmax)
+{
+  Real tmin = 0;
+  for(int k=0;k<3;k++) {
+    if(IsInf(invDir[k])) {
+      if(r.source[k] < bb.bmin[k] || r.source[k] > bb.bmax[k]) return Inf;
+      continue;
+    }
+    Real t1 = (bb.bmin[k]-r.source[k])*invDir[k];
+    Real t2 = (bb.bmax[k]-r.source[k])*invDir[k];
+    if(t1 > t2) std::swap(t1,t2);
+    if(t1 > tmin) tmin = t1;
+    if(t2 < tmax) tmax = t2;
+    if(tmin > tmax) return Inf;
+  }
+  return tmin;
+}
+
+WorldRayCaster::WorldRayCaster()
+  :numThreads(1),grainSize(64)
+{}
+
+WorldRayCaster::~WorldRayCaster()
+{}
+
+void WorldRayCaster::Build(RobotWorld& world,const vector<int>& ignoreIDList)
+{
+  vector<bool> ignoreIDs(world.NumIDs(),false);
+  for(auto i:ignoreIDList)
+    if(i >= 0 && i < (int)ignoreIDs.size()) ignoreIDs[i] = true;
+  bodies.resize(0);
+  Body b;
+  for(size_t j=0;j<world.robots.size();j++) {
+    if(ignoreIDs[world.RobotID((int)j)]) continue;
+    Robot* robot = world.robots[j].get();
+    robot->InitCollisions();
+    robot->UpdateGeometry();
+    for(size_t i=0;i<robot->links.size();i++) {
+      b.id = world.RobotLinkID((int)j,(int)i);
+      if(ignoreIDs[b.id] || robot->IsGeometryEmpty(i)) continue;
+      b.geometry = robot->GetGeometryLOD(i,world.rayCastGeometryLOD);
+      b.bb = b.geometry->GetAABB();
+      bodies.push_back(b);
+    }
+  }
+  for(size_t j=0;j<world.rigidObjects.size();j++) {
+    b.id = world.RigidObjectID((int)j);
+    RigidObject* obj = world.rigidObjects[j].get();
+    if(ignoreIDs[b.id] || obj->geometry.Empty()) continue;
+    obj->InitCollisions();
+    obj->geometry->SetTransform(obj->T);
+    b.geometry = &*obj->geometry;
+    b.bb = b.geometry->GetAABB();
+    bodies.push_back(b);
+  }
+  for(size_t j=0;j<world.terrains.size();j++) {
+    b.id = world.TerrainID((int)j);
+    Terrain* ter = world.terrains[j].get();
+    if(ignoreIDs[b.id] || ter->geometry.Empty()) continue;
+    ter->InitCollisions();
+    b.geometry = &*ter->geometry;
+    b.bb = b.geometry->GetAABB();
+    bodies.push_back(b);
+  }
+  nodes.resize(0);
+  if(!bodies.empty()) {
+    nodes.reserve(bodies.size()*2);
+    BuildNode(0,(int)bodies.size());
+  }
+}
+
+int WorldRayCaster::BuildNode(int first,int count)
+{
+  int index = (int)nodes.size();
+  nodes.push_back(Node());
+  AABB3D bb = bodies[first].bb;
+  AABB3D centers;
+  centers.setPoint((bodies[first].bb.bmin+bodies[first].bb.bmax)*0.5);
+  for(int i=first+1;i<first+count;i++) {
+    bb.setUnion(bodies[i].bb);
+    centers.expand((bodies[i].bb.bmin+bodies[i].bb.bmax)*0.5);
+  }
+  nodes[index].bb = bb;
+  if(count <= kLeafSize) {
+    nodes[index].left = nodes[index].right = -1;
+    nodes[index].first = first;
+    nodes[index].count = count;
+    return index;
+  }
+  //median split along the widest axis of the box centers
+  Vector3 size = centers.bmax - centers.bmin;
+  int axis = 0;
+  if(size.y > size[axis]) axis = 1;
+  if(size.z > size[axis]) axis = 2;
+  int mid = first + count/2;
+  std::nth_element(bodies.begin()+first,bodies.begin()+mid,bodies.begin()+first+count,
+                   [axis](const Body& a,const Body& b) { return a.bb.bmin[axis]+a.bb.bmax[axis] < b.bb.bmin[axis]+b.bb.bmax[axis]; });
+  int left = BuildNode(first,mid-first);
+  int right = BuildNode(mid,first+count-mid);
+  nodes[index].left = left;
+  nodes[index].right = right;
+  nodes[index].first = first;
+  nodes[index].count = 0;
+  return index;
+}
+
+int WorldRayCaster::RayCast(const Ray3D& r,Real& dist,Real maxDist) const
+{
+  if(nodes.empty()) return -1;
+  Vector3 invDir;
+  for(int k=0;k<3;k++)
+    invDir[k] = (r.direction[k] == 0 ? Inf : 1.0/r.direction[k]);
+  int closestBody = -1;
+  Real closestDist = maxDist;
+  //traversal stack of (node, entry parameter)
+  pair<int,Real> stack[64];
+  int stackSize = 0;
+  Real t = RayBoxEntry(r,invDir,nodes[0].bb,closestDist);
+  if(IsInf(t)) return -1;
+  stack[stackSize++] = pair<int,Real>(0,t);
+  while(stackSize > 0) {
+    const pair<int,Real>& top = stack[--stackSize];
+    if(top.second > closestDist) continue;
+    const Node& n = nodes[top.first];
+    if(n.left < 0) {
+      for(int i=n.first;i<n.first+n.count;i++) {
+        const Body& b = bodies[i];
+        if(IsInf(RayBoxEntry(r,invDir,b.bb,closestDist))) continue;
+        Real d;
+        if(b.geometry->RayCast(r,&d) && d < closestDist) {
+          closestDist = d;
+          closestBody = b.id;
+        }
+      }
+      continue;
+    }
+    Real tl = RayBoxEntry(r,invDir,nodes[n.left].bb,closestDist);
+    Real tr = RayBoxEntry(r,invDir,nodes[n.right].bb,closestDist);
+    //push the farther child first so the nearer one is visited first
+    if(tl > tr) {
+      if(!IsInf(tl)) stack[stackSize++] = pair<int,Real>(n.left,tl);
+      if(!IsInf(tr)) stack[stackSize++] = pair<int,Real>(n.right,tr);
+    }
+    else {
+      if(!IsInf(tr)) stack[stackSize++] = pair<int,Real>(n.right,tr);
+      if(!IsInf(tl)) stack[stackSize++] = pair<int,Real>(n.left,tl);
+    }
+  }
+  if(closestBody >= 0) dist = closestDist;
+  return closestBody;
+}
+
+void WorldRayCaster::RayCast(const vector<Ray3D>& rays,vector<int>& ids,vector<Real>& dists,Real maxDist)
+{
+  ids.resize(rays.size());
+  dists.resize(rays.size());
+  auto cast = [&](int i,int thread) {
+    dists[i] = Inf;
+    ids[i] = RayCast(rays[i],dists[i],maxDist);
+  };
+  int n = (numThreads <= 0 ? ThreadPool::DefaultNumThreads() : numThreads);
+  if(n <= 1 || (int)rays.size() <= grainSize) {
+    for(size_t i=0;i<rays.size();i++) cast((int)i,0);
+    return;
+  }
+  if(!pool || pool->NumThreads() != n)
+    pool = make_shared<ThreadPool>(n);
+  pool->ParallelFor((int)rays.size(),cast,grainSize);
+}
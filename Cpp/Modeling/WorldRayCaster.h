@@ -0,0 +1,75 @@
+#ifndef MODELING_WORLD_RAY_CASTER_H
+#define MODELING_WORLD_RAY_CASTER_H
+
+#include "World.h"
+#include <KrisLibrary/math3d/AABB3D.h>
+#include <KrisLibrary/math3d/Ray3D.h>
+
+class ThreadPool;
+
+/** @file WorldRayCaster.h
+ * @ingroup Modeling
+ * @brief Batched ray casting against a RobotWorld.
+ */
+
+/** @ingroup Modeling
+ * @brief Casts many rays against a snapshot of a RobotWorld.
+ *
+ * RobotWorld::RayCast initializes and transforms every geometry and tests
+ * every body for each ray.  This class instead gathers the world's
+ * geometries once, in Build(), and organizes their bounding boxes in a
+ * bounding volume hierarchy.  Each ray then visits bodies near-to-far and
+ * skips those whose boxes lie beyond the closest hit found so far.  Batches
+ * of rays may be split across threads, see numThreads.
+ *
+ * Build() must be called again whenever the world's transforms change.  The
+ * geometries must not be modified while rays are being cast.
+ */
+class WorldRayCaster
+{
+public:
+  WorldRayCaster();
+  ~WorldRayCaster();
+  ///Collects the geometries of the world at their current transforms.  The
+  ///bodies with the given IDs (see RobotWorld::RobotID, RobotLinkID, etc)
+  ///are skipped.
+  void Build(RobotWorld& world,const vector<int>& ignoreIDs=vector<int>());
+  ///Returns the ID of the first body hit by r, or -1 if none is hit before
+  ///maxDist.  On a hit, dist is the distance along r.direction.
+  int RayCast(const Ray3D& r,Real& dist,Real maxDist=Inf) const;
+  ///Casts all rays, in parallel if numThreads != 1.  ids and dists are
+  ///resized to rays.size() and filled with the results of RayCast.
+  void RayCast(const vector<Ray3D>& rays,vector<int>& ids,vector<Real>& dists,Real maxDist=Inf);
+  ///Returns the number of bodies collected by the last Build()
+  int NumBodies() const { return (int)bodies.size(); }
+
+  ///Number of threads for batched ray casting.  If <= 0, uses
+  ///ThreadPool::DefaultNumThreads().  Sensors may already be simulated on
+  ///several threads, so casting is serial unless asked for (default 1)
+  int numThreads;
+  ///Number of rays handed to a thread at a time (default 64)
+  int grainSize;
+
+private:
+  struct Body
+  {
+    int id;
+    Geometry::AnyCollisionGeometry3D* geometry;
+    AABB3D bb;
+  };
+  struct Node
+  {
+    AABB3D bb;
+    //children, or -1 for leaves
+    int left,right;
+    //range of bodies in a leaf
+    int first,count;
+  };
+  int BuildNode(int first,int count);
+
+  vector<Body> bodies;
+  vector<Node> nodes;
+  shared_ptr<ThreadPool> pool;
+};
+
+#endif
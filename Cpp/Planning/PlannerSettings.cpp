@@ -85,6 +85,7 @@ void WorldPlannerSettings::InitializeDefault(RobotWorld& world)
     robotSettings[i].worldBounds = bounds;
     robotSettings[i].contactEpsilon = 0.001;
     robotSettings[i].contactIKMaxIters = 50;
+    robotSettings[i].geometryLOD = GeometryLOD::Original;
   }
 }
 
@@ -174,7 +175,7 @@ bool WorldPlannerSettings::CheckCollision(RobotWorld& world,int id1,int id2,Real
       else {
 	for(size_t j=0;j<robot->links.size();j++)
 	  if(collisionEnabled(world.RobotLinkID(index1,j),id2)) {
-	    if(CheckCollision(world,robot->geometry[j].get(),id2,tol)) return true;
+	    if(CheckCollision(world,RobotLinkGeometry(world,index1,j),id2,tol)) return true;
 	  }
       }
       return false;
@@ -183,7 +184,7 @@ bool WorldPlannerSettings::CheckCollision(RobotWorld& world,int id1,int id2,Real
       Robot* robot2 = world.robots[index2].get();
       for(size_t j=0;j<robot2->links.size();j++)
 	if(collisionEnabled(id1,world.RobotLinkID(index2,j)))
-	  if(CheckCollision(world,robot2->geometry[j].get(),id1,tol)) return true;
+	  if(CheckCollision(world,RobotLinkGeometry(world,index2,j),id1,tol)) return true;
     }
     //non-robots
     index1 = world.IsTerrain(id1);
@@ -199,14 +200,13 @@ bool WorldPlannerSettings::CheckCollision(RobotWorld& world,int id1,int id2,Real
     }
     pair<int,int> linkid = world.IsRobotLink(id1);
     if(linkid.first >= 0) {
-      Robot* robot = world.robots[linkid.first].get();
-      return CheckCollision(world,robot->geometry[linkid.second].get(),id2,tol);
+      return CheckCollision(world,RobotLinkGeometry(world,linkid.first,linkid.second),id2,tol);
     }
     return false;
   }
 }
 
-void GetGeometries(RobotWorld& world,const vector<int>& ids,vector<Geometry::AnyCollisionGeometry3D*>& geoms,vector<int>& activeids)
+void GetGeometries(WorldPlannerSettings& settings,RobotWorld& world,const vector<int>& ids,vector<Geometry::AnyCollisionGeometry3D*>& geoms,vector<int>& activeids)
 {
   geoms.reserve(ids.size());
   activeids.reserve(ids.size());
@@ -218,7 +218,7 @@ void GetGeometries(RobotWorld& world,const vector<int>& ids,vector<Geometry::Any
       for(size_t j=0;j<robot->links.size();j++) {
 	Geometry::AnyCollisionGeometry3D* g=robot->geometry[j].get();
 	if(g && !g->Empty()) {
-	  geoms.push_back(g);
+	  geoms.push_back(settings.RobotLinkGeometry(world,robotindex,j));
 	  activeids.push_back(world.RobotLinkID(robotindex,j));
 	}
       }
@@ -226,6 +226,9 @@ void GetGeometries(RobotWorld& world,const vector<int>& ids,vector<Geometry::Any
     else {
       Geometry::AnyCollisionGeometry3D* g=world.GetGeometry(ids[i]).get();
       if(g && !g->Empty()) {
+	pair<int,int> linkid = world.IsRobotLink(ids[i]);
+	if(linkid.first >= 0)
+	  g = settings.RobotLinkGeometry(world,linkid.first,linkid.second);
 	geoms.push_back(g);
 	activeids.push_back(ids[i]);
       }
@@ -238,7 +241,7 @@ pair<int,int> WorldPlannerSettings::CheckCollision(RobotWorld& world,const vecto
   //first, get all the geometries
   vector<Geometry::AnyCollisionGeometry3D*> geoms;
   vector<int> activeids;
-  GetGeometries(world,ids,geoms,activeids);
+  GetGeometries(*this,world,ids,geoms,activeids);
 
   Vector3 d(tol*0.5); //adjustment
   vector<AABB3D> bbs(geoms.size());
@@ -266,8 +269,8 @@ pair<int,int> WorldPlannerSettings::CheckCollision(RobotWorld& world,const vecto
   //first, get all the geometries
   vector<Geometry::AnyCollisionGeometry3D*> geoms1,geoms2;
   vector<int> activeids1,activeids2;
-  GetGeometries(world,ids1,geoms1,activeids1);
-  GetGeometries(world,ids2,geoms2,activeids2);
+  GetGeometries(*this,world,ids1,geoms1,activeids1);
+  GetGeometries(*this,world,ids2,geoms2,activeids2);
 
   Vector3 d(tol*0.5); //adjustment
   vector<AABB3D> bbs1(geoms1.size()),bbs2(geoms2.size());
@@ -351,14 +354,13 @@ bool WorldPlannerSettings::CheckCollision(RobotWorld& world,AnyCollisionGeometry
     if(index >= 0) {
       Robot* robot = world.robots[index].get();
       for(size_t j=0;j<robot->links.size();j++) {
-	if(::CheckCollision(geom,&*robot->geometry[j].get(),tol)) return true;
+	if(::CheckCollision(geom,RobotLinkGeometry(world,index,j),tol)) return true;
       }
       return false;
     }
     pair<int,int> linkid = world.IsRobotLink(id);
     if(linkid.first >= 0) {
-      Robot* robot = world.robots[linkid.first].get();
-      return ::CheckCollision(geom,&*robot->geometry[linkid.second].get(),tol);
+      return ::CheckCollision(geom,RobotLinkGeometry(world,linkid.first,linkid.second),tol);
     }
     return false;
   }
@@ -386,13 +388,13 @@ Real WorldPlannerSettings::DistanceLowerBound(RobotWorld& world,int id1,int id2,
 	for(size_t j=0;j<robot->links.size();j++)
 	  for(size_t k=0;k<robot2->links.size();k++)
 	    if(collisionEnabled(world.RobotLinkID(index1,j),world.RobotLinkID(index2,k))) {
-	      minDist = Min(minDist,::DistanceLowerBound(robot->geometry[j].get(),robot2->geometry[k].get(),eps,minDist));
+	      minDist = Min(minDist,::DistanceLowerBound(RobotLinkGeometry(world,index1,j),RobotLinkGeometry(world,index2,k),eps,minDist));
 	    }
       }
       else {
 	for(size_t j=0;j<robot->links.size();j++)
 	  if(collisionEnabled(world.RobotLinkID(index1,j),id2)) {
-	    minDist = Min(minDist,DistanceLowerBound(world,robot->geometry[j].get(),id2,eps,minDist));
+	    minDist = Min(minDist,DistanceLowerBound(world,RobotLinkGeometry(world,index1,j),id2,eps,minDist));
 	  }
       }
       return minDist;
@@ -401,7 +403,7 @@ Real WorldPlannerSettings::DistanceLowerBound(RobotWorld& world,int id1,int id2,
       Robot* robot2 = world.robots[index2].get();
       for(size_t j=0;j<robot2->links.size();j++)
 	if(collisionEnabled(id1,world.RobotLinkID(index2,j))) {
-	  minDist = Min(minDist,DistanceLowerBound(world,robot2->geometry[j].get(),id1,eps,minDist));
+	  minDist = Min(minDist,DistanceLowerBound(world,RobotLinkGeometry(world,index2,j),id1,eps,minDist));
 	}
     }
     //non-robots
@@ -421,7 +423,7 @@ Real WorldPlannerSettings::DistanceLowerBound(RobotWorld& world,int id1,int id2,
       assert(linkid.first < (int)world.robots.size());
       Robot* robot = world.robots[linkid.first].get();
       assert(linkid.second >= 0 && linkid.second < (int)robot->links.size());
-      Real d=DistanceLowerBound(world,robot->geometry[linkid.second].get(),id2,eps,minDist);
+      Real d=DistanceLowerBound(world,RobotLinkGeometry(world,linkid.first,linkid.second),id2,eps,minDist);
       //printf("Link %d on robot %d to object %d has distance %g\n",linkid.second,linkid.first,id2,d);
       //printf("Object %s\n",world.GetName(id2).c_str());
       //if(d<=0) {
@@ -461,7 +463,7 @@ Real WorldPlannerSettings::DistanceLowerBound(RobotWorld& world,AnyCollisionGeom
     if(index >= 0) {
       Robot* robot = world.robots[index].get();
       for(size_t j=0;j<robot->links.size();j++) {
-	minDist = Min(minDist,::DistanceLowerBound(mesh,&*robot->geometry[j],eps,minDist));
+	minDist = Min(minDist,::DistanceLowerBound(mesh,RobotLinkGeometry(world,index,j),eps,minDist));
       }
       return minDist;
     }
@@ -471,7 +473,7 @@ Real WorldPlannerSettings::DistanceLowerBound(RobotWorld& world,AnyCollisionGeom
       Robot* robot = world.robots[linkid.first].get();
       assert(linkid.second >= 0 && linkid.second < (int)robot->links.size());
 
-      return ::DistanceLowerBound(mesh,robot->geometry[linkid.second].get(),eps,minDist);
+      return ::DistanceLowerBound(mesh,RobotLinkGeometry(world,linkid.first,linkid.second),eps,minDist);
     }
     return minDist;
   }
@@ -520,7 +522,7 @@ Real WorldPlannerSettings::DistanceLowerBound(RobotWorld& world,const vector<int
   //first, get all the geometries
   vector<Geometry::AnyCollisionGeometry3D*> geoms;
   vector<int> activeids;
-  GetGeometries(world,ids,geoms,activeids);
+  GetGeometries(*this,world,ids,geoms,activeids);
 
   vector<AABB3D> bbs(geoms.size());
   for(size_t i=0;i<geoms.size();i++) {
@@ -567,8 +569,8 @@ Real WorldPlannerSettings::DistanceLowerBound(RobotWorld& world,const vector<int
   //first, get all the geometries
   vector<Geometry::AnyCollisionGeometry3D*> geoms1,geoms2;
   vector<int> activeids1,activeids2;
-  GetGeometries(world,ids1,geoms1,activeids1);
-  GetGeometries(world,ids2,geoms2,activeids2);
+  GetGeometries(*this,world,ids1,geoms1,activeids1);
+  GetGeometries(*this,world,ids2,geoms2,activeids2);
 
   vector<AABB3D> bbs1(geoms1.size()),bbs2(geoms2.size());
   for(size_t i=0;i<geoms1.size();i++) {
@@ -629,6 +631,12 @@ void WorldPlannerSettings::EnumerateCollisionPairs(RobotWorld& world,vector<pair
   }
 }
 
+AnyCollisionGeometry3D* WorldPlannerSettings::RobotLinkGeometry(RobotWorld& world,int robot,int link)
+{
+  int lod = (robot < (int)robotSettings.size() ? robotSettings[robot].geometryLOD : GeometryLOD::Original);
+  return world.robots[robot]->GetGeometryLOD(link,lod);
+}
+
 void WorldPlannerSettings::EnumerateCollisionQueries(RobotWorld& world,int id1,int id2,vector<pair<int,int> >& indices,vector<AnyCollisionQuery>& queries)
 {
   if(id2 < 0) {  //check all
@@ -650,7 +658,7 @@ void WorldPlannerSettings::EnumerateCollisionQueries(RobotWorld& world,int id1,i
 	  for(size_t k=0;k<robot2->links.size();k++)
 	    if(collisionEnabled(world.RobotLinkID(index1,j),world.RobotLinkID(index2,k))) {
 	      indices.push_back(pair<int,int>(world.RobotLinkID(index1,j),world.RobotLinkID(index2,k)));
-	      queries.push_back(AnyCollisionQuery(*robot->geometry[j],*robot2->geometry[k]));
+	      queries.push_back(AnyCollisionQuery(*RobotLinkGeometry(world,index1,j),*RobotLinkGeometry(world,index2,k)));
 	    }
       }
       else {
@@ -658,7 +666,7 @@ void WorldPlannerSettings::EnumerateCollisionQueries(RobotWorld& world,int id1,i
 	  if(collisionEnabled(world.RobotLinkID(index1,j),id2)) {
 	    vector<int> ids;
 	    size_t qsize=queries.size();
-	    EnumerateCollisionQueries(world,robot->geometry[j].get(),id2,ids,queries);
+	    EnumerateCollisionQueries(world,RobotLinkGeometry(world,index1,j),id2,ids,queries);
 	    indices.push_back(pair<int,int>(world.RobotLinkID(index1,j),id2));
 	  }
       }
@@ -669,7 +677,7 @@ void WorldPlannerSettings::EnumerateCollisionQueries(RobotWorld& world,int id1,i
       for(size_t j=0;j<robot2->links.size();j++)
 	if(collisionEnabled(id1,world.RobotLinkID(index2,j))) {
 	  vector<int> ids;
-	  EnumerateCollisionQueries(world,robot2->geometry[j].get(),id1,ids,queries);
+	  EnumerateCollisionQueries(world,RobotLinkGeometry(world,index2,j),id1,ids,queries);
 	  indices.push_back(pair<int,int>(world.RobotLinkID(index2,j),id1));
 	}
       return;
@@ -695,8 +703,7 @@ void WorldPlannerSettings::EnumerateCollisionQueries(RobotWorld& world,int id1,i
     }
     pair<int,int> linkid = world.IsRobotLink(id1);
     if(linkid.first >= 0) {
-      Robot* robot = world.robots[linkid.first].get();
-      EnumerateCollisionQueries(world,robot->geometry[linkid.second].get(),id2,ids,queries);
+      EnumerateCollisionQueries(world,RobotLinkGeometry(world,linkid.first,linkid.second),id2,ids,queries);
       for(size_t i=0;i<ids.size();i++)
 	indices.push_back(pair<int,int>(id1,ids[i]));
     }
@@ -736,7 +743,7 @@ void WorldPlannerSettings::EnumerateCollisionQueries(RobotWorld& world,AnyCollis
       Robot* robot = world.robots[index].get();
       for(size_t j=0;j<robot->links.size();j++) {
 	if(robot->IsGeometryEmpty(j)) continue;
-	queries.push_back(AnyCollisionQuery(*mesh,*robot->geometry[j]));
+	queries.push_back(AnyCollisionQuery(*mesh,*RobotLinkGeometry(world,index,j)));
 	collisionIds.push_back(world.RobotLinkID(index,j));
       }
       return;
@@ -745,7 +752,7 @@ void WorldPlannerSettings::EnumerateCollisionQueries(RobotWorld& world,AnyCollis
     if(linkid.first >= 0) {
       Robot* robot = world.robots[linkid.first].get();
       if(robot->IsGeometryEmpty(linkid.second)) return;
-      queries.push_back(AnyCollisionQuery(*mesh,*robot->geometry[linkid.second]));
+      queries.push_back(AnyCollisionQuery(*mesh,*RobotLinkGeometry(world,linkid.first,linkid.second)));
       collisionIds.push_back(id);
     }
     return;
@@ -13,6 +13,7 @@ struct RobotPlannerSettings
   AABB3D worldBounds;      ///<base position sampling range for free-floating robots
   Real contactEpsilon;     ///<convergence threshold for contact solving
   int contactIKMaxIters;   ///<max iters for contact solving
+  int geometryLOD;         ///<level of detail of the link geometries used for collision checking (a GeometryLOD::Level)
   PropertyMap properties;  ///<other properties
 };
 
@@ -98,6 +99,10 @@ struct WorldPlannerSettings
   void EnumerateCollisionQueries(RobotWorld& world,Geometry::AnyCollisionGeometry3D* mesh,int id,
 				 vector<int>& checkedIDs,
 				 vector<Geometry::AnyCollisionQuery>& queries);
+  ///Returns the geometry of a robot link used for collision checking, at
+  ///the level of detail robotSettings[robot].geometryLOD.  Queries keep
+  ///pointers to it, so set the level before creating a robot's CSpace.
+  Geometry::AnyCollisionGeometry3D* RobotLinkGeometry(RobotWorld& world,int robot,int link);
 
   Array2D<bool> collisionEnabled;    //indexed by world ID #
   vector<RobotPlannerSettings> robotSettings;
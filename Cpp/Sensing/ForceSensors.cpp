@@ -14,7 +14,7 @@ bool HasContact(dBodyID a);
 
 //defined in ODESimulator.cpp
 ///Will produce bogus o1 and o2 vectors
-void GetContacts(dBodyID a,vector<ODEContactList>& contacts);
+void GetContacts(const ODESimulator* sim,dBodyID a,vector<ODEContactList>& contacts);
 
 
 
@@ -48,7 +48,7 @@ void ContactSensor::Simulate(ControlledRobotSimulator* robot,WorldSimulation* si
   RigidTransform TsensorWorld  = Tlink*Tsensor;
   //look through contacts
   vector<ODEContactList> contacts;
-  GetContacts(body,contacts);
+  GetContacts(&sim->odesim,body,contacts);
   Vector3 xlocal,flocal;
   for(size_t i=0;i<contacts.size();i++) {
     for(size_t j=0;j<contacts[i].points.size();j++) {
@@ -18,7 +18,7 @@ using namespace GLDraw;
 
 
 SensorBase::SensorBase()
-  :name("Unnamed sensor"),rate(0)
+  :name("Unnamed sensor"),rate(0),latency(0),measurementTime(0)
 {}
 
 bool SensorBase::ReadState(File& f)
@@ -77,20 +77,30 @@ map<string,string> SensorBase::Settings() const
 {
   map<string,string> settings;
   FILL_SENSOR_SETTING(settings,rate);
+  FILL_SENSOR_SETTING(settings,latency);
   return settings;
 }
 bool SensorBase::GetSetting(const string& name,string& str) const
 {
   GET_SENSOR_SETTING(rate);
+  GET_SENSOR_SETTING(latency);
   return false;
 }
 
 bool SensorBase::SetSetting(const string& name,const string& str)
 {
   SET_SENSOR_SETTING(rate);
+  SET_SENSOR_SETTING(latency);
   return false;
 }
 
+void SensorBase::CopySettings(const SensorBase& s)
+{
+  map<string,string> settings = s.Settings();
+  for(map<string,string>::const_iterator i=settings.begin();i!=settings.end();i++)
+    SetSetting(i->first,i->second);
+}
+
 
 
 
@@ -32,6 +32,10 @@ class TiXmlElement;
  * Default settings:
  * - rate: the number of time per second this should be called, in Hz.  If 0,
  *   the sensor is updated every time the controller is called (default)
+ * - latency: the time between taking a measurement and its delivery to the
+ *   controller, in s.  Only used when the sensor is simulated
+ *   asynchronously (see SupportsAsync); otherwise wrap the sensor in a
+ *   TimeDelayedSensor.  (default 0)
  *
  * FOR IMPLEMENTERS: at a minimum, you must overload the Type(),
  * MeasurementNames and Get/SetMeasurements methods.  (Note: it is important
@@ -47,6 +51,13 @@ class TiXmlElement;
  * If your sensor is reconfigurable, you will want to also override the
  * Settings and Get/SetSetting methods.  The macros FILL_SENSOR_SETTING,
  * GET_SENSOR_SETTING, and SET_SENSOR_SETTING are helpful for doing this.
+ *
+ * If SimulateKinematic is expensive, does not use OpenGL, and only depends
+ * on the robot's link transforms, the world, and the sensor's settings,
+ * override SupportsAsync to return true.  The sensor may then be simulated
+ * on worker threads (see SensorPipeline), SetMeasurements must restore
+ * the measurements returned by GetMeasurements, and CopySettings should
+ * be overridden.
  */
 class SensorBase
 {
@@ -60,6 +71,9 @@ class SensorBase
   virtual void SimulateKinematic(Robot& robot,RobotWorld& world) {}
   ///Advances to the next time step with duration dt elapsed
   virtual void Advance(double dt) {}
+  ///Returns true if a copy of the sensor, configured with the same
+  ///settings, can be simulated with SimulateKinematic on a worker thread
+  virtual bool SupportsAsync() const { return false; }
   ///Should be overridden if the sensor is stateful to reset to an initial state
   virtual void Reset() {}
   virtual bool ReadState(File& f);
@@ -83,12 +97,19 @@ class SensorBase
   ///Set a named setting.  Returns false if the name is not supported, or the
   ///value is formatted incorrectly
   virtual bool SetSetting(const string& name,const string& str);
+  ///Copies all settings of s, a sensor of the same type.  The default goes
+  ///through Settings and SetSetting, which is slow and may round values, so
+  ///sensors that SupportsAsync should override it to copy their members.
+  virtual void CopySettings(const SensorBase& s);
   ///If the sensor can be drawn, draw the sensor on the robot's current configuration,
   ///using these measurements, using OpenGL calls.
   virtual void DrawGL(const Robot& robot,const vector<double>& measurements) {}
 
   string name;
   double rate;
+  double latency;
+  ///The simulation time at which the current measurements were taken
+  double measurementTime;
 };
 
 
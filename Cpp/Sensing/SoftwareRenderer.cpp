@@ -0,0 +1,154 @@
+#include "SoftwareRenderer.h"
+#include "Modeling/World.h"
+#include <KrisLibrary/GLdraw/GeometryAppearance.h>
+#include <algorithm>
+#include <limits>
+
+using namespace Geometry;
+
+//fraction of the face color that is lit regardless of the surface angle
+const static float kAmbient = 0.3f;
+
+SoftwareRenderer::SoftwareRenderer()
+  :xres(0),yres(0),f(1),zmin(0)
+{
+  background[0] = 0x96;
+  background[1] = 0xaa;
+  background[2] = 0xff;
+}
+
+void SoftwareRenderer::ClearCache()
+{
+  meshCache.clear();
+}
+
+const Meshing::TriMesh* SoftwareRenderer::GetMesh(const AnyGeometry3D* geom)
+{
+  if(geom->type == AnyGeometry3D::TriangleMesh)
+    return &geom->AsTriangleMesh();
+  if(geom->type == AnyGeometry3D::PointCloud)
+    return NULL;
+  auto i = meshCache.find(geom);
+  if(i == meshCache.end()) {
+    shared_ptr<Meshing::TriMesh> mesh;
+    AnyGeometry3D converted;
+    if(geom->Convert(AnyGeometry3D::TriangleMesh,converted,0.01))
+      mesh = make_shared<Meshing::TriMesh>(converted.AsTriangleMesh());
+    i = meshCache.insert(make_pair(geom,mesh)).first;
+  }
+  return i->second.get();
+}
+
+void SoftwareRenderer::Render(RobotWorld& world,const RigidTransform& Tcamera,int _xres,int _yres,Real _f,Real _zmin)
+{
+  xres = _xres;
+  yres = _yres;
+  f = _f;
+  zmin = _zmin;
+  color.resize(xres*yres*3);
+  depth.resize(xres*yres);
+  ids.resize(xres*yres);
+  for(int k=0;k<xres*yres;k++) {
+    color[k*3] = background[0];
+    color[k*3+1] = background[1];
+    color[k*3+2] = background[2];
+  }
+  std::fill(depth.begin(),depth.end(),std::numeric_limits<float>::infinity());
+  std::fill(ids.begin(),ids.end(),-1);
+
+  RigidTransform Tinv;
+  Tinv.setInverse(Tcamera);
+  for(int id=0;id<world.NumIDs();id++) {
+    if(world.IsRobot(id) >= 0) continue;
+    RobotWorld::GeometryPtr geom = world.GetGeometry(id);
+    if(!geom || geom->Empty()) continue;
+    const Meshing::TriMesh* mesh = GetMesh(geom.get());
+    if(!mesh || mesh->tris.empty()) continue;
+    RobotWorld::AppearancePtr app = world.GetAppearance(id);
+    const float* rgba = (app ? app->faceColor.rgba : NULL);
+    float grey[4] = {0.5f,0.5f,0.5f,1.0f};
+    DrawMesh(*mesh,Tinv*world.GetTransform(id),(rgba ? rgba : grey),id);
+  }
+}
+
+void SoftwareRenderer::DrawMesh(const Meshing::TriMesh& mesh,const RigidTransform& Tlocal,const float rgba[4],int id)
+{
+  if(rgba[3] == 0) return;
+  cameraVerts.resize(mesh.verts.size());
+  for(size_t i=0;i<mesh.verts.size();i++)
+    cameraVerts[i] = Tlocal*mesh.verts[i];
+  Vector3 n,poly[4];
+  unsigned char rgb[3];
+  for(size_t t=0;t<mesh.tris.size();t++) {
+    const Vector3& a = cameraVerts[mesh.tris[t].a];
+    const Vector3& b = cameraVerts[mesh.tris[t].b];
+    const Vector3& c = cameraVerts[mesh.tris[t].c];
+    if(a.z < zmin && b.z < zmin && c.z < zmin) continue;
+    n.setCross(b-a,c-a);
+    Real len = n.norm();
+    if(len == 0) continue;
+    float shade = kAmbient + (1.0f-kAmbient)*float(Abs(n.z)/len);
+    for(int k=0;k<3;k++)
+      rgb[k] = (unsigned char)(Min(rgba[k]*shade,1.0f)*255.0f);
+    if(a.z >= zmin && b.z >= zmin && c.z >= zmin) {
+      DrawTriangle(a,b,c,rgb,id);
+      continue;
+    }
+    //clip against the near plane, giving a triangle or a quad
+    const Vector3* v[3] = {&a,&b,&c};
+    int npoly = 0;
+    for(int k=0;k<3;k++) {
+      const Vector3& p = *v[k];
+      const Vector3& q = *v[(k+1)%3];
+      if(p.z >= zmin) poly[npoly++] = p;
+      if((p.z >= zmin) != (q.z >= zmin)) {
+        Real u = (zmin-p.z)/(q.z-p.z);
+        poly[npoly] = p + u*(q-p);
+        poly[npoly].z = zmin;
+        npoly++;
+      }
+    }
+    for(int k=1;k+1<npoly;k++)
+      DrawTriangle(poly[0],poly[k],poly[k+1],rgb,id);
+  }
+}
+
+void SoftwareRenderer::DrawTriangle(const Vector3& a,const Vector3& b,const Vector3& c,const unsigned char rgb[3],int id)
+{
+  //project to image coordinates; 1/z is linear in the image
+  Real cx = 0.5*xres, cy = 0.5*yres;
+  Real x0 = cx+f*a.x/a.z, y0 = cy+f*a.y/a.z, iz0 = 1.0/a.z;
+  Real x1 = cx+f*b.x/b.z, y1 = cy+f*b.y/b.z, iz1 = 1.0/b.z;
+  Real x2 = cx+f*c.x/c.z, y2 = cy+f*c.y/c.z, iz2 = 1.0/c.z;
+  Real area = (x1-x0)*(y2-y0) - (x2-x0)*(y1-y0);
+  if(Abs(area) < 1e-12) return;
+  //clamp before converting to int, since vertices near the camera plane
+  //can project far outside the image
+  int imin = (int)Ceil(Max(Min(x0,Min(x1,x2)),0.0));
+  int imax = (int)Floor(Min(Max(x0,Max(x1,x2)),Real(xres-1)));
+  int jmin = (int)Ceil(Max(Min(y0,Min(y1,y2)),0.0));
+  int jmax = (int)Floor(Min(Max(y0,Max(y1,y2)),Real(yres-1)));
+  if(imin > imax || jmin > jmax) return;
+  Real invArea = 1.0/area;
+  //barycentric weights of vertices a and b, and their steps per pixel
+  Real dw0dx = (y1-y2)*invArea, dw0dy = (x2-x1)*invArea;
+  Real dw1dx = (y2-y0)*invArea, dw1dy = (x0-x2)*invArea;
+  Real w0row = ((x1-imin)*(y2-jmin) - (x2-imin)*(y1-jmin))*invArea;
+  Real w1row = ((x2-imin)*(y0-jmin) - (x0-imin)*(y2-jmin))*invArea;
+  const Real eps = -1e-9;
+  for(int j=jmin;j<=jmax;j++,w0row+=dw0dy,w1row+=dw1dy) {
+    Real w0 = w0row, w1 = w1row;
+    int k = j*xres+imin;
+    for(int i=imin;i<=imax;i++,k++,w0+=dw0dx,w1+=dw1dx) {
+      Real w2 = 1.0-w0-w1;
+      if(w0 < eps || w1 < eps || w2 < eps) continue;
+      float z = float(1.0/(w0*iz0 + w1*iz1 + w2*iz2));
+      if(z >= depth[k]) continue;
+      depth[k] = z;
+      ids[k] = id;
+      color[k*3] = rgb[0];
+      color[k*3+1] = rgb[1];
+      color[k*3+2] = rgb[2];
+    }
+  }
+}
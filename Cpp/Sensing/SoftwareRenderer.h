@@ -0,0 +1,62 @@
+#ifndef SENSING_SOFTWARE_RENDERER_H
+#define SENSING_SOFTWARE_RENDERER_H
+
+#include <KrisLibrary/math3d/primitives.h>
+#include <KrisLibrary/meshing/TriMesh.h>
+#include <KrisLibrary/geometry/AnyGeometry.h>
+#include <map>
+#include <memory>
+#include <vector>
+using namespace Math3D;
+using namespace std;
+
+class RobotWorld;
+
+/** @ingroup Sensing
+ * @brief Rasterizes a RobotWorld into color and depth images on the CPU.
+ *
+ * Used by CameraSensor when OpenGL is unavailable, e.g., on machines
+ * without a display or GPU.  Every body is drawn as a triangle mesh with
+ * its appearance's face color, shaded by a light at the camera.  The world
+ * ID of the visible body at each pixel is recorded in the same pass.
+ * Geometries that are not triangle meshes are converted once and cached,
+ * so call ClearCache() if a geometry is modified.  Point clouds are not
+ * drawn.
+ *
+ * The renderer only reads the world, and each instance keeps its own
+ * buffers, so instances on different threads may render copies of the
+ * same world concurrently.
+ */
+class SoftwareRenderer
+{
+public:
+  SoftwareRenderer();
+  ///Renders the world from a camera at Tcamera, whose z axis points forward,
+  ///x to the right of the image, and y down.  f is the focal length in
+  ///pixels and geometry closer than zmin is clipped.  Pixel (i,j) looks
+  ///along (i-xres/2,j-yres/2,f) in the camera frame.
+  void Render(RobotWorld& world,const RigidTransform& Tcamera,int xres,int yres,Real f,Real zmin);
+  ///Drops the cached meshes of converted geometries
+  void ClearCache();
+
+  int xres,yres;
+  ///Color of pixels where nothing is drawn
+  unsigned char background[3];
+  ///xres*yres*3 bytes in r,g,b order, in scan-line order from the top left
+  vector<unsigned char> color;
+  ///xres*yres depths along the camera z axis, Inf where nothing is drawn
+  vector<float> depth;
+  ///xres*yres world IDs of the drawn bodies, -1 where nothing is drawn
+  vector<int> ids;
+
+private:
+  const Meshing::TriMesh* GetMesh(const Geometry::AnyGeometry3D* geom);
+  void DrawMesh(const Meshing::TriMesh& mesh,const RigidTransform& Tlocal,const float rgba[4],int id);
+  void DrawTriangle(const Vector3& a,const Vector3& b,const Vector3& c,const unsigned char rgb[3],int id);
+
+  Real f,zmin;
+  vector<Vector3> cameraVerts;
+  map<const Geometry::AnyGeometry3D*,shared_ptr<Meshing::TriMesh> > meshCache;
+};
+
+#endif
@@ -10,6 +10,7 @@
 #include "Simulation/ControlledSimulator.h"
 #include "Simulation/ODESimulator.h"
 #include "Simulation/WorldSimulation.h"
+#include "Modeling/WorldRayCaster.h"
 #include <KrisLibrary/GLdraw/drawextra.h>
 #include <KrisLibrary/GLdraw/GLView.h>
 #include <KrisLibrary/GLdraw/GLError.h>
@@ -108,6 +109,7 @@ void LaserRangeSensor::SimulateKinematic(Robot& robot,RobotWorld& world)
       printf("  Name %d: %s\n",i,world.robots[i]->name.c_str());
     */
   }
+  vector<Ray3D> rays(measurementCount);
   for(int i=0;i<measurementCount;i++) {
     Real xtheta,ytheta;
     if(i+1 < measurementCount) {
@@ -128,10 +130,17 @@ void LaserRangeSensor::SimulateKinematic(Robot& robot,RobotWorld& world)
     Real z = Cos(xtheta)*Cos(ytheta);
     ray.source = T*(Vector3(x,y,z)*depthMinimum);
     ray.direction = T.R*Vector3(x,y,z);
-    Vector3 pt;
-    int obj = world.RayCastIgnore(ray,ignoreLinkIDs,pt);
-    if (obj >= 0) 
-      depthReadings[i] = pt.distance(ray.source) + depthMinimum;
+    rays[i] = ray;
+  }
+  //cast all beams at once
+  if(!rayCaster) rayCaster = make_shared<WorldRayCaster>();
+  rayCaster->Build(world,ignoreLinkIDs);
+  vector<int> ids;
+  vector<Real> dists;
+  rayCaster->RayCast(rays,ids,dists);
+  for(int i=0;i<measurementCount;i++) {
+    if (ids[i] >= 0) 
+      depthReadings[i] = dists[i] + depthMinimum;
     else 
       depthReadings[i] = Inf;
   }
@@ -169,6 +178,29 @@ void LaserRangeSensor::SetMeasurements(const vector<double>& values)
   depthReadings = values;
 }
 
+void LaserRangeSensor::CopySettings(const SensorBase& s)
+{
+  const LaserRangeSensor& l = dynamic_cast<const LaserRangeSensor&>(s);
+  rate = l.rate;
+  latency = l.latency;
+  link = l.link;
+  Tsensor = l.Tsensor;
+  measurementCount = l.measurementCount;
+  depthResolution = l.depthResolution;
+  depthMinimum = l.depthMinimum;
+  depthMaximum = l.depthMaximum;
+  depthVarianceLinear = l.depthVarianceLinear;
+  depthVarianceConstant = l.depthVarianceConstant;
+  xSweepMagnitude = l.xSweepMagnitude;
+  xSweepPeriod = l.xSweepPeriod;
+  xSweepPhase = l.xSweepPhase;
+  xSweepType = l.xSweepType;
+  ySweepMagnitude = l.ySweepMagnitude;
+  ySweepPeriod = l.ySweepPeriod;
+  ySweepPhase = l.ySweepPhase;
+  ySweepType = l.ySweepType;
+}
+
 map<string,string> LaserRangeSensor::Settings() const
 {
   map<string,string> res = SensorBase::Settings();
@@ -296,12 +328,57 @@ void LaserRangeSensor::DrawGL(const Robot& robot,const vector<double>& measureme
 
 
 
+//Draws each body's appearance, i.e., the same geometry that world.DrawGL()
+//draws, in the flat color SegmentationColor(id) over a black (id -1)
+//background.  The appearances set their own colors, so the label color is
+//applied as a fog so dense that it replaces the color of every fragment,
+//whatever the lighting and textures.
+static void DrawSegmentationGL(RobotWorld& world)
+{
+  glClearColor(0,0,0,0);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  glDisable(GL_DITHER);
+  glEnable(GL_DEPTH_TEST);
+  glEnable(GL_FOG);
+  glFogi(GL_FOG_MODE,GL_EXP);
+  glFogf(GL_FOG_DENSITY,1e10f);
+  for(int id=0;id<world.NumIDs();id++) {
+    if(world.IsRobot(id) >= 0) continue;
+    RobotWorld::GeometryPtr geom = world.GetGeometry(id);
+    if(!geom || geom->Empty()) continue;
+    RobotWorld::AppearancePtr app = world.GetAppearance(id);
+    if(!app || app->faceColor.rgba[3] == 0) continue;
+    float color[4] = {0,0,0,1};
+    CameraSensor::SegmentationColor(id,color);
+    glFogfv(GL_FOG_COLOR,color);
+    glPushMatrix();
+    glMultMatrix(Matrix4(world.GetTransform(id)));
+    app->DrawGL();
+    glPopMatrix();
+  }
+  glDisable(GL_FOG);
+  glEnable(GL_DITHER);
+}
+
+void CameraSensor::SegmentationColor(int id,float rgb[3])
+{
+  int label = id+1;
+  rgb[0] = float((label>>16)&0xff)/255.0f;
+  rgb[1] = float((label>>8)&0xff)/255.0f;
+  rgb[2] = float(label&0xff)/255.0f;
+}
+
+int CameraSensor::SegmentationLabel(const unsigned char rgb[3])
+{
+  return ((int(rgb[0])<<16) | (int(rgb[1])<<8) | int(rgb[2])) - 1;
+}
+
 CameraSensor::CameraSensor()
-:link(-1),rgb(true),depth(true),xres(640),yres(480),
+:link(-1),rgb(true),depth(true),segmentation(false),xres(640),yres(480),
  xfov(DtoR(56.0)),yfov(DtoR(43.0)),
  zmin(0.4),zmax(4.0),zresolution(0),
  zvarianceLinear(0),zvarianceConstant(0),
- useGLFramebuffers(true)
+ useGLFramebuffers(true),useSoftwareRenderer(false),colorTextureDirty(false)
 {
   Tsensor.setIdentity();
 }
@@ -415,14 +492,56 @@ void CameraSensor::SimulateKinematic(Robot& robot,RobotWorld& world)
       #endif //DEBUG_GL_RENDER_TIMING
     }
     DEBUG_GL_ERRORS()
+    if(segmentation) {
+      //the GL appearances don't carry IDs, so an ID pass draws the same
+      //appearance geometry with the same transforms as the pass above, with
+      //the IDs encoded as colors.  It rasterizes and depth tests exactly
+      //like the color and depth pass, so the labels line up with its pixels.
+      renderer.Begin(vp);
+      DrawSegmentationGL(world);
+      renderer.End();
+      renderer.GetRGB(segmentPixels);
+      segments.resize(xres*yres);
+      for(int k=0;k<xres*yres;k++)
+        segments[k] = SegmentationLabel(&segmentPixels[k*3]);
+      #if DEBUG_GL_RENDER_TIMING
+      printf("CameraSensor: Draw and download segmentation %f\n",timer.ElapsedTime());
+      timer.Reset();
+      #endif //DEBUG_GL_RENDER_TIMING
+      DEBUG_GL_ERRORS()
+    }
+  }
+  else if(useSoftwareRenderer) {
+    //fallback rasterizes on the CPU
+    Real f = 0.5*xres/Tan(0.5*xfov);
+    softwareRenderer.Render(world,Tlink*Tsensor,xres,yres,f,zmin);
+    if(rgb) {
+      //the renderer gets the old buffer to draw into next time
+      swap(pixels,softwareRenderer.color);
+    }
+    if(segmentation)
+      swap(segments,softwareRenderer.ids);
+    if(depth) {
+      floats.resize(xres*yres);
+      float fzmax = (float)zmax;
+      for(size_t k=0;k<floats.size();k++) {
+        Real d = softwareRenderer.depth[k];
+        if(d < zmax) floats[k] = (float)Discretize(d,zresolution,zvarianceLinear*d + zvarianceConstant);
+        else floats[k] = fzmax;
+      }
+    }
+    #if DEBUG_GL_RENDER_TIMING
+    printf("CameraSensor: Software rasterization and extraction %f\n",timer.ElapsedTime());
+    timer.Reset();
+    #endif //DEBUG_GL_RENDER_TIMING
+    colorTextureDirty = rgb;
   }
   else {
-    //fallback will use ray casting: (slow!)
+    //fallback will use ray casting (slower than GL)
     //set up the POV of the camera
     Camera::Viewport vp;
     GetViewport(vp);
     vp.xform = Tlink*vp.xform;
-    Ray3D ray;
     Vector3 vsrc;
     Vector3 vfwd,dx,dy;
     vp.getClickSource(0,0,vsrc);
@@ -435,41 +554,54 @@ void CameraSensor::SimulateKinematic(Robot& robot,RobotWorld& world)
       pixels.resize(xres*yres*3);
     if(depth)
       floats.resize(xres*yres);
+    //cast all rays at once, then process them in order
+    vector<Ray3D> rays(xres*yres);
     int k=0;
-    unsigned char bg_r=0x96, bg_g=0xaa, bg_b = 0xff;
-    float fzmax = (float)zmax;
-    Vector3 pt;
     for(int j=0;j<yres;j++) {
       Real v = 0.5*yres - Real(j);
       for(int i=0;i<xres;i++,k++) {
         Real u = Real(i) - 0.5*xres;    
+        Ray3D& ray = rays[k];
         ray.direction = vfwd + u*dx + v*dy;
         ray.direction.inplaceNormalize();
         ray.source = vsrc + ray.direction * zmin / (vfwd.dot(ray.direction));
-        int obj = world.RayCast(ray,pt);
-        if (obj >= 0) {
-          if(rgb) {
-            //get color of object
-            //TODO: lighting
-            RobotWorld::AppearancePtr app = world.GetAppearance(obj);
-            const float* rgba = app->faceColor.rgba;
-            pixels[k*3] = (unsigned char)(rgba[0]*255.0);
-            pixels[k*3+1] = (unsigned char)(rgba[1]*255.0);
-            pixels[k*3+2] = (unsigned char)(rgba[2]*255.0);
-          }
-          Real d = vfwd.dot(pt - vsrc);
-          d = Min(d,zmax);
-          if(depth && d < zmax) floats[k] = (float)Discretize(d,zresolution,zvarianceLinear*d + zvarianceConstant);
+      }
+    }
+    if(!rayCaster) rayCaster = make_shared<WorldRayCaster>();
+    rayCaster->Build(world);
+    vector<int> ids;
+    vector<Real> dists;
+    rayCaster->RayCast(rays,ids,dists);
+    if(segmentation)
+      segments = ids;
+    unsigned char bg_r=0x96, bg_g=0xaa, bg_b = 0xff;
+    float fzmax = (float)zmax;
+    Vector3 pt;
+    for(k=0;k<(int)rays.size();k++) {
+      int obj = ids[k];
+      if (obj >= 0) {
+        if(rgb) {
+          //get color of object
+          //TODO: lighting
+          RobotWorld::AppearancePtr app = world.GetAppearance(obj);
+          const float* rgba = app->faceColor.rgba;
+          pixels[k*3] = (unsigned char)(rgba[0]*255.0);
+          pixels[k*3+1] = (unsigned char)(rgba[1]*255.0);
+          pixels[k*3+2] = (unsigned char)(rgba[2]*255.0);
         }
-        else {
-          //no reading
-          if(rgb) {
-            pixels[k*3] = bg_r;
-            pixels[k*3+1] = bg_g;
-            pixels[k*3+2] = bg_b;
-          }
-          if(depth) floats[k] = fzmax;
+        pt = rays[k].source + dists[k]*rays[k].direction;
+        Real d = vfwd.dot(pt - vsrc);
+        d = Min(d,zmax);
+        if(depth && d < zmax) floats[k] = (float)Discretize(d,zresolution,zvarianceLinear*d + zvarianceConstant);
+      }
+      else {
+        //no reading
+        if(rgb) {
+          pixels[k*3] = bg_r;
+          pixels[k*3+1] = bg_g;
+          pixels[k*3+2] = bg_b;
         }
+        if(depth) floats[k] = fzmax;
       }
     }
     static bool warned = false;
@@ -482,33 +614,36 @@ void CameraSensor::SimulateKinematic(Robot& robot,RobotWorld& world)
     timer.Reset();
     #endif //DEBUG_GL_RENDER_TIMING
 
-    //need to upload the texture for sensor visualization
-    if(renderer.color_tex == 0) { 
-      //RGBA8 2D texture, 24 bit depth texture, 256x256
-      glGenTextures(1, &renderer.color_tex);
-      if(renderer.color_tex != 0) {
-        glBindTexture(GL_TEXTURE_2D, renderer.color_tex);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-      }
-    }
+    //the texture for sensor visualization is uploaded in DrawGL, since
+    //this may run on a thread without an OpenGL context
+    colorTextureDirty = rgb;
+  }
+  depthDisplayList.erase();
+}
+
+void CameraSensor::UploadColorTexture()
+{
+  if(renderer.color_tex == 0) { 
+    //RGBA8 2D texture, 24 bit depth texture, 256x256
+    glGenTextures(1, &renderer.color_tex);
     if(renderer.color_tex != 0) {
       glBindTexture(GL_TEXTURE_2D, renderer.color_tex);
-      //copy measurements into buffer -- don't forget y flip
-      vector<unsigned char> image(xres*yres*3);
-      int k=0;
-      for(int j=0;j<yres;j++)
-        memcpy(&image[(yres-j-1)*xres*3],&pixels[j*xres*3],xres*3);
-      //NULL means reserve texture memory, but texels are undefined
-      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, xres, yres, 0, GL_BGRA, GL_UNSIGNED_BYTE, &image[0]);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     }
-    #if DEBUG_GL_RENDER_TIMING
-    printf("CameraSensor: Software texture setup %f\n",timer.ElapsedTime());
-    #endif //DEBUG_GL_RENDER_TIMING
   }
-  depthDisplayList.erase();
+  if(renderer.color_tex != 0 && (int)pixels.size() == xres*yres*3) {
+    glBindTexture(GL_TEXTURE_2D, renderer.color_tex);
+    //copy measurements into buffer -- don't forget y flip
+    vector<unsigned char> image(xres*yres*3);
+    for(int j=0;j<yres;j++)
+      memcpy(&image[(yres-j-1)*xres*3],&pixels[j*xres*3],xres*3);
+    //NULL means reserve texture memory, but texels are undefined
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, xres, yres, 0, GL_BGRA, GL_UNSIGNED_BYTE, &image[0]);
+  }
+  colorTextureDirty = false;
 }
 
 void CameraSensor::Simulate(ControlledRobotSimulator* robot,WorldSimulation* sim)
@@ -543,19 +678,28 @@ void CameraSensor::MeasurementNames(vector<string>& names) const
       }
     }
   }
+  if(segmentation) {
+    for(int i=0;i<xres;i++) {
+      for(int j=0;j<yres;j++) {
+        snprintf(buf,64,"seg[%d,%d]",i,j);
+        names.push_back(buf);
+      }
+    }
+  }
 }
 
 void CameraSensor::GetMeasurements(vector<double>& measurements) const
 {
-  if(pixels.empty()) {
+  if((rgb && pixels.empty()) || (depth && floats.empty()) || (segmentation && segments.empty()) || (!rgb && !depth && !segmentation)) {
     measurements.resize(0);
     return;
   }
   #if DEBUG_GL_RENDER_TIMING
   Timer timer;
   #endif //DEBUG_GL_RENDER_TIMING
-  measurements.resize((rgb ? xres*yres : 0) + (depth? xres*yres : 0));
+  measurements.resize((rgb ? xres*yres : 0) + (depth? xres*yres : 0) + (segmentation ? xres*yres : 0));
   size_t dstart = (rgb ? xres*yres : 0);
+  size_t sstart = dstart + (depth ? xres*yres : 0);
   if(rgb) {
     int l=0;
     int k=0;
@@ -576,17 +720,87 @@ void CameraSensor::GetMeasurements(vector<double>& measurements) const
       }
     }
   }
+  if(segmentation) {
+    for(size_t k=0;k<segments.size();k++)
+      measurements[sstart+k] = segments[k];
+  }
   #if DEBUG_GL_RENDER_TIMING
   printf("CameraSensor: Extract measurements %f\n",timer.ElapsedTime());
   timer.Reset();
   #endif //DEBUG_GL_RENDER_TIMING
 }
 
+const unsigned char* CameraSensor::ColorImage() const
+{
+  if(!rgb || pixels.empty() || pixels.size() != (size_t)xres*(size_t)yres*3) return NULL;
+  return &pixels[0];
+}
+
+const float* CameraSensor::DepthImage() const
+{
+  if(!depth || floats.empty() || floats.size() != (size_t)xres*(size_t)yres) return NULL;
+  return &floats[0];
+}
+
+const int* CameraSensor::SegmentationImage() const
+{
+  if(!segmentation || segments.empty() || segments.size() != (size_t)xres*(size_t)yres) return NULL;
+  return &segments[0];
+}
+
 void CameraSensor::SetMeasurements(const vector<double>& values)
 {
-  fprintf(stderr,"CameraSensor::SetMeasurements: not implemented yet\n");
-  //measurements = values;
-  //TODO: copy back into pixel buffers?
+  size_t n = (size_t)xres*(size_t)yres;
+  if(values.size() != (rgb ? n : 0) + (depth ? n : 0) + (segmentation ? n : 0)) {
+    LOG4CXX_WARN(GET_LOGGER(Sensing),"CameraSensor::SetMeasurements: invalid number of measurements "<<values.size());
+    return;
+  }
+  size_t dstart = (rgb ? n : 0);
+  size_t sstart = dstart + (depth ? n : 0);
+  if(rgb) {
+    pixels.resize(n*3);
+    for(size_t k=0;k<n;k++) {
+      unsigned int pix = (unsigned int)values[k];
+      pixels[k*3] = (unsigned char)((pix >> 16) & 0xff);
+      pixels[k*3+1] = (unsigned char)((pix >> 8) & 0xff);
+      pixels[k*3+2] = (unsigned char)(pix & 0xff);
+    }
+    colorTextureDirty = !useGLFramebuffers;
+  }
+  if(depth) {
+    floats.resize(n);
+    for(size_t k=0;k<n;k++)
+      floats[k] = (float)values[dstart+k];
+  }
+  if(segmentation) {
+    segments.resize(n);
+    for(size_t k=0;k<n;k++)
+      segments[k] = (int)values[sstart+k];
+  }
+  depthDisplayList.erase();
+}
+
+void CameraSensor::CopySettings(const SensorBase& s)
+{
+  const CameraSensor& c = dynamic_cast<const CameraSensor&>(s);
+  rate = c.rate;
+  latency = c.latency;
+  link = c.link;
+  Tsensor = c.Tsensor;
+  rgb = c.rgb;
+  depth = c.depth;
+  segmentation = c.segmentation;
+  xres = c.xres;
+  yres = c.yres;
+  xfov = c.xfov;
+  yfov = c.yfov;
+  zmin = c.zmin;
+  zmax = c.zmax;
+  zresolution = c.zresolution;
+  zvarianceLinear = c.zvarianceLinear;
+  zvarianceConstant = c.zvarianceConstant;
+  useGLFramebuffers = c.useGLFramebuffers;
+  useSoftwareRenderer = c.useSoftwareRenderer;
 }
 
 map<string,string> CameraSensor::Settings() const
@@ -596,6 +810,7 @@ map<string,string> CameraSensor::Settings() const
   FILL_SENSOR_SETTING(res,Tsensor);
   FILL_SENSOR_SETTING(res,rgb);
   FILL_SENSOR_SETTING(res,depth);
+  FILL_SENSOR_SETTING(res,segmentation);
   FILL_SENSOR_SETTING(res,xres);
   FILL_SENSOR_SETTING(res,xfov);
   FILL_SENSOR_SETTING(res,yres);
@@ -605,6 +820,8 @@ map<string,string> CameraSensor::Settings() const
   FILL_SENSOR_SETTING(res,zmax);
   FILL_SENSOR_SETTING(res,zvarianceLinear);
   FILL_SENSOR_SETTING(res,zvarianceConstant);
+  FILL_SENSOR_SETTING(res,useGLFramebuffers);
+  FILL_SENSOR_SETTING(res,useSoftwareRenderer);
   return res;
 }
 bool CameraSensor::GetSetting(const string& name,string& str) const
@@ -613,6 +830,7 @@ bool CameraSensor::GetSetting(const string& name,string& str) const
   GET_SENSOR_SETTING(Tsensor);
   GET_SENSOR_SETTING(rgb);
   GET_SENSOR_SETTING(depth);
+  GET_SENSOR_SETTING(segmentation);
   GET_SENSOR_SETTING(xres);
   GET_SENSOR_SETTING(xfov);
   GET_SENSOR_SETTING(yres);
@@ -622,6 +840,8 @@ bool CameraSensor::GetSetting(const string& name,string& str) const
   GET_SENSOR_SETTING(zmax);
   GET_SENSOR_SETTING(zvarianceLinear);
   GET_SENSOR_SETTING(zvarianceConstant);
+  GET_SENSOR_SETTING(useGLFramebuffers);
+  GET_SENSOR_SETTING(useSoftwareRenderer);
   if(SensorBase::GetSetting(name,str)) return true;
   return false;
 }
@@ -631,6 +851,7 @@ bool CameraSensor::SetSetting(const string& name,const string& str)
   SET_SENSOR_SETTING(Tsensor);
   SET_SENSOR_SETTING(rgb);
   SET_SENSOR_SETTING(depth);
+  SET_SENSOR_SETTING(segmentation);
   SET_SENSOR_SETTING(xres);
   SET_SENSOR_SETTING(xfov);
   SET_SENSOR_SETTING(yres);
@@ -640,6 +861,8 @@ bool CameraSensor::SetSetting(const string& name,const string& str)
   SET_SENSOR_SETTING(zmax);
   SET_SENSOR_SETTING(zvarianceLinear);
   SET_SENSOR_SETTING(zvarianceConstant);
+  SET_SENSOR_SETTING(useGLFramebuffers);
+  SET_SENSOR_SETTING(useSoftwareRenderer);
   if(SensorBase::SetSetting(name,str)) return true;
   return false;
 }
@@ -753,6 +976,7 @@ void CameraSensor::DrawGL(const Robot& robot,const vector<double>& measurements)
   }
 
   
+  if(colorTextureDirty) UploadColorTexture();
   if(rgb && !measurements.empty() && renderer.color_tex != 0) {
     //debugging: draw image in frustum
     glPushMatrix();
@@ -2,6 +2,7 @@
 #define CONTROL_VISUAL_SENSORS_H
 
 #include "Sensor.h"
+#include "SoftwareRenderer.h"
 #include <KrisLibrary/camera/viewport.h>
 #include <KrisLibrary/math3d/primitives.h>
 #include <KrisLibrary/GLdraw/GLRenderToImage.h>
@@ -10,6 +11,7 @@ using namespace Math3D;
 
 class RobotWorld;
 class Robot;
+class WorldRayCaster;
 
 /** @ingroup Sensing
  * @brief Simulates a laser range sensor, either sweeping or stationary.  Can
@@ -44,6 +46,8 @@ class LaserRangeSensor : public SensorBase
   virtual void Simulate(ControlledRobotSimulator* robot,WorldSimulation* sim);
   virtual void SimulateKinematic(Robot& robot,RobotWorld& world);
   virtual void Advance(double dt);
+  virtual bool SupportsAsync() const { return true; }
+  virtual void CopySettings(const SensorBase& s);
   virtual void Reset();
   virtual void MeasurementNames(vector<string>& names) const;
   virtual void GetMeasurements(vector<double>& values) const;
@@ -86,6 +90,7 @@ class LaserRangeSensor : public SensorBase
   vector<double> depthReadings;
   //internal state
   Real last_dt,last_t;
+  shared_ptr<WorldRayCaster> rayCaster;
 };
 
 
@@ -100,25 +105,38 @@ class LaserRangeSensor : public SensorBase
  *
  * The format of the measurements list is a list of rgb[i,j] pixels if rgb=true, 
  * then followed by a list of d[i,j] pixels giving depth in meters (or whatever unit
- * you are generally using) if depth=true.  The rgb pixels are given as casts from
+ * you are generally using) if depth=true, then followed by a list of seg[i,j]
+ * pixels if segmentation=true.  The rgb pixels are given as casts from
  * unsigned integers in the pixel format 0xrrggbb to doubles.  The depth pixels are given
- * as floats.
+ * as floats.  The seg pixels are the world IDs of the bodies seen at each
+ * pixel (see RobotWorld::GetID), or -1 for the background.
  *
  * The list of measurements proceeds in scan-line order from the upper-left pixel.
  *
+ * ColorImage(), DepthImage() and SegmentationImage() give the same images
+ * in their native types without the conversion to doubles.
+ *
  * For optimal performance using the graphics card, you must install the GLEW package
  * on your system.  You must also initialize OpenGL before running the simulator, 
- * which typically requires popping up a visualization window.
+ * which typically requires popping up a visualization window.  If
+ * useGLFramebuffers is false, or OpenGL can't be initialized, the image is
+ * made without OpenGL and the sensor can be simulated asynchronously.  The
+ * world is then ray cast, or rasterized on the CPU by a SoftwareRenderer if
+ * useSoftwareRenderer is true (default false).  The rasterizer is much
+ * faster for large images, but shades surfaces and samples triangle edges
+ * slightly differently from the ray caster.
  *
  * Configurable settings:
  * - link: int
  * - Tsensor: RigidTransform
- * - rgb,depth: bool
+ * - rgb,depth,segmentation: bool
  * - xres,yres: int
  * - xfov,yfov: float
  * - zmin,zmax: float
  * - zresolution: int
  * - zvarianceLinear,zvarianceConstant: float
+ * - useGLFramebuffers: bool
+ * - useSoftwareRenderer: bool
  */
 class CameraSensor : public SensorBase
 {
@@ -128,6 +146,8 @@ class CameraSensor : public SensorBase
   virtual const char* Type() const { return "CameraSensor"; }
   virtual void Simulate(ControlledRobotSimulator* robot,WorldSimulation* sim);
   virtual void SimulateKinematic(Robot& robot,RobotWorld& world);
+  virtual bool SupportsAsync() const { return !useGLFramebuffers; }
+  virtual void CopySettings(const SensorBase& s);
   virtual void Reset();
   virtual void MeasurementNames(vector<string>& names) const;
   virtual void GetMeasurements(vector<double>& values) const;
@@ -142,10 +162,31 @@ class CameraSensor : public SensorBase
   ///Sets the camera to match the OpenGL view.  The view is assumed to be in the link's local frame.
   ///Note that in OpenGL views, Z is backward, and Y is up.
   void SetViewport(const Camera::Viewport& view);
+  ///Returns the latest color image as xres*yres*3 bytes in r,g,b order, or
+  ///NULL if rgb is false or no image has been taken.  The buffer is reused
+  ///by later measurements and is invalidated when the resolution changes.
+  const unsigned char* ColorImage() const;
+  ///Returns the latest depth image as xres*yres floats, or NULL if depth is
+  ///false or no image has been taken.  Same lifetime as ColorImage().
+  const float* DepthImage() const;
+  ///Returns the latest segmentation image as xres*yres world IDs, -1 for the
+  ///background, or NULL if segmentation is false or no image has been
+  ///taken.  Same lifetime as ColorImage().
+  const int* SegmentationImage() const;
+  ///Uploads the ray cast color image to renderer.color_tex.  Must be called
+  ///with an OpenGL context.
+  void UploadColorTexture();
+  ///Gets the color, in [0,1], that the GL segmentation pass draws the body
+  ///with world ID id in
+  static void SegmentationColor(int id,float rgb[3]);
+  ///Decodes the world ID, or -1 for the background, from a pixel of the GL
+  ///segmentation pass
+  static int SegmentationLabel(const unsigned char rgb[3]);
 
   int link;
   RigidTransform Tsensor; ///< z is forward, x is to the right of image, and y is *down*
   bool rgb,depth;  ///< If rgb is true, gives color measurements. If depth is true, gives depth measurements.
+  bool segmentation;  ///< If true, gives the world ID of the body seen at each pixel
   int xres,yres;  ///< resolution of camera in x and y directions (# of pixels)
   double xfov,yfov; ///< field of view in x and y directions (radians)
   double zmin,zmax;  ///< range limits, > 0
@@ -155,10 +196,20 @@ class CameraSensor : public SensorBase
 
   //internal: used for OpenGL rendering / buffers
   bool useGLFramebuffers; 
+  //if useGLFramebuffers = false, rasterizes on the CPU instead of ray casting
+  bool useSoftwareRenderer;
   GLDraw::GLRenderToImage renderer;
+  //true if the ray cast image should be uploaded to renderer.color_tex
+  bool colorTextureDirty;
+  //used when useGLFramebuffers = false
+  SoftwareRenderer softwareRenderer;
+  shared_ptr<WorldRayCaster> rayCaster;
   //last measurements
   vector<unsigned char> pixels;
   vector<float> floats;
+  vector<int> segments;
+  //colors of the GL segmentation pass, decoded into segments
+  vector<unsigned char> segmentPixels;
   //visualization state
   GLDraw::GLDisplayList depthDisplayList;
   unsigned int depthDisplayHash;
@@ -0,0 +1,150 @@
+#include "BatchSimulator.h"
+#include <KrisLibrary/Timer.h>
+#include "Control/Controller.h"
+DECLARE_LOGGER(WorldSimulator)
+
+BatchSimulator::BatchSimulator()
+  :world(NULL),simStep(0.001),makeDefaultSensors(true),checksums(false)
+{}
+
+void BatchSimulator::Init(RobotWorld* _world,int numThreads)
+{
+  world = _world;
+  pool = make_shared<ThreadPool>(numThreads);
+  //the geometry cache is not thread safe, so the clones are made serially.
+  //ODE's custom collider moves the geometry, so it cannot be shared across
+  //threads.
+  threadWorlds.resize(pool->NumThreads());
+  for(size_t i=0;i<threadWorlds.size();i++) {
+    threadWorlds[i] = make_shared<RobotWorld>();
+    CopyWorldUnique(*world,*threadWorlds[i]);
+  }
+}
+
+int BatchSimulator::StateSize() const
+{
+  if(!world) return 0;
+  int n = 0;
+  for(size_t i=0;i<world->robots.size();i++)
+    n += 2*world->robots[i]->q.n;
+  n += 18*(int)world->rigidObjects.size();
+  return n;
+}
+
+void BatchSimulator::GetState(const WorldSimulation& sim,Real* state)
+{
+  sim.GetStateVector(state);
+}
+
+bool BatchSimulator::Run(const vector<BatchRolloutCondition>& rollouts,Real duration,Real dt,BatchSimulationTrace& trace)
+{
+  if(!world || !pool) {
+    LOG4CXX_ERROR(GET_LOGGER(WorldSimulator),"BatchSimulator::Run: Init was not called");
+    return false;
+  }
+  Timer timer;
+  trace.numRollouts = (int)rollouts.size();
+  trace.numSamples = 1 + (dt > 0 ? Max(0,(int)Floor(duration/dt + 0.5)) : 0);
+  trace.stateSize = StateSize();
+  trace.times.resize(trace.numSamples);
+  for(int k=0;k<trace.numSamples;k++)
+    trace.times[k] = k*dt;
+  //large batches overflow int offsets
+  trace.states.resize(size_t(trace.numRollouts)*trace.numSamples*trace.stateSize);
+  trace.statuses.resize(size_t(trace.numRollouts)*trace.numSamples);
+  trace.lengths.resize(trace.numRollouts);
+  trace.checksums.resize(checksums ? size_t(trace.numRollouts)*trace.numSamples : 0);
+  pool->ParallelFor(trace.numRollouts,[&](int index,int thread) {
+      RunRollout(index,thread,rollouts[index],dt,trace);
+    });
+  trace.wallClockTime = timer.ElapsedTime();
+  return true;
+}
+
+void BatchSimulator::RunRollout(int index,int thread,const BatchRolloutCondition& rollout,Real dt,BatchSimulationTrace& trace)
+{
+  RobotWorld& w = *threadWorlds[thread];
+  //reset the thread's world so that results don't depend on which
+  //rollouts ran before on this thread
+  for(size_t i=0;i<w.robots.size();i++) {
+    w.robots[i]->dq = world->robots[i]->dq;
+    w.robots[i]->UpdateConfig(world->robots[i]->q);
+  }
+  for(size_t i=0;i<w.rigidObjects.size();i++)
+    w.rigidObjects[i]->T = world->rigidObjects[i]->T;
+
+  WorldSimulation sim;
+  sim.odesim.GetSettings() = settings;
+  //rollouts are already run in parallel
+  sim.odesim.GetSettings().collisionThreads = 1;
+  sim.simStep = simStep;
+  sim.Init(&w);
+  sim.odesim.SetGravity(Vector3(settings.gravity));
+  sim.odesim.SetERP(settings.errorReductionParameter);
+  sim.odesim.SetCFM(settings.dampedLeastSquaresParameter);
+  sim.robotControllers.resize(w.robots.size());
+  for(size_t i=0;i<w.robots.size();i++) {
+    Robot* robot = w.robots[i].get();
+    sim.SetController(i,(makeController ? makeController(robot) : MakeDefaultController(robot)));
+    if(makeDefaultSensors)
+      sim.controlSimulators[i].sensors.MakeDefault(robot);
+  }
+  if(!initialState.empty()) {
+    if(!sim.ReadState(initialState))
+      LOG4CXX_ERROR(GET_LOGGER(WorldSimulator),"BatchSimulator: error reading initial state of rollout "<<index);
+  }
+
+  //apply initial condition
+  //ODERobot reads the link frames from the robot model
+  for(size_t i=0;i<rollout.robotConfigs.size() && i<sim.odesim.numRobots();i++) {
+    w.robots[i]->UpdateConfig(rollout.robotConfigs[i]);
+    sim.odesim.robot(i)->SetConfig(rollout.robotConfigs[i]);
+  }
+  for(size_t i=0;i<rollout.robotVelocities.size() && i<sim.odesim.numRobots();i++) {
+    w.robots[i]->dq = rollout.robotVelocities[i];
+    sim.odesim.robot(i)->SetVelocities(rollout.robotVelocities[i]);
+  }
+  for(size_t i=0;i<rollout.objectTransforms.size() && i<sim.odesim.numObjects();i++)
+    sim.odesim.object(i)->SetTransform(rollout.objectTransforms[i]);
+  for(size_t i=0;i<sim.odesim.numObjects();i++) {
+    if(i >= rollout.objectAngularVelocities.size() && i >= rollout.objectVelocities.size()) continue;
+    Vector3 ow,ov;
+    sim.odesim.object(i)->GetVelocity(ow,ov);
+    if(i < rollout.objectAngularVelocities.size()) ow = rollout.objectAngularVelocities[i];
+    if(i < rollout.objectVelocities.size()) ov = rollout.objectVelocities[i];
+    sim.odesim.object(i)->SetVelocity(ow,ov);
+  }
+  for(map<string,string>::const_iterator s=rollout.controllerSettings.begin();s!=rollout.controllerSettings.end();s++) {
+    for(size_t i=0;i<sim.robotControllers.size();i++) {
+      if(!sim.robotControllers[i]->SetSetting(s->first,s->second))
+        LOG4CXX_WARN(GET_LOGGER(WorldSimulator),"BatchSimulator: robot "<<i<<" controller does not accept setting "<<s->first);
+    }
+  }
+  if(simInit) simInit(index,sim);
+
+  size_t n = trace.stateSize;
+  size_t offset = size_t(index)*trace.numSamples;
+  Real* states = trace.states.data() + offset*n;
+  int* statuses = trace.statuses.data() + offset;
+  uint64_t* sums = (checksums ? trace.checksums.data() + offset : NULL);
+  if(n > 0) GetState(sim,states);
+  statuses[0] = sim.worstStatus;
+  //simInit or the step callback may turn on kinematic simulation
+  if(sums) { sim.SyncKinematicRobots(); sums[0] = sim.StateChecksum(); }
+  int length = 1;
+  while(length < trace.numSamples) {
+    if(simStepCallback) simStepCallback(index,sim);
+    sim.Advance(dt);
+    if(n > 0) GetState(sim,states+length*n);
+    statuses[length] = sim.worstStatus;
+    if(sums) { sim.SyncKinematicRobots(); sums[length] = sim.StateChecksum(); }
+    length++;
+    if(simTerm && simTerm(index,sim)) break;
+  }
+  trace.lengths[index] = length;
+  for(int k=length;k<trace.numSamples;k++) {
+    if(n > 0) std::copy(states+(length-1)*n,states+length*n,states+k*n);
+    statuses[k] = statuses[length-1];
+    if(sums) sums[k] = sums[length-1];
+  }
+}
@@ -0,0 +1,114 @@
+#ifndef BATCH_SIMULATOR_H
+#define BATCH_SIMULATOR_H
+
+#include "WorldSimulation.h"
+#include <Klampt/Modeling/ThreadPool.h>
+#include <functional>
+
+/** @ingroup Simulation
+ * @brief The initial condition of one rollout of a BatchSimulator.
+ *
+ * Empty members are left at the value given by the base world (or by
+ * BatchSimulator::initialState, if set).
+ */
+struct BatchRolloutCondition
+{
+  ///Initial robot configurations / velocities, one per robot
+  vector<Config> robotConfigs,robotVelocities;
+  ///Initial rigid object transforms, one per object
+  vector<RigidTransform> objectTransforms;
+  ///Initial rigid object angular / linear velocities, one per object
+  vector<Vector3> objectAngularVelocities,objectVelocities;
+  ///Settings applied to every robot's controller via RobotController::SetSetting
+  map<string,string> controllerSettings;
+};
+
+/** @ingroup Simulation
+ * @brief The trace of a batch of rollouts, stored as flat arrays.
+ *
+ * The state of rollout r at sample k is stored at
+ * states[(r*numSamples+k)*stateSize], and its status (a
+ * ODESimulator::Status value) at statuses[r*numSamples+k].  Sample k is
+ * taken at time times[k].
+ *
+ * Each state vector concatenates, for each robot, its configuration and
+ * velocity, then for each rigid object its rotation matrix (9 entries,
+ * column major), translation, angular velocity, and linear velocity.
+ *
+ * A rollout that is terminated early has lengths[r] < numSamples, and its
+ * remaining samples repeat the last state.
+ */
+struct BatchSimulationTrace
+{
+  int numRollouts,numSamples,stateSize;
+  vector<Real> times;
+  vector<Real> states;
+  vector<int> statuses;
+  vector<int> lengths;
+  ///If BatchSimulator::checksums is set, the WorldSimulation::StateChecksum
+  ///of each sample, indexed like statuses
+  vector<uint64_t> checksums;
+  ///Wall clock time spent in Run, in seconds
+  double wallClockTime;
+};
+
+/** @ingroup Simulation
+ * @brief Runs many independent simulations of the same world in parallel.
+ *
+ * Init() makes one copy of the world for each worker thread, with its own
+ * collision geometry, so that the worker threads never share mutable data.
+ * Each rollout then builds a fresh WorldSimulation on its thread's copy,
+ * applies its BatchRolloutCondition, and is advanced in steps of dt.
+ *
+ * The optional callbacks are called from the worker threads and must only
+ * touch the WorldSimulation they are given.
+ */
+class BatchSimulator
+{
+public:
+  BatchSimulator();
+  ///Sets up the base world and the per-thread world copies.  If numThreads
+  ///<= 0, uses all hardware threads.
+  void Init(RobotWorld* world,int numThreads=0);
+  ///Returns the size of a state vector in the trace
+  int StateSize() const;
+  ///Simulates all rollouts for the given duration, recording a sample
+  ///every dt seconds.  Returns false if Init was not called.
+  bool Run(const vector<BatchRolloutCondition>& rollouts,Real duration,Real dt,BatchSimulationTrace& trace);
+  ///Writes the current state of sim into state, in the trace layout (see
+  ///WorldSimulation::GetStateVector)
+  static void GetState(const WorldSimulation& sim,Real* state);
+
+  RobotWorld* world;
+  ///ODE settings used for every rollout
+  ODESimulatorSettings settings;
+  ///Internal simulation step, see WorldSimulation::simStep
+  Real simStep;
+  ///If nonempty, a WorldSimulation::WriteState string loaded into each
+  ///rollout before its initial condition is applied
+  string initialState;
+  ///If true (default), robots get the default sensors of
+  ///RobotSensors::MakeDefault
+  bool makeDefaultSensors;
+  ///If true, the trace records the state checksum of every sample, e.g., to
+  ///check that the rollouts match serial runs (default false).  Set
+  ///settings.deterministic as well for bitwise reproducible rollouts.
+  bool checksums;
+  ///Creates the controller for a robot.  Defaults to MakeDefaultController
+  std::function<shared_ptr<RobotController>(Robot*)> makeController;
+  ///Called with (rollout,sim) after the initial condition is applied
+  std::function<void(int,WorldSimulation&)> simInit;
+  ///Called with (rollout,sim) before each Advance call
+  std::function<void(int,WorldSimulation&)> simStepCallback;
+  ///Called with (rollout,sim) after each Advance call.  Returning true
+  ///terminates the rollout.
+  std::function<bool(int,WorldSimulation&)> simTerm;
+
+  vector<shared_ptr<RobotWorld> > threadWorlds;
+  shared_ptr<ThreadPool> pool;
+
+private:
+  void RunRollout(int index,int thread,const BatchRolloutCondition& rollout,Real dt,BatchSimulationTrace& trace);
+};
+
+#endif
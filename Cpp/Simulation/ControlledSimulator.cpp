@@ -1,7 +1,9 @@
 #include "ControlledSimulator.h"
+#include "WorldSimulation.h"
 #include "Sensing/JointSensors.h"
 #include "Sensing/Common_Internal.h"
 #include <KrisLibrary/math/angle.h>
+#include <KrisLibrary/Timer.h>
 DEFINE_LOGGER(ControlledRobotSimulator)
 
 //Set these values to 0 to get all warnings
@@ -209,6 +211,8 @@ void ControlledRobotSimulator::GetActuatorTorques(Vector& t) const
 void ControlledRobotSimulator::Step(Real dt,WorldSimulation* sim)
 {
   Real endOfTimeStep = curTime + dt;
+  SimulationProfile* profile = (sim && sim->profiling ? &sim->profile : NULL);
+  Timer timer;
 
   //process sensors, which don't operate on the same loop as the controller,
   //necessarily.
@@ -216,6 +220,11 @@ void ControlledRobotSimulator::Step(Real dt,WorldSimulation* sim)
     //make sure the sensors get updated
     nextSenseTime.resize(sensors.sensors.size(),curTime);
   }
+  int robotIndex = -1;
+  if(sim && sim->asyncSensors) {
+    robotIndex = int(this - &sim->controlSimulators[0]);
+    if(!sim->sensorPipeline) sim->sensorPipeline = make_shared<SensorPipeline>();
+  }
   for(size_t i=0;i<sensors.sensors.size();i++) {
     Real delay = 0;
     if(sensors.sensors[i]->rate == 0)
@@ -232,11 +241,24 @@ void ControlledRobotSimulator::Step(Real dt,WorldSimulation* sim)
 
     if(curTime >= nextSenseTime[i]) {
       //trigger a sensing action
-      sensors.sensors[i]->Simulate(this,sim);
-      sensors.sensors[i]->Advance(delay);
+      if(robotIndex >= 0 && sensors.sensors[i]->SupportsAsync()) {
+        //the pipeline's copy of the sensor is advanced on the worker
+        sim->sensorPipeline->Submit(sim,robotIndex,i,curTime,delay);
+      }
+      else {
+        sensors.sensors[i]->Simulate(this,sim);
+        sensors.sensors[i]->Advance(delay);
+        sensors.sensors[i]->measurementTime = curTime;
+      }
       nextSenseTime[i] += delay;
     }
   }
+  if(robotIndex >= 0)
+    sim->sensorPipeline->Deliver(this,robotIndex,curTime);
+  if(profile) {
+    profile->sensorTime += timer.ElapsedTime();
+    timer.Reset();
+  }
 
   if(controller) {
     //the controller update happens less often than the PID update loop
@@ -246,6 +268,7 @@ void ControlledRobotSimulator::Step(Real dt,WorldSimulation* sim)
       controller->command = &command;
       controller->Update(controlTimeStep);
       nextControlTime += controlTimeStep;
+      if(profile) profile->controllerTime += timer.ElapsedTime();
     }
 
     //get torques
@@ -317,6 +340,56 @@ void ControlledRobotSimulator::Step(Real dt,WorldSimulation* sim)
   curTime = endOfTimeStep;
 }
 
+bool ControlledRobotSimulator::StepKinematic(Real dt,RobotWorld& world)
+{
+  Real endOfTimeStep = curTime + dt;
+  if(controller && nextControlTime <= endOfTimeStep) {
+    //controllers read the joint sensors, so only those are kept up to date
+    JointPositionSensor* qs = sensors.GetTypedSensor<JointPositionSensor>();
+    JointVelocitySensor* dqs = sensors.GetTypedSensor<JointVelocitySensor>();
+    if(qs) { qs->SimulateKinematic(*robot,world); qs->measurementTime = curTime; }
+    if(dqs) { dqs->SimulateKinematic(*robot,world); dqs->measurementTime = curTime; }
+    controller->sensors = &sensors;
+    controller->command = &command;
+    controller->Update(controlTimeStep);
+    nextControlTime += controlTimeStep;
+  }
+  curTime = endOfTimeStep;
+
+  Assert(command.actuators.size() == robot->drivers.size());
+  bool changed = false;
+  for(size_t i=0;i<command.actuators.size();i++) {
+    const RobotJointDriver& d=robot->drivers[i];
+    const ActuatorCommand& cmd=command.actuators[i];
+    Real q = robot->GetDriverValue(i), dq = robot->GetDriverVelocity(i);
+    Real qnew = q, dqnew = 0;
+    switch(cmd.mode) {
+    case ActuatorCommand::PID:
+      //ideal tracking of the setpoint
+      qnew = cmd.qdes;
+      dqnew = cmd.dqdes;
+      break;
+    case ActuatorCommand::LOCKED_VELOCITY:
+      qnew = q + cmd.desiredVelocity*dt;
+      dqnew = cmd.desiredVelocity;
+      if(d.type == RobotJointDriver::Normal) {
+        Vector2 limits = robot->GetDriverLimits(i);
+        if(qnew < limits.x || qnew > limits.y) {
+          qnew = Clamp(qnew,limits.x,limits.y);
+          dqnew = 0;
+        }
+      }
+      break;
+    default:
+      //no dynamics, so torque-controlled and disabled drivers hold still
+      break;
+    }
+    if(qnew != q) { robot->SetDriverValue(i,qnew); changed = true; }
+    if(dqnew != dq) { robot->SetDriverVelocity(i,dqnew); changed = true; }
+  }
+  return changed;
+}
+
 void ControlledRobotSimulator::UpdateRobot()
 {
   oderobot->GetConfig(robot->q);
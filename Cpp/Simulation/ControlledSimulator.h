@@ -20,6 +20,11 @@ class ControlledRobotSimulator
   ControlledRobotSimulator();
   void Init(Robot* robot,ODERobot* oderobot,RobotController* controller=NULL);
   void Step(Real dt,WorldSimulation* sim);
+  ///Advances the controller and applies its commands directly to the robot
+  ///model, without physics.  Only the joint position and velocity sensors
+  ///are simulated.  Returns true if the robot's configuration or velocity
+  ///changed.  Used by WorldSimulation::AdvanceKinematic.
+  bool StepKinematic(Real dt,RobotWorld& world);
   void UpdateRobot();
 
   void GetCommandedConfig(Config& q);
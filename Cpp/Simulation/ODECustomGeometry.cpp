@@ -6,12 +6,26 @@
 #include <KrisLibrary/errors.h>
 #include <KrisLibrary/meshing/IO.h>
 #include <iostream>
+#include <limits>
 using namespace std;
+using namespace Math;
 
 DECLARE_LOGGER(ODESimulator)
 
 
-static bool gCustomGeometryMeshesIntersect = false;
+//thread-local so that simulators on different threads do not clobber one another
+static thread_local bool gCustomGeometryMeshesIntersect = false;
+//if false, the collider assumes geometry transforms are already up to date
+static thread_local bool gCustomGeometryUpdateTransforms = true;
+//per-pair contact budget and its normal scale, 0 for no budget
+static thread_local int gCustomGeometryContactBudget = 0;
+static thread_local Real gCustomGeometryContactNormalScale = 0.1;
+//scratch space for contact selection
+static thread_local vector<Real> gCustomGeometryContactDistances;
+
+//contact selection stops once every raw contact is within this distance of
+//a selected one
+const static Real kContactBudgetCoverageTolerance = 1e-3;
 
 int gdCustomGeometryClass = 0;
 
@@ -23,6 +37,7 @@ dGeomID dCreateCustomGeometry(AnyCollisionGeometry3D* geometry,Real outerMargin)
   data->geometry = geometry;
   data->outerMargin = outerMargin;
   data->odeOffset.setZero();
+  data->fixedTransform = false;
   dGeomSetCategoryBits(geom,0xffffffff);
   dGeomSetCollideBits(geom,0xffffffff);
   dGeomEnable(geom);
@@ -34,29 +49,105 @@ CustomGeometryData* dGetCustomGeometryData(dGeomID o)
   return (CustomGeometryData*)dGeomGetClassData(o);
 }
 
+void dCustomGeometryUpdateTransform(dGeomID o)
+{
+  if(dGeomGetClass(o) != gdCustomGeometryClass) return;
+  CustomGeometryData* d = dGetCustomGeometryData(o);
+  if(d->fixedTransform) return;
+  RigidTransform T;
+  CopyMatrix(T.R,dGeomGetRotation(o));
+  CopyVector(T.t,dGeomGetPosition(o));
+  T.t += T.R*d->odeOffset;
+  d->geometry->SetTransform(T);
+}
+
+void dCustomGeometryFixTransform(dGeomID o)
+{
+  if(dGeomGetClass(o) != gdCustomGeometryClass) return;
+  CustomGeometryData* d = dGetCustomGeometryData(o);
+  RigidTransform T;
+  CopyMatrix(T.R,dGeomGetRotation(o));
+  CopyVector(T.t,dGeomGetPosition(o));
+  T.t += T.R*d->odeOffset;
+  //the geometry may be shared with simulators on other threads (see
+  //CopyWorldUnique), which all set it from the same pose, so it is
+  //only written the first time.  The ODE pose is stored in dReal, so
+  //compare at that precision.
+  const Real tol = 4*std::numeric_limits<dReal>::epsilon();
+  const RigidTransform& Tcur = d->geometry->GetTransform();
+  if(!Tcur.R.isEqual(T.R,tol) || !Tcur.t.isEqual(T.t,tol*Max(One,T.t.norm())))
+    d->geometry->SetTransform(T);
+  d->fixedTransform = true;
+}
+
+AnyCollisionGeometry3D* dCustomGeometryGetGeometry(dGeomID o)
+{
+  if(dGeomGetClass(o) != gdCustomGeometryClass) return NULL;
+  return dGetCustomGeometryData(o)->geometry;
+}
+
+
+//squared distance between contacts in position / scaled normal space
+inline Real ContactDistance2(const dContactGeom& a,const dContactGeom& b,Real normalScale)
+{
+  Real d2 = 0;
+  for(int k=0;k<3;k++) {
+    d2 += Sqr(a.pos[k]-b.pos[k]);
+    d2 += Sqr(normalScale*(a.normal[k]-b.normal[k]));
+  }
+  return d2;
+}
+
+//Moves up to budget contacts that cover the contact region to the front of
+//contacts and returns how many were picked.  Starts from the deepest
+//contact, then repeatedly picks the contact farthest from those already
+//picked, stopping early once all contacts are covered.
+int SelectCoveringContacts(dContactGeom* contacts,int n,int budget,Real normalScale)
+{
+  if(n <= budget) return n;
+  if(budget <= 0) return 0;
+  int deepest = 0;
+  for(int i=1;i<n;i++)
+    if(contacts[i].depth > contacts[deepest].depth) deepest = i;
+  std::swap(contacts[0],contacts[deepest]);
+  vector<Real>& dist = gCustomGeometryContactDistances;
+  dist.resize(n);
+  for(int i=1;i<n;i++)
+    dist[i] = ContactDistance2(contacts[i],contacts[0],normalScale);
+  int k=1;
+  for(;k<budget;k++) {
+    int farthest = k;
+    for(int i=k+1;i<n;i++)
+      if(dist[i] > dist[farthest]) farthest = i;
+    if(dist[farthest] < Sqr(kContactBudgetCoverageTolerance)) break;
+    std::swap(contacts[k],contacts[farthest]);
+    std::swap(dist[k],dist[farthest]);
+    for(int i=k+1;i<n;i++)
+      dist[i] = Min(dist[i],ContactDistance2(contacts[i],contacts[k],normalScale));
+  }
+  return k;
+}
 
 int dCustomGeometryCollide (dGeomID o1, dGeomID o2, int flags,
                            dContactGeom *contact, int skip)
 {
   int m = (flags&0xffff);
   if(m == 0) m=1;
+  int budget = gCustomGeometryContactBudget;
   //printf("CustomGeometry collide\n");
   CustomGeometryData* d1 = dGetCustomGeometryData(o1);
   CustomGeometryData* d2 = dGetCustomGeometryData(o2);
-  RigidTransform T1;
-  RigidTransform T2;
-  CopyMatrix(T1.R,dGeomGetRotation(o1));
-  CopyVector(T1.t,dGeomGetPosition(o1));
-  CopyMatrix(T2.R,dGeomGetRotation(o2));
-  CopyVector(T2.t,dGeomGetPosition(o2));
-  T1.t += T1.R*d1->odeOffset;
-  T2.t += T2.R*d2->odeOffset;
-  d1->geometry->SetTransform(T1);
-  d2->geometry->SetTransform(T2);
+  if(gCustomGeometryUpdateTransforms) {
+    dCustomGeometryUpdateTransform(o1);
+    dCustomGeometryUpdateTransform(o2);
+  }
 
   AnyContactsQuerySettings settings;
   settings.padding1 = d1->outerMargin;
   settings.padding2 = d2->outerMargin;
+  //with a budget, all contacts are still requested.  The geometry returns
+  //them in BVH traversal order, so capping the query would keep an arbitrary
+  //part of the contact region.  The budget is applied after collection.
   settings.maxcontacts = m;
   AnyContactsQueryResult res = d1->geometry->Contacts(*d2->geometry,settings);
   int k=0;
@@ -74,6 +165,8 @@ int dCustomGeometryCollide (dGeomID o1, dGeomID o2, int flags,
     k++;
     if(k >= m) break;
   }
+  if(budget > 0)
+    k = SelectCoveringContacts(contact,k,budget,gCustomGeometryContactNormalScale);
   return k;
 }
 
@@ -88,13 +181,8 @@ dColliderFn * dCustomGeometryGetColliderFn (int num)
 void dCustomGeometryAABB(dGeomID o,dReal aabb[6])
 {
   CustomGeometryData* d = dGetCustomGeometryData(o);
-  AABB3D bb;
-  RigidTransform T;
-  CopyMatrix(T.R,dGeomGetRotation(o));
-  CopyVector(T.t,dGeomGetPosition(o));  
-  T.t += T.R*d->odeOffset;
-  d->geometry->SetTransform(T);
-  bb = d->geometry->GetAABB();
+  dCustomGeometryUpdateTransform(o);
+  AABB3D bb = d->geometry->GetAABB();
   bb.bmin -= Vector3(d->outerMargin,d->outerMargin,d->outerMargin);
   bb.bmax += Vector3(d->outerMargin,d->outerMargin,d->outerMargin);
   aabb[0] = bb.bmin.x;
@@ -131,3 +219,14 @@ void ClearCustomGeometryCollisionReliableFlag()
 {
   gCustomGeometryMeshesIntersect = false;
 }
+
+void SetCustomGeometryTransformUpdates(bool update)
+{
+  gCustomGeometryUpdateTransforms = update;
+}
+
+void SetCustomGeometryContactBudget(int budget,Real normalScale)
+{
+  gCustomGeometryContactBudget = budget;
+  gCustomGeometryContactNormalScale = normalScale;
+}
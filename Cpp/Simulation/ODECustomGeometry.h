@@ -3,6 +3,7 @@
 
 #include <KrisLibrary/geometry/AnyGeometry.h>
 #include <ode/common.h>
+#include <ode/contact.h>
 using namespace Geometry;
 
 struct CustomGeometryData
@@ -17,18 +18,45 @@ struct CustomGeometryData
   ///The translation from the geometry local frame to the ODE frame.
   ///i.e., the negation of the local COM vector.
   Vector3 odeOffset;
+  ///If true, the geom never moves, and dCustomGeometryUpdateTransform
+  ///leaves the geometry's transform alone.  Set for terrains, whose
+  ///geometry may be shared between simulators.
+  bool fixedTransform;
 };
 
 
 dGeomID dCreateCustomGeometry(AnyCollisionGeometry3D* geom,Real outerMargin=0);
 CustomGeometryData* dGetCustomGeometryData(dGeomID o);
+///Sets the transform of o's geometry to match the ODE geom (no-op if o is
+///not a custom geometry, or its transform is fixed)
+void dCustomGeometryUpdateTransform(dGeomID o);
+///Sets the transform of o's geometry to match the ODE geom once, then fixes
+///it so later updates don't write it.  The geometry is only written if its
+///transform differs from the geom's by more than the precision of dReal.
+void dCustomGeometryFixTransform(dGeomID o);
+///Returns the geometry of o, or NULL if o is not a custom geometry
+AnyCollisionGeometry3D* dCustomGeometryGetGeometry(dGeomID o);
 void InitODECustomGeometry();
 
 ///if the underlying meshes had a collision, the result is flagged as
-///unreliable in a global flag.
+///unreliable in a thread-local flag.
 bool GetCustomGeometryCollisionReliableFlag();
 ///Resets the reliability flag to true
 void ClearCustomGeometryCollisionReliableFlag();
+///If set to false, the collider on this thread assumes the geometry
+///transforms were already updated with dCustomGeometryUpdateTransform.  This
+///lets several threads test pairs that share a dGeom.  It is not valid if
+///several dGeoms share one AnyCollisionGeometry3D.
+void SetCustomGeometryTransformUpdates(bool update);
+///Sets a budget on the number of contacts the collider on this thread
+///returns per pair.  This does not bound the narrowphase: all contacts of
+///the pair are collected, then reduced to ones that cover the contact
+///region, using normalScale to weigh normal distance as in contact
+///clustering.  0 (the default) disables the budget.
+void SetCustomGeometryContactBudget(int budget,Real normalScale=0.1);
+///Moves up to budget contacts that cover the contact region to the front of
+///contacts, and returns how many were picked
+int SelectCoveringContacts(dContactGeom* contacts,int n,int budget,Real normalScale);
 
 #endif
 
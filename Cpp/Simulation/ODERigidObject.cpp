@@ -65,6 +65,8 @@ void ODERigidObject::SetTransform(const RigidTransform& T)
   dMatrix3 rot;
   CopyMatrix(rot,T.R);
   dBodySetRotation(bodyID,rot);
+  //wake the body if it was sleeping
+  dBodyEnable(bodyID);
 }
 
 
@@ -93,6 +95,7 @@ void ODERigidObject::SetVelocity(const Vector3& w,const Vector3& v)
 
   dBodySetLinearVel(bodyID,vcom.x,vcom.y,vcom.z);
   dBodySetAngularVel(bodyID,w.x,w.y,w.z);
+  dBodyEnable(bodyID);
 }
 
 void ODERigidObject::GetVelocity(Vector3& w,Vector3& v) const
@@ -103,7 +103,7 @@ bool ODERobot::SelfCollisionsEnabled() const
   else return false;
 }
 
-void ODERobot::Create(int robotIndex,dWorldID worldID,bool useBoundaryLayer)
+void ODERobot::Create(int robotIndex,dWorldID worldID,bool useBoundaryLayer,int geometryLOD)
 {
   Clear();
 
@@ -200,7 +200,7 @@ void ODERobot::Create(int robotIndex,dWorldID worldID,bool useBoundaryLayer)
       bodyObjects[i].T.t = robot.links[baseLink].T_World * robot.links[baseLink].com; 
       if(!robot.IsGeometryEmpty(baseLink)) {
         bodyGeometry[i] = new ODEGeometry;
-        bodyGeometry[i]->Create(robot.geometry[baseLink].get(),spaceID,-robot.links[baseLink].com,useBoundaryLayer);
+        bodyGeometry[i]->Create(robot.GetGeometryLOD(baseLink,geometryLOD),spaceID,-robot.links[baseLink].com,useBoundaryLayer);
       }
     }
     else {
@@ -227,7 +227,7 @@ void ODERobot::Create(int robotIndex,dWorldID worldID,bool useBoundaryLayer)
 
         if(!robot.IsGeometryEmpty(link)) {
           //get transformed mesh
-          meshes[j] = Geometry::AnyGeometry3D(*robot.geometry[link]);
+          meshes[j] = Geometry::AnyGeometry3D(*robot.GetGeometryLOD(link,geometryLOD));
           meshes[j].Transform(Trel);
         }
       }
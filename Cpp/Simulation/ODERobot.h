@@ -33,7 +33,9 @@ class ODERobot
 
   ODERobot(Robot& robot);
   ~ODERobot();
-  void Create(int index,dWorldID worldID,bool useBoundaryLayer=true);
+  ///Creates the ODE bodies and geoms.  The geoms use the link geometries at
+  ///level of detail geometryLOD (see Robot::GetGeometryLOD)
+  void Create(int index,dWorldID worldID,bool useBoundaryLayer=true,int geometryLOD=0);
   void Clear();
   void EnableSelfCollisions(bool enabled);
   bool SelfCollisionsEnabled() const;
@@ -2,8 +2,10 @@
 #include "ODECommon.h"
 #include "ODECustomGeometry.h"
 #include "Settings.h"
+#include <Klampt/Modeling/ThreadPool.h>
 #include <list>
 #include <fstream>
+#include <mutex>
 //#include "Geometry/Clusterize.h"
 #include <KrisLibrary/geometry/ConvexHull2D.h>
 #include <KrisLibrary/statistics/KMeans.h>
@@ -25,29 +27,30 @@ DEFINE_LOGGER(ODESimulator)
 
 const static size_t gMaxKMeansSize = 5000;
 const static size_t gMaxHClusterSize = 2000;
-static size_t gPreclusterContacts = 0;
-static double gClusterTime = 0;
-static double gContactDetectTime = 0;
 
 //if at the beginning of the timestep, the two objects are touching with depth d in the boundary layer
 //of size m, but after the timestep, they are penetrating the boundary layer, the sim will roll back
 //until the new depth d' gives a remaining margin of (m-d') >= c*(m-d) where c<1 is this fraction.
 const static double gRollbackPenetrationFraction = 0.5;  
 
-//stuff for contact detection callbacks
-struct ODEContactResult
-{
-  dGeomID o1,o2;
-  vector<dContactGeom> contacts;
-  vector<dJointFeedback> feedback;
-  bool meshOverlap;
-};
-
 //this must be less than 2^16
 const static int max_contacts = 10000;
-static dContactGeom gContactTemp[max_contacts];
-static list<ODEContactResult> gContacts;
-static vector<ODEContactResult*> gContactsVector;
+
+//narrowphase is only distributed over threads if there are at least this many candidate pairs
+const static size_t gMinParallelCollisionPairs = 4;
+
+//contact histories of pairs out of contact are freed after this many steps
+const static int gMaxContactHistoryIdleSteps = 100;
+
+//ODE needs its collision / step caches allocated on every thread that uses it
+static void AllocateODEThreadData()
+{
+  static thread_local bool allocated = false;
+  if(!allocated) {
+    dAllocateODEDataForThread(dAllocateMaskAll);
+    allocated = true;
+  }
+}
 
 
 //Method for identifying objects via dGeomSetData/dGeomGetData
@@ -139,6 +142,10 @@ ODESimulatorSettings::ODESimulatorSettings()
   gravity[0] = gravity[1] = 0;
   gravity[2] = -9.8;
   autoDisable = false;
+  sleeping = false;
+  sleepTime = 0.5;
+  sleepLinearVelocity = 0.01;
+  sleepAngularVelocity = 0.05;
   defaultEnvPadding = gDefaultEnvPadding;
   defaultEnvSurface.kFriction = 0.3;
   defaultEnvSurface.kRestitution = 0.1;
@@ -157,6 +164,13 @@ ODESimulatorSettings::ODESimulatorSettings()
 
   maxContacts = 20;
   clusterNormalScale = 0.1;
+  contactReduction = ContactReductionKMeans;
+  contactBudget = 0;
+  contactMatchTolerance = 0.01;
+  collisionThreads = 1;
+  collisionCaching = false;
+  deterministic = false;
+  robotGeometryLOD = 0;
 
   errorReductionParameter = 0.95;
   dampedLeastSquaresParameter = 1e-6;
@@ -183,8 +197,10 @@ inline Real CFMFromSpring(Real timestep,Real kP,Real kD)
 struct ODEObject 
 {
   bool gODEInitialized;
+  std::mutex initMutex;
   ODEObject () : gODEInitialized(false) {}
   void Init() {
+    std::lock_guard<std::mutex> lock(initMutex);
     if(!gODEInitialized) {
       #ifdef dDOUBLE
       if(dCheckConfiguration("ODE_double_precision")!=1) {
@@ -222,6 +238,11 @@ ODESimulator::ODESimulator()
   simTime = 0;
   timestep = 0;
   lastStateTimestep = 0;
+  numPreclusterContacts = 0;
+  numContactAllocations = 0;
+  contactDetectTime = clusterTime = 0;
+  profile = NULL;
+  nextContactID = 0;
 
   g_ODE_object.Init();
   worldID = dWorldCreate();
@@ -296,6 +317,7 @@ void ODESimulator::AddTerrain(Terrain& terr)
   terrainGeoms.resize(terrainGeoms.size()+1);
   terrainGeoms.back() = new ODEGeometry;
   terrainGeoms.back()->Create(&*terr.geometry,envSpaceID,Vector3(Zero),settings.boundaryLayerCollisions);
+  dCustomGeometryFixTransform(terrainGeoms.back()->geom());
   terrainGeoms.back()->surf() = settings.defaultEnvSurface;
   terrainGeoms.back()->SetPadding(settings.defaultEnvPadding);
   if(!terr.kFriction.empty())
@@ -311,7 +333,7 @@ void ODESimulator::AddRobot(Robot& robot)
 {
   robots.push_back(new ODERobot(robot));
   //For some reason, self collisions don't work with hash spaces
-  robots.back()->Create(robots.size()-1,worldID,settings.boundaryLayerCollisions);
+  robots.back()->Create(robots.size()-1,worldID,settings.boundaryLayerCollisions,settings.robotGeometryLOD);
   //robotStances.resize(robots.size());
   for(size_t i=0;i<robot.links.size();i++)
     if(robots.back()->triMesh(i) && robots.back()->geom(i)) {
@@ -372,7 +394,7 @@ void GetCurrentCollisionStatus(ODESimulator* sim,
 {
   marginsRemaining.clear();
   concernedObjects.resize(0);
-  for(list<ODEContactResult>::iterator i=gContacts.begin();i!=gContacts.end();i++) {
+  for(ODEContactArena::iterator i=sim->contactResults.begin();i!=sim->contactResults.end();i++) {
     CollisionPair collpair(GeomDataToObjectID(dGeomGetData(i->o1)),GeomDataToObjectID(dGeomGetData(i->o2)));
     if(collpair.second < collpair.first) 
       swap(collpair.first,collpair.second);
@@ -469,7 +491,7 @@ bool ODESimulator::CheckObjectOverlap(vector<pair<ODEObjectID,ODEObjectID> >& ov
 {
   DetectCollisions();
   overlaps.resize(0);
-  for(list<ODEContactResult>::iterator i=gContacts.begin();i!=gContacts.end();i++) {
+  for(ODEContactArena::iterator i=contactResults.begin();i!=contactResults.end();i++) {
     CollisionPair collpair(GeomDataToObjectID(dGeomGetData(i->o1)),GeomDataToObjectID(dGeomGetData(i->o2)));
     if(collpair.second < collpair.first) 
       swap(collpair.first,collpair.second);
@@ -490,12 +512,11 @@ void ODESimulator::Step(Real dt)
     return;
   }
   Assert(timestep == 0);
+  AllocateODEThreadData();
 
 #if DO_TIMING
   Timer timer;
   double collisionTime,stepTime,updateTime;
-  gContactDetectTime = gClusterTime = 0;
-  gPreclusterContacts = 0;
 #endif // DO_TIMING
 
   Status status = StatusNormal;
@@ -548,6 +569,8 @@ void ODESimulator::Step(Real dt)
     //13. step(dt)
     //14. lastdt = dt
     vector<CollisionPair > concernedObjects;
+    //simulated time accepted by this call, for sleeping
+    Real acceptedTime = 0;
   	if(lastStateTimestep > 0) {
   		timestep=lastStateTimestep;
   		Real validTime = -lastStateTimestep, desiredTime = 0;
@@ -615,7 +638,7 @@ void ODESimulator::Step(Real dt)
             }
           }
         }
-  		  if(rollback && !lastState.IsOpen()) {
+  		  if(rollback && !lastState.valid) {
           LOG4CXX_INFO(GET_LOGGER(ODESimulator),"Rollback rejected because last state not saved");
           //getchar();
           rollback = false;
@@ -643,8 +666,7 @@ void ODESimulator::Step(Real dt)
           Assert(temp.IsOpen());
           WriteState(temp);
           
-          lastState.Seek(0,FILESEEKSTART);
-          ReadState_Internal(lastState);
+          RestoreSnapshot(lastState);
           printf("STARTING CONFIGURATION:\n");
           PrintStatus(this,concernedObjects,"Concerned objects originally","had");
           DetectCollisions();
@@ -684,8 +706,8 @@ void ODESimulator::Step(Real dt)
           
           didRollback = true;
           didAnyRollback = true;
-          lastState.Seek(0,FILESEEKSTART);
-          ReadState_Internal(lastState);
+          if(profile) profile->numRollbacks++;
+          RestoreSnapshot(lastState);
           timestep *= 0.5;
 
           //PrintStatus(this,concernedObjects,"Backed up colliding objects","to previous");
@@ -705,11 +727,7 @@ void ODESimulator::Step(Real dt)
   		  }
   		  else {
           //accept prior step
-          lastState.Close();
-          bool res = lastState.OpenData(FILEREAD | FILEWRITE);
-          Assert(res);
-          Assert(lastState.IsOpen());
-          WriteState_Internal(lastState);
+          SaveSnapshot(lastState);
           for(size_t i=0;i<concernedObjects.size();i++) {
             if(marginsRemaining.count(concernedObjects[i]) == 0) {
               LOG4CXX_INFO(GET_LOGGER(ODESimulator),"collision "<<ObjectName(concernedObjects[i].first)<<" - "<<ObjectName(concernedObjects[i].second)<<" erased entirely");
@@ -777,6 +795,7 @@ void ODESimulator::Step(Real dt)
   		if(didAnyRollback) {
   		  LOG4CXX_INFO(GET_LOGGER(ODESimulator),"Adaptive time step done, arrived at time "<<simTime);
   		}
+      acceptedTime = validTime + lastStateTimestep;
   	}
   	else {
   		//first step
@@ -789,7 +808,7 @@ void ODESimulator::Step(Real dt)
   		//determine whether to rollback
   		bool rollback = false;
   		map<CollisionPair,double> marginsRemaining;
-  		for(list<ODEContactResult>::iterator i=gContacts.begin();i!=gContacts.end();i++) {
+  		for(ODEContactArena::iterator i=contactResults.begin();i!=contactResults.end();i++) {
   		  CollisionPair collpair(GeomDataToObjectID(dGeomGetData(i->o1)),GeomDataToObjectID(dGeomGetData(i->o2)));
   		  if(i->meshOverlap) { 
   		    rollback = true;
@@ -824,12 +843,14 @@ void ODESimulator::Step(Real dt)
   		}
       
   		//save state
-  		lastState.Close();
-  		bool res = lastState.OpenData(FILEREAD | FILEWRITE);
-  		Assert(lastState.IsOpen());
-  		WriteState_Internal(lastState);
+  		SaveSnapshot(lastState);
   		lastMarginsRemaining = marginsRemaining;
   	}
+    //objects are put to sleep at the accepted state, which is saved again so
+    //that rollbacks keep them asleep
+    if(UpdateSleeping(acceptedTime))
+      SaveSnapshot(lastState);
+
     //do the prospective time step for the next call
     timestep = dt;
     SetupContactResponse();
@@ -848,7 +869,7 @@ void ODESimulator::Step(Real dt)
     DetectCollisions();
     SetupContactResponse();
 
-  //printf("  %d contacts detected\n",gContacts.size());
+  //printf("  %d contacts detected\n",contactResults.size());
 
 #if DO_TIMING
     collisionTime = timer.ElapsedTime();
@@ -857,13 +878,14 @@ void ODESimulator::Step(Real dt)
 
     StepDynamics(dt);
     simTime += dt;
+    UpdateSleeping(dt);
 
 #if DO_TIMING
     stepTime = timer.ElapsedTime();
     timer.Reset();
 #endif // DO_TIMING
 
-    for(list<ODEContactResult>::iterator i=gContacts.begin();i!=gContacts.end();i++) {
+    for(ODEContactArena::iterator i=contactResults.begin();i!=contactResults.end();i++) {
       if(i->meshOverlap) 
         status = StatusContactUnreliable;
     }
@@ -874,6 +896,8 @@ void ODESimulator::Step(Real dt)
   }
 
 
+  UpdateSleepingFeedback();
+
   //copy out feedback forces
   for(map<CollisionPair,ODEContactList>::iterator i=contactList.begin();i!=contactList.end();i++) {  
     ODEContactList& cl=i->second;
@@ -881,8 +905,8 @@ void ODESimulator::Step(Real dt)
     cl.penetrating = false;
     for(size_t j=0;j<cl.feedbackIndices.size();j++) {
       int k=cl.feedbackIndices[j];
-      Assert(k >= 0 && k < (int)gContactsVector.size());
-      ODEContactResult* cres = gContactsVector[k];
+      Assert(k >= 0 && k < (int)contactResults.size());
+      ODEContactResult* cres = &contactResults[k];
       if(cres->meshOverlap) cl.penetrating = true;
       Vector3 temp;
       for(size_t i=0;i<cres->feedback.size();i++) {
@@ -913,13 +937,13 @@ void ODESimulator::Step(Real dt)
     out<<"total,#preclusterContacts,#contacts,collision detection,contact detect,clustering,dynamics step,misc update"<<endl;
   }
   size_t nc = 0;
-  for(list<ODEContactResult>::iterator i=gContacts.begin();i!=gContacts.end();i++)
+  for(ODEContactArena::iterator i=contactResults.begin();i!=contactResults.end();i++)
     nc += i->contacts.size();
-  out<<collisionTime+stepTime+updateTime<<","<<gPreclusterContacts<<","<<nc<<","<<collisionTime<<","<<gContactDetectTime<<","<<gClusterTime<<","<<stepTime<<","<<updateTime<<endl;
+  out<<collisionTime+stepTime+updateTime<<","<<numPreclusterContacts<<","<<nc<<","<<collisionTime<<","<<contactDetectTime<<","<<clusterTime<<","<<stepTime<<","<<updateTime<<endl;
 #endif
 
   //KH: commented this out so GetContacts() would work for ContactSensor simulation.  Be careful about loading state
-  //gContacts.clear();
+  //contactResults.clear();
 }
 
 
@@ -1118,10 +1142,11 @@ void ClusterContactsMerge(vector<dContactGeom>& contacts,int maxClusters,Real cl
   }
 }
 
-void ClusterContactsKMeans(vector<dContactGeom>& contacts,int maxClusters,Real clusterNormalScale)
+void ClusterContactsKMeans(vector<dContactGeom>& contacts,int maxClusters,Real clusterNormalScale,ODEContactScratch& scratch)
 {
   if((int)contacts.size() <= maxClusters) return;
-  vector<Vector> pts(contacts.size());
+  vector<Vector>& pts = scratch.points;
+  pts.resize(contacts.size());
   for(size_t i=0;i<pts.size();i++) {
     pts[i].resize(7);
     pts[i][0] = contacts[i].pos[0];
@@ -1200,15 +1225,12 @@ bool depthGreater(const dContactGeom& a,const dContactGeom& b)
 }
 
 
-void ClusterContacts(vector<dContactGeom>& contacts,int maxClusters,Real clusterNormalScale)
+void ClusterContacts(vector<dContactGeom>& contacts,int maxClusters,Real clusterNormalScale,ODEContactScratch& scratch)
 {
-  gPreclusterContacts += contacts.size();
-
   //for really big contact sets, do a subsampling
   if(contacts.size()*maxClusters > gMaxKMeansSize && contacts.size()*contacts.size() > gMaxHClusterSize) {
     int minsize = Max((int)gMaxKMeansSize/maxClusters,(int)Sqrt(Real(gMaxHClusterSize)));
     LOG4CXX_INFO(GET_LOGGER(ODESimulator),"ClusterContacts: subsampling "<<contacts.size()<<" to "<<minsize<<" contacts");
-    vector<dContactGeom> subcontacts(minsize);
     //random subsample
     /*
     vector<int> subsample(contacts.size());
@@ -1217,18 +1239,19 @@ void ClusterContacts(vector<dContactGeom>& contacts,int maxClusters,Real cluster
     for(size_t i=0;i<subsample.size();i++)
       subcontacts[i] = contacts[subsample[i]];
     */
-    //deterministic subsample
+    //deterministic subsample, in place since each source index is >= i
+    size_t n = contacts.size();
     for(int i=0;i<minsize;i++) {
-      subcontacts[i] = contacts[(i*minsize)/contacts.size()];
+      contacts[i] = contacts[(i*n)/minsize];
     }
-    swap(subcontacts,contacts);
+    contacts.resize(minsize);
   }
   size_t hclusterSize = contacts.size()*contacts.size();
   size_t kmeansSize = contacts.size()*maxClusters;
   //if(hclusterSize < gMaxHClusterSize)
   //ClusterContactsMerge(contacts,maxClusters,clusterNormalScale);
   //else 
-  ClusterContactsKMeans(contacts,maxClusters,clusterNormalScale);
+  ClusterContactsKMeans(contacts,maxClusters,clusterNormalScale,scratch);
   /*
   //TEST: contact depth sorting
   if(contacts.size() > maxClusters) {
@@ -1238,6 +1261,104 @@ void ClusterContacts(vector<dContactGeom>& contacts,int maxClusters,Real cluster
   */
 }
 
+//hash of a cell (6 indices) in the (position, scaled normal) voxel grid
+static size_t HashContactVoxel(const int* v)
+{
+  size_t h = 0;
+  for(int i=0;i<6;i++)
+    h = h*1000003 ^ (size_t)(unsigned int)v[i];
+  return h;
+}
+
+//Reduces contacts to at most maxClusters by binning them in a voxel grid over
+//position and scaled normal space, then keeping the deepest contact in each
+//occupied cell.  Runs in expected linear time, and the result only depends on
+//the input order.  Unlike k-means, the kept contacts are original contacts,
+//so they lie on the contact surface and preserve its extent.
+void ClusterContactsVoxelGrid(vector<dContactGeom>& contacts,int maxClusters,Real clusterNormalScale,ODEContactScratch& scratch)
+{
+  if((int)contacts.size() <= maxClusters) return;
+  if(maxClusters <= 0) {
+    contacts.resize(0);
+    return;
+  }
+  Vector3 bmin,bmax;
+  CopyVector(bmin,contacts[0].pos);
+  bmax = bmin;
+  for(size_t i=1;i<contacts.size();i++) {
+    Vector3 x;
+    CopyVector(x,contacts[i].pos);
+    for(int k=0;k<3;k++) {
+      bmin[k] = Min(bmin[k],x[k]);
+      bmax[k] = Max(bmax[k],x[k]);
+    }
+  }
+  //contact sets are usually near-planar, so pick the initial cell size so
+  //that the two largest extents split into about maxClusters cells
+  Real ext[3] = {bmax.x-bmin.x,bmax.y-bmin.y,bmax.z-bmin.z};
+  sort(ext,ext+3);
+  Real h;
+  if(ext[1] > 0) h = Sqrt(ext[2]*ext[1]/maxClusters);
+  else if(ext[2] > 0) h = ext[2]/maxClusters;
+  else h = 1e-3;
+  h = Max(h,Real(1e-6));
+
+  //cells are found with an open addressing hash table of cell indices,
+  //keyed by the voxel of each cell's representative
+  size_t n = contacts.size();
+  vector<int>& voxels = scratch.voxels;
+  vector<int>& table = scratch.cellTable;
+  vector<int>& representative = scratch.representatives;
+  voxels.resize(n*6);
+  size_t tableSize = 1;
+  while(tableSize < 2*n) tableSize *= 2;
+  table.resize(tableSize);
+  for(int iters=0;iters<64;iters++) {
+    fill(table.begin(),table.end(),-1);
+    representative.resize(0);
+    for(size_t i=0;i<n;i++) {
+      int* v = &voxels[i*6];
+      for(int k=0;k<3;k++) {
+        v[k] = (int)Floor((contacts[i].pos[k]-bmin[k])/h);
+        v[k+3] = (int)Floor(contacts[i].normal[k]*clusterNormalScale/h);
+      }
+      size_t slot = HashContactVoxel(v) & (tableSize-1);
+      while(table[slot] >= 0 && !equal(v,v+6,&voxels[representative[table[slot]]*6]))
+        slot = (slot+1) & (tableSize-1);
+      if(table[slot] < 0) {
+        table[slot] = (int)representative.size();
+        representative.push_back((int)i);
+      }
+      else {
+        int& rep = representative[table[slot]];
+        if(contacts[i].depth > contacts[rep].depth) rep = (int)i;
+      }
+    }
+    if((int)representative.size() <= maxClusters) break;
+    h *= 1.5;
+  }
+  if((int)representative.size() > maxClusters) {
+    //should only happen with degenerate data, keep the deepest
+    sort(representative.begin(),representative.end(),[&](int a,int b) { return contacts[a].depth > contacts[b].depth || (contacts[a].depth == contacts[b].depth && a < b); });
+    representative.resize(maxClusters);
+    sort(representative.begin(),representative.end());
+  }
+  //compact in place.  Each cell's representative is at or after the cell's
+  //first contact, so representative[i] >= i.
+  for(size_t i=0;i<representative.size();i++)
+    contacts[i] = contacts[representative[i]];
+  contacts.resize(representative.size());
+}
+
+//Reduces contacts to at most maxClusters using the method in settings
+void ReduceContacts(vector<dContactGeom>& contacts,int maxClusters,const ODESimulatorSettings& settings,ODEContactScratch& scratch)
+{
+  if(settings.contactReduction == ODESimulatorSettings::ContactReductionVoxelGrid)
+    ClusterContactsVoxelGrid(contacts,maxClusters,settings.clusterNormalScale,scratch);
+  else
+    ClusterContacts(contacts,maxClusters,settings.clusterNormalScale,scratch);
+}
+
 void MergeContacts(vector<dContactGeom>& contacts,double posTolerance,double oriTolerance)
 {
   EqualPlane eq(posTolerance,oriTolerance);
@@ -1262,129 +1383,152 @@ void MergeContacts(vector<dContactGeom>& contacts,double posTolerance,double ori
   swap(contacts,res);
 }
 
-void collisionCallback(void *data, dGeomID o1, dGeomID o2)
+//the data pointer passed to broadphaseCallback
+struct BroadphaseCallbackData
 {
-  Assert(!dGeomIsSpace(o1) && !dGeomIsSpace(o2));
+  ODESimulator* sim;
+  //set for robot self collisions, NULL otherwise
+  ODERobot* selfRobot;
+  int group;
+};
 
-  dBodyID b1 = dGeomGetBody(o1);
-  dBodyID b2 = dGeomGetBody(o2);
+//collects the candidate pairs in sim->collisionCandidates
+static bool GeomAsleep(ODESimulator* sim,dGeomID o)
+{
+  ODEObjectID id = GeomDataToObjectID(dGeomGetData(o));
+  return id.IsRigidObject() && sim->ObjectAsleep(id.index);
+}
 
-  // take care of disabled bodies
-  if( b1 && !b2 && !dBodyIsEnabled(b1) )
-   return; // b1 is disabled and collides with no-body
-  if( b2 && !b1 && !dBodyIsEnabled(b2) )
-    return; // b2 is disabled and collides with no-body
-  if( b1 && b2 && !dBodyIsEnabled(b1) && !dBodyIsEnabled(b2) )
-   return; // both b1 and b2 are disabled
-  
-  ClearCustomGeometryCollisionReliableFlag();
-  int num = dCollide (o1,o2,max_contacts,gContactTemp,sizeof(dContactGeom));
-  vector<dContactGeom> vcontact(num);
-  int numOk = 0;
-  for(int i=0;i<num;i++) {
-    if(gContactTemp[i].g1 == o2 && gContactTemp[i].g2 == o1) {
-      LOG4CXX_INFO(GET_LOGGER(ODESimulator),"Swapping contact... should this be reached?");
-      std::swap(gContactTemp[i].g1,gContactTemp[i].g2);
-      for(int k=0;k<3;k++) gContactTemp[i].normal[k]*=-1.0;
-      std::swap(gContactTemp[i].side1,gContactTemp[i].side2);
-    }
-    Assert(gContactTemp[i].g1 == o1);
-    Assert(gContactTemp[i].g2 == o2);
-    vcontact[numOk] = gContactTemp[i];
-    const dReal* n=vcontact[numOk].normal;
-    if(Sqr(n[0])+Sqr(n[1])+Sqr(n[2]) < 0.9 || Sqr(n[0])+Sqr(n[1])+Sqr(n[2]) > 1.2) {
-      //GIMPACT will report this
-      //printf("Warning, degenerate contact with normal %f %f %f\n",vcontact[numOk].normal[0],vcontact[numOk].normal[1],vcontact[numOk].normal[2]);
-      continue;
+void broadphaseCallback(void *data, dGeomID o1, dGeomID o2)
+{
+  BroadphaseCallbackData* cbdata = reinterpret_cast<BroadphaseCallbackData*>(data);
+  Assert(!dGeomIsSpace(o1) && !dGeomIsSpace(o2));
+  if(cbdata->selfRobot) {
+    ODERobot* robot = cbdata->selfRobot;
+    int link1 = GeomDataToRobotLinkIndex(dGeomGetData(o1));
+    int link2 = GeomDataToRobotLinkIndex(dGeomGetData(o2));
+    Assert(link1 >= 0 && link1 < (int)robot->robot.links.size());
+    Assert(link2 >= 0 && link2 < (int)robot->robot.links.size());
+    if(robot->robot.selfCollisions(link1,link2)==NULL && robot->robot.selfCollisions(link2,link1)==NULL) {
+      return;
     }
-    numOk++;
-  }
-  vcontact.resize(numOk);
-  
-  if(vcontact.size() > 0) {
-    gContacts.push_back(ODEContactResult());
-    gContacts.back().o1 = o1;
-    gContacts.back().o2 = o2;
-    swap(gContacts.back().contacts,vcontact);
-    gContacts.back().meshOverlap = !GetCustomGeometryCollisionReliableFlag();
   }
   else {
-    if(!GetCustomGeometryCollisionReliableFlag()) {
-      LOG4CXX_WARN(GET_LOGGER(ODESimulator),"collision callback: meshes overlapped, but no contacts were generated?");
-      gContacts.push_back(ODEContactResult());
-      gContacts.back().o1 = o1;
-      gContacts.back().o2 = o2;
-      swap(gContacts.back().contacts,vcontact);
-      gContacts.back().meshOverlap = !GetCustomGeometryCollisionReliableFlag();
-    }
+    dBodyID b1 = dGeomGetBody(o1);
+    dBodyID b2 = dGeomGetBody(o2);
+
+    // take care of disabled bodies.  Sleeping objects keep their contacts,
+    // so that they are reported and keep their contact islands together
+    bool disabled1 = (b1 && !dBodyIsEnabled(b1) && !GeomAsleep(cbdata->sim,o1));
+    bool disabled2 = (b2 && !dBodyIsEnabled(b2) && !GeomAsleep(cbdata->sim,o2));
+    if( disabled1 && !b2 )
+     return; // b1 is disabled and collides with no-body
+    if( disabled2 && !b1 )
+      return; // b2 is disabled and collides with no-body
+    if( disabled1 && disabled2 )
+     return; // both b1 and b2 are disabled
   }
+
+  ODECollisionCandidate c;
+  c.o1 = o1;
+  c.o2 = o2;
+  c.group = cbdata->group;
+  c.self = (cbdata->selfRobot != NULL);
+  cbdata->sim->collisionCandidates.push_back(c);
 }
 
-void selfCollisionCallback(void *data, dGeomID o1, dGeomID o2)
+//Orders candidate pairs by group, then by the object IDs of their geoms
+bool CandidateLess(const ODECollisionCandidate& a,const ODECollisionCandidate& b)
 {
-  ODERobot* robot = reinterpret_cast<ODERobot*>(data);
-  Assert(!dGeomIsSpace(o1) && !dGeomIsSpace(o2));
-  int link1 = GeomDataToRobotLinkIndex(dGeomGetData(o1));
-  int link2 = GeomDataToRobotLinkIndex(dGeomGetData(o2));
-  Assert(link1 >= 0 && link1 < (int)robot->robot.links.size());
-  Assert(link2 >= 0 && link2 < (int)robot->robot.links.size());
-  if(robot->robot.selfCollisions(link1,link2)==NULL && robot->robot.selfCollisions(link2,link1)==NULL) {
-    return;
+  if(a.group != b.group) return a.group < b.group;
+  ODEObjectID a1 = GeomDataToObjectID(dGeomGetData(a.o1)), b1 = GeomDataToObjectID(dGeomGetData(b.o1));
+  if(a1 < b1) return true;
+  if(b1 < a1) return false;
+  return GeomDataToObjectID(dGeomGetData(a.o2)) < GeomDataToObjectID(dGeomGetData(b.o2));
+}
+
+//Puts the candidate pairs in a canonical order.  Each pair is oriented so
+//that o1 has the smaller object ID, then the pairs are sorted within their
+//groups.  Each geom has a unique object ID, so the order is total.
+void SortCollisionCandidates(vector<ODECollisionCandidate>& candidates)
+{
+  for(size_t i=0;i<candidates.size();i++) {
+    ODECollisionCandidate& c = candidates[i];
+    if(GeomDataToObjectID(dGeomGetData(c.o2)) < GeomDataToObjectID(dGeomGetData(c.o1)))
+      std::swap(c.o1,c.o2);
   }
-  
+  sort(candidates.begin(),candidates.end(),CandidateLess);
+}
+
+//Runs the narrowphase test for a candidate pair, using contactTemp as
+//scratch space.  Returns true if a result should be recorded in res.
+bool NarrowphaseCollide(const ODECollisionCandidate& c,vector<dContactGeom>& contactTempVec,ODEContactResult& res)
+{
+  dGeomID o1 = c.o1, o2 = c.o2;
   ClearCustomGeometryCollisionReliableFlag();
-  int num = dCollide (o1,o2,max_contacts,gContactTemp,sizeof(dContactGeom));
-  vector<dContactGeom> vcontact(num);
+  if(contactTempVec.empty()) contactTempVec.resize(max_contacts);
+  dContactGeom* contactTemp = &contactTempVec[0];
+  int num = dCollide (o1,o2,max_contacts,contactTemp,sizeof(dContactGeom));
+  //fill res.contacts in place so that it keeps its storage across steps
+  vector<dContactGeom>& vcontact = res.contacts;
+  vcontact.resize(num);
   int numOk = 0;
   for(int i=0;i<num;i++) {
-    if(gContactTemp[i].g1 == o2 && gContactTemp[i].g2 == o1) {
-      LOG4CXX_INFO(GET_LOGGER(ODESimulator),"Swapping contact... shouldn't be here?");
-      std::swap(gContactTemp[i].g1,gContactTemp[i].g2);
-      for(int k=0;k<3;k++) gContactTemp[i].normal[k]*=-1.0;
-      std::swap(gContactTemp[i].side1,gContactTemp[i].side2);
+    if(contactTemp[i].g1 == o2 && contactTemp[i].g2 == o1) {
+      LOG4CXX_INFO(GET_LOGGER(ODESimulator),"Swapping contact... should this be reached?");
+      std::swap(contactTemp[i].g1,contactTemp[i].g2);
+      for(int k=0;k<3;k++) contactTemp[i].normal[k]*=-1.0;
+      std::swap(contactTemp[i].side1,contactTemp[i].side2);
     }
-    Assert(gContactTemp[i].g1 == o1);
-    Assert(gContactTemp[i].g2 == o2);
-    vcontact[numOk] = gContactTemp[i];
+    Assert(contactTemp[i].g1 == o1);
+    Assert(contactTemp[i].g2 == o2);
+    vcontact[numOk] = contactTemp[i];
     const dReal* n=vcontact[numOk].normal;
     if(Sqr(n[0])+Sqr(n[1])+Sqr(n[2]) < 0.9 || Sqr(n[0])+Sqr(n[1])+Sqr(n[2]) > 1.2) {
+      if(!c.self) {
+        //GIMPACT will report this
+        //printf("Warning, degenerate contact with normal %f %f %f\n",vcontact[numOk].normal[0],vcontact[numOk].normal[1],vcontact[numOk].normal[2]);
+        continue;
+      }
       LOG4CXX_WARN(GET_LOGGER(ODESimulator),"Warning, degenerate contact with normal "<<vcontact[numOk].normal[0]<<" "<<vcontact[numOk].normal[1]<<" "<<vcontact[numOk].normal[2]);
-      //continue;
     }
     numOk++;
   }
-  //TEMP: printing self collisions
-  //if(numOk > 0) printf("%d self collision contacts between links %d and %d\n",numOk,(int)link1,(int)link2);
   vcontact.resize(numOk);
-  
-  if(kMergeContacts && numOk > 0) {
-    MergeContacts(vcontact,kContactPosMergeTolerance,kContactOriMergeTolerance);
-  }
 
-  if(vcontact.size() > 0) {
+  if(c.self) {
+    //TEMP: printing self collisions
+    //if(numOk > 0) printf("%d self collision contacts between links %d and %d\n",numOk,(int)link1,(int)link2);
+    if(kMergeContacts && numOk > 0) {
+      MergeContacts(vcontact,kContactPosMergeTolerance,kContactOriMergeTolerance);
+    }
+    if(vcontact.empty()) return false;
     if(numOk != (int)vcontact.size())
-    	//// The int type is not guaranteed to be big enough, use intptr_t
-		//cout<<numOk<<" contacts between env "<<(int)dGeomGetData(o2)<<" and body "<<(int)dGeomGetData(o1)<<"  (clustered to "<<vcontact.size()<<")"<<endl;
       LOG4CXX_INFO(GET_LOGGER(ODESimulator),numOk<<" contacts between link "<<GeomDataToRobotLinkIndex(dGeomGetData(o2))<<" and link "<<GeomDataToRobotLinkIndex(dGeomGetData(o1))<<"  (clustered to "<<vcontact.size()<<")");
-    gContacts.push_back(ODEContactResult());
-    gContacts.back().o1 = o1;
-    gContacts.back().o2 = o2;
-    swap(gContacts.back().contacts,vcontact);
-    gContacts.back().meshOverlap = !GetCustomGeometryCollisionReliableFlag();
   }
+  else if(vcontact.empty()) {
+    if(GetCustomGeometryCollisionReliableFlag()) return false;
+    LOG4CXX_WARN(GET_LOGGER(ODESimulator),"collision callback: meshes overlapped, but no contacts were generated?");
+  }
+  res.o1 = o1;
+  res.o2 = o2;
+  res.meshOverlap = !GetCustomGeometryCollisionReliableFlag();
+  return true;
 }
 
-void ProcessContacts(list<ODEContactResult>::iterator start,list<ODEContactResult>::iterator end,const ODESimulatorSettings& settings,bool aggregateCount=true)
+//Merges / clusters contacts in the range [start,end).  Returns the number of contacts that were passed to clustering
+size_t ProcessContacts(ODEContactArena::iterator start,ODEContactArena::iterator end,const ODESimulatorSettings& settings,ODEContactScratch& scratch,bool aggregateCount=true)
 {
+  size_t numClustered = 0;
   if(kMergeContacts) {
-    for(list<ODEContactResult>::iterator j=start;j!=end;j++) 
+    for(ODEContactArena::iterator j=start;j!=end;j++) 
       MergeContacts(j->contacts,kContactPosMergeTolerance,kContactOriMergeTolerance);
   }
 
   static bool warnedContacts = false;
   if(aggregateCount) {
     int numContacts = 0;
-    for(list<ODEContactResult>::iterator j=start;j!=end;j++) 
+    for(ODEContactArena::iterator j=start;j!=end;j++) 
       numContacts += (int)j->contacts.size();
     if(numContacts > settings.maxContacts) {
       //printf("Warning: %d robot-env contacts > maximum %d, may crash\n",numContacts,settings.maxContacts);
@@ -1395,15 +1539,16 @@ void ProcessContacts(list<ODEContactResult>::iterator start,list<ODEContactResul
 	warnedContacts = true;
       }
       Real scale = Real(settings.maxContacts)/numContacts;
-      for(list<ODEContactResult>::iterator j=start;j!=end;j++) {
+      for(ODEContactArena::iterator j=start;j!=end;j++) {
 	int n=(int)Ceil(Real(j->contacts.size())*scale);
 	//printf("Clustering %d->%d\n",j->contacts.size(),n);
-	ClusterContacts(j->contacts,n,settings.clusterNormalScale);
+	numClustered += j->contacts.size();
+	ReduceContacts(j->contacts,n,settings,scratch);
       }
     }
   }
   else {
-    for(list<ODEContactResult>::iterator j=start;j!=end;j++) {
+    for(ODEContactArena::iterator j=start;j!=end;j++) {
       if(settings.maxContacts > 50) {
 	if(!warnedContacts) {
 	  LOG4CXX_WARN(GET_LOGGER(ODESimulator),"Max contacts > 50, may crash!");
@@ -1411,11 +1556,14 @@ void ProcessContacts(list<ODEContactResult>::iterator start,list<ODEContactResul
 	}
 	warnedContacts = true;
       }
-      for(list<ODEContactResult>::iterator j=start;j!=end;j++) {
-	ClusterContacts(j->contacts,settings.maxContacts,settings.clusterNormalScale);
+      for(ODEContactArena::iterator j=start;j!=end;j++) {
+	if((int)j->contacts.size() > settings.maxContacts)
+	  numClustered += j->contacts.size();
+	ReduceContacts(j->contacts,settings.maxContacts,settings,scratch);
       }
     }
   }
+  return numClustered;
 }
 
 void ODESimulator::ClearCollisions()
@@ -1482,13 +1630,83 @@ void ODESimulator::SetupContactResponse()
   //clear global ODE collider feedback stuff
   dJointGroupEmpty(contactGroupID);
 
+  size_t numAllocations = AssignContactIDs();
+
   int index=0;
-  gContactsVector.resize(gContacts.size());
-  for(list<ODEContactResult>::iterator i=gContacts.begin();i!=gContacts.end();i++) {
-    gContactsVector[index] = &(*i);
+  for(ODEContactArena::iterator i=contactResults.begin();i!=contactResults.end();i++) {
+    if(i->feedback.capacity() < i->contacts.size()) numAllocations++;
     SetupContactResponse(GeomDataToObjectID(dGeomGetData(i->o1)),GeomDataToObjectID(dGeomGetData(i->o2)),index,*i);
     index++;
   }
+  numContactAllocations += numAllocations;
+  if(profile) profile->numAllocations += numAllocations;
+}
+
+//Gives each contact in res the id of the closest matching contact of the
+//previous step, or a new id if there is none.  Each previous contact is
+//matched at most once.
+static void MatchContacts(const ODEContactHistory* prev,ODEContactResult& res,Real tolerance,int& nextID,vector<char>& taken)
+{
+  res.ids.resize(res.contacts.size());
+  size_t n = (prev ? prev->contacts.size() : 0);
+  taken.resize(0);
+  taken.resize(n,0);
+  Real tol2 = Sqr(tolerance);
+  for(size_t k=0;k<res.contacts.size();k++) {
+    const dContactGeom& c = res.contacts[k];
+    int best = -1;
+    Real bestd2 = tol2;
+    for(size_t j=0;j<n;j++) {
+      if(taken[j]) continue;
+      const dContactGeom& p = prev->contacts[j];
+      Real d2 = Sqr(c.pos[0]-p.pos[0])+Sqr(c.pos[1]-p.pos[1])+Sqr(c.pos[2]-p.pos[2]);
+      if(d2 > bestd2) continue;
+      if(c.normal[0]*p.normal[0]+c.normal[1]*p.normal[1]+c.normal[2]*p.normal[2] < 0.9) continue;
+      best = (int)j;
+      bestd2 = d2;
+    }
+    if(best >= 0) {
+      taken[best] = 1;
+      res.ids[k] = prev->ids[best];
+    }
+    else
+      res.ids[k] = nextID++;
+  }
+}
+
+size_t ODESimulator::AssignContactIDs()
+{
+  size_t numAllocations = 0;
+  for(map<pair<dGeomID,dGeomID>,ODEContactHistory>::iterator e=contactHistory.begin();e!=contactHistory.end();e++)
+    e->second.used = false;
+  for(ODEContactArena::iterator i=contactResults.begin();i!=contactResults.end();i++) {
+    pair<dGeomID,dGeomID> key(i->o1,i->o2);
+    map<pair<dGeomID,dGeomID>,ODEContactHistory>::iterator e = contactHistory.find(key);
+    if(e == contactHistory.end()) {
+      e = contactHistory.insert(make_pair(key,ODEContactHistory())).first;
+      numAllocations++;
+    }
+    ODEContactHistory& h = e->second;
+    if(i->ids.capacity() < i->contacts.size()) numAllocations++;
+    MatchContacts(&h,*i,settings.contactMatchTolerance,nextContactID,contactScratch.taken);
+    if(h.contacts.capacity() < i->contacts.size()) numAllocations++;
+    h.contacts.assign(i->contacts.begin(),i->contacts.end());
+    h.ids.assign(i->ids.begin(),i->ids.end());
+    h.used = true;
+    h.idleSteps = 0;
+  }
+  //pairs no longer in contact keep their storage, with no contacts to
+  //match, until they have been idle for a while
+  for(map<pair<dGeomID,dGeomID>,ODEContactHistory>::iterator e=contactHistory.begin();e!=contactHistory.end();) {
+    if(e->second.used) { e++; continue; }
+    e->second.contacts.resize(0);
+    e->second.ids.resize(0);
+    e->second.feedbackIDs.resize(0);
+    e->second.feedback.resize(0);
+    if(++e->second.idleSteps > gMaxContactHistoryIdleSteps) contactHistory.erase(e++);
+    else e++;
+  }
+  return numAllocations;
 }
 
 void ODESimulator::SetupContactResponse(const ODEObjectID& a,const ODEObjectID& b,int feedbackIndex,ODEContactResult& c)
@@ -1557,122 +1775,248 @@ void ODESimulator::SetupContactResponse(const ODEObjectID& a,const ODEObjectID&
       if(reverse)
 	cl->points[k+start].n.inplaceNegative();
     }
-    Assert(feedbackIndex >= 0 && feedbackIndex < (int)gContacts.size());
+    cl->ids.insert(cl->ids.end(),c.ids.begin(),c.ids.end());
+    Assert(feedbackIndex >= 0 && feedbackIndex < (int)contactResults.size());
     cl->feedbackIndices.push_back(feedbackIndex);
   }
 }
 
 void dCustomGeometryAABB(dGeomID o,dReal aabb[6]);
 
+//Gets the pose, geometry, and margin of a geom, for contact caching
+static void GetGeomState(dGeomID g,ODEGeomState& state)
+{
+  copy(dGeomGetPosition(g),dGeomGetPosition(g)+3,state.pose);
+  copy(dGeomGetRotation(g),dGeomGetRotation(g)+12,state.pose+3);
+  state.geometry = dCustomGeometryGetGeometry(g);
+  state.margin = 0;
+  if(state.geometry) state.margin = state.geometry->margin + dGetCustomGeometryData(g)->outerMargin;
+}
+
+//Copies the narrowphase contacts of src into dst, reusing dst's storage.
+//Feedback and ids are filled in later, so they are not copied.
+static void CopyContacts(const ODEContactResult& src,ODEContactResult& dst)
+{
+  dst.o1 = src.o1;
+  dst.o2 = src.o2;
+  dst.meshOverlap = src.meshOverlap;
+  dst.contacts.assign(src.contacts.begin(),src.contacts.end());
+}
+
+static bool SameState(const ODEGeomState& a,const ODEGeomState& b)
+{
+  if(a.geometry != b.geometry || a.margin != b.margin) return false;
+  for(int i=0;i<15;i++)
+    if(a.pose[i] != b.pose[i]) return false;
+  return true;
+}
+
+void SimulationProfile::Clear()
+{
+  numSteps = numRollbacks = numCollisionChecks = 0;
+  numCollisionPairs = numCachedCollisionPairs = numPreclusterContacts = numContacts = numAllocations = 0;
+  totalTime = collisionTime = clusterTime = dynamicsTime = 0;
+  controllerTime = sensorTime = hookTime = 0;
+}
+
 void ODESimulator::DetectCollisions()
 {
-#if DO_TIMING
   Timer timer;
-#endif //DO_TIMING
-
-  gContacts.clear();
-  gContactsVector.resize(0);
 
-  CollisionPair cindex;
-  int jcount=0;
+  AllocateODEThreadData();
+  contactResults.Clear();
+  collisionCandidates.resize(0);
+  numPreclusterContacts = 0;
+  numContactAllocations = 0;
+  contactDetectTime = clusterTime = 0;
+  size_t arenaAllocations = contactResults.numAllocations;
+
+  //broadphase: collect candidate pairs.  Each group is clustered separately,
+  //and only the first (object-environment) group is not aggregated.
+  vector<bool>& groupAggregate = collisionGroupAggregate;
+  groupAggregate.resize(0);
+  BroadphaseCallbackData cbdata;
+  cbdata.sim = this;
+  cbdata.selfRobot = NULL;
   if(settings.rigidObjectCollisions) {
     //call the collision routine between objects and the world
-    dSpaceCollide(envSpaceID,(void*)this,collisionCallback);
-
-#if DO_TIMING
-    gContactDetectTime += timer.ElapsedTime();
-    timer.Reset();
-#endif //DO_TIMING
-    
-    ProcessContacts(gContacts.begin(),gContacts.end(),settings,false);
-
-#if DO_TIMING
-    gClusterTime += timer.ElapsedTime();
-    timer.Reset();
-#endif //DO_TIMING
+    cbdata.group = (int)groupAggregate.size();
+    groupAggregate.push_back(false);
+    dSpaceCollide(envSpaceID,(void*)&cbdata,broadphaseCallback);
   }
-
-  //do robot-environment collisions
   for(size_t i=0;i<robots.size();i++) {
-#if DO_TIMING
-    timer.Reset();
-#endif //DO_TIMING
-
-    //call the collision routine between the robot and the world
-    bool gContactsEmpty = gContacts.empty();
-    list<ODEContactResult>::iterator gContactStart;
-    if(!gContactsEmpty) gContactStart = --gContacts.end();
-    dSpaceCollide2((dxGeom *)robots[i]->space(),(dxGeom *)envSpaceID,(void*)this,collisionCallback);
-    if(!gContactsEmpty) ++gContactStart;
-    else gContactStart = gContacts.begin();
-
-#if DO_TIMING
-    gContactDetectTime += timer.ElapsedTime();
-    timer.Reset();
-#endif //DO_TIMING
-
-    ProcessContacts(gContactStart,gContacts.end(),settings);
-
-#if DO_TIMING
-    gClusterTime += timer.ElapsedTime();
-    timer.Reset();
-#endif //DO_TIMING
+    //robot-environment collisions
+    cbdata.group = (int)groupAggregate.size();
+    groupAggregate.push_back(true);
+    dSpaceCollide2((dxGeom *)robots[i]->space(),(dxGeom *)envSpaceID,(void*)&cbdata,broadphaseCallback);
 
     if(settings.robotSelfCollisions) {
       robots[i]->EnableSelfCollisions(true);
-
-#if DO_TIMING
-      timer.Reset();
-#endif
-
-      gContactsEmpty = gContacts.empty();
-      if(!gContactsEmpty) gContactStart = --gContacts.end();
-      //call the self collision routine for the robot
-      dSpaceCollide(robots[i]->space(),(void*)robots[i],selfCollisionCallback);
-      if(!gContactsEmpty) ++gContactStart;
-      else gContactStart = gContacts.begin();
-
-#if DO_TIMING
-      gContactDetectTime += timer.ElapsedTime();
-      timer.Reset();
-#endif //DO_TIMING
-      
-      ProcessContacts(gContactStart,gContacts.end(),settings);
-
-#if DO_TIMING
-      gClusterTime += timer.ElapsedTime();
-      timer.Reset();
-#endif //DO_TIMING
+      cbdata.group = (int)groupAggregate.size();
+      groupAggregate.push_back(true);
+      cbdata.selfRobot = robots[i];
+      dSpaceCollide(robots[i]->space(),(void*)&cbdata,broadphaseCallback);
+      cbdata.selfRobot = NULL;
     }
 
     if(settings.robotRobotCollisions) {    
       for(size_t k=i+1;k<robots.size();k++) {
-	cindex.second = ODEObjectID(1,k);
+        cbdata.group = (int)groupAggregate.size();
+        groupAggregate.push_back(true);
+        dSpaceCollide2((dxGeom *)robots[i]->space(),(dxGeom *)robots[k]->space(),(void*)&cbdata,broadphaseCallback);
+      }
+    }
+  }
 
-#if DO_TIMING
-    timer.Reset();
-#endif //DO_TIMING
+  //the order of the callbacks depends on the layout of ODE's spaces
+  if(settings.deterministic) SortCollisionCandidates(collisionCandidates);
+
+  //reuse the results of pairs that have not moved since the last call
+  size_t numCandidates = collisionCandidates.size();
+  vector<ODEContactResult>& results = narrowphaseResults;
+  vector<char>& hit = narrowphaseHits;
+  vector<int>& uncached = narrowphasePairs;
+  if(results.size() < numCandidates) results.resize(numCandidates);
+  hit.resize(0);
+  hit.resize(numCandidates,0);
+  uncached.resize(0);
+  if(settings.collisionCaching) {
+    narrowphaseStates.resize(numCandidates*2);
+    for(map<pair<dGeomID,dGeomID>,ODECachedContact>::iterator e=contactCache.begin();e!=contactCache.end();e++)
+      e->second.used = false;
+    for(size_t i=0;i<numCandidates;i++) {
+      const ODECollisionCandidate& c = collisionCandidates[i];
+      ODEGeomState* state = &narrowphaseStates[i*2];
+      GetGeomState(c.o1,state[0]);
+      GetGeomState(c.o2,state[1]);
+      map<pair<dGeomID,dGeomID>,ODECachedContact>::iterator e = contactCache.find(pair<dGeomID,dGeomID>(c.o1,c.o2));
+      if(e != contactCache.end() && SameState(e->second.state1,state[0]) && SameState(e->second.state2,state[1])) {
+        e->second.used = true;
+        hit[i] = e->second.hit;
+        if(hit[i]) {
+          if(results[i].contacts.capacity() < e->second.result.contacts.size()) numContactAllocations++;
+          CopyContacts(e->second.result,results[i]);
+        }
+      }
+      else
+        uncached.push_back((int)i);
+    }
+  }
+  else {
+    contactCache.clear();
+    for(size_t i=0;i<numCandidates;i++) uncached.push_back((int)i);
+  }
+
+  //narrowphase: test the remaining pairs, possibly in parallel.  Pairs may
+  //share a geom (e.g., the terrain), so the collision data of each geometry
+  //is built and its transform is updated up front, and the threads only
+  //read them.  If several geoms share one collision geometry (e.g.,
+  //identical objects loaded from the same file) the transforms must be set
+  //per pair, so the pairs are tested serially.
+  int numUncached = (int)uncached.size();
+  vector<pair<AnyCollisionGeometry3D*,dGeomID> >& geoms = narrowphaseGeometries;
+  geoms.resize(0);
+  for(int i=0;i<numUncached;i++) {
+    const ODECollisionCandidate& c = collisionCandidates[uncached[i]];
+    AnyCollisionGeometry3D* g1 = dCustomGeometryGetGeometry(c.o1);
+    AnyCollisionGeometry3D* g2 = dCustomGeometryGetGeometry(c.o2);
+    if(g1 && !g1->CollisionDataInitialized()) g1->InitCollisionData();
+    if(g2 && !g2->CollisionDataInitialized()) g2->InitCollisionData();
+    dCustomGeometryUpdateTransform(c.o1);
+    dCustomGeometryUpdateTransform(c.o2);
+    if(g1) geoms.push_back(make_pair(g1,c.o1));
+    if(g2) geoms.push_back(make_pair(g2,c.o2));
+  }
+  sort(geoms.begin(),geoms.end());
+  bool sharedGeometry = false;
+  for(size_t i=1;i<geoms.size();i++)
+    if(geoms[i].first == geoms[i-1].first && geoms[i].second != geoms[i-1].second) {
+      sharedGeometry = true;
+      break;
+    }
+  int numThreads = (settings.collisionThreads <= 0 ? ThreadPool::DefaultNumThreads() : settings.collisionThreads);
+  if(numThreads > 1 && numUncached >= gMinParallelCollisionPairs && !sharedGeometry) {
+    if(!collisionThreadPool || collisionThreadPool->NumThreads() != numThreads)
+      collisionThreadPool = make_shared<ThreadPool>(numThreads);
+  }
+  else numThreads = 1;
+  if((int)contactTemp.size() < numThreads) contactTemp.resize(numThreads);
+  threadAllocations.resize(0);
+  threadAllocations.resize(numThreads,0);
+  auto narrowphase = [&](int i,int thread) {
+    int index = uncached[i];
+    size_t capacity = results[index].contacts.capacity();
+    AllocateODEThreadData();
+    SetCustomGeometryTransformUpdates(sharedGeometry);
+    SetCustomGeometryContactBudget(settings.contactBudget,settings.clusterNormalScale);
+    hit[index] = NarrowphaseCollide(collisionCandidates[index],contactTemp[thread],results[index]);
+    SetCustomGeometryContactBudget(0);
+    SetCustomGeometryTransformUpdates(true);
+    if(results[index].contacts.capacity() != capacity) threadAllocations[thread]++;
+  };
+  if(numThreads > 1)
+    collisionThreadPool->ParallelFor(numUncached,narrowphase);
+  else
+    for(int i=0;i<numUncached;i++) narrowphase(i,0);
+  for(int t=0;t<numThreads;t++)
+    numContactAllocations += threadAllocations[t];
+  if(settings.collisionCaching) {
+    for(int i=0;i<numUncached;i++) {
+      int index = uncached[i];
+      const ODECollisionCandidate& c = collisionCandidates[index];
+      pair<dGeomID,dGeomID> key(c.o1,c.o2);
+      map<pair<dGeomID,dGeomID>,ODECachedContact>::iterator e = contactCache.find(key);
+      if(e == contactCache.end()) {
+        e = contactCache.insert(make_pair(key,ODECachedContact())).first;
+        numContactAllocations++;
+      }
+      e->second.state1 = narrowphaseStates[index*2];
+      e->second.state2 = narrowphaseStates[index*2+1];
+      e->second.used = true;
+      e->second.hit = (hit[index] != 0);
+      if(e->second.hit) {
+        if(e->second.result.contacts.capacity() < results[index].contacts.size()) numContactAllocations++;
+        CopyContacts(results[index],e->second.result);
+      }
+    }
+    //drop the pairs that are no longer found by the broadphase
+    for(map<pair<dGeomID,dGeomID>,ODECachedContact>::iterator e=contactCache.begin();e!=contactCache.end();) {
+      if(!e->second.used) contactCache.erase(e++);
+      else e++;
+    }
+  }
 
-	gContactsEmpty = gContacts.empty();
-	if(!gContactsEmpty) gContactStart = --gContacts.end();
-	dSpaceCollide2((dxGeom *)robots[i]->space(),(dxGeom *)robots[k]->space(),(void*)this,collisionCallback);
-	if(!gContactsEmpty) ++gContactStart;
-	else gContactStart = gContacts.begin();
+  contactDetectTime += timer.ElapsedTime();
+  timer.Reset();
 
-#if DO_TIMING
-    gContactDetectTime += timer.ElapsedTime();
-    timer.Reset();
-#endif //DO_TIMING
+  //merge in broadphase order and cluster each group.  Results are swapped
+  //into the arena so that both keep their storage.
+  size_t k=0;
+  for(size_t g=0;g<groupAggregate.size();g++) {
+    size_t groupStart = contactResults.size();
+    for(;k<numCandidates && collisionCandidates[k].group==(int)g;k++) {
+      if(!hit[k]) continue;
+      swap(contactResults.Add(),results[k]);
+    }
+    numPreclusterContacts += ProcessContacts(contactResults.begin()+groupStart,contactResults.end(),settings,contactScratch,groupAggregate[g]);
+  }
+  numContactAllocations += contactResults.numAllocations - arenaAllocations;
 
-	ProcessContacts(gContactStart,gContacts.end(),settings);
+  clusterTime += timer.ElapsedTime();
 
-#if DO_TIMING
-    gClusterTime += timer.ElapsedTime();
-    timer.Reset();
-#endif //DO_TIMING
-      }
-    }
+  if(profile) {
+    profile->numCollisionChecks++;
+    profile->numCollisionPairs += numCandidates;
+    profile->numCachedCollisionPairs += numCandidates-numUncached;
+    profile->numPreclusterContacts += numPreclusterContacts;
+    for(ODEContactArena::const_iterator i=contactResults.begin();i!=contactResults.end();i++)
+      profile->numContacts += i->contacts.size();
+    profile->numAllocations += numContactAllocations;
+    profile->collisionTime += contactDetectTime;
+    profile->clusterTime += clusterTime;
   }
+
+  WakeObjects();
 }
 
 void ODESimulator::EnableContactFeedback(const ODEObjectID& a,const ODEObjectID& b)
@@ -1718,12 +2062,12 @@ bool HasContact(dBodyID a)
 }
 
 ///Will produce bogus o1 and o2 vectors
-void GetContacts(dBodyID a,vector<ODEContactList>& contacts)
+void GetContacts(const ODESimulator* sim,dBodyID a,vector<ODEContactList>& contacts)
 {
   if(a == 0) return;
 
   contacts.resize(0);
-  for(list<ODEContactResult>::iterator i=gContacts.begin();i!=gContacts.end();i++) {
+  for(ODEContactArena::const_iterator i=sim->contactResults.begin();i!=sim->contactResults.end();i++) {
     if(a == dGeomGetBody(i->o1) || a == dGeomGetBody(i->o2)) {
       dBodyID b = dGeomGetBody(i->o2);
       bool reverse = false;
@@ -1833,8 +2177,168 @@ bool ODESimulator::InContact(const ODEObjectID& a,const ODEObjectID& b) const
   return false;
 }
 
+bool ODESimulator::ObjectAsleep(int object) const
+{
+  if(object < 0 || object >= (int)objectAsleep.size()) return false;
+  return objectAsleep[object];
+}
+
+static int FindIsland(vector<int>& island,int i)
+{
+  while(island[i] != i) {
+    island[i] = island[island[i]];
+    i = island[i];
+  }
+  return i;
+}
+
+static void MergeIslands(const ODEObjectID& a,const ODEObjectID& b,vector<int>& island,vector<bool>& robotContact)
+{
+  if(a.IsRigidObject() && b.IsRigidObject())
+    island[FindIsland(island,a.index)] = FindIsland(island,b.index);
+  else if(a.IsRigidObject() && b.IsRobot())
+    robotContact[a.index] = true;
+  else if(b.IsRigidObject() && a.IsRobot())
+    robotContact[b.index] = true;
+}
+
+void ODESimulator::GetContactIslands(vector<int>& island,vector<bool>& robotContact)
+{
+  island.resize(objects.size());
+  for(size_t i=0;i<objects.size();i++)
+    island[i] = (int)i;
+  robotContact.resize(0);
+  robotContact.resize(objects.size(),false);
+  for(ODEContactArena::const_iterator i=contactResults.begin();i!=contactResults.end();i++) {
+    if(i->contacts.empty()) continue;
+    MergeIslands(GeomDataToObjectID(dGeomGetData(i->o1)),GeomDataToObjectID(dGeomGetData(i->o2)),island,robotContact);
+  }
+  for(list<ODEJoint>::const_iterator j=joints.begin();j!=joints.end();j++) {
+    if(j->type < 0) continue;
+    MergeIslands(j->o1,j->o2,island,robotContact);
+  }
+  for(size_t i=0;i<objects.size();i++)
+    island[i] = FindIsland(island,(int)i);
+}
+
+//Called after an accepted step.  Puts each island whose objects have all
+//been at rest for settings.sleepTime to sleep.  Returns true if any object
+//was put to sleep.
+bool ODESimulator::UpdateSleeping(Real dt)
+{
+  if(!settings.sleeping) return false;
+  objectRestingTimes.resize(objects.size(),0);
+  objectAsleep.resize(objects.size(),false);
+  Real v2 = Sqr(settings.sleepLinearVelocity), w2 = Sqr(settings.sleepAngularVelocity);
+  for(size_t i=0;i<objects.size();i++) {
+    if(objectAsleep[i]) continue;
+    const dReal* v = dBodyGetLinearVel(objects[i]->body());
+    const dReal* w = dBodyGetAngularVel(objects[i]->body());
+    if(Sqr(v[0])+Sqr(v[1])+Sqr(v[2]) <= v2 && Sqr(w[0])+Sqr(w[1])+Sqr(w[2]) <= w2)
+      objectRestingTimes[i] += dt;
+    else
+      objectRestingTimes[i] = 0;
+  }
+  vector<int> island;
+  vector<bool> robotContact;
+  GetContactIslands(island,robotContact);
+  vector<bool> canSleep(objects.size(),true);
+  for(size_t i=0;i<objects.size();i++) {
+    if(robotContact[i] || (!objectAsleep[i] && objectRestingTimes[i] < settings.sleepTime))
+      canSleep[island[i]] = false;
+  }
+  bool changed = false;
+  for(size_t i=0;i<objects.size();i++) {
+    if(objectAsleep[i] || !canSleep[island[i]]) continue;
+    dBodyID body = objects[i]->body();
+    dBodySetLinearVel(body,0,0,0);
+    dBodySetAngularVel(body,0,0,0);
+    dBodyDisable(body);
+    objectAsleep[i] = true;
+    changed = true;
+  }
+  return changed;
+}
+
+//Called after collision detection.  Wakes each sleeping island that touches
+//a moving object or a robot, or that has a disturbed object (an object
+//that was enabled externally, e.g., by setting its transform or velocity,
+//or that has external forces applied).
+void ODESimulator::WakeObjects()
+{
+  objectRestingTimes.resize(objects.size(),0);
+  objectAsleep.resize(objects.size(),false);
+  if(!settings.sleeping) {
+    //sleeping was turned off
+    for(size_t i=0;i<objects.size();i++) {
+      if(!objectAsleep[i]) continue;
+      dBodyEnable(objects[i]->body());
+      objectAsleep[i] = false;
+      objectRestingTimes[i] = 0;
+    }
+    return;
+  }
+  bool anyAsleep = false;
+  for(size_t i=0;i<objects.size();i++)
+    if(objectAsleep[i]) { anyAsleep = true; break; }
+  if(!anyAsleep) return;
+  vector<int> island;
+  vector<bool> robotContact;
+  GetContactIslands(island,robotContact);
+  vector<bool> active(objects.size(),false);
+  for(size_t i=0;i<objects.size();i++) {
+    if(robotContact[i]) active[island[i]] = true;
+    else if(!objectAsleep[i]) {
+      if(objectRestingTimes[i] < settings.sleepTime) active[island[i]] = true;
+    }
+    else {
+      dBodyID body = objects[i]->body();
+      const dReal* f = dBodyGetForce(body);
+      const dReal* t = dBodyGetTorque(body);
+      if(dBodyIsEnabled(body) || f[0]!=0 || f[1]!=0 || f[2]!=0 || t[0]!=0 || t[1]!=0 || t[2]!=0)
+        active[island[i]] = true;
+    }
+  }
+  for(size_t i=0;i<objects.size();i++) {
+    if(!objectAsleep[i] || !active[island[i]]) continue;
+    dBodyEnable(objects[i]->body());
+    objectAsleep[i] = false;
+    objectRestingTimes[i] = 0;
+  }
+}
+
+//Called after a step.  ODE doesn't solve the contacts of bodies that are
+//not stepped, so pairs whose bodies are all disabled report the forces of
+//the last step they were simulated, matched by contact id.
+void ODESimulator::UpdateSleepingFeedback()
+{
+  for(ODEContactArena::iterator i=contactResults.begin();i!=contactResults.end();i++) {
+    map<pair<dGeomID,dGeomID>,ODEContactHistory>::iterator e = contactHistory.find(pair<dGeomID,dGeomID>(i->o1,i->o2));
+    if(e == contactHistory.end()) continue;
+    ODEContactHistory& h = e->second;
+    dBodyID b1 = dGeomGetBody(i->o1);
+    dBodyID b2 = dGeomGetBody(i->o2);
+    if((b1 && dBodyIsEnabled(b1)) || (b2 && dBodyIsEnabled(b2))) {
+      h.feedbackIDs.assign(i->ids.begin(),i->ids.end());
+      h.feedback.assign(i->feedback.begin(),i->feedback.end());
+      continue;
+    }
+    for(size_t k=0;k<i->feedback.size() && k<i->ids.size();k++) {
+      size_t j = find(h.feedbackIDs.begin(),h.feedbackIDs.end(),i->ids[k]) - h.feedbackIDs.begin();
+      if(j < h.feedback.size()) i->feedback[k] = h.feedback[j];
+      else i->feedback[k] = dJointFeedback();
+    }
+  }
+}
+
 void ODESimulator::StepDynamics(Real dt)
 {
+  if(profile) {
+    Timer timer;
+    dWorldStep(worldID,dt);
+    profile->dynamicsTime += timer.ElapsedTime();
+    return;
+  }
   dWorldStep(worldID,dt);
   //dWorldQuickStep(worldID,dt);
 }
@@ -1959,6 +2463,7 @@ void ODESimulator::ClearContactFeedback()
   for(map<CollisionPair,ODEContactList>::iterator i=contactList.begin();i!=contactList.end();i++) {
     i->second.points.clear();
     i->second.forces.clear();
+    i->second.ids.clear();
     i->second.feedbackIndices.clear();
   }
 }
@@ -2043,6 +2548,22 @@ bool ODESimulator::ReadState_Internal(File& f)
   return true;
 }
 
+bool WriteFile(File& f,const ODEObjectID& obj)
+{
+  if(!WriteFile(f,obj.type)) return false;
+  if(!WriteFile(f,obj.index)) return false;
+  if(!WriteFile(f,obj.bodyIndex)) return false;
+  return true;
+}
+
+bool ReadFile(File& f,ODEObjectID& obj)
+{
+  if(!ReadFile(f,obj.type)) return false;
+  if(!ReadFile(f,obj.index)) return false;
+  if(!ReadFile(f,obj.bodyIndex)) return false;
+  return true;
+}
+
 bool ODESimulator::ReadState(File& f)
 {
   if(!ReadFile(f,simTime)) return false;
@@ -2051,9 +2572,53 @@ bool ODESimulator::ReadState(File& f)
   if(!ReadFile(f,status)) return false;
   if(!ReadState_Internal(f)) return false;
 
-  //TODO: maintain instability detection state, margins, and status
-  energies.clear();
+  //rollback state for adaptive time stepping.  The body list is rebuilt
+  //from the current robots and objects, in the order WriteState used
+  int valid;
+  if(!ReadFile(f,valid)) return false;
+  if(valid) {
+    int n;
+    if(!ReadFile(f,n)) return false;
+    SaveSnapshot(lastState);
+    if(n != (int)lastState.data.size()) {
+      LOG4CXX_ERROR(GET_LOGGER(ODESimulator),"ODESimulator::ReadState(): rollback state has "<<n<<" entries, expected "<<lastState.data.size());
+      lastState.valid = false;
+      return false;
+    }
+    if(n > 0 && !ReadArrayFile(f,&lastState.data[0],n)) return false;
+  }
+  else lastState.valid = false;
+  int n;
+  if(!ReadFile(f,n)) return false;
   lastMarginsRemaining.clear();
+  for(int i=0;i<n;i++) {
+    pair<ODEObjectID,ODEObjectID> key;
+    double margin;
+    if(!ReadFile(f,key.first) || !ReadFile(f,key.second)) return false;
+    if(!ReadFile(f,margin)) return false;
+    lastMarginsRemaining[key] = margin;
+  }
+  if(!ReadFile(f,n)) return false;
+  energies.clear();
+  for(int i=0;i<n;i++) {
+    ODEObjectID id;
+    Real ke;
+    if(!ReadFile(f,id)) return false;
+    if(!ReadFile(f,ke)) return false;
+    energies[id] = ke;
+  }
+  objectRestingTimes.resize(objects.size());
+  objectAsleep.resize(objects.size());
+  for(size_t i=0;i<objects.size();i++) {
+    int asleep;
+    if(!ReadFile(f,objectRestingTimes[i])) return false;
+    if(!ReadFile(f,asleep)) return false;
+    objectAsleep[i] = (asleep != 0);
+    //ReadState_Internal may have enabled the body
+    if(objectAsleep[i]) dBodyDisable(objects[i]->body());
+    else if(!settings.autoDisable) dBodyEnable(objects[i]->body());
+  }
+
   statusHistory.clear();
   statusHistory.push_back(pair<Status,Real>((Status)status,simTime));
   return true;
@@ -2066,6 +2631,33 @@ bool ODESimulator::WriteState(File& f) const
   int status = (int)GetStatus();
   if(!WriteFile(f,status)) return false;
   if(!WriteState_Internal(f)) return false;
+
+  //the state that the next Step() depends on besides the bodies
+  int valid = (lastState.valid ? 1 : 0);
+  if(!WriteFile(f,valid)) return false;
+  if(valid) {
+    int n = (int)lastState.data.size();
+    if(!WriteFile(f,n)) return false;
+    if(n > 0 && !WriteArrayFile(f,&lastState.data[0],n)) return false;
+  }
+  int n = (int)lastMarginsRemaining.size();
+  if(!WriteFile(f,n)) return false;
+  for(map<pair<ODEObjectID,ODEObjectID>,double>::const_iterator i=lastMarginsRemaining.begin();i!=lastMarginsRemaining.end();i++) {
+    if(!WriteFile(f,i->first.first) || !WriteFile(f,i->first.second)) return false;
+    if(!WriteFile(f,i->second)) return false;
+  }
+  n = (int)energies.size();
+  if(!WriteFile(f,n)) return false;
+  for(map<ODEObjectID,Real>::const_iterator i=energies.begin();i!=energies.end();i++) {
+    if(!WriteFile(f,i->first)) return false;
+    if(!WriteFile(f,i->second)) return false;
+  }
+  for(size_t i=0;i<objects.size();i++) {
+    Real restingTime = (i < objectRestingTimes.size() ? objectRestingTimes[i] : 0);
+    int asleep = (i < objectAsleep.size() && objectAsleep[i] ? 1 : 0);
+    if(!WriteFile(f,restingTime)) return false;
+    if(!WriteFile(f,asleep)) return false;
+  }
   return true;
 }
 
@@ -2078,6 +2670,49 @@ bool ODESimulator::WriteState_Internal(File& f) const
   return true;
 }
 
+void ODESimulator::SaveSnapshot(ODEStateSnapshot& snapshot) const
+{
+  snapshot.bodies.resize(0);
+  for(size_t i=0;i<robots.size();i++)
+    for(size_t j=0;j<robots[i]->robot.links.size();j++)
+      if(robots[i]->body(j)) snapshot.bodies.push_back(robots[i]->body(j));
+  for(size_t i=0;i<objects.size();i++)
+    if(objects[i]->body()) snapshot.bodies.push_back(objects[i]->body());
+  snapshot.data.resize(snapshot.bodies.size()*ODEStateSnapshot::BodySize);
+  dReal* x = snapshot.data.empty() ? NULL : &snapshot.data[0];
+  for(size_t i=0;i<snapshot.bodies.size();i++,x+=ODEStateSnapshot::BodySize) {
+    dBodyID b = snapshot.bodies[i];
+    copy(dBodyGetPosition(b),dBodyGetPosition(b)+3,x);
+    copy(dBodyGetQuaternion(b),dBodyGetQuaternion(b)+4,x+3);
+    copy(dBodyGetAngularVel(b),dBodyGetAngularVel(b)+3,x+7);
+    copy(dBodyGetLinearVel(b),dBodyGetLinearVel(b)+3,x+10);
+    copy(dBodyGetForce(b),dBodyGetForce(b)+3,x+13);
+    copy(dBodyGetTorque(b),dBodyGetTorque(b)+3,x+16);
+  }
+  snapshot.valid = true;
+}
+
+void ODESimulator::RestoreSnapshot(const ODEStateSnapshot& snapshot)
+{
+  Assert(snapshot.valid);
+  Assert(snapshot.data.size() == snapshot.bodies.size()*ODEStateSnapshot::BodySize);
+  const dReal* x = snapshot.data.empty() ? NULL : &snapshot.data[0];
+  for(size_t i=0;i<snapshot.bodies.size();i++,x+=ODEStateSnapshot::BodySize) {
+    dBodyID b = snapshot.bodies[i];
+    dBodySetPosition(b,x[0],x[1],x[2]);
+    dBodySetQuaternion(b,x+3);
+    //need to do this to avoid the normalization
+    dReal* bq = (dReal*)dBodyGetQuaternion(b);
+    for(int j=0;j<4;j++)
+      bq[j] = x[3+j];
+    dBodySetAngularVel(b,x[7],x[8],x[9]);
+    dBodySetLinearVel(b,x[10],x[11],x[12]);
+    dBodySetForce(b,x[13],x[14],x[15]);
+    dBodySetTorque(b,x[16],x[17],x[18]);
+  }
+  ClearContactFeedback();
+}
+
 
 
 
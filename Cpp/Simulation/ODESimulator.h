@@ -9,23 +9,232 @@
 #include <KrisLibrary/robotics/Contact.h>
 #include <ode/contact.h>
 #include <map>
+#include <list>
 
 struct ODEObjectID;
 struct ODEContactList;
-struct ODEContactResult;
 struct ODEJoint;
+class ThreadPool;
+
+/** @ingroup Simulation
+ * @brief The raw contacts between two ODE geoms produced by collision
+ * detection.  Used internally.
+ */
+struct ODEContactResult
+{
+  dGeomID o1,o2;
+  vector<dContactGeom> contacts;
+  vector<dJointFeedback> feedback;
+  ///Persistent id of each contact, see ODESimulatorSettings::contactMatchTolerance
+  vector<int> ids;
+  bool meshOverlap;
+};
+
+/** @ingroup Simulation
+ * @brief The contacts of a pair of ODE geoms on the last step, used to give
+ * contacts persistent ids.  Used internally.
+ */
+struct ODEContactHistory
+{
+  vector<dContactGeom> contacts;
+  vector<int> ids;
+  ///Ids and solved forces of the contacts on the last step the pair was
+  ///simulated.  Reported while the pair is asleep.
+  vector<int> feedbackIDs;
+  vector<dJointFeedback> feedback;
+  ///Set if the pair was in contact on the current step
+  bool used;
+  ///Number of steps since the pair was last in contact.  Idle entries are
+  ///kept for a while so that their storage is reused if contact resumes.
+  int idleSteps;
+};
+
+/** @ingroup Simulation
+ * @brief Scratch space for contact reduction and contact id assignment,
+ * kept between steps so that they do not allocate.  Used internally.
+ */
+struct ODEContactScratch
+{
+  ///k-means data points
+  vector<Math::Vector> points;
+  ///Voxel grid cell of each contact, 6 indices per contact
+  vector<int> voxels;
+  ///Open addressing hash table of the occupied voxel grid cells
+  vector<int> cellTable;
+  ///The contact kept in each occupied cell
+  vector<int> representatives;
+  ///Previous contacts already matched by a contact id
+  vector<char> taken;
+};
+
+/** @ingroup Simulation
+ * @brief Preallocated storage for the ODEContactResults of one collision
+ * detection call.  Used internally.
+ *
+ * Clear() only resets the count, so the results and their contact and
+ * feedback arrays keep their capacity across steps, and steady-state
+ * collision detection does not touch the heap.
+ */
+class ODEContactArena
+{
+public:
+  typedef vector<ODEContactResult>::iterator iterator;
+  typedef vector<ODEContactResult>::const_iterator const_iterator;
+
+  ODEContactArena() : count(0), numAllocations(0) {}
+  ///Empties the arena without freeing its storage
+  void Clear() { count = 0; }
+  ///Appends a slot.  Its old contents are left in place so that their
+  ///storage can be reused, e.g., by swapping.
+  ODEContactResult& Add() {
+    if(count == items.size()) { items.resize(count+1); numAllocations++; }
+    return items[count++];
+  }
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+  ODEContactResult& operator [] (size_t i) { return items[i]; }
+  const ODEContactResult& operator [] (size_t i) const { return items[i]; }
+  iterator begin() { return items.begin(); }
+  iterator end() { return items.begin()+count; }
+  const_iterator begin() const { return items.begin(); }
+  const_iterator end() const { return items.begin()+count; }
+
+  vector<ODEContactResult> items;
+  size_t count;
+  ///Number of slots added to the storage over the arena's lifetime
+  size_t numAllocations;
+};
+
+/** @ingroup Simulation
+ * @brief A pair of ODE geoms found by broadphase collision detection, to be
+ * tested in the narrowphase.  Used internally.
+ */
+struct ODECollisionCandidate
+{
+  dGeomID o1,o2;
+  ///Pairs in the same group are clustered together
+  int group;
+  ///True for robot self-collision pairs
+  bool self;
+};
+
+/** @ingroup Simulation
+ * @brief The state of an ODE geom that determines its narrowphase results.
+ * Used internally for contact caching.
+ */
+struct ODEGeomState
+{
+  ///Geom pose (position, then rotation)
+  dReal pose[3+12];
+  ///The collision geometry of the geom, or NULL if it is not a custom geometry
+  const AnyCollisionGeometry3D* geometry;
+  ///The geometry's margin plus the geom's outer margin
+  Real margin;
+};
+
+/** @ingroup Simulation
+ * @brief The narrowphase result of a pair of ODE geoms, kept between
+ * collision detection calls so that it can be reused if neither geom has
+ * moved or changed its geometry or margin.  Used internally.
+ */
+struct ODECachedContact
+{
+  ///Geom states at the time of the test
+  ODEGeomState state1,state2;
+  ///False if the pair had no contact
+  bool hit;
+  ///Set if the pair was found by the current broadphase
+  bool used;
+  ODEContactResult result;
+};
+
+/** @ingroup Simulation
+ * @brief A flat in-memory copy of the dynamic state of all bodies in an
+ * ODESimulator.  Used internally for adaptive time stepping rollback.
+ *
+ * Each body takes BodySize entries: position (3), quaternion (4), angular
+ * velocity (3), linear velocity (3), accumulated force (3), and torque (3).
+ * The storage is reused between saves, so saving and restoring only copy
+ * numbers rather than serializing each field.
+ */
+struct ODEStateSnapshot
+{
+  enum { BodySize = 19 };
+  ODEStateSnapshot() : valid(false) {}
+  vector<dBodyID> bodies;
+  vector<dReal> data;
+  bool valid;
+};
+
+/** @ingroup Simulation
+ * @brief Timings and counters for one WorldSimulation::Advance call.
+ *
+ * Filled when profiling is enabled (see WorldSimulation::profiling).  Times
+ * are wall clock seconds summed over all sub-steps, and counts are summed
+ * over all collision detection calls, including those done during adaptive
+ * time stepping rollbacks.
+ */
+struct SimulationProfile
+{
+  SimulationProfile() { Clear(); }
+  void Clear();
+
+  ///Number of ODE sub-steps taken
+  int numSteps;
+  ///Number of adaptive time stepping rollbacks
+  int numRollbacks;
+  ///Number of DetectCollisions() calls
+  int numCollisionChecks;
+  ///Number of broadphase pairs, and how many of them reused cached
+  ///narrowphase results
+  size_t numCollisionPairs,numCachedCollisionPairs;
+  ///Number of contacts before / after clustering
+  size_t numPreclusterContacts,numContacts;
+  ///Number of times the contact storage (the contact arena, the narrowphase
+  ///results, and the contact cache) had to grow.  Zero once the contacts
+  ///reach a steady state.
+  size_t numAllocations;
+  ///Total time spent in Advance
+  double totalTime;
+  ///Narrowphase and clustering time, respectively
+  double collisionTime,clusterTime;
+  ///Time spent in dWorldStep
+  double dynamicsTime;
+  ///Time spent in controller updates, sensor simulation, and hooks
+  double controllerTime,sensorTime,hookTime;
+};
 
 /** @ingroup Simulation
  * @brief Global simulator settings.
  */
 struct ODESimulatorSettings
 {
+  /**Method used to reduce the contacts between two objects to maxContacts.
+   * - KMeans: k-means clustering in position / normal space.  Contacts are
+   *   replaced by cluster centers.
+   * - VoxelGrid: keeps the deepest contact in each cell of a voxel grid over
+   *   position / normal space.  Linear time, and keeps the extent of the
+   *   contact region.
+   */
+  enum ContactReduction { ContactReductionKMeans=0, ContactReductionVoxelGrid=1 };
+
   ODESimulatorSettings();
 
   ///The gravity vector
   double gravity[3];
-  ///Whether to use ODE's auto-disable functionality for non-moving objects
+  ///Whether to use ODE's auto-disable functionality for non-moving objects.
+  ///Not compatible with adaptive time stepping; use sleeping instead.
   bool autoDisable;
+  ///If true, rigid objects whose contact island has been at rest for
+  ///sleepTime are put to sleep and not simulated until the island is
+  ///touched by a moving object, a robot, or an external force.  Sleeping
+  ///objects still report their contacts, with the forces of the last step
+  ///they were simulated.  Turning this off wakes all objects.  Unlike
+  ///autoDisable, this works with adaptive time stepping (default false)
+  bool sleeping;
+  ///Time an object must stay below sleepLinearVelocity and
+  ///sleepAngularVelocity before it may sleep (default 0.5, 0.01, 0.05)
+  double sleepTime,sleepLinearVelocity,sleepAngularVelocity;
   ///The default collision padding for environments
   double defaultEnvPadding;
   ///The default surface property for environments
@@ -44,7 +253,7 @@ struct ODESimulatorSettings
   ///adaptive time stepping methods (default true)
   ///
   ///NOTE: adaptiveTimeStepping and autoDisable should not be on at the same
-  ///time!  Disabling does weird stuff.
+  ///time!  Disabling does weird stuff.  Use sleeping instead.
   bool adaptiveTimeStepping;
   ///The minimum time step used by adaptive time stepping (default 1e-6)
   double minimumAdaptiveTimeStep;
@@ -57,6 +266,40 @@ struct ODESimulatorSettings
   ///uses this weight to scale distances in normal space.  Distance in position
   ///space have weight 1. (default 0.1)
   double clusterNormalScale;
+  ///Method used to reduce the number of contacts (default KMeans)
+  ContactReduction contactReduction;
+  ///If > 0, the contacts the narrowphase finds between each pair of geoms
+  ///are reduced to at most this many, picked by farthest-point sampling to
+  ///cover the contact region, before they are merged and clustered down to
+  ///maxContacts.  This only reduces the number of contacts: the narrowphase
+  ///still finds all of them, but clustering, which dominates for large
+  ///mesh-mesh overlaps, gets far fewer.  Runs on the narrowphase threads.
+  ///Should be <= maxContacts (default 0, no budget)
+  int contactBudget;
+  ///A contact that lies within this distance of a contact between the same
+  ///pair of geoms on the previous step, with a normal within ~25 degrees,
+  ///keeps that contact's id in ODEContactList::ids (default 0.01)
+  double contactMatchTolerance;
+  ///Number of threads used for narrowphase collision detection.  0 uses all
+  ///hardware threads, 1 disables threading (default 1)
+  int collisionThreads;
+  ///If true, the narrowphase result of a pair of geoms is reused when
+  ///neither geom has moved or changed its geometry or margin since the last
+  ///collision detection call.  Does not change simulation results, unless
+  ///a geometry's data is modified in place (default false)
+  bool collisionCaching;
+  ///If true, broadphase pairs are put in a canonical order before the
+  ///narrowphase, so that contacts, contact ids, and contact joints are
+  ///created in an order that does not depend on ODE's space layout.  Then
+  ///stepping from the same state always gives bitwise identical results,
+  ///regardless of the number of collision threads or how the simulation was
+  ///set up.  Adds a sort per step (default false)
+  bool deterministic;
+  ///The level of detail of the robot link geometries used for contact
+  ///detection, a GeometryLOD::Level.  Coarser levels make contact generation
+  ///much cheaper for large meshes.  Takes effect for robots added after it
+  ///is set (default 0, the original geometry)
+  int robotGeometryLOD;
 
   //ODE constants, mostly relevant to tightness of robot constraints
   ///ODE's global ERP parameter
@@ -89,12 +332,30 @@ struct ODESimulatorSettings
  * StepDynamics() integrates the dynamics without setting up collision
  * detection structures.  This probably should not be used externally.
  *
- * Read/WriteState can be used to serialize state to binary.
+ * Read/WriteState can be used to serialize state to binary.  The state
+ * includes the adaptive time stepping rollback state, the instability
+ * detection energies, and the sleep state of rigid objects, so that
+ * stepping a restored simulator continues exactly like the original.
  *
  * To get contact force information from the simulator, use the
  * EnableContactFeedback() function to initialize feedback, and then call
  * GetContactFeedback() to get a pointer to the feedback data structure.
  * Contact forces are updated after Step().
+ *
+ * Collision detection first collects candidate pairs from the ODE
+ * broadphase, then runs the narrowphase tests, optionally on a thread pool
+ * (see ODESimulatorSettings::collisionThreads).  Results are merged in broadphase
+ * order, so they do not depend on the number of threads.  With
+ * ODESimulatorSettings::deterministic, the broadphase order is made
+ * canonical as well, so that replaying from a saved state (see ReadState)
+ * reproduces the original run bitwise.
+ *
+ * All collision detection results are stored per-instance, so separate
+ * ODESimulator instances may be stepped concurrently on different threads.
+ * The simulators must not share robot or rigid object geometry, but they
+ * may share terrain geometry, as worlds copied with CopyWorldUnique do.
+ * Terrains never move, so their geometry transforms are only set when they
+ * are added, and stepping only reads them.
  */
 class ODESimulator
 {
@@ -151,6 +412,9 @@ class ODESimulator
   void ClearContactFeedback();
   bool InContact(const ODEObjectID& a) const;
   bool InContact(const ODEObjectID& a,const ODEObjectID& b) const;
+  ///Returns true if the given rigid object is sleeping (see
+  ///ODESimulatorSettings::sleeping)
+  bool ObjectAsleep(int object) const;
   ///Disables instability correction for the next time step.  This should be done if you manually set several objects' velocities, for example.
   void DisableInstabilityCorrection();
   ///Disables instability correction for the given object on the next time step. This should be done if you manually set an object's velocities, for example.
@@ -170,11 +434,19 @@ class ODESimulator
   //used internally
   bool ReadState_Internal(File& f);
   bool WriteState_Internal(File& f) const;
+  void SaveSnapshot(ODEStateSnapshot& snapshot) const;
+  void RestoreSnapshot(const ODEStateSnapshot& snapshot);
   void DetectCollisions();
   void SetupContactResponse(); 
   void SetupContactResponse(const ODEObjectID& a,const ODEObjectID& b,int feedbackIndex,ODEContactResult& c);
+  //returns the number of times contact id storage grew
+  size_t AssignContactIDs();
   void ClearCollisions();
   bool InstabilityCorrection();
+  void GetContactIslands(vector<int>& island,vector<bool>& robotContact);
+  bool UpdateSleeping(Real dt);
+  void WakeObjects();
+  void UpdateSleepingFeedback();
     
   //overload this to have custom parameters for surface pairs
   virtual void GetSurfaceParameters(const ODEObjectID& a,const ODEObjectID& b,dSurfaceParameters& surface) const;
@@ -196,11 +468,42 @@ class ODESimulator
 
 public:
   //for adaptive time stepping
-  File lastState;
+  ODEStateSnapshot lastState;
   Real lastStateTimestep;
   map<pair<ODEObjectID,ODEObjectID>,double> lastMarginsRemaining;
   //joints
   list<ODEJoint> joints;
+  //collision detection results from the last DetectCollisions() call
+  ODEContactArena contactResults;
+  //broadphase results from the last DetectCollisions() call
+  vector<ODECollisionCandidate> collisionCandidates;
+  //narrowphase results of the last DetectCollisions() call, keyed by geom pair
+  map<pair<dGeomID,dGeomID>,ODECachedContact> contactCache;
+  //contacts of the last step, for persistent contact ids
+  map<pair<dGeomID,dGeomID>,ODEContactHistory> contactHistory;
+  int nextContactID;
+  //sleep state of each rigid object, see ODESimulatorSettings::sleeping
+  vector<Real> objectRestingTimes;
+  vector<bool> objectAsleep;
+  //narrowphase thread pool and per-thread scratch space for dCollide
+  shared_ptr<ThreadPool> collisionThreadPool;
+  vector<vector<dContactGeom> > contactTemp;
+  //DetectCollisions() scratch space, kept to avoid per-step allocation
+  vector<ODEContactResult> narrowphaseResults;
+  vector<char> narrowphaseHits;
+  vector<int> narrowphasePairs;
+  vector<ODEGeomState> narrowphaseStates;
+  vector<bool> collisionGroupAggregate;
+  vector<size_t> threadAllocations;
+  vector<pair<AnyCollisionGeometry3D*,dGeomID> > narrowphaseGeometries;
+  ODEContactScratch contactScratch;
+  //number of times contact storage grew since the last DetectCollisions() call
+  size_t numContactAllocations;
+  //timing / statistics from the last DetectCollisions() call
+  size_t numPreclusterContacts;
+  double contactDetectTime,clusterTime;
+  //if non-NULL, Step() accumulates its timings and counters here
+  SimulationProfile* profile;
 };
 
 
@@ -238,6 +541,9 @@ struct ODEObjectID
   int bodyIndex;  //for robots, this identifies a link
 };
 
+bool WriteFile(File& f,const ODEObjectID& obj);
+bool ReadFile(File& f,ODEObjectID& obj);
+
 /** @ingroup Simulation
  * @brief A list of contacts between two objects, returned as feedback 
  * from the simulation.
@@ -250,6 +556,11 @@ struct ODEContactList
   //the contact points
   vector<ContactPoint> points;
   vector<Vector3> forces;
+  //persistent contact ids, one per point.  A contact keeps its id across
+  //steps as long as it can be matched to a contact of the previous step,
+  //so forces of consecutive steps can be associated.  Not saved in the
+  //simulation state.
+  vector<int> ids;
   //whether the contact detector found excessive penetration
   bool penetrating;   
 
@@ -0,0 +1,181 @@
+#include "SensorPipeline.h"
+#include "WorldSimulation.h"
+#include <KrisLibrary/Logger.h>
+DECLARE_LOGGER(WorldSimulator)
+
+SensorPipeline::SensorPipeline()
+  :numThreads(1),blocking(true),numDropped(0),quit(false)
+{}
+
+SensorPipeline::~SensorPipeline()
+{
+  Shutdown();
+}
+
+void SensorPipeline::Start(RobotWorld* world)
+{
+  int n = Max(numThreads,1);
+  //the geometry cache is not thread safe, so the copies are made here
+  workerWorlds.resize(n);
+  for(int i=0;i<n;i++) {
+    workerWorlds[i] = make_shared<RobotWorld>();
+    CopyWorldUnique(*world,*workerWorlds[i]);
+  }
+  quit = false;
+  for(int i=0;i<n;i++)
+    workers.push_back(std::thread(&SensorPipeline::WorkerLoop,this,i));
+}
+
+void SensorPipeline::Shutdown()
+{
+  Clear();
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    quit = true;
+  }
+  wakeCondition.notify_all();
+  for(size_t i=0;i<workers.size();i++)
+    workers[i].join();
+  workers.clear();
+  workerWorlds.clear();
+  slots.clear();
+}
+
+SensorPipeline::Slot* SensorPipeline::GetSlot(int robot,int sensor)
+{
+  for(size_t i=0;i<slots.size();i++)
+    if(slots[i]->robot == robot && slots[i]->sensor == sensor) return slots[i].get();
+  return NULL;
+}
+
+void SensorPipeline::Submit(WorldSimulation* sim,int robot,int sensor,Real time,Real dt)
+{
+  if(workers.empty()) Start(sim->world);
+  SensorBase* s = sim->controlSimulators[robot].sensors.sensors[sensor].get();
+  std::unique_lock<std::mutex> lock(mutex);
+  Slot* slot = GetSlot(robot,sensor);
+  if(!slot) {
+    slots.push_back(make_shared<Slot>());
+    slot = slots.back().get();
+    slot->robot = robot;
+    slot->sensor = sensor;
+  }
+  if(slot->busy) {
+    if(!blocking) {
+      numDropped++;
+      return;
+    }
+    doneCondition.wait(lock,[slot]{ return !slot->busy; });
+  }
+  //the worker's copy gets the current settings of the sensor
+  if(!slot->copy || slot->copy->Type() != string(s->Type())) {
+    slot->copy = sim->controlSimulators[robot].sensors.CreateByType(s->Type());
+    if(!slot->copy) {
+      LOG4CXX_ERROR(GET_LOGGER(WorldSimulator),"SensorPipeline: can't create a copy of sensor "<<s->name<<" of type "<<s->Type());
+      return;
+    }
+  }
+  //copied member-wise: the string round trip of Settings would be slow on
+  //the physics thread, and would round values such as Tsensor
+  slot->copy->CopySettings(*s);
+  slot->copy->name = s->name;
+
+  //snapshot the simulated transforms
+  Snapshot& snap = slot->snapshot;
+  snap.robotLinks.resize(sim->odesim.numRobots());
+  for(size_t i=0;i<sim->odesim.numRobots();i++) {
+    ODERobot* oderobot = sim->odesim.robot(i);
+    snap.robotLinks[i].resize(oderobot->robot.links.size());
+    for(size_t j=0;j<snap.robotLinks[i].size();j++)
+      oderobot->GetLinkTransform(j,snap.robotLinks[i][j]);
+  }
+  snap.objects.resize(sim->odesim.numObjects());
+  for(size_t i=0;i<sim->odesim.numObjects();i++)
+    sim->odesim.object(i)->GetTransform(snap.objects[i]);
+  slot->time = time;
+  slot->dt = dt;
+  slot->busy = true;
+  queue.push_back(slot);
+  lock.unlock();
+  wakeCondition.notify_one();
+}
+
+void SensorPipeline::Deliver(ControlledRobotSimulator* robot,int robotIndex,Real time)
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  for(size_t i=0;i<slots.size();i++) {
+    Slot* slot = slots[i].get();
+    if(slot->robot != robotIndex) continue;
+    if(slot->sensor >= (int)robot->sensors.sensors.size()) continue;
+    SensorBase* s = robot->sensors.sensors[slot->sensor].get();
+    if(blocking && slot->busy && slot->time + s->latency <= time)
+      doneCondition.wait(lock,[slot]{ return !slot->busy; });
+    while(!slot->inTransit.empty() && slot->inTransit.front().deliveryTime <= time) {
+      Measurement& m = slot->inTransit.front();
+      s->SetMeasurements(m.values);
+      s->measurementTime = m.time;
+      slot->inTransit.pop_front();
+    }
+  }
+}
+
+void SensorPipeline::Clear()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  for(size_t i=0;i<slots.size();i++) {
+    Slot* slot = slots[i].get();
+    doneCondition.wait(lock,[slot]{ return !slot->busy; });
+    slot->inTransit.clear();
+  }
+}
+
+int SensorPipeline::NumPending()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  int n = 0;
+  for(size_t i=0;i<slots.size();i++)
+    n += (slots[i]->busy ? 1 : 0) + (int)slots[i]->inTransit.size();
+  return n;
+}
+
+void SensorPipeline::WorkerLoop(int thread)
+{
+  RobotWorld& world = *workerWorlds[thread];
+  vector<double> values;
+  while(true) {
+    Slot* slot;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wakeCondition.wait(lock,[this]{ return quit || !queue.empty(); });
+      if(quit) return;
+      slot = queue.front();
+      queue.pop_front();
+    }
+    //the slot's snapshot and copy are not touched by the simulation thread
+    //while it is busy
+    const Snapshot& snap = slot->snapshot;
+    for(size_t i=0;i<snap.robotLinks.size() && i<world.robots.size();i++) {
+      Robot& r = *world.robots[i];
+      for(size_t j=0;j<snap.robotLinks[i].size() && j<r.links.size();j++)
+        r.links[j].T_World = snap.robotLinks[i][j];
+      r.UpdateGeometry();
+    }
+    for(size_t i=0;i<snap.objects.size() && i<world.rigidObjects.size();i++) {
+      world.rigidObjects[i]->T = snap.objects[i];
+      world.rigidObjects[i]->UpdateGeometry();
+    }
+    slot->copy->SimulateKinematic(*world.robots[slot->robot],world);
+    slot->copy->Advance(slot->dt);
+    slot->copy->GetMeasurements(values);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      Measurement m;
+      m.time = slot->time;
+      m.deliveryTime = slot->time + slot->copy->latency;
+      slot->inTransit.push_back(m);
+      swap(slot->inTransit.back().values,values);
+      slot->busy = false;
+    }
+    doneCondition.notify_all();
+  }
+}
@@ -0,0 +1,98 @@
+#ifndef SENSOR_PIPELINE_H
+#define SENSOR_PIPELINE_H
+
+#include <Klampt/Modeling/World.h>
+#include <Klampt/Sensing/Sensor.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+class WorldSimulation;
+class ControlledRobotSimulator;
+
+/** @ingroup Simulation
+ * @brief Simulates expensive sensors on worker threads, so that physics and
+ * control do not wait for them.
+ *
+ * When WorldSimulation::asyncSensors is true, sensors whose SupportsAsync()
+ * returns true are passed to Submit() rather than simulated inline.  Submit
+ * records a snapshot of all robot link and rigid object transforms, which
+ * is cheap, and queues the sensor.  A worker thread then applies the
+ * snapshot to its own copy of the world (see CopyWorldUnique, made once
+ * when the workers start) and simulates a private copy of the sensor, which
+ * gets the sensor's settings by SensorBase::CopySettings on each Submit.
+ *
+ * A measurement taken at time t is delivered to the sensor, with
+ * SensorBase::measurementTime = t, at the first step at or after
+ * t + SensorBase::latency.  If blocking is true (default), the simulation
+ * waits for a measurement that is due but not finished, so results do not
+ * depend on thread timing; rendering overlaps with physics for the duration
+ * of the latency.  If blocking is false, late measurements are delivered
+ * when they finish, and a sensor that is triggered while its previous
+ * measurement is still being computed skips that measurement.
+ */
+class SensorPipeline
+{
+public:
+  SensorPipeline();
+  ~SensorPipeline();
+  ///Queues sensor index sensor of robot index robot to be measured at time
+  ///from the current state of sim.  dt is the time until its next
+  ///measurement, passed to SensorBase::Advance.
+  void Submit(WorldSimulation* sim,int robot,int sensor,Real time,Real dt);
+  ///Delivers the measurements of the robot's sensors that are due at time
+  void Deliver(ControlledRobotSimulator* robot,int robotIndex,Real time);
+  ///Waits for all queued measurements and discards them, e.g., when the
+  ///simulation state is reset
+  void Clear();
+  ///Stops the worker threads.  They are restarted, with fresh copies of the
+  ///world, on the next Submit.
+  void Shutdown();
+  ///Returns the number of measurements queued, being computed, or in transit
+  int NumPending();
+
+  ///Number of worker threads (default 1)
+  int numThreads;
+  ///Whether to wait for measurements that are due (default true)
+  bool blocking;
+  ///Number of measurements skipped because the sensor was still busy
+  int numDropped;
+
+private:
+  struct Snapshot
+  {
+    vector<vector<RigidTransform> > robotLinks;
+    vector<RigidTransform> objects;
+  };
+  struct Measurement
+  {
+    Real time,deliveryTime;
+    vector<double> values;
+  };
+  struct Slot
+  {
+    Slot() : robot(-1),sensor(-1),busy(false),time(0),dt(0) {}
+    int robot,sensor;
+    shared_ptr<SensorBase> copy;
+    //true if the slot's job is queued or running
+    bool busy;
+    Real time,dt;
+    Snapshot snapshot;
+    deque<Measurement> inTransit;
+  };
+
+  void Start(RobotWorld* world);
+  void WorkerLoop(int thread);
+  Slot* GetSlot(int robot,int sensor);
+
+  vector<shared_ptr<RobotWorld> > workerWorlds;
+  vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable wakeCondition,doneCondition;
+  vector<shared_ptr<Slot> > slots;
+  deque<Slot*> queue;
+  bool quit;
+};
+
+#endif
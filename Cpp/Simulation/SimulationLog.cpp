@@ -0,0 +1,601 @@
+#include "SimulationLog.h"
+#include <KrisLibrary/Logger.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+DECLARE_LOGGER(WorldSimulator)
+
+const static char kHeaderMagic[8] = {'K','L','S','I','M','L','O','G'};
+const static char kIndexMagic[8] = {'K','L','S','I','M','I','D','X'};
+const static uint32_t kVersion = 1;
+const static uint32_t kFlagCompressed = 1;
+//bytes of a chunk header, an index entry, and the index footer
+const static size_t kChunkHeaderSize = 28;
+const static size_t kIndexEntrySize = 28;
+const static size_t kFooterSize = 20;
+//values per logged contact
+const static int kContactSize = 9;
+
+//raw little-endian values; all supported platforms are little-endian
+template <class T>
+static void Put(vector<unsigned char>& buf,const T& x)
+{
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(&x);
+  buf.insert(buf.end(),p,p+sizeof(T));
+}
+
+static void PutVarint(vector<unsigned char>& buf,uint64_t x)
+{
+  while(x >= 0x80) {
+    buf.push_back((unsigned char)(x | 0x80));
+    x >>= 7;
+  }
+  buf.push_back((unsigned char)x);
+}
+
+static inline uint64_t ZigZag(int64_t x) { return (uint64_t(x) << 1) ^ uint64_t(x >> 63); }
+static inline int64_t UnZigZag(uint64_t x) { return int64_t(x >> 1) ^ -int64_t(x & 1); }
+
+//Returns the word that encodes x: x/quantum rounded to an integer, or the
+//bits of x if quantum is 0
+static uint64_t ToWord(Real x,Real quantum)
+{
+  if(quantum > 0) {
+    double s = double(x)/quantum;
+    //saturate, which also maps NaN to the lower limit
+    if(!(s > -9.0e18)) s = -9.0e18;
+    else if(s > 9.0e18) s = 9.0e18;
+    return uint64_t((int64_t)llround(s));
+  }
+  double d = x;
+  uint64_t w;
+  memcpy(&w,&d,8);
+  return w;
+}
+
+static Real FromWord(uint64_t w,Real quantum)
+{
+  if(quantum > 0) return Real(int64_t(w))*quantum;
+  double d;
+  memcpy(&d,&w,8);
+  return d;
+}
+
+//Bounds-checked reads from a memory range.  Once a read fails, ok is
+//false and all further reads return 0.
+struct LogCursor
+{
+  LogCursor(const unsigned char* _p,size_t n) :p(_p),end(_p+n),ok(true) {}
+  template <class T>
+  T Get() {
+    T x = 0;
+    if(!ok || (size_t)(end-p) < sizeof(T)) { ok = false; return x; }
+    memcpy(&x,p,sizeof(T));
+    p += sizeof(T);
+    return x;
+  }
+  uint64_t GetVarint() {
+    uint64_t x = 0;
+    for(int shift=0;shift<64;shift+=7) {
+      if(!ok || p == end) { ok = false; return 0; }
+      unsigned char b = *p++;
+      x |= uint64_t(b & 0x7f) << shift;
+      if(!(b & 0x80)) return x;
+    }
+    ok = false;
+    return 0;
+  }
+  const unsigned char* p,*end;
+  bool ok;
+};
+
+static void PutBlocks(vector<unsigned char>& buf,const vector<StateVectorBlock>& blocks)
+{
+  Put(buf,uint32_t(blocks.size()));
+  for(size_t i=0;i<blocks.size();i++) {
+    Put(buf,uint32_t(blocks[i].name.length()));
+    buf.insert(buf.end(),blocks[i].name.begin(),blocks[i].name.end());
+    Put(buf,int32_t(blocks[i].offset));
+    Put(buf,int32_t(blocks[i].size));
+  }
+}
+
+static bool GetBlocks(LogCursor& c,vector<StateVectorBlock>& blocks)
+{
+  uint32_t n = c.Get<uint32_t>();
+  if(!c.ok || n > (uint32_t)(c.end-c.p)) return false;
+  blocks.resize(n);
+  for(uint32_t i=0;i<n;i++) {
+    uint32_t len = c.Get<uint32_t>();
+    if(!c.ok || len > (uint32_t)(c.end-c.p)) return false;
+    blocks[i].name.assign((const char*)c.p,len);
+    c.p += len;
+    blocks[i].offset = c.Get<int32_t>();
+    blocks[i].size = c.Get<int32_t>();
+  }
+  return c.ok;
+}
+
+static int BlocksSize(const vector<StateVectorBlock>& blocks)
+{
+  int n = 0;
+  for(size_t i=0;i<blocks.size();i++)
+    n = Max(n,blocks[i].offset+blocks[i].size);
+  return n;
+}
+
+static void GetCommandLayout(const WorldSimulation& sim,vector<StateVectorBlock>& blocks)
+{
+  blocks.resize(0);
+  StateVectorBlock b;
+  b.offset = 0;
+  const char* suffixes[3] = {".qcmd",".dqcmd",".torquecmd"};
+  for(size_t i=0;i<sim.controlSimulators.size();i++) {
+    b.size = (int)sim.controlSimulators[i].command.actuators.size();
+    for(int k=0;k<3;k++) {
+      b.name = sim.world->robots[i]->name + suffixes[k];
+      blocks.push_back(b);
+      b.offset += b.size;
+    }
+  }
+}
+
+static void GetCommands(const WorldSimulation& sim,Real* x)
+{
+  for(size_t i=0;i<sim.controlSimulators.size();i++) {
+    const vector<ActuatorCommand>& a = sim.controlSimulators[i].command.actuators;
+    for(size_t j=0;j<a.size();j++) {
+      x[j] = a[j].qdes;
+      x[j+a.size()] = a[j].dqdes;
+      x[j+2*a.size()] = a[j].torque;
+    }
+    x += 3*a.size();
+  }
+}
+
+
+SimulationLogWriter::SimulationLogWriter()
+  :quantum(0),compress(false),saveCommands(true),saveContacts(true),
+   framesPerChunk(256),maxChunkBytes(1<<20),file(NULL)
+{}
+
+SimulationLogWriter::~SimulationLogWriter()
+{
+  Close();
+}
+
+bool SimulationLogWriter::Open(const char* fn,const WorldSimulation& sim)
+{
+  Close();
+#if !HAVE_ZLIB
+  if(compress) {
+    LOG4CXX_WARN(GET_LOGGER(WorldSimulator),"SimulationLogWriter: Klamp't was built without zlib, not compressing");
+    compress = false;
+  }
+#endif
+  file = fopen(fn,"wb");
+  if(!file) {
+    LOG4CXX_ERROR(GET_LOGGER(WorldSimulator),"SimulationLogWriter: could not open "<<fn<<" for writing");
+    return false;
+  }
+  vector<StateVectorBlock> stateBlocks,commandBlocks;
+  sim.GetStateVectorLayout(stateBlocks);
+  if(saveCommands) GetCommandLayout(sim,commandBlocks);
+  stateSize = sim.StateVectorSize();
+  commandSize = BlocksSize(commandBlocks);
+
+  buffer.resize(0);
+  buffer.insert(buffer.end(),kHeaderMagic,kHeaderMagic+8);
+  Put(buffer,kVersion);
+  Put(buffer,uint32_t(compress ? kFlagCompressed : 0));
+  Put(buffer,double(quantum));
+  PutBlocks(buffer,stateBlocks);
+  PutBlocks(buffer,commandBlocks);
+  if(fwrite(&buffer[0],1,buffer.size(),file) != buffer.size()) {
+    LOG4CXX_ERROR(GET_LOGGER(WorldSimulator),"SimulationLogWriter: error writing header to "<<fn);
+    fclose(file);
+    file = NULL;
+    return false;
+  }
+  buffer.resize(0);
+  index.resize(0);
+  numFrames = 0;
+  previous.resize(stateSize+commandSize);
+  return true;
+}
+
+bool SimulationLogWriter::SaveStep(const WorldSimulation& sim)
+{
+  if(!file) return false;
+  if(sim.StateVectorSize() != stateSize) {
+    LOG4CXX_ERROR(GET_LOGGER(WorldSimulator),"SimulationLogWriter: the world changed since the log was opened");
+    return false;
+  }
+  if(numFrames == 0) {
+    std::fill(previous.begin(),previous.end(),0);
+    startTime = sim.time;
+  }
+  endTime = sim.time;
+  Put(buffer,double(sim.time));
+  values.resize(stateSize+commandSize);
+  if(stateSize > 0) sim.GetStateVector(&values[0]);
+  if(commandSize > 0) GetCommands(sim,&values[stateSize]);
+  for(size_t i=0;i<values.size();i++) {
+    uint64_t w = ToWord(values[i],quantum);
+    if(quantum > 0) PutVarint(buffer,ZigZag(int64_t(w - previous[i])));
+    else PutVarint(buffer,w ^ previous[i]);
+    previous[i] = w;
+  }
+  //contacts
+  vector<const ODEContactList*> lists;
+  if(saveContacts) {
+    for(WorldSimulation::ContactFeedbackMap::const_iterator i=sim.contactFeedback.begin();i!=sim.contactFeedback.end();i++) {
+      const ODEContactList* list = const_cast<ODESimulator&>(sim.odesim).GetContactFeedback(i->first.first,i->first.second);
+      if(list && !list->points.empty()) lists.push_back(list);
+    }
+  }
+  PutVarint(buffer,lists.size());
+  Real c[kContactSize];
+  for(size_t i=0;i<lists.size();i++) {
+    const ODEContactList* list = lists[i];
+    PutVarint(buffer,ZigZag(sim.ODEToWorldID(list->o1)));
+    PutVarint(buffer,ZigZag(sim.ODEToWorldID(list->o2)));
+    PutVarint(buffer,list->points.size());
+    for(size_t j=0;j<list->points.size();j++) {
+      list->points[j].x.get(c[0],c[1],c[2]);
+      list->points[j].n.get(c[3],c[4],c[5]);
+      if(j < list->forces.size()) list->forces[j].get(c[6],c[7],c[8]);
+      else c[6] = c[7] = c[8] = 0;
+      for(int k=0;k<kContactSize;k++) {
+        uint64_t w = ToWord(c[k],quantum);
+        PutVarint(buffer,(quantum > 0 ? ZigZag(int64_t(w)) : w));
+      }
+    }
+  }
+  numFrames++;
+  if(numFrames >= framesPerChunk || buffer.size() >= maxChunkBytes)
+    return FlushChunk();
+  return true;
+}
+
+bool SimulationLogWriter::FlushChunk()
+{
+  if(numFrames == 0) return true;
+  const vector<unsigned char>* stored = &buffer;
+#if HAVE_ZLIB
+  if(compress) {
+    uLongf len = compressBound(buffer.size());
+    compressed.resize(len);
+    if(::compress(&compressed[0],&len,&buffer[0],buffer.size()) != Z_OK) {
+      LOG4CXX_ERROR(GET_LOGGER(WorldSimulator),"SimulationLogWriter: zlib error");
+      return false;
+    }
+    compressed.resize(len);
+    stored = &compressed;
+  }
+#endif
+  ChunkInfo info;
+  info.startTime = startTime;
+  info.endTime = endTime;
+  info.offset = (uint64_t)ftell(file);
+  info.numFrames = (uint32_t)numFrames;
+  vector<unsigned char> header;
+  Put(header,info.numFrames);
+  Put(header,uint32_t(buffer.size()));
+  Put(header,uint32_t(stored->size()));
+  Put(header,double(startTime));
+  Put(header,double(endTime));
+  if(fwrite(&header[0],1,header.size(),file) != header.size() ||
+     fwrite(&(*stored)[0],1,stored->size(),file) != stored->size()) {
+    LOG4CXX_ERROR(GET_LOGGER(WorldSimulator),"SimulationLogWriter: error writing chunk");
+    return false;
+  }
+  index.push_back(info);
+  buffer.resize(0);
+  numFrames = 0;
+  return true;
+}
+
+bool SimulationLogWriter::Close()
+{
+  if(!file) return true;
+  bool res = FlushChunk();
+  vector<unsigned char> footer;
+  uint64_t indexOffset = (uint64_t)ftell(file);
+  for(size_t i=0;i<index.size();i++) {
+    Put(footer,double(index[i].startTime));
+    Put(footer,double(index[i].endTime));
+    Put(footer,index[i].offset);
+    Put(footer,index[i].numFrames);
+  }
+  Put(footer,indexOffset);
+  Put(footer,uint32_t(index.size()));
+  footer.insert(footer.end(),kIndexMagic,kIndexMagic+8);
+  if(fwrite(&footer[0],1,footer.size(),file) != footer.size()) res = false;
+  if(fclose(file) != 0) res = false;
+  file = NULL;
+  if(!res) LOG4CXX_ERROR(GET_LOGGER(WorldSimulator),"SimulationLogWriter: error closing log");
+  return res;
+}
+
+
+SimulationLogReader::SimulationLogReader()
+  :flags(0),quantum(0),data(NULL),size(0),stateSize(0),commandSize(0),headerSize(0),numFrames(0),cachedChunk(-1)
+{
+#ifdef _WIN32
+  fileHandle = mappingHandle = NULL;
+#endif
+}
+
+SimulationLogReader::~SimulationLogReader()
+{
+  Close();
+}
+
+bool SimulationLogReader::Open(const char* fn)
+{
+  Close();
+#ifdef _WIN32
+  HANDLE f = CreateFileA(fn,GENERIC_READ,FILE_SHARE_READ,NULL,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,NULL);
+  if(f == INVALID_HANDLE_VALUE) {
+    LOG4CXX_ERROR(GET_LOGGER(WorldSimulator),"SimulationLogReader: could not open "<<fn);
+    return false;
+  }
+  LARGE_INTEGER len;
+  GetFileSizeEx(f,&len);
+  size = (size_t)len.QuadPart;
+  fileHandle = f;
+  if(size > 0) {
+    mappingHandle = CreateFileMapping(f,NULL,PAGE_READONLY,0,0,NULL);
+    if(mappingHandle) data = (const unsigned char*)MapViewOfFile(mappingHandle,FILE_MAP_READ,0,0,0);
+  }
+#else
+  int fd = open(fn,O_RDONLY);
+  if(fd < 0) {
+    LOG4CXX_ERROR(GET_LOGGER(WorldSimulator),"SimulationLogReader: could not open "<<fn);
+    return false;
+  }
+  struct stat st;
+  if(fstat(fd,&st) == 0 && st.st_size > 0) {
+    size = (size_t)st.st_size;
+    void* p = mmap(NULL,size,PROT_READ,MAP_PRIVATE,fd,0);
+    if(p != MAP_FAILED) data = (const unsigned char*)p;
+  }
+  close(fd);
+#endif
+  if(!data) {
+    LOG4CXX_ERROR(GET_LOGGER(WorldSimulator),"SimulationLogReader: could not map "<<fn);
+    Close();
+    return false;
+  }
+  LogCursor c(data,size);
+  if(size < 8 || memcmp(data,kHeaderMagic,8) != 0) {
+    LOG4CXX_ERROR(GET_LOGGER(WorldSimulator),"SimulationLogReader: "<<fn<<" is not a simulation log");
+    Close();
+    return false;
+  }
+  c.p += 8;
+  uint32_t version = c.Get<uint32_t>();
+  flags = c.Get<uint32_t>();
+  quantum = c.Get<double>();
+  if(!c.ok || version != kVersion) {
+    LOG4CXX_ERROR(GET_LOGGER(WorldSimulator),"SimulationLogReader: unsupported version "<<version<<" of "<<fn);
+    Close();
+    return false;
+  }
+#if !HAVE_ZLIB
+  if(flags & kFlagCompressed) {
+    LOG4CXX_ERROR(GET_LOGGER(WorldSimulator),"SimulationLogReader: "<<fn<<" is compressed, but Klamp't was built without zlib");
+    Close();
+    return false;
+  }
+#endif
+  if(!GetBlocks(c,stateBlocks) || !GetBlocks(c,commandBlocks)) {
+    LOG4CXX_ERROR(GET_LOGGER(WorldSimulator),"SimulationLogReader: corrupt header in "<<fn);
+    Close();
+    return false;
+  }
+  stateSize = BlocksSize(stateBlocks);
+  commandSize = BlocksSize(commandBlocks);
+  headerSize = c.p - data;
+  if(!ReadIndex()) {
+    LOG4CXX_WARN(GET_LOGGER(WorldSimulator),"SimulationLogReader: "<<fn<<" has no index, was it closed?  Scanning chunks");
+    if(!ScanChunks(headerSize))
+      LOG4CXX_WARN(GET_LOGGER(WorldSimulator),"SimulationLogReader: "<<fn<<" is truncated, read "<<numFrames<<" frames");
+  }
+  return true;
+}
+
+void SimulationLogReader::Close()
+{
+#ifdef _WIN32
+  if(data) UnmapViewOfFile(data);
+  if(mappingHandle) CloseHandle(mappingHandle);
+  if(fileHandle) CloseHandle(fileHandle);
+  fileHandle = mappingHandle = NULL;
+#else
+  if(data) munmap((void*)data,size);
+#endif
+  data = NULL;
+  size = 0;
+  chunks.resize(0);
+  numFrames = 0;
+  cachedChunk = -1;
+  cachedFrames.resize(0);
+}
+
+bool SimulationLogReader::ReadIndex()
+{
+  if(size < headerSize + kFooterSize || memcmp(data+size-8,kIndexMagic,8) != 0) return false;
+  LogCursor footer(data+size-kFooterSize,kFooterSize);
+  uint64_t indexOffset = footer.Get<uint64_t>();
+  uint32_t n = footer.Get<uint32_t>();
+  if(indexOffset < headerSize || indexOffset + uint64_t(n)*kIndexEntrySize + kFooterSize != size) return false;
+  LogCursor c(data+indexOffset,n*kIndexEntrySize);
+  chunks.resize(n);
+  numFrames = 0;
+  for(uint32_t i=0;i<n;i++) {
+    chunks[i].startTime = c.Get<double>();
+    chunks[i].endTime = c.Get<double>();
+    chunks[i].offset = c.Get<uint64_t>();
+    chunks[i].numFrames = (int)c.Get<uint32_t>();
+    chunks[i].firstFrame = numFrames;
+    numFrames += chunks[i].numFrames;
+    if(chunks[i].offset + kChunkHeaderSize > indexOffset) {
+      chunks.resize(0);
+      numFrames = 0;
+      return false;
+    }
+  }
+  return c.ok;
+}
+
+bool SimulationLogReader::ScanChunks(size_t offset)
+{
+  chunks.resize(0);
+  numFrames = 0;
+  while(offset + kChunkHeaderSize <= size) {
+    LogCursor c(data+offset,kChunkHeaderSize);
+    ChunkInfo info;
+    info.numFrames = (int)c.Get<uint32_t>();
+    c.Get<uint32_t>();
+    uint32_t storedSize = c.Get<uint32_t>();
+    info.startTime = c.Get<double>();
+    info.endTime = c.Get<double>();
+    if(offset + kChunkHeaderSize + storedSize > size) return false;
+    info.offset = offset;
+    info.firstFrame = numFrames;
+    chunks.push_back(info);
+    numFrames += info.numFrames;
+    offset += kChunkHeaderSize + storedSize;
+  }
+  return offset == size;
+}
+
+Real SimulationLogReader::StartTime() const
+{
+  return (chunks.empty() ? 0 : chunks.front().startTime);
+}
+
+Real SimulationLogReader::EndTime() const
+{
+  return (chunks.empty() ? 0 : chunks.back().endTime);
+}
+
+bool SimulationLogReader::DecodeChunk(int chunk)
+{
+  if(chunk == cachedChunk) return true;
+  cachedChunk = -1;
+  const ChunkInfo& info = chunks[chunk];
+  LogCursor header(data+info.offset,kChunkHeaderSize);
+  header.Get<uint32_t>();
+  uint32_t rawSize = header.Get<uint32_t>();
+  uint32_t storedSize = header.Get<uint32_t>();
+  if(!header.ok || info.offset + kChunkHeaderSize + storedSize > size) return false;
+  if(!(flags & kFlagCompressed) && rawSize != storedSize) return false;
+  const unsigned char* payload = data + info.offset + kChunkHeaderSize;
+  size_t payloadSize = storedSize;
+#if HAVE_ZLIB
+  if(flags & kFlagCompressed) {
+    decompressed.resize(rawSize);
+    uLongf len = rawSize;
+    if(uncompress(decompressed.empty() ? NULL : &decompressed[0],&len,payload,storedSize) != Z_OK || len != rawSize) {
+      LOG4CXX_ERROR(GET_LOGGER(WorldSimulator),"SimulationLogReader: zlib error in chunk "<<chunk);
+      return false;
+    }
+    payload = decompressed.empty() ? NULL : &decompressed[0];
+    payloadSize = rawSize;
+  }
+#endif
+  LogCursor c(payload,payloadSize);
+  vector<uint64_t> previous(stateSize+commandSize,0);
+  cachedFrames.resize(info.numFrames);
+  for(int f=0;f<info.numFrames;f++) {
+    SimulationLogFrame& frame = cachedFrames[f];
+    frame.time = c.Get<double>();
+    frame.state.resize(stateSize);
+    frame.commands.resize(commandSize);
+    for(int i=0;i<stateSize+commandSize;i++) {
+      uint64_t v = c.GetVarint();
+      uint64_t w = (quantum > 0 ? previous[i] + uint64_t(UnZigZag(v)) : previous[i] ^ v);
+      previous[i] = w;
+      if(i < stateSize) frame.state[i] = FromWord(w,quantum);
+      else frame.commands[i-stateSize] = FromWord(w,quantum);
+    }
+    size_t numPairs = (size_t)c.GetVarint();
+    if(!c.ok || numPairs > payloadSize) return false;
+    frame.contacts.resize(numPairs);
+    for(size_t i=0;i<numPairs;i++) {
+      SimulationLogContacts& contacts = frame.contacts[i];
+      contacts.id1 = (int)UnZigZag(c.GetVarint());
+      contacts.id2 = (int)UnZigZag(c.GetVarint());
+      size_t n = (size_t)c.GetVarint();
+      if(!c.ok || n > payloadSize) return false;
+      contacts.values.resize(n*kContactSize);
+      for(size_t k=0;k<contacts.values.size();k++) {
+        uint64_t v = c.GetVarint();
+        contacts.values[k] = FromWord(quantum > 0 ? uint64_t(UnZigZag(v)) : v,quantum);
+      }
+    }
+    if(!c.ok) {
+      LOG4CXX_ERROR(GET_LOGGER(WorldSimulator),"SimulationLogReader: corrupt chunk "<<chunk);
+      return false;
+    }
+  }
+  cachedChunk = chunk;
+  return true;
+}
+
+int SimulationLogReader::FindFrame(Real t)
+{
+  if(numFrames == 0) return -1;
+  //last chunk starting at or before t
+  int lo = 0, hi = (int)chunks.size();
+  while(hi - lo > 1) {
+    int mid = (lo+hi)/2;
+    if(chunks[mid].startTime <= t) lo = mid;
+    else hi = mid;
+  }
+  if(!DecodeChunk(lo) || cachedFrames.empty()) return -1;
+  //last frame of the chunk at or before t
+  vector<SimulationLogFrame>::const_iterator i = std::upper_bound(cachedFrames.begin()+1,cachedFrames.end(),t,
+                                                                  [](Real t,const SimulationLogFrame& f) { return t < f.time; });
+  return chunks[lo].firstFrame + int(i - cachedFrames.begin()) - 1;
+}
+
+bool SimulationLogReader::GetFrame(int frame,SimulationLogFrame& out)
+{
+  if(frame < 0 || frame >= numFrames) return false;
+  int lo = 0, hi = (int)chunks.size();
+  while(hi - lo > 1) {
+    int mid = (lo+hi)/2;
+    if(chunks[mid].firstFrame <= frame) lo = mid;
+    else hi = mid;
+  }
+  if(!DecodeChunk(lo)) return false;
+  out = cachedFrames[frame-chunks[lo].firstFrame];
+  return true;
+}
+
+bool SimulationLogReader::Apply(const SimulationLogFrame& frame,WorldSimulation& sim) const
+{
+  if((int)frame.state.size() != sim.StateVectorSize()) {
+    LOG4CXX_ERROR(GET_LOGGER(WorldSimulator),"SimulationLogReader::Apply: logged state has size "<<frame.state.size()<<", simulation state has size "<<sim.StateVectorSize());
+    return false;
+  }
+  if(!frame.state.empty()) sim.SetStateVector(&frame.state[0]);
+  sim.time = frame.time;
+  sim.UpdateModel();
+  return true;
+}
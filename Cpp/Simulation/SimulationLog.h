@@ -0,0 +1,180 @@
+#ifndef SIMULATION_LOG_H
+#define SIMULATION_LOG_H
+
+#include "WorldSimulation.h"
+#include <stdio.h>
+#include <stdint.h>
+
+/** @file SimulationLog.h
+ * @ingroup Simulation
+ * @brief A compact binary log of WorldSimulation trajectories.
+ *
+ * A log file consists of a header, a sequence of chunks, and an index.  All
+ * numbers are little-endian.
+ *
+ * Header: "KLSIMLOG", uint32 version (1), uint32 flags (1 if chunks are
+ * zlib-compressed), double quantum, then the block lists of the state
+ * vector (see WorldSimulation::GetStateVectorLayout) and of the commands.
+ * Each list is a uint32 count followed by, for each block, a uint32 name
+ * length, the name, an int32 offset and an int32 size.
+ *
+ * Chunk: uint32 numFrames, uint32 rawSize, uint32 storedSize, double
+ * startTime, double endTime, then storedSize bytes of frame data, which
+ * are rawSize bytes after decompression.
+ *
+ * Frame: double time, the state values, the command values, then a varint
+ * number of contact pairs.  Each pair has the zigzag varint world IDs of the
+ * two bodies, a varint number of contacts, and 9 values per contact: point,
+ * normal, and force on the first body.  Values are stored as varints:
+ * - If quantum > 0, a value x is rounded to the integer x/quantum.  State
+ *   and command values are stored as the zigzag-encoded difference from
+ *   their value on the previous frame.
+ * - If quantum = 0, which is lossless, the bits of a state or command value
+ *   are stored XORed with the bits of its value on the previous frame.
+ * The first frame of each chunk is encoded against zeros, so every chunk
+ * decodes on its own.  Contact values are stored as is.
+ *
+ * Index: for each chunk, double startTime, double endTime, uint64 file
+ * offset and uint32 numFrames; then the uint64 offset of the index, the
+ * uint32 number of chunks, and "KLSIMIDX".  If the writer was not closed,
+ * the log has no index and the reader rebuilds it from the chunk headers.
+ */
+
+/** @ingroup Simulation
+ * @brief The contacts between two bodies on a frame of a simulation log.
+ */
+struct SimulationLogContacts
+{
+  ///World IDs of the two bodies
+  int id1,id2;
+  ///9 values per contact: point, normal, and force on id1
+  vector<Real> values;
+};
+
+/** @ingroup Simulation
+ * @brief One frame of a simulation log.
+ */
+struct SimulationLogFrame
+{
+  Real time;
+  ///The flat state vector, see WorldSimulation::GetStateVector
+  vector<Real> state;
+  ///For each robot, the qdes, dqdes, and torque of all its actuators
+  vector<Real> commands;
+  vector<SimulationLogContacts> contacts;
+};
+
+/** @ingroup Simulation
+ * @brief Streams the trajectory of a WorldSimulation to a binary log.
+ *
+ * Frames are encoded into a buffer that is written out as a chunk once it
+ * holds framesPerChunk frames or maxChunkBytes bytes, so memory use stays
+ * bounded however long the run.  Contacts are logged for the pairs of
+ * bodies with contact feedback enabled (see
+ * WorldSimulation::EnableContactFeedback).
+ *
+ * Usage:
+ * @code
+ * SimulationLogWriter log;
+ * log.Open("run.simlog",sim);
+ * while(...) {
+ *   sim.Advance(dt);
+ *   log.SaveStep(sim);
+ * }
+ * log.Close();
+ * @endcode
+ */
+class SimulationLogWriter
+{
+public:
+  SimulationLogWriter();
+  ~SimulationLogWriter();
+  ///Creates the file and writes the header, using the layout of sim.  The
+  ///settings below must be set before this call.
+  bool Open(const char* fn,const WorldSimulation& sim);
+  ///Appends the current state of sim.  The bodies of the world must not
+  ///change while the log is open.
+  bool SaveStep(const WorldSimulation& sim);
+  ///Writes the remaining frames and the index, and closes the file
+  bool Close();
+  bool IsOpen() const { return file != NULL; }
+
+  ///If > 0, values are rounded to multiples of quantum, which makes the
+  ///log smaller.  0 is lossless (default 0)
+  Real quantum;
+  ///If true, chunks are zlib-compressed.  Ignored if Klamp't was built
+  ///without zlib (default false)
+  bool compress;
+  ///Whether to log the motor commands / contacts (default true)
+  bool saveCommands,saveContacts;
+  ///The max number of frames in a chunk (default 256).  Smaller chunks make
+  ///seeking faster and larger chunks compress better.
+  int framesPerChunk;
+  ///The max size of the chunk buffer in bytes (default 1MB)
+  size_t maxChunkBytes;
+
+private:
+  bool FlushChunk();
+
+  FILE* file;
+  int stateSize,commandSize;
+  vector<unsigned char> buffer,compressed;
+  vector<uint64_t> previous;
+  int numFrames;
+  Real startTime,endTime;
+  vector<Real> values;
+  struct ChunkInfo { Real startTime,endTime; uint64_t offset; uint32_t numFrames; };
+  vector<ChunkInfo> index;
+};
+
+/** @ingroup Simulation
+ * @brief Reads a log written by SimulationLogWriter.
+ *
+ * The file is memory-mapped, and chunks are only decoded when one of their
+ * frames is requested.  Finding the frame at a given time takes a binary
+ * search over the chunks plus the decoding of one chunk.  The last decoded
+ * chunk is cached, so reading frames in order is cheap.
+ */
+class SimulationLogReader
+{
+public:
+  SimulationLogReader();
+  ~SimulationLogReader();
+  bool Open(const char* fn);
+  void Close();
+  int NumFrames() const { return numFrames; }
+  Real StartTime() const;
+  Real EndTime() const;
+  ///Returns the index of the last frame with time <= t, or 0 if t is before
+  ///the first frame.  Returns -1 if the log is empty.
+  int FindFrame(Real t);
+  bool GetFrame(int frame,SimulationLogFrame& out);
+  ///Sets the time and state of sim to those of the given frame, and updates
+  ///the world model.  The world must have the layout of the logged one.
+  bool Apply(const SimulationLogFrame& frame,WorldSimulation& sim) const;
+
+  uint32_t flags;
+  Real quantum;
+  vector<StateVectorBlock> stateBlocks,commandBlocks;
+
+private:
+  bool ReadIndex();
+  bool ScanChunks(size_t start);
+  bool DecodeChunk(int chunk);
+
+  const unsigned char* data;
+  size_t size;
+#ifdef _WIN32
+  void* fileHandle,*mappingHandle;
+#endif
+  int stateSize,commandSize;
+  size_t headerSize;
+  struct ChunkInfo { Real startTime,endTime; uint64_t offset; int firstFrame,numFrames; };
+  vector<ChunkInfo> chunks;
+  int numFrames;
+  int cachedChunk;
+  vector<SimulationLogFrame> cachedFrames;
+  vector<unsigned char> decompressed;
+};
+
+#endif
@@ -132,22 +132,6 @@ bool ReadFile(File& f,ContactPoint& cp)
   return true;
 }
 
-bool WriteFile(File& f,const ODEObjectID& obj)
-{
-  if(!WriteFile(f,obj.type)) return false;
-  if(!WriteFile(f,obj.index)) return false;
-  if(!WriteFile(f,obj.bodyIndex)) return false;
-  return true;
-}
-
-bool ReadFile(File& f,ODEObjectID& obj)
-{
-  READ_FILE_DEBUG(f,obj.type,"ReadFile(ODEObjectID)");
-  READ_FILE_DEBUG(f,obj.index,"ReadFile(ODEObjectID)");
-  READ_FILE_DEBUG(f,obj.bodyIndex,"ReadFile(ODEObjectID)");
-  return true;
-}
-
 bool WriteFile(File& f,const ODEContactList& list)
 {
   if(!WriteFile(f,list.o1)) return false;
@@ -204,7 +188,7 @@ bool ReadFile(File& f,ContactFeedbackInfo& info)
 
 
 WorldSimulation::WorldSimulation()
-  :time(0),simStep(0.001),fakeSimulation(false),worstStatus(ODESimulator::StatusNormal)
+  :time(0),simStep(0.001),fakeSimulation(false),worstStatus(ODESimulator::StatusNormal),profiling(false),asyncSensors(false),checksums(false),stateChecksum(0),kinematicSimulation(false)
 {}
 
 void WorldSimulation::Init(RobotWorld* _world)
@@ -212,6 +196,7 @@ void WorldSimulation::Init(RobotWorld* _world)
   LOG4CXX_INFO(GET_LOGGER(WorldSimulator),"Creating WorldSimulation");
   time = 0;
   world = _world;
+  if(sensorPipeline) sensorPipeline->Shutdown();
   odesim.SetGravity(Vector3(0,0,-9.8));
   for(size_t i=0;i<world->terrains.size();i++)
     odesim.AddTerrain(*world->terrains[i]);
@@ -332,12 +317,22 @@ void WorldSimulation::Advance(Real dt)
     return;
   }
 
+  if(kinematicSimulation) {
+    AdvanceKinematic(dt);
+    return;
+  }
+  SyncKinematicRobots();
+
+  Timer totalTimer;
+  if(profiling) profile.Clear();
+  odesim.profile = (profiling ? &profile : NULL);
+
   if(dt == 0) {
     //just update the control simulators and hooks
     for(size_t i=0;i<controlSimulators.size();i++) 
       controlSimulators[i].Step(0,this);
-    for(size_t i=0;i<hooks.size();i++)
-      hooks[i]->Step(0);
+    StepHooks(0);
+    if(profiling) profile.totalTime = totalTimer.ElapsedTime();
     return;
   }
 
@@ -353,8 +348,7 @@ void WorldSimulation::Advance(Real dt)
     Real step = Min(timeLeft,simStep);
     for(size_t i=0;i<controlSimulators.size();i++) 
       controlSimulators[i].Step(step,this);
-    for(size_t i=0;i<hooks.size();i++)
-      hooks[i]->Step(step);
+    StepHooks(step);
 
     //update viscous friction approximation as dry friction from current velocity
     for(size_t i=0;i<controlSimulators.size();i++) {
@@ -380,6 +374,7 @@ void WorldSimulation::Advance(Real dt)
     accumTime += step;
     timeLeft -= step;
     numSteps++;
+    if(profiling) profile.numSteps++;
 
     //accumulate contact information
     for(ContactFeedbackMap::iterator i=contactFeedback.begin();i!=contactFeedback.end();i++) {
@@ -444,6 +439,8 @@ void WorldSimulation::Advance(Real dt)
   if(anyKilled) {
     swap(hooks,newhooks);
   }
+  if(checksums) stateChecksum = StateChecksum();
+  if(profiling) profile.totalTime = totalTimer.ElapsedTime();
   /*
   //convert sums to means
   for(ContactFeedbackMap::iterator i=contactFeedback.begin();i!=contactFeedback.end();i++) {
@@ -457,6 +454,19 @@ void WorldSimulation::Advance(Real dt)
   //printf("WorldSimulation: Sim step %gs, real step %gs\n",dt,timer.ElapsedTime());
 }
 
+void WorldSimulation::StepHooks(Real dt)
+{
+  if(!profiling) {
+    for(size_t i=0;i<hooks.size();i++)
+      hooks[i]->Step(dt);
+    return;
+  }
+  Timer timer;
+  for(size_t i=0;i<hooks.size();i++)
+    hooks[i]->Step(dt);
+  profile.hookTime += timer.ElapsedTime();
+}
+
 void WorldSimulation::AdvanceFake(Real dt)
 {
   bool oldFake = fakeSimulation;
@@ -483,6 +493,52 @@ void WorldSimulation::AdvanceFake(Real dt)
   }
   if(anyKilled)
     swap(hooks,newhooks);
+  if(checksums) stateChecksum = StateChecksum();
+}
+
+void WorldSimulation::AdvanceKinematic(Real dt)
+{
+  Timer totalTimer;
+  if(profiling) profile.Clear();
+  kinematicStale.resize(controlSimulators.size(),0);
+  for(size_t i=0;i<controlSimulators.size();i++) {
+    if(!controlSimulators[i].StepKinematic(dt,*world)) continue;
+    Robot* robot = world->robots[i].get();
+    robot->UpdateFrames();
+    robot->UpdateGeometry();
+    kinematicStale[i] = 1;
+  }
+  time += dt;
+  if(profiling) {
+    profile.numSteps++;
+    profile.controllerTime = profile.totalTime = totalTimer.ElapsedTime();
+  }
+  if(checksums) {
+    SyncKinematicRobots();
+    stateChecksum = StateChecksum();
+  }
+}
+
+void WorldSimulation::SyncKinematicRobots()
+{
+  for(size_t i=0;i<kinematicStale.size();i++) {
+    if(!kinematicStale[i]) continue;
+    Robot* robot = world->robots[i].get();
+    odesim.robot(i)->SetConfig(robot->q);
+    odesim.robot(i)->SetVelocities(robot->dq);
+    kinematicStale[i] = 0;
+  }
+}
+
+void WorldSimulation::SimulateSensors(int index)
+{
+  ControlledRobotSimulator& c = controlSimulators[index];
+  for(size_t i=0;i<c.sensors.sensors.size();i++) {
+    SensorBase* s = c.sensors.sensors[i].get();
+    if(kinematicSimulation) s->SimulateKinematic(*world->robots[index],*world);
+    else s->Simulate(&c,this);
+    s->measurementTime = time;
+  }
 }
 
 void WorldSimulation::UpdateModel()
@@ -497,6 +553,10 @@ void WorldSimulation::UpdateModel()
       odesim.robot(i)->SetVelocities(q);
     }
   }
+  else if(kinematicSimulation) {
+    //AdvanceKinematic has already updated the robots that moved, and
+    //nothing else moves
+  }
   else {
     for(size_t i=0;i<world->robots.size();i++) {
       odesim.robot(i)->GetConfig(world->robots[i]->q);
@@ -520,6 +580,9 @@ void WorldSimulation::UpdateRobot(int i)
     world->robots[i]->UpdateGeometry();
     odesim.robot(i)->SetConfig(q);
   }
+  else if(kinematicSimulation) {
+    //the robot model holds the kinematic state
+  }
   else {
     odesim.robot(i)->GetConfig(world->robots[i]->q);
     world->robots[i]->UpdateFrames();
@@ -527,6 +590,96 @@ void WorldSimulation::UpdateRobot(int i)
   }
 }
 
+int WorldSimulation::StateVectorSize() const
+{
+  int n = 0;
+  for(size_t i=0;i<odesim.numRobots();i++)
+    n += 2*(int)odesim.robot(i)->robot.links.size();
+  n += 18*(int)odesim.numObjects();
+  return n;
+}
+
+void WorldSimulation::GetStateVectorLayout(vector<StateVectorBlock>& blocks) const
+{
+  blocks.resize(0);
+  StateVectorBlock b;
+  b.offset = 0;
+  for(size_t i=0;i<odesim.numRobots();i++) {
+    const Robot& robot = odesim.robot(i)->robot;
+    b.size = (int)robot.links.size();
+    b.name = robot.name + ".q";
+    blocks.push_back(b); b.offset += b.size;
+    b.name = robot.name + ".dq";
+    blocks.push_back(b); b.offset += b.size;
+  }
+  const char* objectFields[4] = {".R",".t",".w",".v"};
+  const int objectSizes[4] = {9,3,3,3};
+  for(size_t i=0;i<odesim.numObjects();i++) {
+    for(int k=0;k<4;k++) {
+      b.name = odesim.object(i)->obj.name + objectFields[k];
+      b.size = objectSizes[k];
+      blocks.push_back(b); b.offset += b.size;
+    }
+  }
+}
+
+void WorldSimulation::GetStateVector(Real* x) const
+{
+  //scratch space, so that per-step calls don't allocate
+  static thread_local Config q;
+  for(size_t i=0;i<odesim.numRobots();i++) {
+    if(i < kinematicStale.size() && kinematicStale[i]) {
+      const Robot* robot = world->robots[i].get();
+      robot->q.getCopy(x); x += robot->q.n;
+      robot->dq.getCopy(x); x += robot->dq.n;
+      continue;
+    }
+    odesim.robot(i)->GetConfig(q);
+    q.getCopy(x); x += q.n;
+    odesim.robot(i)->GetVelocities(q);
+    q.getCopy(x); x += q.n;
+  }
+  RigidTransform T;
+  Vector3 w,v;
+  for(size_t i=0;i<odesim.numObjects();i++) {
+    odesim.object(i)->GetTransform(T);
+    odesim.object(i)->GetVelocity(w,v);
+    T.R.get(x); x += 9;
+    T.t.get(x); x += 3;
+    w.get(x); x += 3;
+    v.get(x); x += 3;
+  }
+}
+
+void WorldSimulation::SetStateVector(const Real* x)
+{
+  Config q;
+  for(size_t i=0;i<odesim.numRobots();i++) {
+    ODERobot* robot = odesim.robot(i);
+    q.resize((int)robot->robot.links.size());
+    q.copy(x); x += q.n;
+    //SetConfig reads the link transforms of the robot model
+    robot->robot.UpdateConfig(q);
+    robot->SetConfig(q);
+    q.copy(x); x += q.n;
+    robot->robot.dq = q;
+    robot->SetVelocities(q);
+    if(kinematicSimulation) robot->robot.UpdateGeometry();
+  }
+  kinematicStale.resize(0);
+  RigidTransform T;
+  Vector3 w,v;
+  for(size_t i=0;i<odesim.numObjects();i++) {
+    T.R.set(x); x += 9;
+    T.t.set(x); x += 3;
+    w.set(x); x += 3;
+    v.set(x); x += 3;
+    odesim.object(i)->SetTransform(T);
+    odesim.object(i)->SetVelocity(w,v);
+  }
+  odesim.ClearContactFeedback();
+}
+
 bool WorldSimulation::ReadState(File& f)
 {
 #if TEST_READ_WRITE
@@ -539,6 +692,7 @@ bool WorldSimulation::ReadState(File& f)
   //TODO: read this too?
   worstStatus = ODESimulator::StatusNormal;
 
+  if(sensorPipeline) sensorPipeline->Clear();
   READ_FILE_DEBUG(f,time,"WorldSimulation::ReadState");
   if(!odesim.ReadState(f)) {
     LOG4CXX_ERROR(GET_LOGGER(WorldSimulator),"WorldSimulation::ReadState: ODE sim failed to read");
@@ -591,7 +745,13 @@ bool WorldSimulation::ReadState(File& f)
     }
     contactFeedback[key] = info;
   }
+  //the robots were just read into ODE, so copy them to the model even in
+  //kinematic simulation
+  kinematicStale.resize(0);
+  bool oldKinematic = kinematicSimulation;
+  kinematicSimulation = false;
   UpdateModel();
+  kinematicSimulation = oldKinematic;
   return true;
 }
 
@@ -647,6 +807,24 @@ bool WorldSimulation::WriteState(string& s) const
   return true;
 }
 
+uint64_t WorldSimulation::StateChecksum() const
+{
+  File f;
+  if(!f.OpenData() || !WriteState(f)) {
+    LOG4CXX_ERROR(GET_LOGGER(WorldSimulator),"WorldSimulation::StateChecksum: error writing state");
+    return 0;
+  }
+  const unsigned char* buf = (const unsigned char*)f.GetDataBuffer();
+  //see WriteState(string&) for why this isn't f.Length()
+  int len = f.Position();
+  uint64_t hash = 14695981039346656037ull;
+  for(int i=0;i<len;i++) {
+    hash ^= buf[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
 void WorldSimulation::EnableContactFeedback(int aid,int bid,bool accum,bool accumFull)
 {
   ContactFeedbackInfo f;
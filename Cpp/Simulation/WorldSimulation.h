@@ -4,7 +4,9 @@
 #include <Klampt/Modeling/World.h>
 #include "ODESimulator.h"
 #include "ControlledSimulator.h"
+#include "SensorPipeline.h"
 #include <map>
+#include <stdint.h>
 
 /** @defgroup Simulation
  * Klampt's rigid body physics simulation engine.
@@ -61,6 +63,19 @@ class WorldSimulationHook
   bool autokill;
 };
 
+/** @ingroup Simulation
+ * @brief A named range of entries of WorldSimulation's flat state vector.
+ */
+struct StateVectorBlock
+{
+  ///"<robot>.q" or "<robot>.dq" for a robot's configuration or velocity,
+  ///"<object>.R", "<object>.t", "<object>.w" or "<object>.v" for a rigid
+  ///object's rotation matrix (column major), translation, angular
+  ///velocity, or linear velocity
+  string name;
+  int offset,size;
+};
+
 /** @ingroup Simulation
  * @brief A physical simulator for a RobotWorld.
  */
@@ -77,10 +92,52 @@ public:
   void Advance(Real dt);
   ///Advance simulation time without actually performing ODE simulation
   void AdvanceFake(Real dt);
+  ///Advances the robots kinematically, without physics.  Each robot's
+  ///controller is updated and its actuator commands are applied directly to
+  ///the robot model: PID drivers move to their setpoints, locked-velocity
+  ///drivers integrate their velocities, and torque-controlled drivers hold
+  ///still.  Only the robots that moved get their frames and geometry
+  ///updated.  Hooks are not run and rigid objects do not move.
+  ///
+  ///Sensors are not simulated, except for the joint position and velocity
+  ///sensors read by controllers; call SimulateSensors() to get the other
+  ///measurements on demand.  The ODE bodies of the moved robots are only
+  ///updated by SyncKinematicRobots(), which Advance() calls before
+  ///simulating physics.
+  void AdvanceKinematic(Real dt);
+  ///Copies the robots moved by AdvanceKinematic() to their ODE bodies.
+  ///Call this before WriteState, StateChecksum, or reading the ODE bodies
+  ///directly after kinematic steps.  GetStateVector reads moved robots
+  ///from their models, so it doesn't need this.
+  void SyncKinematicRobots();
+  ///Simulates all sensors of the given robot at the current state
+  void SimulateSensors(int robot);
+  ///Steps all hooks, timing them if profiling is enabled
+  void StepHooks(Real dt);
   ///Takes the simulation state and puts it in the world model
   void UpdateModel(); 
   ///Takes the simulation state for the robot and puts it in the world model
   void UpdateRobot(int index); 
+  ///Returns the size of the flat state vector
+  int StateVectorSize() const;
+  ///Returns the layout of the flat state vector.  It concatenates, for each
+  ///robot, its configuration and velocity, then for each rigid object its
+  ///rotation matrix (9 entries, column major), translation, angular
+  ///velocity, and linear velocity.  The layout only changes when bodies are
+  ///added to the world.
+  void GetStateVectorLayout(vector<StateVectorBlock>& blocks) const;
+  ///Writes the physical state of all bodies into x, which must hold
+  ///StateVectorSize() entries.  Unlike WriteState, controller and hook
+  ///state is not included.  Nothing is allocated, except for scratch space
+  ///on a thread's first call.  Robots moved by AdvanceKinematic() are read
+  ///from their models.
+  void GetStateVector(Real* x) const;
+  ///Sets the physical state of all bodies from x, in the layout of
+  ///GetStateVector.  Contact feedback is cleared, but controller and hook
+  ///state are left as is.  The robot models take the new configurations,
+  ///but the rest of the world model is not updated; call UpdateModel() for
+  ///that.
+  void SetStateVector(const Real* x);
   ///Load/save state
   ///Note: when reading state, the user must make sure that the controllers
   ///and hooks are *exactly* the same objects as when they were written!
@@ -88,6 +145,10 @@ public:
   bool WriteState(File& f) const;
   bool ReadState(const string& data);
   bool WriteState(string& data) const;
+  ///Returns a 64-bit hash (FNV-1a) of the WriteState output.  Simulations
+  ///in the same state have the same checksum, so comparing checksums step
+  ///by step finds where a replay diverges from the original run.
+  uint64_t StateChecksum() const;
 
   //contact querying routines
   ///Enables contact feedback between the two objects.  This must be called
@@ -137,6 +198,27 @@ public:
   ContactFeedbackMap contactFeedback;
   ///Worst simulation status over the last Advance() call.
   ODESimulator::Status worstStatus;
+  ///If true, each Advance() call fills out profile (default false)
+  bool profiling;
+  ///Timings and counters of the last Advance() call
+  SimulationProfile profile;
+  ///If true, sensors that support it are simulated on worker threads by
+  ///sensorPipeline (default false).  See SensorPipeline.
+  bool asyncSensors;
+  ///Created on demand when asyncSensors is true
+  shared_ptr<SensorPipeline> sensorPipeline;
+  ///If true, stateChecksum is updated at the end of each Advance() call
+  ///(default false).  For reproducible runs, also set
+  ///odesim.GetSettings().deterministic.
+  bool checksums;
+  ///StateChecksum() after the last Advance() call, if checksums is true
+  uint64_t stateChecksum;
+  ///If true, Advance() calls AdvanceKinematic(), and the robot models
+  ///rather than the ODE bodies hold the robots' state (default false).  For
+  ///large fleets of robots that don't need physics.
+  bool kinematicSimulation;
+  ///Robots moved by AdvanceKinematic() whose ODE bodies are out of date
+  vector<char> kinematicStale;
 };
 
 /** @ingroup Simulation
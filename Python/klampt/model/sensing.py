@@ -192,14 +192,42 @@ def camera_to_images(camera,image_format='numpy',color_format='channels'):
     h = int(camera.getSetting('yres'))
     has_rgb = int(camera.getSetting('rgb'))
     has_depth = int(camera.getSetting('depth'))
+    if image_format == 'numpy':
+        if not _try_numpy_import():
+            image_format = 'native'
+    rgb_buffer,depth_buffer = None,None
+    if image_format == 'numpy' and sys.version_info[0] >= 3 and hasattr(camera,'getColorImageBuffer'):
+        rgb_buffer = camera.getColorImageBuffer() if has_rgb else None
+        depth_buffer = camera.getDepthImageBuffer() if has_depth else None
+    if (rgb_buffer is not None or depth_buffer is not None) and (rgb_buffer is not None) == bool(has_rgb) and (depth_buffer is not None) == bool(has_depth):
+        #read the typed image buffers directly.  They are read-only copies
+        #owned by the buffers, so only the returned arrays need new memory
+        rgb = None
+        depth = None
+        if has_rgb:
+            channels = np.asarray(rgb_buffer)
+            if color_format == 'rgb':
+                channels = channels.astype(np.uint32)
+                rgb = np.bitwise_or.reduce((np.left_shift(channels[:,:,0],16),np.left_shift(channels[:,:,1],8),channels[:,:,2]))
+            elif color_format == 'bgr':
+                channels = channels.astype(np.uint32)
+                rgb = np.bitwise_or.reduce((np.left_shift(channels[:,:,2],16),np.left_shift(channels[:,:,1],8),channels[:,:,0]))
+            else:
+                rgb = np.array(channels)
+        if has_depth:
+            depth = np.asarray(depth_buffer).astype(float)
+        if has_rgb and has_depth:
+            return rgb,depth
+        elif has_rgb:
+            return rgb
+        elif has_depth:
+            return depth
+        return None
     #t0 = time.time()
     #print("camera.getSettings() time",t0-t_1)
     measurements = camera.getMeasurements()
     #t1 = time.time()
     #print("camera.getMeasurements() time",t1-t0)
-    if image_format == 'numpy':
-        if not _try_numpy_import():
-            image_format = 'native'
     rgb = None
     depth = None
     if has_rgb:
@@ -230,6 +230,60 @@ def monteCarloSim(world,duration,initialConditionSamplers,N,returnItems,
         res.append((initCond,simRes))
     return res
 
+def parallelSim(world,duration,initialConfigs,initialVelocities=None,
+                simDt=0.01,sim=None,numThreads=0):
+    """Runs many simulations from different initial robot configurations in
+    parallel, in native threads.  Much faster than batchSim(), but
+    Python callbacks are not supported: each robot is driven by its default
+    controller.
+
+    Args:
+        world (WorldModel): the world
+        duration (float): the duration of each simulation, in seconds
+        initialConfigs (list or array): N initial configurations.  Each is
+            the concatenation of the configurations of all robots.
+        initialVelocities (list or array, optional): N initial velocities,
+            laid out like initialConfigs.
+        simDt (float, optional, default 0.01): the sampling time step.
+        sim (Simulator, optional): if given, simulations start from this
+            simulator's state and settings.  Otherwise, a new Simulator is
+            created for the world.
+        numThreads (int, optional): number of threads.  0 uses all hardware
+            threads.
+
+    Returns:
+        dict: contains the following items:
+
+            * 'time': array of the numSamples sample times
+            * 'state': array of shape (N,numSamples,stateSize) of the
+              simulation states.  Each state contains each robot's
+              configuration and velocity, then each rigid object's
+              rotation matrix (column major), translation, angular velocity,
+              and linear velocity.
+            * 'status': array of shape (N,numSamples) of status codes
+            * 'wall_clock_time': the time elapsed while computing the
+              simulations, in s
+    """
+    import numpy as np
+    assert simDt > 0,"Time step must be positive"
+    if sim is None:
+        sim = Simulator(world)
+    initialConfigs = np.asarray(initialConfigs,dtype=float)
+    if initialVelocities is None:
+        initialVelocities = []
+    else:
+        initialVelocities = np.asarray(initialVelocities,dtype=float).tolist()
+    N = initialConfigs.shape[0]
+    numSamples = int(np.floor(duration/simDt + 0.5))+1
+    t0 = time.time()
+    states,statuses = sim.batchSimulate(initialConfigs.tolist(),initialVelocities,duration,simDt,numThreads)
+    res = dict()
+    res['time'] = np.arange(numSamples)*simDt
+    res['state'] = np.array(states).reshape((N,numSamples,-1))
+    res['status'] = np.array(statuses,dtype=int).reshape((N,numSamples))
+    res['wall_clock_time'] = time.time()-t0
+    return res
+
 
 
 def saveStateHeaderCSV(state,f):
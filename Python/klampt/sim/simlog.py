@@ -1,4 +1,7 @@
 from ..math import vectorops,so3,se3
+import bisect
+import mmap
+import struct
 
 
 class SimLogger:
@@ -178,21 +181,233 @@ class SimLogger:
 
 
 
+_LOG_MAGIC = b'KLSIMLOG'
+_INDEX_MAGIC = b'KLSIMIDX'
+_CHUNK_HEADER = struct.Struct('<IIIdd')
+_INDEX_ENTRY = struct.Struct('<ddQI')
+_FOOTER = struct.Struct('<QI8s')
+_CONTACT_SIZE = 9
+
+def _read_varint(data,pos):
+    x = 0
+    shift = 0
+    while True:
+        b = data[pos]
+        pos += 1
+        x |= (b & 0x7f) << shift
+        if b < 0x80:
+            return x,pos
+        shift += 7
+
+def _unzigzag(x):
+    return (x >> 1) ^ -(x & 1)
+
+def _read_blocks(data,pos):
+    (n,) = struct.unpack_from('<I',data,pos)
+    pos += 4
+    blocks = []
+    for i in range(n):
+        (length,) = struct.unpack_from('<I',data,pos)
+        pos += 4
+        name = data[pos:pos+length].decode('utf-8')
+        pos += length
+        offset,size = struct.unpack_from('<ii',data,pos)
+        pos += 8
+        blocks.append((name,offset,size))
+    return blocks,pos
+
+def is_binary_log(fn):
+    """Returns True if fn is a binary log written by Simulator.beginLog."""
+    with open(fn,'rb') as f:
+        return f.read(len(_LOG_MAGIC)) == _LOG_MAGIC
+
+
+class SimLogFrame:
+    """A frame of a binary simulation log.
+
+    Attributes:
+        time (float): the simulation time
+        state (list of floats): the state vector, see Simulator.getStateVector
+        commands (list of floats): for each robot, the qdes, dqdes, and torque
+            commands of its actuators
+        contacts (list): a list of (id1,id2,values) tuples, where values
+            holds 9 floats per contact: point, normal, and force on id1.
+    """
+    def __init__(self,time,state,commands,contacts):
+        self.time = time
+        self.state = state
+        self.commands = commands
+        self.contacts = contacts
+
+
+class SimLogReader:
+    """Reads a binary log written by Simulator.beginLog.
+
+    The file is memory-mapped and only the chunk holding a requested frame
+    is decoded, so seeking in long logs is fast.  The last decoded chunk is
+    cached, so reading frames in order is cheap.
+
+    Attributes:
+        stateBlocks (list): (name,offset,size) tuples giving the layout of the
+            state vector
+        commandBlocks (list): (name,offset,size) tuples giving the layout of
+            the commands
+        times (list): the start time of each chunk
+    """
+    def __init__(self,fn):
+        self.file = open(fn,'rb')
+        try:
+            self.data = mmap.mmap(self.file.fileno(),0,access=mmap.ACCESS_READ)
+        except ValueError:
+            self.file.close()
+            raise IOError("SimLogReader: "+fn+" is empty")
+        data = self.data
+        if data[:8] != _LOG_MAGIC:
+            self.close()
+            raise IOError("SimLogReader: "+fn+" is not a simulation log")
+        version,self.flags,self.quantum = struct.unpack_from('<IId',data,8)
+        if version != 1:
+            self.close()
+            raise IOError("SimLogReader: unsupported log version %d"%(version,))
+        self.stateBlocks,pos = _read_blocks(data,24)
+        self.commandBlocks,pos = _read_blocks(data,pos)
+        self.stateSize = max([o+n for (name,o,n) in self.stateBlocks] or [0])
+        self.commandSize = max([o+n for (name,o,n) in self.commandBlocks] or [0])
+        #chunk offsets, number of frames, and start times
+        self.offsets = []
+        self.counts = []
+        self.times = []
+        if not self._read_index(pos):
+            print("SimLogReader: Warning,",fn,"has no index, scanning chunks")
+            self._scan_chunks(pos)
+        self.firstFrames = []
+        n = 0
+        for c in self.counts:
+            self.firstFrames.append(n)
+            n += c
+        self.numFrames = n
+        self._cachedChunk = -1
+        self._cachedFrames = []
+
+    def close(self):
+        self.data.close()
+        self.file.close()
+
+    def _read_index(self,headerSize):
+        data = self.data
+        if len(data) < headerSize + _FOOTER.size:
+            return False
+        indexOffset,n,magic = _FOOTER.unpack_from(data,len(data)-_FOOTER.size)
+        if magic != _INDEX_MAGIC or indexOffset + n*_INDEX_ENTRY.size + _FOOTER.size != len(data):
+            return False
+        for i in range(n):
+            t0,t1,offset,count = _INDEX_ENTRY.unpack_from(data,indexOffset+i*_INDEX_ENTRY.size)
+            self.times.append(t0)
+            self.offsets.append(offset)
+            self.counts.append(count)
+        return True
+
+    def _scan_chunks(self,pos):
+        data = self.data
+        while pos + _CHUNK_HEADER.size <= len(data):
+            count,rawSize,storedSize,t0,t1 = _CHUNK_HEADER.unpack_from(data,pos)
+            if pos + _CHUNK_HEADER.size + storedSize > len(data):
+                break
+            self.times.append(t0)
+            self.offsets.append(pos)
+            self.counts.append(count)
+            pos += _CHUNK_HEADER.size + storedSize
+
+    def _decode_chunk(self,chunk):
+        if chunk == self._cachedChunk:
+            return
+        offset = self.offsets[chunk]
+        count,rawSize,storedSize,t0,t1 = _CHUNK_HEADER.unpack_from(self.data,offset)
+        start = offset+_CHUNK_HEADER.size
+        payload = self.data[start:start+storedSize]
+        if self.flags & 1:
+            import zlib
+            payload = zlib.decompress(payload)
+        quantum = self.quantum
+        n = self.stateSize+self.commandSize
+        previous = [0]*n
+        pos = 0
+        frames = []
+        for f in range(count):
+            (time,) = struct.unpack_from('<d',payload,pos)
+            pos += 8
+            values = [0.0]*n
+            for i in range(n):
+                v,pos = _read_varint(payload,pos)
+                if quantum > 0:
+                    w = previous[i] + _unzigzag(v)
+                    values[i] = w*quantum
+                else:
+                    w = previous[i] ^ v
+                    values[i] = struct.unpack('<d',struct.pack('<Q',w))[0]
+                previous[i] = w
+            numPairs,pos = _read_varint(payload,pos)
+            contacts = []
+            for i in range(numPairs):
+                id1,pos = _read_varint(payload,pos)
+                id2,pos = _read_varint(payload,pos)
+                numContacts,pos = _read_varint(payload,pos)
+                cvalues = [0.0]*(numContacts*_CONTACT_SIZE)
+                for k in range(len(cvalues)):
+                    v,pos = _read_varint(payload,pos)
+                    if quantum > 0:
+                        cvalues[k] = _unzigzag(v)*quantum
+                    else:
+                        cvalues[k] = struct.unpack('<d',struct.pack('<Q',v))[0]
+                contacts.append((_unzigzag(id1),_unzigzag(id2),cvalues))
+            frames.append(SimLogFrame(time,values[:self.stateSize],values[self.stateSize:],contacts))
+        self._cachedChunk = chunk
+        self._cachedFrames = frames
+
+    def findFrame(self,time):
+        """Returns the index of the last frame at or before the given time,
+        or 0 if time is before the first frame."""
+        if self.numFrames == 0:
+            return -1
+        chunk = max(bisect.bisect_right(self.times,time)-1,0)
+        self._decode_chunk(chunk)
+        k = bisect.bisect_right([f.time for f in self._cachedFrames],time)-1
+        return self.firstFrames[chunk] + max(k,0)
+
+    def frame(self,index):
+        """Returns the SimLogFrame with the given index"""
+        if index < 0 or index >= self.numFrames:
+            raise IndexError("SimLogReader: invalid frame index")
+        chunk = bisect.bisect_right(self.firstFrames,index)-1
+        self._decode_chunk(chunk)
+        return self._cachedFrames[index-self.firstFrames[chunk]]
+
+
 class SimLogPlayback:
-    """A replay class for simulation traces from SimLogger or the SimTest app. """
+    """A replay class for simulation traces from SimLogger, the SimTest app,
+    or Simulator.beginLog. """
     def __init__(self,sim,state_fn,contact_fn=None):
         """
-        Loads from a CSV file.
+        Loads from a CSV file or a binary log.
 
         Arguments:
             sim (Simulator): the klampt.Simulator object you wish to use.  This should be
                 instantiated with all objects that you recorded from.
-            state_fn (str): the state file that you want to load
+            state_fn (str): the state file that you want to load.  If it is
+                a binary log written by Simulator.beginLog, it is memory-mapped
+                rather than loaded, and contact_fn is ignored.
             contact_fn (str, optional): the contact file that you want to load
         
         """
         import csv
         self.sim = sim
+        self.reader = None
+        if state_fn != None and is_binary_log(state_fn):
+            self.reader = SimLogReader(state_fn)
+            size = sim.getStateVectorOffsets()[-1]
+            if self.reader.stateSize != size:
+                raise ValueError("SimLogPlayback: log has state size %d, simulation has %d"%(self.reader.stateSize,size))
+            return
         self.state_header = []
         self.state_array = []
         self.contact_header = []
@@ -290,6 +505,13 @@ class SimLogPlayback:
     def updateSim(self,time=-1,timestep=-1):
         sim = self.sim
         world = sim.world
+        if self.reader is not None:
+            if time >= 0:
+                timestep = self.reader.findFrame(time)
+            timestep = min(max(timestep,0),self.reader.numFrames-1)
+            sim.setStateVector(self.reader.frame(timestep).state)
+            sim.updateWorld()
+            return
         if time >= 0:
             try:
                 timeindex = self.state_to_index['time']
@@ -779,7 +779,10 @@ class WorldModel
   ///Sets this WorldModel to a reference to w
   const WorldModel& operator = (const WorldModel& w);
   ///Creates a copy of the world model.  Note that geometries and appearances
-  ///are shared, so this is very quick.
+  ///are shared, so this is very quick.  The copy has its own configurations
+  ///and transforms, but geometries store the transform of their last
+  ///update.  So after using one world, set the robot configurations and
+  ///object transforms of the other before querying its collisions.
   WorldModel copy();
   ///Reads from a world XML file.
   bool readFile(const char* fn);
@@ -11,8 +11,11 @@
 #include <Klampt/Control/FeedforwardController.h>
 #include <Klampt/Control/LoggingController.h>
 #include <Klampt/Sensing/JointSensors.h>
+#include <Klampt/Sensing/VisualSensors.h>
 #include <Klampt/Planning/RobotCSpace.h>
 #include <Klampt/Simulation/WorldSimulation.h>
+#include <Klampt/Simulation/BatchSimulator.h>
+#include <Klampt/Simulation/SimulationLog.h>
 #include <Klampt/Modeling/Interpolate.h>
 #include <Klampt/Modeling/Mass.h>
 #include <Klampt/Planning/RobotCSpace.h>
@@ -61,6 +64,8 @@ struct WorldData
 struct SimData
 {
   WorldSimulation sim;
+  //set between Simulator.beginLog and endLog
+  shared_ptr<SimulationLogWriter> log;
 };
 
 
@@ -357,6 +362,31 @@ inline PolynomialMotionQueue* GetMotionQueue(RobotController* controller)
   return GetPathController(controller);
 }
 
+#ifdef IS_PY3K
+//Returns a memoryview of buf, a bytes or bytearray object, cast to the
+//given struct format and shape (a tuple, or NULL to stay 1-D).  The view
+//holds the reference to buf, so it stays valid after the simulation moves
+//on or is destroyed.  Steals the references to buf and shape.
+static PyObject* CastMemoryView(PyObject* buf,const char* format,PyObject* shape)
+{
+  if(!buf) {
+    Py_XDECREF(shape);
+    throw PyException("Couldn't allocate buffer");
+  }
+  PyObject* bytesView = PyMemoryView_FromObject(buf);
+  Py_DECREF(buf);
+  PyObject* view = NULL;
+  if(bytesView) {
+    if(shape) view = PyObject_CallMethod(bytesView,"cast","sO",format,shape);
+    else view = PyObject_CallMethod(bytesView,"cast","s",format);
+    Py_DECREF(bytesView);
+  }
+  Py_XDECREF(shape);
+  if(!view) throw PyException("Couldn't create memoryview");
+  return view;
+}
+#endif //IS_PY3K
+
 
 void GetMesh(const Geometry::AnyCollisionGeometry3D& geom,TriangleMesh& tmesh)
 {
@@ -2444,21 +2474,8 @@ WorldModel WorldModel::copy()
   WorldModel res;
   RobotWorld& myworld = *worlds[index]->world;
   RobotWorld& otherworld = *worlds[res.index]->world;
-  otherworld = myworld;
   //world occupants -- copy everything but geometry
-  for(size_t i=0;i<otherworld.robots.size();i++) {
-    otherworld.robots[i] = make_shared<Robot>();
-    *otherworld.robots[i] = *myworld.robots[i];
-    otherworld.robotViews[i].robot = otherworld.robots[i].get();
-  }
-  for(size_t i=0;i<otherworld.terrains.size();i++) {
-    otherworld.terrains[i] = make_shared<Terrain>();
-    *otherworld.terrains[i] = *myworld.terrains[i];
-  }
-  for(size_t i=0;i<otherworld.rigidObjects.size();i++) {
-    otherworld.rigidObjects[i] = make_shared<RigidObject>();
-    *otherworld.rigidObjects[i] = *myworld.rigidObjects[i];
-  }
+  CopyWorld(myworld,otherworld);
   return res;
 }
 
@@ -4460,6 +4477,34 @@ int Simulator::getStatus()
   return sim->worstStatus;
 }
 
+void Simulator::enableProfiling(bool enabled)
+{
+  sim->profiling = enabled;
+  if(!enabled) sim->odesim.profile = NULL;
+}
+
+std::map<std::string,double> Simulator::getProfile()
+{
+  const SimulationProfile& p = sim->profile;
+  std::map<std::string,double> res;
+  res["total"] = p.totalTime;
+  res["collision"] = p.collisionTime;
+  res["cluster"] = p.clusterTime;
+  res["dynamics"] = p.dynamicsTime;
+  res["controller"] = p.controllerTime;
+  res["sensor"] = p.sensorTime;
+  res["hook"] = p.hookTime;
+  res["steps"] = p.numSteps;
+  res["rollbacks"] = p.numRollbacks;
+  res["collisionChecks"] = p.numCollisionChecks;
+  res["collisionPairs"] = (double)p.numCollisionPairs;
+  res["cachedCollisionPairs"] = (double)p.numCachedCollisionPairs;
+  res["preclusterContacts"] = (double)p.numPreclusterContacts;
+  res["contacts"] = (double)p.numContacts;
+  res["allocations"] = (double)p.numAllocations;
+  return res;
+}
+
 std::string Simulator::getStatusString(int s)
 {
   if(s < 0) s = getStatus();
@@ -4475,6 +4520,7 @@ std::string Simulator::getStatusString(int s)
 string Simulator::getState()
 {
   string str;
+  sim->SyncKinematicRobots();
   sim->WriteState(str);
   return ToBase64(str);
 }
@@ -4484,6 +4530,89 @@ void Simulator::setState(const string& str)
   sim->ReadState(FromBase64(str));
 }
 
+unsigned long long Simulator::getStateChecksum()
+{
+  sim->SyncKinematicRobots();
+  return sim->StateChecksum();
+}
+
+PyObject* Simulator::getStateVector(PyObject* out)
+{
+#ifdef IS_PY3K
+  int n = sim->StateVectorSize();
+  if(out && out != Py_None) {
+    //written in place, so that per-step calls don't allocate
+    Py_buffer view;
+    if(PyObject_GetBuffer(out,&view,PyBUF_C_CONTIGUOUS | PyBUF_FORMAT | PyBUF_WRITABLE) < 0)
+      throw PyException("getStateVector: out must be a writable contiguous buffer");
+    const char* fmt = (view.format ? view.format : "B");
+    if(fmt[0] == '@' || fmt[0] == '=' || fmt[0] == '<') fmt++;
+    bool valid = (view.itemsize == sizeof(double) && strcmp(fmt,"d")==0 && view.len == Py_ssize_t(n*sizeof(double)));
+    if(valid && n > 0) sim->GetStateVector((double*)view.buf);
+    PyBuffer_Release(&view);
+    if(!valid) throw PyException("getStateVector: out must hold the right number of float64s");
+    Py_INCREF(out);
+    return out;
+  }
+  //the state is written straight into a bytearray that the view owns
+  PyObject* buf = PyByteArray_FromStringAndSize(NULL,Py_ssize_t(n)*sizeof(double));
+  if(buf && n > 0) sim->GetStateVector((double*)PyByteArray_AsString(buf));
+  return CastMemoryView(buf,"d",NULL);
+#else
+  throw PyException("State buffers are only supported in Python 3");
+  return NULL;
+#endif //IS_PY3K
+}
+
+void Simulator::setStateVector(PyObject* x)
+{
+  int n = sim->StateVectorSize();
+  if(PyObject_CheckBuffer(x)) {
+    Py_buffer view;
+    if(PyObject_GetBuffer(x,&view,PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) < 0)
+      throw PyException("setStateVector: argument must be a contiguous buffer");
+    //accepts "d" with an optional native byte order prefix
+    const char* fmt = (view.format ? view.format : "B");
+    if(fmt[0] == '@' || fmt[0] == '=' || fmt[0] == '<') fmt++;
+    bool valid = (view.itemsize == sizeof(double) && strcmp(fmt,"d")==0 && view.len == Py_ssize_t(n*sizeof(double)));
+    if(valid) sim->SetStateVector((const double*)view.buf);
+    PyBuffer_Release(&view);
+    if(!valid) throw PyException("setStateVector: argument must hold the right number of float64s");
+    return;
+  }
+  //slow path for lists
+  if(!PySequence_Check(x) || PySequence_Size(x) != n)
+    throw PyException("setStateVector: argument has the wrong size");
+  vector<double> temp(n);
+  for(int i=0;i<n;i++) {
+    PyObject* item = PySequence_GetItem(x,i);
+    temp[i] = PyFloat_AsDouble(item);
+    Py_XDECREF(item);
+  }
+  if(PyErr_Occurred()) throw PyException("setStateVector: argument must contain numbers");
+  if(n > 0) sim->SetStateVector(&temp[0]);
+}
+
+std::vector<std::string> Simulator::getStateVectorNames()
+{
+  vector<StateVectorBlock> blocks;
+  sim->GetStateVectorLayout(blocks);
+  std::vector<std::string> res(blocks.size());
+  for(size_t i=0;i<blocks.size();i++)
+    res[i] = blocks[i].name;
+  return res;
+}
+
+void Simulator::getStateVectorOffsets(std::vector<int>& out)
+{
+  vector<StateVectorBlock> blocks;
+  sim->GetStateVectorLayout(blocks);
+  out.resize(blocks.size()+1);
+  for(size_t i=0;i<blocks.size();i++)
+    out[i] = blocks[i].offset;
+  out[blocks.size()] = sim->StateVectorSize();
+}
+
 void Simulator::checkObjectOverlap(std::vector<int>& out,std::vector<int>& out2)
 {
   vector<pair<ODEObjectID,ODEObjectID> > overlaps;
@@ -4500,6 +4629,27 @@ void Simulator::simulate(double t)
 {
   sim->Advance(t);
   sim->UpdateModel();
+  SimulationLogWriter* log = sims[index]->log.get();
+  if(log && !log->SaveStep(*sim))
+    throw PyException("Simulator.simulate(): error writing to the log");
+}
+
+void Simulator::beginLog(const std::string& fn,double quantum,bool compress)
+{
+  shared_ptr<SimulationLogWriter> log = make_shared<SimulationLogWriter>();
+  log->quantum = quantum;
+  log->compress = compress;
+  if(!log->Open(fn.c_str(),*sim))
+    throw PyException("Simulator.beginLog(): could not open the log file");
+  sims[index]->log = log;
+}
+
+void Simulator::endLog()
+{
+  shared_ptr<SimulationLogWriter> log = sims[index]->log;
+  sims[index]->log.reset();
+  if(log && !log->Close())
+    throw PyException("Simulator.endLog(): error writing the log");
 }
 
 void Simulator::fakeSimulate(double t)
@@ -4523,6 +4673,7 @@ void Simulator::getActualConfig(int robot,std::vector<double>& out)
   if(robot < 0 || robot>= (int)sim->controlSimulators.size()) 
     throw PyException("Invalid robot index, out of bounds");
   Vector qv;
+  sim->SyncKinematicRobots();
   sim->controlSimulators[robot].GetSimulatedConfig(qv);
   out = qv;
 }
@@ -4532,6 +4683,7 @@ void Simulator::getActualVelocity(int robot,std::vector<double>& out)
   if(robot < 0 || robot>= (int)sim->controlSimulators.size()) 
     throw PyException("Invalid robot index, out of bounds");
   Vector qv;
+  sim->SyncKinematicRobots();
   sim->controlSimulators[robot].GetSimulatedVelocity(qv);
   out = qv;
 }
@@ -4613,6 +4765,16 @@ void Simulator::getContactForces(int aid,int bid,std::vector<std::vector<double>
   }
 }
 
+void Simulator::getContactIDs(int aid,int bid,std::vector<int>& out)
+{
+  ODEContactList* c=sim->GetContactList(aid,bid);
+  if(!c) {
+    out.resize(0);
+    return;
+  }
+  out = c->ids;
+}
+
 bool Simulator::hadContact(int aid,int bid)
 {
   return sim->HadContact(aid,bid);
@@ -4695,9 +4857,13 @@ void Simulator::setSimStep(double dt)
 
 std::vector<std::string> Simulator::settings()
 {
-  std::vector<std::string> res; res.reserve(17);
+  std::vector<std::string> res; res.reserve(27);
   res.push_back("gravity");
   res.push_back("autoDisable");
+  res.push_back("sleeping");
+  res.push_back("sleepTime");
+  res.push_back("sleepLinearVelocity");
+  res.push_back("sleepAngularVelocity");
   res.push_back("boundaryLayerCollisions");
   res.push_back("rigidObjectCollisions");
   res.push_back("robotSelfCollisions");
@@ -4706,6 +4872,13 @@ std::vector<std::string> Simulator::settings()
   res.push_back("minimumAdaptiveTimeStep");
   res.push_back("maxContacts");
   res.push_back("clusterNormalScale");
+  res.push_back("contactReduction");
+  res.push_back("contactBudget");
+  res.push_back("collisionThreads");
+  res.push_back("collisionCaching");
+  res.push_back("deterministic");
+  res.push_back("asyncSensors");
+  res.push_back("kinematic");
   res.push_back("errorReductionParameter");
   res.push_back("dampedLeastSquaresParameter");
   res.push_back("instabilityConstantEnergyThreshold");
@@ -4722,6 +4895,10 @@ std::string Simulator::getSetting(const std::string& name)
   if(name == "gravity") ss << Vector3(settings.gravity);
   else if(name == "simStep") ss << sim->simStep;
   else if(name == "autoDisable") ss >> settings.autoDisable;
+  else if(name == "sleeping") ss << settings.sleeping;
+  else if(name == "sleepTime") ss << settings.sleepTime;
+  else if(name == "sleepLinearVelocity") ss << settings.sleepLinearVelocity;
+  else if(name == "sleepAngularVelocity") ss << settings.sleepAngularVelocity;
   else if(name == "boundaryLayerCollisions") ss << settings.boundaryLayerCollisions;
   else if(name == "rigidObjectCollisions") ss << settings.rigidObjectCollisions;
   else if(name == "robotSelfCollisions") ss << settings.robotSelfCollisions;
@@ -4730,6 +4907,13 @@ std::string Simulator::getSetting(const std::string& name)
   else if(name == "minimumAdaptiveTimeStep") ss << settings.minimumAdaptiveTimeStep;
   else if(name == "maxContacts") ss << settings.maxContacts;
   else if(name == "clusterNormalScale") ss << settings.clusterNormalScale;
+  else if(name == "contactReduction") ss << (int)settings.contactReduction;
+  else if(name == "contactBudget") ss << settings.contactBudget;
+  else if(name == "collisionThreads") ss << settings.collisionThreads;
+  else if(name == "collisionCaching") ss << settings.collisionCaching;
+  else if(name == "deterministic") ss << settings.deterministic;
+  else if(name == "asyncSensors") ss << sim->asyncSensors;
+  else if(name == "kinematic") ss << sim->kinematicSimulation;
   else if(name == "errorReductionParameter") ss << settings.errorReductionParameter;
   else if(name == "dampedLeastSquaresParameter") ss << settings.dampedLeastSquaresParameter;
   else if(name == "instabilityConstantEnergyThreshold") ss << settings.instabilityConstantEnergyThreshold;
@@ -4747,6 +4931,10 @@ void Simulator::setSetting(const std::string& name,const std::string& value)
   if(name == "gravity") { Vector3 g; ss >> g; sim->odesim.SetGravity(g); }
   else if(name == "simStep") ss >> sim->simStep;
   else if(name == "autoDisable") { ss >> settings.autoDisable; sim->odesim.SetAutoDisable(settings.autoDisable); }
+  else if(name == "sleeping") ss >> settings.sleeping;
+  else if(name == "sleepTime") ss >> settings.sleepTime;
+  else if(name == "sleepLinearVelocity") ss >> settings.sleepLinearVelocity;
+  else if(name == "sleepAngularVelocity") ss >> settings.sleepAngularVelocity;
   else if(name == "boundaryLayerCollisions") ss >> settings.boundaryLayerCollisions;
   else if(name == "rigidObjectCollisions") ss >> settings.rigidObjectCollisions;
   else if(name == "robotSelfCollisions") ss >> settings.robotSelfCollisions;
@@ -4755,6 +4943,25 @@ void Simulator::setSetting(const std::string& name,const std::string& value)
   else if(name == "minimumAdaptiveTimeStep") ss >> settings.minimumAdaptiveTimeStep;
   else if(name == "maxContacts") ss >> settings.maxContacts;
   else if(name == "clusterNormalScale") ss >> settings.clusterNormalScale;
+  else if(name == "contactReduction") {
+    int method;
+    ss >> method;
+    if(ss.fail() || method < ODESimulatorSettings::ContactReductionKMeans || method > ODESimulatorSettings::ContactReductionVoxelGrid)
+      throw PyException("Invalid contactReduction in Simulator.setSetting(), must be 0 (k-means) or 1 (voxel grid)");
+    settings.contactReduction = (ODESimulatorSettings::ContactReduction)method;
+  }
+  else if(name == "contactBudget") ss >> settings.contactBudget;
+  else if(name == "collisionThreads") ss >> settings.collisionThreads;
+  else if(name == "collisionCaching") ss >> settings.collisionCaching;
+  else if(name == "deterministic") ss >> settings.deterministic;
+  else if(name == "asyncSensors") ss >> sim->asyncSensors;
+  else if(name == "kinematic") {
+    bool kinematic;
+    ss >> kinematic;
+    //the ODE bodies must be current when physics resumes
+    if(!kinematic) sim->SyncKinematicRobots();
+    sim->kinematicSimulation = kinematic;
+  }
   else if(name == "errorReductionParameter") { ss >> settings.errorReductionParameter; sim->odesim.SetERP(settings.errorReductionParameter); }
   else if(name == "dampedLeastSquaresParameter") { ss >> settings.dampedLeastSquaresParameter; sim->odesim.SetCFM(settings.dampedLeastSquaresParameter); }
   else if(name == "instabilityConstantEnergyThreshold") ss >> settings.instabilityConstantEnergyThreshold;
@@ -4765,6 +4972,49 @@ void Simulator::setSetting(const std::string& name,const std::string& value)
   if(ss.bad()) throw PyException("Invalid value string argument in Simulator.setSetting()");
 }
 
+void Simulator::batchSimulate(const std::vector<std::vector<double> >& initialConfigs,const std::vector<std::vector<double> >& initialVelocities,double duration,double dt,int numThreads,std::vector<double>& out,std::vector<int>& out2)
+{
+  if(dt <= 0) throw PyException("Simulator.batchSimulate(): dt must be positive");
+  if(!initialVelocities.empty() && initialVelocities.size() != initialConfigs.size())
+    throw PyException("Simulator.batchSimulate(): initialVelocities must be empty or the same size as initialConfigs");
+  RobotWorld& rworld=*worlds[world.index]->world;
+  int nq = 0;
+  for(size_t i=0;i<rworld.robots.size();i++)
+    nq += rworld.robots[i]->q.n;
+  vector<BatchRolloutCondition> rollouts(initialConfigs.size());
+  for(size_t k=0;k<rollouts.size();k++) {
+    if((int)initialConfigs[k].size() != nq)
+      throw PyException("Simulator.batchSimulate(): invalid size of initial configuration");
+    if(!initialVelocities.empty() && (int)initialVelocities[k].size() != nq)
+      throw PyException("Simulator.batchSimulate(): invalid size of initial velocity");
+    rollouts[k].robotConfigs.resize(rworld.robots.size());
+    if(!initialVelocities.empty())
+      rollouts[k].robotVelocities.resize(rworld.robots.size());
+    int ofs = 0;
+    for(size_t i=0;i<rworld.robots.size();i++) {
+      int n = rworld.robots[i]->q.n;
+      rollouts[k].robotConfigs[i].resize(n);
+      rollouts[k].robotConfigs[i].copy(&initialConfigs[k][ofs]);
+      if(!initialVelocities.empty()) {
+        rollouts[k].robotVelocities[i].resize(n);
+        rollouts[k].robotVelocities[i].copy(&initialVelocities[k][ofs]);
+      }
+      ofs += n;
+    }
+  }
+
+  BatchSimulator batch;
+  batch.settings = sim->odesim.GetSettings();
+  batch.simStep = sim->simStep;
+  sim->WriteState(batch.initialState);
+  batch.makeController = [](Robot* robot) { return shared_ptr<RobotController>(MakeController(robot)); };
+  batch.Init(&rworld,numThreads);
+  BatchSimulationTrace trace;
+  batch.Run(rollouts,duration,dt,trace);
+  out.swap(trace.states);
+  out2.swap(trace.statuses);
+}
+
 
 
 SimRobotController Simulator::controller(int robot)
@@ -5298,6 +5548,42 @@ void SimRobotSensor::getMeasurements(std::vector<double>& out)
   sensor->GetMeasurements(out);
 }
 
+//Returns a read-only memoryview of a copy of a rows x cols x channels
+//image.  The last dimension is dropped if channels = 1.  The sensor reuses
+//its image storage, so the view owns a copy rather than pointing into it.
+static PyObject* ImageMemoryView(const void* data,int rows,int cols,int channels,const char* format,int itemsize)
+{
+#ifdef IS_PY3K
+  PyObject* bytes = PyBytes_FromStringAndSize((const char*)data,Py_ssize_t(rows)*cols*channels*itemsize);
+  PyObject* shape = (channels == 1 ? Py_BuildValue("(ii)",rows,cols) : Py_BuildValue("(iii)",rows,cols,channels));
+  return CastMemoryView(bytes,format,shape);
+#else
+  throw PyException("Image buffers are only supported in Python 3");
+  return NULL;
+#endif //IS_PY3K
+}
+
+PyObject* SimRobotSensor::getColorImageBuffer()
+{
+  CameraSensor* camera = dynamic_cast<CameraSensor*>(sensor);
+  if(!camera || !camera->ColorImage()) Py_RETURN_NONE;
+  return ImageMemoryView(camera->ColorImage(),camera->yres,camera->xres,3,"B",1);
+}
+
+PyObject* SimRobotSensor::getDepthImageBuffer()
+{
+  CameraSensor* camera = dynamic_cast<CameraSensor*>(sensor);
+  if(!camera || !camera->DepthImage()) Py_RETURN_NONE;
+  return ImageMemoryView(camera->DepthImage(),camera->yres,camera->xres,1,"f",sizeof(float));
+}
+
+PyObject* SimRobotSensor::getSegmentationImageBuffer()
+{
+  CameraSensor* camera = dynamic_cast<CameraSensor*>(sensor);
+  if(!camera || !camera->SegmentationImage()) Py_RETURN_NONE;
+  return ImageMemoryView(camera->SegmentationImage(),camera->yres,camera->xres,1,"i",sizeof(int));
+}
+
 std::vector<std::string> SimRobotSensor::settings()
 {
   std::vector<std::string> res;
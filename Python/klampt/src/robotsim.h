@@ -7,6 +7,10 @@
 #include <stddef.h>
 #include "robotmodel.h"
 
+// Forward declaration of C-type PyObject
+struct _object;
+typedef _object PyObject;
+
 class Simulator;
 class SimRobotController;
 
@@ -68,6 +72,27 @@ class SimRobotSensor
   std::vector<std::string> measurementNames();
   ///Returns a list of measurements from the previous simulation (or kinematicSimulate) timestep
   void getMeasurements(std::vector<double>& out);
+  ///For a CameraSensor, returns the color image from the previous timestep
+  ///as a read-only memoryview with shape (yres,xres,3) and uint8 r,g,b
+  ///channels.  The image is copied once, in a single block, and
+  ///``numpy.asarray(sensor.getColorImageBuffer())`` wraps it without any
+  ///further copying.  The view owns its memory, so it stays valid after
+  ///later timesteps or after the simulator is destroyed.  Returns None if
+  ///the sensor has no color image.
+  PyObject* getColorImageBuffer();
+  ///For a CameraSensor, returns the depth image from the previous timestep
+  ///as a read-only memoryview with shape (yres,xres) of float32s.  Same
+  ///ownership rules as :meth:`getColorImageBuffer`.  Returns None if the
+  ///sensor has no depth image.
+  PyObject* getDepthImageBuffer();
+  ///For a CameraSensor with the segmentation setting enabled, returns the
+  ///segmentation image from the previous timestep as a read-only memoryview
+  ///with shape (yres,xres) of int32 IDs, as returned by the getID() methods
+  ///of RobotModelLink, RigidObjectModel and TerrainModel, with -1 for the
+  ///background.  Same ownership rules as
+  ///:meth:`getColorImageBuffer`.  Returns None if the sensor has no
+  ///segmentation image.
+  PyObject* getSegmentationImageBuffer();
   ///Returns all setting names
   std::vector<std::string> settings();
   ///Returns the value of the named setting (you will need to manually parse this)
@@ -431,6 +456,30 @@ class Simulator
   /// Returns a string indicating the simulator's status.  If s is provided and >= 0,
   /// this function maps the indicator code s to a string.
   std::string getStatusString(int s=-1);
+  /// Turns on/off per-call timing and counters of the simulate() call.
+  void enableProfiling(bool enabled=true);
+  /** Returns the timings and counters of the last simulate() call, if
+   * profiling is enabled (see enableProfiling).  Times are in seconds.
+   *
+   * Keys are:
+   *
+   * - total: total time
+   * - collision, cluster: narrowphase collision detection and contact
+   *   clustering time
+   * - dynamics: time spent in ODE's dWorldStep
+   * - controller, sensor, hook: time spent in controller updates, sensor
+   *   simulation, and simulation hooks
+   * - steps: number of ODE sub-steps
+   * - rollbacks: number of adaptive time stepping rollbacks
+   * - collisionChecks: number of collision detection calls
+   * - collisionPairs: number of object pairs found by the broadphase
+   * - cachedCollisionPairs: number of those pairs that reused the results of
+   *   a prior collision detection call
+   * - preclusterContacts, contacts: number of contacts before / after
+   *   clustering, summed over all collision detection calls
+   * - allocations: number of times the contact storage had to grow
+   */
+  std::map<std::string,double> getProfile();
   /// Checks if any objects are overlapping. Returns a pair of lists of
   /// integers, giving the pairs of object ids that are overlapping.
   void checkObjectOverlap(std::vector<int>& out,std::vector<int>& out2);
@@ -441,6 +490,53 @@ class Simulator
   /// Sets the current simulation state from a Base64 string returned by
   /// a prior getState call.
   void setState(const std::string& str);
+  ///Returns a 64-bit hash of the binary state returned by :meth:`getState`.
+  ///With the "deterministic" setting, a simulation restored by setState and
+  ///advanced the same way reproduces the checksums of the original run, so
+  ///comparing them step by step finds where two runs diverge.
+  unsigned long long getStateChecksum();
+  ///Returns the physical state of all bodies as a flat, writable memoryview
+  ///of float64s.  ``numpy.asarray(sim.getStateVector())`` gives an array
+  ///without copying.  The state concatenates each robot's configuration
+  ///and velocity, then each rigid object's rotation matrix (column major),
+  ///translation, angular velocity, and linear velocity; see
+  ///:meth:`getStateVectorNames`.
+  ///
+  ///Each call returns a new view that owns its own copy of the state, so
+  ///it stays valid after the simulation advances or is destroyed.  To
+  ///avoid allocating on each step, pass a writable, contiguous float64
+  ///buffer of the right size (e.g., a numpy array) as out; the state is
+  ///written into it and out is returned.  Unlike :meth:`getState`,
+  ///controller state is not included.
+  PyObject* getStateVector(PyObject* out=NULL);
+  ///Sets the physical state of all bodies from a flat array in the layout
+  ///of :meth:`getStateVector`.  A contiguous float64 numpy array (or any
+  ///object with the buffer protocol) is read without copying.  Controller
+  ///state is left as is, and the world model is not updated.
+  void setStateVector(PyObject* x);
+  ///Returns the names of the blocks of the state vector: "ROBOT.q",
+  ///"ROBOT.dq", "OBJECT.R", "OBJECT.t", "OBJECT.w", and "OBJECT.v"
+  std::vector<std::string> getStateVectorNames();
+  ///Returns the start of each block of the state vector, followed by the
+  ///size of the state vector
+  void getStateVectorOffsets(std::vector<int>& out);
+
+  /** @brief Starts logging the simulation to a compact binary file.
+   *
+   * After each :meth:`simulate` call, the state vector (see
+   * :meth:`getStateVector`), the robots' motor commands, and the contacts of
+   * the pairs with contact feedback enabled are appended to the log.  The
+   * log is much smaller and faster to write than the CSV files of
+   * :class:`klampt.sim.simlog.SimLogger`, and it can be replayed by
+   * :class:`klampt.sim.simlog.SimLogPlayback`.
+   *
+   * If quantum > 0, values are rounded to multiples of quantum; 0 is
+   * lossless.  If compress is true, the log is zlib-compressed if Klamp't
+   * was built with zlib.
+   */
+  void beginLog(const std::string& fn,double quantum=0,bool compress=false);
+  /// Finishes the log started by :meth:`beginLog`
+  void endLog();
 
   /// Advances the simulation by time t, and updates the world model from the
   /// simulation state.
@@ -488,6 +584,10 @@ class Simulator
   void getContacts(int aid,int bid,std::vector<std::vector<double> >& out);
   /// Returns the list of contact forces on object a at the last time step
   void getContactForces(int aid,int bid,std::vector<std::vector<double> >& out);
+  /// Returns the persistent ids of the contacts returned by getContacts.  A
+  /// contact keeps its id over time steps while it stays near the same place,
+  /// so that contacts and forces can be tracked from step to step.
+  void getContactIDs(int aid,int bid,std::vector<int>& out);
   /// Returns the contact force on object a at the last time step.  You can set
   /// bid to -1 to get the overall contact force on object a.
   void contactForce(int aid,int bid,double out[3]);
@@ -546,6 +646,13 @@ class Simulator
    * - simStep: the internal simulation step (default "0.001")
    * - autoDisable: whether to disable bodies that don't move much between time
    *   steps (default "0", set to "1" for many static objects)
+   * - sleeping: whether rigid objects that have come to rest are put to
+   *   sleep until disturbed.  Unlike autoDisable, works with adaptive time
+   *   stepping (default "0", set to "1" for many resting objects)
+   * - sleepTime: how long an object must be at rest before sleeping
+   *   (default "0.5")
+   * - sleepLinearVelocity, sleepAngularVelocity: velocity thresholds below
+   *   which an object is at rest (default "0.01", "0.05")
    * - boundaryLayerCollisions: whether to use the Klampt inflated boundaries
    *   for contact detection'(default "1", recommended)
    * - rigidObjectCollisions: whether rigid objects should collide (default "1")
@@ -559,6 +666,27 @@ class Simulator
    * - maxContacts: max # of clustered contacts between pairs of objects
    *   (default "20")
    * - clusterNormalScale: a parameter for clustering contacts (default "0.1")
+   * - contactReduction: method used to reduce contacts to maxContacts, 0 for
+   *   k-means clustering, 1 for voxel grid binning (faster) (default "0")
+   * - contactBudget: if > 0, the contacts found between each pair of
+   *   objects are reduced to at most this many, picked to cover the contact
+   *   region, before clustering.  All contacts are still found, but
+   *   clustering gets far fewer of them (default "0")
+   * - collisionThreads: number of threads used for narrowphase collision
+   *   detection, 0 for all hardware threads (default "1")
+   * - collisionCaching: whether to reuse the narrowphase results of pairs of
+   *   objects that have not moved (default "0")
+   * - deterministic: whether contacts are generated in a canonical order, so
+   *   that runs restored from the same state give bitwise identical results
+   *   (default "0")
+   * - asyncSensors: whether laser range sensors and cameras that don't use
+   *   OpenGL framebuffers are simulated on a worker thread, overlapping with
+   *   physics.  Measurements arrive after each sensor's "latency" setting
+   *   (default "0")
+   * - kinematic: whether robots are moved directly to their commanded
+   *   setpoints without physics, for simulating large fleets of robots.
+   *   Rigid objects don't move, and only the joint sensors are updated each
+   *   step (default "0")
    * - errorReductionParameter: see ODE docs on ERP (default "0.95")
    * - dampedLeastSquaresParameter: see ODE docs on CFM (default "1e-6")
    * - instabilityConstantEnergyThreshold: parameter c0 in instability correction
@@ -581,6 +709,28 @@ class Simulator
   /// unknown or the value is of improper format
   void setSetting(const std::string& name,const std::string& value);
 
+  /** @brief Runs many rollouts of this simulation in parallel, each starting
+   * from the current simulation state and settings.
+   *
+   * Rollout i sets the robots' configurations to initialConfigs[i] and, if
+   * initialVelocities is nonempty, their velocities to
+   * initialVelocities[i].  Each of these is the concatenation of the values
+   * for all robots.  Each robot uses a fresh default controller.
+   *
+   * The rollouts are simulated for the given duration and sampled every dt
+   * seconds, giving numSamples = round(duration/dt)+1 samples each.  The
+   * first returned list is the flattened array of shape
+   * (N,numSamples,stateSize) of simulation states.  Each state concatenates
+   * each robot's configuration and velocity, then for each rigid object
+   * its rotation matrix (column major), translation, angular velocity, and
+   * linear velocity.  The second returned list holds the N*numSamples
+   * statuses (see getStatus).
+   *
+   * numThreads<=0 uses all hardware threads.  This Simulator is not
+   * changed.
+   */
+  void batchSimulate(const std::vector<std::vector<double> >& initialConfigs,const std::vector<std::vector<double> >& initialVelocities,double duration,double dt,int numThreads,std::vector<double>& out,std::vector<int>& out2);
+
   int index;
   WorldModel world;
   WorldSimulation* sim;
@@ -28,6 +28,7 @@ namespace std {
    %template(intVector) vector<int>;
    %template(doubleMatrix) vector<vector<double> >;
    %template(stringMap) map<string,string>;
+   %template(doubleMap) map<string,double>;
 };
 
 %exception {
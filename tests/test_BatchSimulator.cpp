@@ -0,0 +1,146 @@
+#include <Klampt/Simulation/BatchSimulator.h>
+#include <KrisLibrary/meshing/MeshPrimitives.h>
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <vector>
+
+static Meshing::TriMesh MakeBox(const Math3D::Vector3& dims)
+{
+    Math3D::Box3D box;
+    box.dims = dims;
+    box.origin = -0.5*dims;
+    box.xbasis.set(1,0,0);
+    box.ybasis.set(0,1,0);
+    box.zbasis.set(0,0,1);
+    Meshing::TriMesh mesh;
+    Meshing::MakeTriMesh(box,mesh);
+    return mesh;
+}
+
+class testBatchSimulator: public ::testing::Test
+{
+public:
+
+protected:
+    RobotWorld world;
+    ODESimulatorSettings settings;
+    std::vector<BatchRolloutCondition> rollouts;
+    const double duration,dt;
+
+    testBatchSimulator() : duration(0.5),dt(0.01)
+    {
+        int index = world.AddTerrain("ground",new Terrain());
+        Terrain* t = world.terrains[index].get();
+        *t->geometry.CreateEmpty() = Geometry::AnyCollisionGeometry3D(MakeBox(Math3D::Vector3(2,2,0.2)));
+        t->InitCollisions();
+        for(int i=0;i<2;i++) {
+            index = world.AddRigidObject("box",new RigidObject());
+            RigidObject* obj = world.rigidObjects[index].get();
+            *obj->geometry.CreateEmpty() = Geometry::AnyCollisionGeometry3D(MakeBox(Math3D::Vector3(0.2,0.2,0.2)));
+            obj->SetMassFromGeometry(0.5);
+            obj->T.t.set(0.3*i,0,0.3);
+            obj->InitCollisions();
+        }
+        settings.deterministic = true;
+        //each rollout drops the boxes from a different pose
+        rollouts.resize(6);
+        for(size_t r=0;r<rollouts.size();r++) {
+            for(size_t i=0;i<world.rigidObjects.size();i++) {
+                Math3D::RigidTransform T = world.rigidObjects[i]->T;
+                T.R.setRotateZ(0.2*r+0.5*i);
+                T.t.z += 0.05*r;
+                rollouts[r].objectTransforms.push_back(T);
+            }
+            rollouts[r].objectVelocities.push_back(Math3D::Vector3(0.1*r,0,0));
+        }
+    }
+
+    //runs rollout r on a plain WorldSimulation of world, set up the way
+    //BatchSimulator sets up its rollouts, and returns the state of each
+    //sample
+    std::vector<double> RunSerial(int r,int numSamples) {
+        WorldSimulation sim;
+        sim.odesim.GetSettings() = settings;
+        sim.odesim.GetSettings().collisionThreads = 1;
+        sim.simStep = WorldSimulation().simStep;
+        sim.Init(&world);
+        sim.odesim.SetGravity(Math3D::Vector3(settings.gravity));
+        sim.odesim.SetERP(settings.errorReductionParameter);
+        sim.odesim.SetCFM(settings.dampedLeastSquaresParameter);
+        for(size_t i=0;i<rollouts[r].objectTransforms.size();i++)
+            sim.odesim.object(i)->SetTransform(rollouts[r].objectTransforms[i]);
+        for(size_t i=0;i<rollouts[r].objectVelocities.size();i++)
+            sim.odesim.object(i)->SetVelocity(Math3D::Vector3(0.0),rollouts[r].objectVelocities[i]);
+        int n = sim.StateVectorSize();
+        std::vector<double> states(numSamples*n);
+        sim.GetStateVector(&states[0]);
+        for(int k=1;k<numSamples;k++) {
+            sim.Advance(dt);
+            sim.GetStateVector(&states[k*n]);
+        }
+        return states;
+    }
+};
+
+TEST_F(testBatchSimulator, testMatchesSerial)
+{
+    BatchSimulator batch;
+    batch.settings = settings;
+    batch.simStep = WorldSimulation().simStep;
+    batch.Init(&world,3);
+    BatchSimulationTrace trace;
+    ASSERT_TRUE(batch.Run(rollouts,duration,dt,trace));
+    ASSERT_EQ(trace.numRollouts,(int)rollouts.size());
+    ASSERT_EQ(trace.numSamples,51);
+    ASSERT_EQ(trace.stateSize,36);
+    ASSERT_EQ(trace.states.size(),size_t(trace.numRollouts)*trace.numSamples*trace.stateSize);
+    for(int r=0;r<trace.numRollouts;r++) {
+        EXPECT_EQ(trace.lengths[r],trace.numSamples);
+        std::vector<double> serial = RunSerial(r,trace.numSamples);
+        ASSERT_EQ(serial.size(),size_t(trace.numSamples)*trace.stateSize);
+        const double* states = &trace.states[size_t(r)*trace.numSamples*trace.stateSize];
+        for(size_t k=0;k<serial.size();k++)
+            ASSERT_EQ(states[k],serial[k]) << "rollout " << r << " entry " << k;
+    }
+}
+
+TEST_F(testBatchSimulator, testThreadIndependence)
+{
+    std::vector<double> states[2];
+    for(int i=0;i<2;i++) {
+        BatchSimulator batch;
+        batch.settings = settings;
+        batch.Init(&world,(i==0 ? 1 : 4));
+        BatchSimulationTrace trace;
+        ASSERT_TRUE(batch.Run(rollouts,duration,dt,trace));
+        states[i] = trace.states;
+    }
+    EXPECT_TRUE(states[0] == states[1]);
+}
+
+TEST_F(testBatchSimulator, testTermination)
+{
+    BatchSimulator batch;
+    batch.settings = settings;
+    batch.simTerm = [](int rollout,WorldSimulation& sim) { return sim.time >= 0.1*(rollout+1)-1e-9; };
+    batch.Init(&world,2);
+    BatchSimulationTrace trace;
+    ASSERT_TRUE(batch.Run(rollouts,duration,dt,trace));
+    for(int r=0;r<trace.numRollouts;r++) {
+        int expected = std::min(1+10*(r+1),trace.numSamples);
+        EXPECT_EQ(trace.lengths[r],expected);
+        //the remaining samples repeat the last state
+        size_t n = trace.stateSize;
+        const double* last = &trace.states[(size_t(r)*trace.numSamples+trace.lengths[r]-1)*n];
+        for(int k=trace.lengths[r];k<trace.numSamples;k++) {
+            const double* x = &trace.states[(size_t(r)*trace.numSamples+k)*n];
+            for(size_t j=0;j<n;j++)
+                ASSERT_EQ(x[j],last[j]);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
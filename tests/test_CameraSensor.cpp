@@ -0,0 +1,113 @@
+#include <Klampt/Sensing/VisualSensors.h>
+#include <Klampt/Modeling/World.h>
+#include <KrisLibrary/meshing/MeshPrimitives.h>
+#include <gtest/gtest.h>
+#include <math.h>
+
+class testCameraSensor: public ::testing::Test
+{
+public:
+
+protected:
+    RobotWorld world;
+    Robot robot;
+    CameraSensor camera;
+    int boxID;
+
+    testCameraSensor()
+    {
+        //a 1m box straddling the optical axis, 1.5m in front of the camera
+        Math3D::Box3D box;
+        box.dims.set(1,1,1);
+        box.origin.set(-0.5,-0.5,1.5);
+        box.xbasis.set(1,0,0);
+        box.ybasis.set(0,1,0);
+        box.zbasis.set(0,0,1);
+        Meshing::TriMesh mesh;
+        Meshing::MakeTriMesh(box,mesh);
+        int index = world.AddTerrain("box",new Terrain());
+        Terrain* terrain = world.terrains[index].get();
+        *terrain->geometry.CreateEmpty() = Geometry::AnyCollisionGeometry3D(mesh);
+        terrain->InitCollisions();
+        boxID = world.TerrainID(index);
+    }
+
+    virtual void SetUp() {
+        //link = -1 puts the camera at the world origin, looking along +z
+        camera.useGLFramebuffers = false;
+        camera.rgb = true;
+        camera.depth = true;
+        camera.segmentation = true;
+        camera.xres = 64;
+        camera.yres = 48;
+    }
+
+    virtual void TearDown() {
+    }
+
+};
+
+TEST_F(testCameraSensor, testDefaultRenderer)
+{
+    CameraSensor defaults;
+    ASSERT_FALSE(defaults.useSoftwareRenderer);
+}
+
+TEST_F(testCameraSensor, testSoftwareMatchesRayCast)
+{
+    int n = camera.xres*camera.yres;
+    camera.useSoftwareRenderer = false;
+    camera.SimulateKinematic(robot,world);
+    std::vector<float> castDepth(camera.DepthImage(),camera.DepthImage()+n);
+    std::vector<int> castIDs(camera.SegmentationImage(),camera.SegmentationImage()+n);
+
+    camera.useSoftwareRenderer = true;
+    camera.SimulateKinematic(robot,world);
+    const float* depth = camera.DepthImage();
+    const int* ids = camera.SegmentationImage();
+    const unsigned char* color = camera.ColorImage();
+    ASSERT_TRUE(depth != NULL);
+    ASSERT_TRUE(ids != NULL);
+    ASSERT_TRUE(color != NULL);
+
+    //the two only disagree on pixels that straddle the box's silhouette
+    int mismatches = 0;
+    for(int k=0;k<n;k++) {
+        if(ids[k] != castIDs[k] || std::fabs(depth[k]-castDepth[k]) > 1e-2) mismatches++;
+    }
+    EXPECT_LE(mismatches,n/20);
+
+    int center = (camera.yres/2)*camera.xres + camera.xres/2;
+    EXPECT_EQ(ids[center],boxID);
+    EXPECT_NEAR(depth[center],1.5,1e-3);
+    EXPECT_EQ(ids[0],-1);
+    EXPECT_FLOAT_EQ(depth[0],(float)camera.zmax);
+    EXPECT_EQ(color[0],0x96);
+    EXPECT_EQ(color[1],0xaa);
+    EXPECT_EQ(color[2],0xff);
+}
+
+TEST_F(testCameraSensor, testSegmentationColors)
+{
+    //labels must survive the conversion of the pass' float colors to the
+    //bytes of an 8 bit per channel framebuffer
+    int ids[] = {-1,0,1,254,255,256,4095,65535,65536,(1<<24)-2};
+    for(size_t i=0;i<sizeof(ids)/sizeof(int);i++) {
+        float rgb[3];
+        CameraSensor::SegmentationColor(ids[i],rgb);
+        unsigned char pixel[3];
+        for(int k=0;k<3;k++) {
+            ASSERT_GE(rgb[k],0.0f);
+            ASSERT_LE(rgb[k],1.0f);
+            pixel[k] = (unsigned char)(rgb[k]*255.0f+0.5f);
+        }
+        EXPECT_EQ(CameraSensor::SegmentationLabel(pixel),ids[i]);
+    }
+    unsigned char background[3] = {0,0,0};
+    EXPECT_EQ(CameraSensor::SegmentationLabel(background),-1);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,126 @@
+#include <Klampt/Simulation/WorldSimulation.h>
+#include <KrisLibrary/meshing/MeshPrimitives.h>
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+static Meshing::TriMesh MakeBox(const Math3D::Vector3& dims)
+{
+    Math3D::Box3D box;
+    box.dims = dims;
+    box.origin = -0.5*dims;
+    box.xbasis.set(1,0,0);
+    box.ybasis.set(0,1,0);
+    box.zbasis.set(0,0,1);
+    Meshing::TriMesh mesh;
+    Meshing::MakeTriMesh(box,mesh);
+    return mesh;
+}
+
+class testContactIDs: public ::testing::Test
+{
+public:
+
+protected:
+    RobotWorld world;
+    WorldSimulation sim;
+    ODEObjectID ground,box;
+
+    testContactIDs()
+    {
+        //the ground's top is at z=0.1, and the box rests on it at z=0.2
+        int index = world.AddTerrain("ground",new Terrain());
+        Terrain* t = world.terrains[index].get();
+        *t->geometry.CreateEmpty() = Geometry::AnyCollisionGeometry3D(MakeBox(Math3D::Vector3(2,2,0.2)));
+        t->InitCollisions();
+        index = world.AddRigidObject("box",new RigidObject());
+        RigidObject* obj = world.rigidObjects[index].get();
+        *obj->geometry.CreateEmpty() = Geometry::AnyCollisionGeometry3D(MakeBox(Math3D::Vector3(0.2,0.2,0.2)));
+        obj->SetMassFromGeometry(0.5);
+        obj->T.t.set(0,0,0.205);
+        obj->InitCollisions();
+        sim.simStep = 0.001;
+        sim.Init(&world);
+        ground = sim.WorldToODEID(world.TerrainID(0));
+        box = sim.WorldToODEID(world.RigidObjectID(0));
+        sim.odesim.EnableContactFeedback(ground,box);
+    }
+
+    //steps once and returns the sorted ids of the ground-box contacts
+    std::vector<int> Step() {
+        sim.Advance(0.001);
+        ODEContactList* contacts = sim.odesim.GetContactFeedback(ground,box);
+        EXPECT_TRUE(contacts != NULL);
+        if(!contacts) return std::vector<int>();
+        EXPECT_EQ(contacts->ids.size(),contacts->points.size());
+        std::vector<int> ids = contacts->ids;
+        std::sort(ids.begin(),ids.end());
+        //ids are unique within a step
+        EXPECT_TRUE(std::adjacent_find(ids.begin(),ids.end()) == ids.end());
+        return ids;
+    }
+};
+
+TEST_F(testContactIDs, testResting)
+{
+    for(int k=0;k<200;k++)
+        Step();
+    std::vector<int> ids = Step();
+    ASSERT_FALSE(ids.empty());
+    //a resting contact keeps its ids, although contacts at the edge of the
+    //contact region may come and go
+    for(int k=0;k<50;k++) {
+        std::vector<int> next = Step();
+        std::vector<int> kept;
+        std::set_intersection(ids.begin(),ids.end(),next.begin(),next.end(),std::back_inserter(kept));
+        EXPECT_GE(2*kept.size(),std::min(ids.size(),next.size())) << "step " << k;
+        ids = next;
+    }
+}
+
+TEST_F(testContactIDs, testSliding)
+{
+    for(int k=0;k<200;k++)
+        Step();
+    std::vector<int> ids = Step();
+    ASSERT_FALSE(ids.empty());
+    //slides 1mm per step, well within contactMatchTolerance
+    Math3D::Vector3 v(1,0,0);
+    int numKept = 0;
+    for(int k=0;k<20;k++) {
+        sim.odesim.object(0)->SetVelocity(Math3D::Vector3(0.0),v);
+        std::vector<int> next = Step();
+        for(size_t i=0;i<next.size();i++)
+            if(std::binary_search(ids.begin(),ids.end(),next[i])) numKept++;
+        ids = next;
+    }
+    EXPECT_GT(numKept,0);
+}
+
+TEST_F(testContactIDs, testBreakingContact)
+{
+    for(int k=0;k<200;k++)
+        Step();
+    std::vector<int> ids = Step();
+    ASSERT_FALSE(ids.empty());
+    //lift the box out of contact, then put it back
+    Math3D::RigidTransform T;
+    sim.odesim.object(0)->GetTransform(T);
+    Math3D::RigidTransform Tup = T;
+    Tup.t.z += 1;
+    sim.odesim.object(0)->SetTransform(Tup);
+    sim.odesim.object(0)->SetVelocity(Math3D::Vector3(0.0),Math3D::Vector3(0.0));
+    EXPECT_TRUE(Step().empty());
+    sim.odesim.object(0)->SetTransform(T);
+    sim.odesim.object(0)->SetVelocity(Math3D::Vector3(0.0),Math3D::Vector3(0.0));
+    std::vector<int> next = Step();
+    ASSERT_FALSE(next.empty());
+    //contacts that were broken get new ids
+    EXPECT_GT(next.front(),ids.back());
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
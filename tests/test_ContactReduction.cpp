@@ -0,0 +1,111 @@
+#include <Klampt/Simulation/WorldSimulation.h>
+#include <KrisLibrary/meshing/MeshPrimitives.h>
+#include <gtest/gtest.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+static Meshing::TriMesh MakeBox(const Math3D::Vector3& dims)
+{
+    Math3D::Box3D box;
+    box.dims = dims;
+    box.origin = -0.5*dims;
+    box.xbasis.set(1,0,0);
+    box.ybasis.set(0,1,0);
+    box.zbasis.set(0,0,1);
+    Meshing::TriMesh mesh;
+    Meshing::MakeTriMesh(box,mesh);
+    return mesh;
+}
+
+class testContactReduction: public ::testing::Test
+{
+public:
+
+protected:
+    RobotWorld world;
+    const int maxContacts;
+
+    testContactReduction() : maxContacts(8)
+    {
+        //the ground's top is at z=0.1, and the box rests on it at z=0.2
+        int index = world.AddTerrain("ground",new Terrain());
+        Terrain* t = world.terrains[index].get();
+        *t->geometry.CreateEmpty() = Geometry::AnyCollisionGeometry3D(MakeBox(Math3D::Vector3(2,2,0.2)));
+        t->InitCollisions();
+        index = world.AddRigidObject("box",new RigidObject());
+        RigidObject* obj = world.rigidObjects[index].get();
+        *obj->geometry.CreateEmpty() = Geometry::AnyCollisionGeometry3D(MakeBox(Math3D::Vector3(0.2,0.2,0.2)));
+        obj->SetMassFromGeometry(0.5);
+        obj->T.R.setRotateZ(0.3);
+        obj->T.t.set(0,0,0.205);
+        obj->InitCollisions();
+    }
+
+    //drops the box for numSteps steps of 1ms, checking the reduced contacts
+    //of each step, and returns the final state.  The simulation writes the
+    //box's pose back to the world, so it is restored afterwards
+    std::vector<double> Run(ODESimulatorSettings::ContactReduction mode,int numSteps,size_t& numFinalContacts) {
+        Math3D::RigidTransform T0 = world.rigidObjects[0]->T;
+        WorldSimulation sim;
+        sim.odesim.GetSettings().maxContacts = maxContacts;
+        sim.odesim.GetSettings().contactReduction = mode;
+        sim.simStep = 0.001;
+        sim.Init(&world);
+        ODEObjectID ground = sim.WorldToODEID(world.TerrainID(0));
+        ODEObjectID box = sim.WorldToODEID(world.RigidObjectID(0));
+        sim.odesim.EnableContactFeedback(ground,box);
+        numFinalContacts = 0;
+        for(int k=0;k<numSteps;k++) {
+            sim.Advance(0.001);
+            ODEContactList* contacts = sim.odesim.GetContactFeedback(ground,box);
+            EXPECT_TRUE(contacts != NULL);
+            if(!contacts) break;
+            EXPECT_LE((int)contacts->points.size(),maxContacts) << "step " << k;
+            //the kept contacts lie on the ground's surface
+            for(size_t i=0;i<contacts->points.size();i++)
+                EXPECT_NEAR(contacts->points[i].x.z,0.1,0.02) << "step " << k;
+            numFinalContacts = contacts->points.size();
+        }
+        std::vector<double> x(sim.StateVectorSize());
+        sim.GetStateVector(&x[0]);
+        world.rigidObjects[0]->T = T0;
+        world.rigidObjects[0]->UpdateGeometry();
+        return x;
+    }
+};
+
+TEST_F(testContactReduction, testVoxelGrid)
+{
+    size_t numContacts;
+    std::vector<double> x = Run(ODESimulatorSettings::ContactReductionVoxelGrid,300,numContacts);
+    //a resting box needs a support polygon
+    EXPECT_GE(numContacts,3u);
+    //the box's state is its transform, then its velocity
+    ASSERT_EQ(x.size(),18u);
+    EXPECT_NEAR(x[11],0.2,0.01);
+    for(int i=12;i<18;i++)
+        EXPECT_NEAR(x[i],0,0.05) << "entry " << i;
+
+    //the result only depends on the input
+    size_t numContacts2;
+    std::vector<double> x2 = Run(ODESimulatorSettings::ContactReductionVoxelGrid,300,numContacts2);
+    EXPECT_EQ(numContacts2,numContacts);
+    EXPECT_TRUE(x2 == x);
+}
+
+TEST_F(testContactReduction, testMatchesKMeans)
+{
+    size_t numVoxel,numKMeans;
+    std::vector<double> xv = Run(ODESimulatorSettings::ContactReductionVoxelGrid,300,numVoxel);
+    std::vector<double> xk = Run(ODESimulatorSettings::ContactReductionKMeans,300,numKMeans);
+    ASSERT_EQ(xv.size(),xk.size());
+    //both modes leave the box resting in the same place
+    for(size_t i=0;i<xv.size();i++)
+        EXPECT_NEAR(xv[i],xk[i],0.01) << "entry " << i;
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
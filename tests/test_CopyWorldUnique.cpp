@@ -0,0 +1,109 @@
+#include <Klampt/Simulation/WorldSimulation.h>
+#include <KrisLibrary/meshing/MeshPrimitives.h>
+#include <KrisLibrary/geometry/CollisionMesh.h>
+#include <gtest/gtest.h>
+#include <thread>
+
+static Meshing::TriMesh MakeBox(const Math3D::Vector3& dims)
+{
+    Math3D::Box3D box;
+    box.dims = dims;
+    box.origin = -0.5*dims;
+    box.xbasis.set(1,0,0);
+    box.ybasis.set(0,1,0);
+    box.zbasis.set(0,0,1);
+    Meshing::TriMesh mesh;
+    Meshing::MakeTriMesh(box,mesh);
+    return mesh;
+}
+
+class testCopyWorldUnique: public ::testing::Test
+{
+public:
+
+protected:
+    RobotWorld world;
+    RobotWorld copies[2];
+
+    testCopyWorldUnique()
+    {
+        //the ground's top is at z=0.1
+        int index = world.AddTerrain("ground",new Terrain());
+        Terrain* t = world.terrains[index].get();
+        *t->geometry.CreateEmpty() = Geometry::AnyCollisionGeometry3D(MakeBox(Math3D::Vector3(2,2,0.2)));
+        t->InitCollisions();
+        index = world.AddRigidObject("box",new RigidObject());
+        RigidObject* obj = world.rigidObjects[index].get();
+        *obj->geometry.CreateEmpty() = Geometry::AnyCollisionGeometry3D(MakeBox(Math3D::Vector3(0.2,0.2,0.2)));
+        obj->SetMassFromGeometry(0.5);
+        obj->T.t.set(0,0,1);
+        obj->InitCollisions();
+        for(int i=0;i<2;i++)
+            CopyWorldUnique(world,copies[i]);
+    }
+};
+
+TEST_F(testCopyWorldUnique, testSharing)
+{
+    const RigidObject& obj = *world.rigidObjects[0];
+    for(int i=0;i<2;i++) {
+        EXPECT_TRUE(&*copies[i].rigidObjects[0]->geometry != &*obj.geometry);
+        EXPECT_TRUE(&*copies[i].terrains[0]->geometry == &*world.terrains[0]->geometry);
+        ASSERT_TRUE(copies[i].rigidObjects[0]->geometry->CollisionDataInitialized());
+    }
+    EXPECT_TRUE(&*copies[0].rigidObjects[0]->geometry != &*copies[1].rigidObjects[0]->geometry);
+    //the copies share the BVH of the original
+    EXPECT_TRUE(copies[0].rigidObjects[0]->geometry->TriangleMeshCollisionData().pqpModel == obj.geometry->TriangleMeshCollisionData().pqpModel);
+    EXPECT_TRUE(copies[1].rigidObjects[0]->geometry->TriangleMeshCollisionData().pqpModel == obj.geometry->TriangleMeshCollisionData().pqpModel);
+}
+
+TEST_F(testCopyWorldUnique, testQueries)
+{
+    //each thread moves its copy's box in and out of the ground, out of step
+    //with the other
+    int errors[2] = {0,0};
+    std::vector<std::thread> threads;
+    for(int i=0;i<2;i++)
+        threads.push_back(std::thread([&,i]() {
+            RigidObject& obj = *copies[i].rigidObjects[0];
+            const Terrain& ground = *copies[i].terrains[0];
+            for(int k=0;k<1000;k++) {
+                bool touching = ((k+i)%2 == 0);
+                obj.T.t.set(0,0,touching ? 0.15 : 0.5);
+                obj.UpdateGeometry();
+                if(obj.geometry->Collides(*ground.geometry) != touching) errors[i]++;
+            }
+        }));
+    for(size_t i=0;i<threads.size();i++)
+        threads[i].join();
+    EXPECT_EQ(errors[0],0);
+    EXPECT_EQ(errors[1],0);
+    //the original is untouched
+    EXPECT_EQ(world.rigidObjects[0]->geometry->GetTransform().t.z,1.0);
+}
+
+TEST_F(testCopyWorldUnique, testSimulations)
+{
+    //one box starts resting on the ground, the other well above it
+    copies[0].rigidObjects[0]->T.t.set(0,0,0.2);
+    copies[1].rigidObjects[0]->T.t.set(0,0,3);
+    bool inContact[2] = {false,false};
+    std::vector<std::thread> threads;
+    for(int i=0;i<2;i++)
+        threads.push_back(std::thread([&,i]() {
+            WorldSimulation sim;
+            sim.Init(&copies[i]);
+            for(int k=0;k<20;k++)
+                sim.Advance(0.01);
+            inContact[i] = sim.InContact(copies[i].TerrainID(0),copies[i].RigidObjectID(0));
+        }));
+    for(size_t i=0;i<threads.size();i++)
+        threads[i].join();
+    EXPECT_TRUE(inContact[0]);
+    EXPECT_FALSE(inContact[1]);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
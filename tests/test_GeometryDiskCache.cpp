@@ -0,0 +1,125 @@
+#include <Klampt/Modeling/GeometryDiskCache.h>
+#include <KrisLibrary/meshing/MeshPrimitives.h>
+#include <KrisLibrary/geometry/CollisionMesh.h>
+#include <KrisLibrary/utils/fileutils.h>
+#include <KrisLibrary/utils/stringutils.h>
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+class testGeometryDiskCache: public ::testing::Test
+{
+public:
+
+protected:
+    std::string directory;
+    Geometry::AnyCollisionGeometry3D geom;
+
+    testGeometryDiskCache() : directory("test_GeometryDiskCache.cache")
+    {
+        Math3D::Box3D box;
+        box.dims.set(1,2,3);
+        box.origin.set(-0.5,-1,-1.5);
+        box.xbasis.set(1,0,0);
+        box.ybasis.set(0,1,0);
+        box.zbasis.set(0,0,1);
+        Meshing::TriMesh mesh;
+        Meshing::MakeTriMesh(box,mesh);
+        geom = Geometry::AnyCollisionGeometry3D(mesh);
+    }
+
+    virtual void TearDown() {
+        remove(JoinPath(directory,"box.kgc").c_str());
+        remove(directory.c_str());
+    }
+
+    //a cube of the given size, offset along x
+    Geometry::AnyCollisionGeometry3D MakeCube(double size,double x) {
+        Math3D::Box3D box;
+        box.dims.set(size,size,size);
+        box.origin.set(x-0.5*size,-0.5*size,-0.5*size);
+        box.xbasis.set(1,0,0);
+        box.ybasis.set(0,1,0);
+        box.zbasis.set(0,0,1);
+        Meshing::TriMesh mesh;
+        Meshing::MakeTriMesh(box,mesh);
+        Geometry::AnyCollisionGeometry3D res(mesh);
+        res.InitCollisionData();
+        return res;
+    }
+};
+
+TEST_F(testGeometryDiskCache, testKeys)
+{
+    std::string key1 = GeometryDiskCache::FileKey("tests/objects/block.obj");
+    std::string key2 = GeometryDiskCache::FileKey("tests/objects/cube.off");
+    ASSERT_FALSE(key1.empty());
+    ASSERT_FALSE(key2.empty());
+    EXPECT_NE(key1,key2);
+    EXPECT_EQ(key1,GeometryDiskCache::FileKey("tests/objects/block.obj"));
+    EXPECT_TRUE(GeometryDiskCache::FileKey("tests/objects/missing.obj").empty());
+
+    Math3D::Matrix4 xform;
+    xform.setIdentity();
+    std::string key3 = GeometryDiskCache::TransformKey(key1,xform);
+    EXPECT_NE(key3,key1);
+    EXPECT_EQ(key3,GeometryDiskCache::TransformKey(key1,xform));
+    xform(0,3) = 1;
+    EXPECT_NE(key3,GeometryDiskCache::TransformKey(key1,xform));
+}
+
+TEST_F(testGeometryDiskCache, testRoundTrip)
+{
+    Geometry::AnyCollisionGeometry3D loaded;
+    EXPECT_FALSE(GeometryDiskCache::Load(directory,"box",loaded));
+    ASSERT_TRUE(GeometryDiskCache::Save(directory,"box",geom));
+    ASSERT_TRUE(GeometryDiskCache::Load(directory,"box",loaded));
+
+    ASSERT_EQ(loaded.type,Geometry::AnyGeometry3D::TriangleMesh);
+    const Meshing::TriMesh& mesh = geom.AsTriangleMesh();
+    const Meshing::TriMesh& loadedMesh = loaded.AsTriangleMesh();
+    ASSERT_EQ(loadedMesh.verts.size(),mesh.verts.size());
+    ASSERT_EQ(loadedMesh.tris.size(),mesh.tris.size());
+    for(size_t i=0;i<mesh.verts.size();i++)
+        EXPECT_TRUE(loadedMesh.verts[i] == mesh.verts[i]);
+    for(size_t i=0;i<mesh.tris.size();i++) {
+        EXPECT_EQ(loadedMesh.tris[i].a,mesh.tris[i].a);
+        EXPECT_EQ(loadedMesh.tris[i].b,mesh.tris[i].b);
+        EXPECT_EQ(loadedMesh.tris[i].c,mesh.tris[i].c);
+    }
+
+    //the stored BVH answers queries without being rebuilt
+    ASSERT_TRUE(loaded.CollisionDataInitialized());
+    ASSERT_TRUE(loaded.TriangleMeshCollisionData().pqpModel != NULL);
+    Geometry::AnyCollisionGeometry3D nearCube = MakeCube(0.2,0.5);
+    Geometry::AnyCollisionGeometry3D farCube = MakeCube(0.2,2.0);
+    EXPECT_TRUE(loaded.Collides(nearCube));
+    EXPECT_FALSE(loaded.Collides(farCube));
+}
+
+TEST_F(testGeometryDiskCache, testConcurrentSaves)
+{
+    //threads saving the same entry must not clobber each other's
+    //temporary files
+    const int numThreads = 8;
+    std::vector<Geometry::AnyCollisionGeometry3D> geoms(numThreads,geom);
+    std::vector<char> saved(numThreads,0);
+    std::vector<std::thread> threads;
+    for(int i=0;i<numThreads;i++)
+        threads.push_back(std::thread([&,i]() {
+            saved[i] = GeometryDiskCache::Save(directory,"box",geoms[i]);
+        }));
+    for(size_t i=0;i<threads.size();i++)
+        threads[i].join();
+    for(int i=0;i<numThreads;i++)
+        EXPECT_TRUE(saved[i]);
+    Geometry::AnyCollisionGeometry3D loaded;
+    ASSERT_TRUE(GeometryDiskCache::Load(directory,"box",loaded));
+    EXPECT_EQ(loaded.AsTriangleMesh().tris.size(),geom.AsTriangleMesh().tris.size());
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,107 @@
+#include <Klampt/Modeling/Robot.h>
+#include <KrisLibrary/meshing/MeshPrimitives.h>
+#include <KrisLibrary/math3d/geometry3d.h>
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+class testGeometryLOD: public ::testing::Test
+{
+public:
+
+protected:
+    Meshing::TriMesh sphere;
+
+    testGeometryLOD()
+    {
+        //about 5000 triangles
+        Meshing::MakeTriSphere(50,50,sphere);
+    }
+};
+
+TEST_F(testGeometryLOD, testSimplify)
+{
+    Meshing::TriMesh out;
+    EXPECT_FALSE(GeometryLOD::Simplify(sphere,(int)sphere.tris.size(),out));
+    ASSERT_TRUE(GeometryLOD::Simplify(sphere,500,out));
+    EXPECT_GT(out.tris.size(),0u);
+    EXPECT_LE(out.tris.size(),600u);
+    for(size_t i=0;i<out.tris.size();i++) {
+        EXPECT_LT(out.tris[i].a,(int)out.verts.size());
+        EXPECT_LT(out.tris[i].b,(int)out.verts.size());
+        EXPECT_LT(out.tris[i].c,(int)out.verts.size());
+    }
+    //cluster means stay inside the unit sphere, near its surface
+    for(size_t i=0;i<out.verts.size();i++) {
+        EXPECT_LE(out.verts[i].norm(),1.0+1e-9);
+        EXPECT_GT(out.verts[i].norm(),0.8);
+    }
+}
+
+TEST_F(testGeometryLOD, testLevels)
+{
+    std::shared_ptr<Geometry::AnyCollisionGeometry3D> geom = std::make_shared<Geometry::AnyCollisionGeometry3D>(sphere);
+    geom->margin = 0.05;
+    geom->InitCollisionData();
+    GeometryLOD lod;
+    EXPECT_TRUE(lod.Get(GeometryLOD::BoundingBox) == NULL);
+    lod.Build(geom);
+    ASSERT_TRUE(lod.IsBuilt(geom));
+    ASSERT_TRUE(lod.levels[GeometryLOD::Simplified] != NULL);
+    ASSERT_TRUE(lod.levels[GeometryLOD::BoundingBox] != NULL);
+    EXPECT_TRUE(lod.Get(GeometryLOD::Original) == geom.get());
+
+    Math3D::RigidTransform T;
+    T.R.setRotateZ(0.5);
+    T.t.set(1,2,3);
+    geom->SetTransform(T);
+    for(int level=GeometryLOD::Simplified;level<GeometryLOD::NumLevels;level++) {
+        Geometry::AnyCollisionGeometry3D* g = lod.Get(level);
+        ASSERT_TRUE(g != NULL);
+        //the coarser levels keep the margin and follow the original
+        EXPECT_EQ(g->margin,0.05);
+        EXPECT_TRUE(g->GetTransform().t == T.t);
+        EXPECT_TRUE(g->GetTransform().R == T.R);
+    }
+    EXPECT_EQ(lod.levels[GeometryLOD::Simplified]->margin,0.05);
+    EXPECT_LE(lod.levels[GeometryLOD::Simplified]->AsTriangleMesh().tris.size(),size_t(GeometryLOD::simplifiedTris+GeometryLOD::simplifiedTris/5));
+
+    //primitives have no coarser levels
+    Math3D::Sphere3D s;
+    s.center.setZero();
+    s.radius = 1;
+    std::shared_ptr<Geometry::AnyCollisionGeometry3D> prim = std::make_shared<Geometry::AnyCollisionGeometry3D>(Math3D::GeometricPrimitive3D(s));
+    GeometryLOD primLOD;
+    primLOD.Build(prim);
+    EXPECT_TRUE(primLOD.Get(GeometryLOD::BoundingBox) == prim.get());
+}
+
+TEST_F(testGeometryLOD, testRobotConcurrentLookups)
+{
+    Robot robot;
+    ASSERT_TRUE(robot.Load("tests/objects/chain.rob"));
+    robot.UpdateGeometry();
+    //the levels are built by whichever thread asks first
+    const int numThreads = 8;
+    std::vector<std::vector<Geometry::AnyCollisionGeometry3D*> > found(numThreads);
+    std::vector<std::thread> threads;
+    for(int t=0;t<numThreads;t++)
+        threads.push_back(std::thread([&,t]() {
+            for(size_t i=0;i<robot.links.size();i++)
+                found[t].push_back(robot.IsGeometryEmpty(i) ? NULL : robot.GetGeometryLOD(i,GeometryLOD::BoundingBox));
+        }));
+    for(size_t t=0;t<threads.size();t++)
+        threads[t].join();
+    for(int t=1;t<numThreads;t++)
+        EXPECT_TRUE(found[t] == found[0]);
+    for(size_t i=0;i<robot.links.size();i++) {
+        if(robot.IsGeometryEmpty(i)) continue;
+        ASSERT_TRUE(found[0][i] != NULL);
+        EXPECT_EQ(found[0][i]->margin,robot.geometry[i]->margin);
+    }
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,136 @@
+#include <Klampt/Simulation/WorldSimulation.h>
+#include <Klampt/Sensing/JointSensors.h>
+#include <KrisLibrary/meshing/MeshPrimitives.h>
+#include <gtest/gtest.h>
+#include <math.h>
+#include <vector>
+
+//moves each joint 0.01 further than its sensed position on every update
+class IncrementController : public RobotController
+{
+public:
+    IncrementController(Robot& robot) : RobotController(robot) {}
+    virtual void Update(Real dt) {
+        Config q;
+        if(GetSensedConfig(q)) {
+            for(int i=0;i<q.n;i++) q(i) += 0.01;
+            SetPIDCommand(q);
+        }
+        RobotController::Update(dt);
+    }
+};
+
+class testKinematicSimulation: public ::testing::Test
+{
+public:
+
+protected:
+    RobotWorld world;
+    WorldSimulation sim;
+    const double dt;
+
+    testKinematicSimulation() : dt(0.01)
+    {
+        //the chain robot and a box in the air next to it
+        world.LoadRobot("tests/objects/chain.rob");
+        Math3D::Box3D box;
+        box.dims.set(0.1,0.1,0.1);
+        box.origin.set(-0.05,-0.05,-0.05);
+        box.xbasis.set(1,0,0);
+        box.ybasis.set(0,1,0);
+        box.zbasis.set(0,0,1);
+        Meshing::TriMesh mesh;
+        Meshing::MakeTriMesh(box,mesh);
+        int index = world.AddRigidObject("box",new RigidObject());
+        RigidObject* obj = world.rigidObjects[index].get();
+        *obj->geometry.CreateEmpty() = Geometry::AnyCollisionGeometry3D(mesh);
+        obj->SetMassFromGeometry(0.5);
+        obj->T.t.set(1,0,1);
+        obj->InitCollisions();
+        sim.Init(&world);
+        sim.kinematicSimulation = true;
+    }
+
+    RobotMotorCommand& Command() { return sim.controlSimulators[0].command; }
+    Robot& TheRobot() { return *world.robots[0]; }
+};
+
+TEST_F(testKinematicSimulation, testPID)
+{
+    for(size_t i=0;i<Command().actuators.size();i++)
+        Command().actuators[i].SetPID(0.1*(i+1),0.2);
+    sim.Advance(dt);
+    EXPECT_NEAR(sim.time,dt,1e-12);
+    //PID drivers reach their setpoints exactly
+    for(int i=0;i<TheRobot().q.n;i++) {
+        EXPECT_EQ(TheRobot().q(i),0.1*(i+1));
+        EXPECT_EQ(TheRobot().dq(i),0.2);
+    }
+    //the frames and geometry follow
+    Math3D::RigidTransform T = TheRobot().links[4].T_World;
+    EXPECT_GT(T.t.norm(),0.5);
+    EXPECT_TRUE(TheRobot().geometry[4]->GetTransform().t == T.t);
+    //rigid objects don't move
+    EXPECT_EQ(world.rigidObjects[0]->T.t.z,1.0);
+    for(int k=0;k<5;k++)
+        sim.Advance(dt);
+    EXPECT_EQ(world.rigidObjects[0]->T.t.z,1.0);
+    EXPECT_EQ(TheRobot().q(0),0.1);
+}
+
+TEST_F(testKinematicSimulation, testLockedVelocity)
+{
+    for(size_t i=0;i<Command().actuators.size();i++)
+        Command().actuators[i].SetLockedVelocity((i%2 == 0 ? 1.0 : -2.0),100);
+    for(int k=0;k<10;k++)
+        sim.AdvanceKinematic(dt);
+    for(int i=0;i<TheRobot().q.n;i++) {
+        EXPECT_NEAR(TheRobot().q(i),(i%2 == 0 ? 0.1 : -0.2),1e-12);
+        EXPECT_EQ(TheRobot().dq(i),(i%2 == 0 ? 1.0 : -2.0));
+    }
+    //joints stop at their limits of +/-2.5
+    for(int k=0;k<200;k++)
+        sim.AdvanceKinematic(dt);
+    for(int i=0;i<TheRobot().q.n;i++) {
+        EXPECT_EQ(TheRobot().q(i),(i%2 == 0 ? 2.5 : -2.5));
+        EXPECT_EQ(TheRobot().dq(i),0.0);
+    }
+}
+
+TEST_F(testKinematicSimulation, testTorqueHoldsStill)
+{
+    Config q0 = TheRobot().q;
+    for(size_t i=0;i<Command().actuators.size();i++)
+        Command().actuators[i].SetTorque(10);
+    for(int k=0;k<10;k++)
+        sim.AdvanceKinematic(dt);
+    EXPECT_TRUE(TheRobot().q == q0);
+    //nothing moved, so there is nothing to sync
+    EXPECT_FALSE(sim.controlSimulators[0].StepKinematic(dt,world));
+}
+
+TEST_F(testKinematicSimulation, testController)
+{
+    //the controller reads the joint position sensor, which kinematic steps
+    //keep up to date
+    sim.controlSimulators[0].sensors.sensors.push_back(make_shared<JointPositionSensor>());
+    sim.SetController(0,make_shared<IncrementController>(TheRobot()));
+    for(int k=0;k<10;k++)
+        sim.AdvanceKinematic(dt);
+    for(int i=0;i<TheRobot().q.n;i++)
+        EXPECT_NEAR(TheRobot().q(i),0.1,1e-9);
+
+    //the ODE bodies catch up when synced
+    Config q;
+    sim.odesim.robot(0)->GetConfig(q);
+    EXPECT_NEAR(q(0),0,1e-6);
+    sim.SyncKinematicRobots();
+    sim.odesim.robot(0)->GetConfig(q);
+    for(int i=0;i<q.n;i++)
+        EXPECT_NEAR(q(i),0.1,1e-6);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,127 @@
+#include <ode/ode.h>
+#include <Klampt/Simulation/WorldSimulation.h>
+#include <KrisLibrary/meshing/MeshPrimitives.h>
+#include <gtest/gtest.h>
+#include <math.h>
+
+static void AddBox(RobotWorld& world,bool terrain,const Math3D::Vector3& dims)
+{
+    Math3D::Box3D box;
+    box.dims = dims;
+    box.origin = -0.5*dims;
+    box.xbasis.set(1,0,0);
+    box.ybasis.set(0,1,0);
+    box.zbasis.set(0,0,1);
+    Meshing::TriMesh mesh;
+    Meshing::MakeTriMesh(box,mesh);
+    if(terrain) {
+        int index = world.AddTerrain("ground",new Terrain());
+        Terrain* t = world.terrains[index].get();
+        *t->geometry.CreateEmpty() = Geometry::AnyCollisionGeometry3D(mesh);
+        t->InitCollisions();
+    }
+    else {
+        int index = world.AddRigidObject("box",new RigidObject());
+        RigidObject* obj = world.rigidObjects[index].get();
+        *obj->geometry.CreateEmpty() = Geometry::AnyCollisionGeometry3D(mesh);
+        obj->SetMassFromGeometry(0.5);
+        obj->T.t.set(0,0,0.16);
+        obj->InitCollisions();
+    }
+}
+
+class testObjectSleeping: public ::testing::Test
+{
+public:
+
+protected:
+    RobotWorld world;
+    WorldSimulation sim;
+    int groundID,boxID;
+
+    testObjectSleeping()
+    {
+        AddBox(world,true,Math3D::Vector3(2,2,0.2));
+        AddBox(world,false,Math3D::Vector3(0.2,0.2,0.2));
+        groundID = world.TerrainID(0);
+        boxID = world.RigidObjectID(0);
+        sim.odesim.GetSettings().sleeping = true;
+        sim.odesim.GetSettings().sleepTime = 0.1;
+        sim.Init(&world);
+        sim.EnableContactFeedback(groundID,boxID);
+    }
+
+    //steps until the box falls asleep, or gives up after 5 seconds
+    bool Settle() {
+        for(int i=0;i<500;i++) {
+            sim.Advance(0.01);
+            if(sim.odesim.ObjectAsleep(0)) return true;
+        }
+        return false;
+    }
+
+    //checks that the resting contact is reported with a force holding up
+    //the box
+    void CheckRestingContact() {
+        EXPECT_TRUE(sim.InContact(groundID,boxID));
+        EXPECT_TRUE(sim.HadContact(groundID,boxID));
+        ContactFeedbackInfo* info = sim.GetContactFeedback(groundID,boxID);
+        ASSERT_TRUE(info != NULL);
+        EXPECT_TRUE(info->inContact);
+        double weight = world.rigidObjects[0]->mass*9.8;
+        EXPECT_NEAR(fabs(info->meanForce.z),weight,0.1*weight);
+    }
+};
+
+TEST_F(testObjectSleeping, testSleepingContacts)
+{
+    ASSERT_TRUE(Settle());
+    Math3D::RigidTransform T;
+    sim.odesim.object(0)->GetTransform(T);
+    for(int i=0;i<10;i++) {
+        sim.Advance(0.01);
+        ASSERT_TRUE(sim.odesim.ObjectAsleep(0));
+        CheckRestingContact();
+    }
+    //sleeping objects are not moved
+    Math3D::RigidTransform T2;
+    sim.odesim.object(0)->GetTransform(T2);
+    EXPECT_TRUE(T2.t == T.t);
+}
+
+TEST_F(testObjectSleeping, testPoke)
+{
+    ASSERT_TRUE(Settle());
+    Math3D::RigidTransform T;
+    sim.odesim.object(0)->GetTransform(T);
+    //setting a velocity enables the body, which wakes it
+    sim.odesim.object(0)->SetVelocity(Math3D::Vector3(0.0),Math3D::Vector3(0.5,0,0));
+    sim.Advance(0.01);
+    EXPECT_FALSE(sim.odesim.ObjectAsleep(0));
+    sim.Advance(0.01);
+    Math3D::RigidTransform T2;
+    sim.odesim.object(0)->GetTransform(T2);
+    EXPECT_GT(T2.t.x,T.t.x);
+    CheckRestingContact();
+    //and it settles again
+    EXPECT_TRUE(Settle());
+}
+
+TEST_F(testObjectSleeping, testTurnOff)
+{
+    ASSERT_TRUE(Settle());
+    sim.odesim.GetSettings().sleeping = false;
+    sim.Advance(0.01);
+    EXPECT_FALSE(sim.odesim.ObjectAsleep(0));
+    EXPECT_TRUE(dBodyIsEnabled(sim.odesim.object(0)->body()) != 0);
+    for(int i=0;i<100;i++) {
+        sim.Advance(0.01);
+        ASSERT_FALSE(sim.odesim.ObjectAsleep(0));
+    }
+    CheckRestingContact();
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
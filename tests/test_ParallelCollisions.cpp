@@ -0,0 +1,93 @@
+#include <Klampt/Simulation/WorldSimulation.h>
+#include <KrisLibrary/meshing/MeshPrimitives.h>
+#include <gtest/gtest.h>
+#include <vector>
+
+static Meshing::TriMesh MakeBox(const Math3D::Vector3& dims)
+{
+    Math3D::Box3D box;
+    box.dims = dims;
+    box.origin = -0.5*dims;
+    box.xbasis.set(1,0,0);
+    box.ybasis.set(0,1,0);
+    box.zbasis.set(0,0,1);
+    Meshing::TriMesh mesh;
+    Meshing::MakeTriMesh(box,mesh);
+    return mesh;
+}
+
+class testParallelCollisions: public ::testing::Test
+{
+public:
+
+protected:
+    RobotWorld world;
+
+    testParallelCollisions()
+    {
+        //every box touches the shared terrain geom, and the boxes in each
+        //column touch one another
+        int index = world.AddTerrain("ground",new Terrain());
+        Terrain* t = world.terrains[index].get();
+        *t->geometry.CreateEmpty() = Geometry::AnyCollisionGeometry3D(MakeBox(Math3D::Vector3(4,4,0.2)));
+        t->InitCollisions();
+        for(int i=0;i<4;i++)
+            for(int j=0;j<4;j++)
+                for(int k=0;k<2;k++) {
+                    index = world.AddRigidObject("box",new RigidObject());
+                    RigidObject* obj = world.rigidObjects[index].get();
+                    *obj->geometry.CreateEmpty() = Geometry::AnyCollisionGeometry3D(MakeBox(Math3D::Vector3(0.2,0.2,0.2)));
+                    obj->SetMassFromGeometry(0.5);
+                    obj->T.R.setRotateZ(0.1*(i+j+k));
+                    obj->T.t.set(0.5*i-0.75,0.5*j-0.75,0.2+0.21*k);
+                    obj->InitCollisions();
+                }
+    }
+
+    //runs the boxes onto the ground, recording the contacts and the state
+    //after each step
+    void Run(int threads,std::vector<std::vector<dContactGeom> >& contacts,std::vector<std::vector<double> >& states) {
+        WorldSimulation sim;
+        sim.odesim.GetSettings().collisionThreads = threads;
+        sim.Init(&world);
+        for(int i=0;i<50;i++) {
+            sim.Advance(0.01);
+            contacts.push_back(std::vector<dContactGeom>());
+            for(ODEContactArena::const_iterator c=sim.odesim.contactResults.begin();c!=sim.odesim.contactResults.end();c++)
+                contacts.back().insert(contacts.back().end(),c->contacts.begin(),c->contacts.end());
+            states.push_back(std::vector<double>(sim.StateVectorSize()));
+            sim.GetStateVector(&states.back()[0]);
+        }
+    }
+};
+
+TEST_F(testParallelCollisions, testThreadsMatchSerial)
+{
+    std::vector<std::vector<dContactGeom> > serialContacts,parallelContacts;
+    std::vector<std::vector<double> > serialStates,parallelStates;
+    Run(1,serialContacts,serialStates);
+    Run(4,parallelContacts,parallelStates);
+    ASSERT_EQ(serialContacts.size(),parallelContacts.size());
+    size_t numContacts = 0;
+    for(size_t i=0;i<serialContacts.size();i++) {
+        ASSERT_EQ(serialContacts[i].size(),parallelContacts[i].size()) << "step " << i;
+        numContacts += serialContacts[i].size();
+        for(size_t j=0;j<serialContacts[i].size();j++) {
+            const dContactGeom& a = serialContacts[i][j];
+            const dContactGeom& b = parallelContacts[i][j];
+            for(int k=0;k<3;k++) {
+                EXPECT_EQ(a.pos[k],b.pos[k]);
+                EXPECT_EQ(a.normal[k],b.normal[k]);
+            }
+            EXPECT_EQ(a.depth,b.depth);
+        }
+        EXPECT_TRUE(serialStates[i] == parallelStates[i]) << "step " << i;
+    }
+    //the boxes land, so there is something to compare
+    EXPECT_GT(numContacts,0u);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
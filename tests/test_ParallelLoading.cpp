@@ -0,0 +1,171 @@
+#include <Klampt/Modeling/Robot.h>
+#include <KrisLibrary/meshing/MeshPrimitives.h>
+#include <KrisLibrary/utils/stringutils.h>
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+//what a loaded link geometry looks like
+struct LinkSnapshot
+{
+    bool empty;
+    std::vector<Math3D::Vector3> verts;
+    std::vector<Meshing::TriMesh::Tri> tris;
+    Math3D::AABB3D bb;
+};
+
+class testParallelLoading: public ::testing::Test
+{
+public:
+
+protected:
+    std::string robotFile;
+    std::vector<std::string> meshFiles;
+
+    testParallelLoading() : robotFile("test_ParallelLoading.rob")
+    {
+        //a chain of 6 links: 4 distinct spheres, the cube, and a repeat of
+        //the first sphere
+        for(int i=0;i<4;i++) {
+            Meshing::TriMesh mesh;
+            Meshing::MakeTriSphere(10+5*i,10+5*i,mesh);
+            meshFiles.push_back(std::string("test_ParallelLoading_")+IntToStr(i)+".off");
+            WriteOFF(meshFiles.back(),mesh,0.1+0.02*i);
+        }
+        std::ofstream out(robotFile.c_str());
+        out<<"links \"l0\" \"l1\" \"l2\" \"l3\" \"l4\" \"l5\""<<std::endl;
+        out<<"parents -1 0 1 2 3 4"<<std::endl;
+        out<<"tparent 1 0 0 0 1 0 0 0 1 0 0 0";
+        for(int i=1;i<6;i++)
+            out<<" \\"<<std::endl<<"1 0 0 0 1 0 0 0 1 0 0 0.3";
+        out<<std::endl;
+        out<<"axis 0 1 0 0 1 0 0 1 0 0 1 0 0 1 0 0 1 0"<<std::endl;
+        out<<"qmin -2.5 -2.5 -2.5 -2.5 -2.5 -2.5"<<std::endl;
+        out<<"qmax 2.5 2.5 2.5 2.5 2.5 2.5"<<std::endl;
+        out<<"geometry";
+        for(int i=0;i<4;i++)
+            out<<" \""<<meshFiles[i]<<"\"";
+        out<<" \"tests/objects/cube.off\" \""<<meshFiles[0]<<"\""<<std::endl;
+        out.close();
+    }
+
+    virtual ~testParallelLoading() {
+        remove(robotFile.c_str());
+        for(size_t i=0;i<meshFiles.size();i++)
+            remove(meshFiles[i].c_str());
+    }
+
+    virtual void TearDown() {
+        ManagedGeometry::loadThreads = 0;
+    }
+
+    static void WriteOFF(const std::string& fn,const Meshing::TriMesh& mesh,double scale) {
+        std::ofstream out(fn.c_str());
+        out.precision(17);
+        out<<"OFF"<<std::endl;
+        out<<mesh.verts.size()<<" "<<mesh.tris.size()<<" 0"<<std::endl;
+        for(size_t i=0;i<mesh.verts.size();i++)
+            out<<scale*mesh.verts[i].x<<" "<<scale*mesh.verts[i].y<<" "<<scale*mesh.verts[i].z<<std::endl;
+        for(size_t i=0;i<mesh.tris.size();i++)
+            out<<"3 "<<mesh.tris[i].a<<" "<<mesh.tris[i].b<<" "<<mesh.tris[i].c<<std::endl;
+    }
+
+    //loads the robot with the given number of threads, and returns its
+    //link geometries at the zero configuration
+    static std::vector<LinkSnapshot> Load(const std::string& fn,int numThreads) {
+        ManagedGeometry::loadThreads = numThreads;
+        std::vector<LinkSnapshot> res;
+        Robot robot;
+        EXPECT_TRUE(robot.Load(fn.c_str()));
+        EXPECT_EQ(robot.links.size(),6u);
+        robot.UpdateGeometry();
+        for(size_t i=0;i<robot.links.size();i++) {
+            LinkSnapshot s;
+            s.empty = robot.IsGeometryEmpty(i);
+            if(!s.empty) {
+                const Meshing::TriMesh& mesh = robot.geometry[i]->AsTriangleMesh();
+                s.verts = mesh.verts;
+                s.tris = mesh.tris;
+                s.bb = robot.geometry[i]->GetAABB();
+            }
+            res.push_back(s);
+        }
+        //repeated files share one geometry
+        if(robot.links.size() == 6)
+            EXPECT_TRUE(robot.geometry[0].get() == robot.geometry[5].get());
+        return res;
+    }
+
+    static void ExpectEqual(const std::vector<LinkSnapshot>& a,const std::vector<LinkSnapshot>& b) {
+        ASSERT_EQ(a.size(),b.size());
+        for(size_t i=0;i<a.size();i++) {
+            ASSERT_EQ(a[i].empty,b[i].empty) << "link " << i;
+            ASSERT_EQ(a[i].verts.size(),b[i].verts.size()) << "link " << i;
+            ASSERT_EQ(a[i].tris.size(),b[i].tris.size()) << "link " << i;
+            for(size_t j=0;j<a[i].verts.size();j++)
+                EXPECT_TRUE(a[i].verts[j] == b[i].verts[j]) << "link " << i << " vertex " << j;
+            for(size_t j=0;j<a[i].tris.size();j++) {
+                EXPECT_EQ(a[i].tris[j].a,b[i].tris[j].a) << "link " << i << " triangle " << j;
+                EXPECT_EQ(a[i].tris[j].b,b[i].tris[j].b) << "link " << i << " triangle " << j;
+                EXPECT_EQ(a[i].tris[j].c,b[i].tris[j].c) << "link " << i << " triangle " << j;
+            }
+            EXPECT_TRUE(a[i].bb.bmin == b[i].bb.bmin) << "link " << i;
+            EXPECT_TRUE(a[i].bb.bmax == b[i].bb.bmax) << "link " << i;
+        }
+    }
+};
+
+TEST_F(testParallelLoading, testMatchesSerial)
+{
+    std::vector<LinkSnapshot> serial = Load(robotFile,1);
+    for(size_t i=0;i<serial.size();i++)
+        ASSERT_FALSE(serial[i].empty) << "link " << i;
+    //each robot is destroyed before the next load, so the files are parsed
+    //again rather than taken from the cache
+    std::vector<LinkSnapshot> parallel = Load(robotFile,4);
+    ExpectEqual(serial,parallel);
+    ExpectEqual(serial,Load(robotFile,0));
+}
+
+TEST_F(testParallelLoading, testCollisionData)
+{
+    ManagedGeometry::loadThreads = 4;
+    Robot robot;
+    ASSERT_TRUE(robot.Load(robotFile.c_str()));
+    //the workers build the collision data along with the meshes
+    for(size_t i=0;i<robot.links.size();i++)
+        EXPECT_TRUE(robot.geometry[i]->CollisionDataInitialized()) << "link " << i;
+}
+
+TEST_F(testParallelLoading, testConcurrentRobots)
+{
+    std::vector<LinkSnapshot> serial = Load(robotFile,1);
+    //several robots load at once, sharing the cache
+    ManagedGeometry::loadThreads = 2;
+    const int numThreads = 4;
+    std::vector<Robot> robots(numThreads);
+    std::vector<char> ok(numThreads,0);
+    std::vector<std::thread> threads;
+    for(int t=0;t<numThreads;t++)
+        threads.push_back(std::thread([&,t]() { ok[t] = robots[t].Load(robotFile.c_str()); }));
+    for(size_t t=0;t<threads.size();t++)
+        threads[t].join();
+    for(int t=0;t<numThreads;t++) {
+        ASSERT_TRUE(ok[t]) << "robot " << t;
+        robots[t].UpdateGeometry();
+        ASSERT_EQ(robots[t].links.size(),serial.size());
+        for(size_t i=0;i<serial.size();i++) {
+            const Meshing::TriMesh& mesh = robots[t].geometry[i]->AsTriangleMesh();
+            EXPECT_EQ(mesh.verts.size(),serial[i].verts.size()) << "robot " << t << " link " << i;
+            EXPECT_EQ(mesh.tris.size(),serial[i].tris.size()) << "robot " << t << " link " << i;
+            EXPECT_TRUE(robots[t].geometry[i]->GetAABB().bmin == serial[i].bb.bmin) << "robot " << t << " link " << i;
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,99 @@
+#include <Klampt/Simulation/WorldSimulation.h>
+#include <KrisLibrary/meshing/MeshPrimitives.h>
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+static Meshing::TriMesh MakeBox(const Math3D::Vector3& dims)
+{
+    Math3D::Box3D box;
+    box.dims = dims;
+    box.origin = -0.5*dims;
+    box.xbasis.set(1,0,0);
+    box.ybasis.set(0,1,0);
+    box.zbasis.set(0,0,1);
+    Meshing::TriMesh mesh;
+    Meshing::MakeTriMesh(box,mesh);
+    return mesh;
+}
+
+class testParallelSimulators: public ::testing::Test
+{
+public:
+
+protected:
+    static const int numWorlds = 4;
+    RobotWorld worlds[numWorlds];
+
+    testParallelSimulators()
+    {
+        //each world drops a few boxes onto the ground, from heights that
+        //differ between worlds
+        for(int w=0;w<numWorlds;w++) {
+            RobotWorld& world = worlds[w];
+            int index = world.AddTerrain("ground",new Terrain());
+            Terrain* t = world.terrains[index].get();
+            *t->geometry.CreateEmpty() = Geometry::AnyCollisionGeometry3D(MakeBox(Math3D::Vector3(2,2,0.2)));
+            t->InitCollisions();
+            for(int i=0;i<3;i++) {
+                index = world.AddRigidObject("box",new RigidObject());
+                RigidObject* obj = world.rigidObjects[index].get();
+                *obj->geometry.CreateEmpty() = Geometry::AnyCollisionGeometry3D(MakeBox(Math3D::Vector3(0.2,0.2,0.2)));
+                obj->SetMassFromGeometry(0.5);
+                obj->T.R.setRotateZ(0.3*i+0.1*w);
+                obj->T.t.set(0.15*i,0.05*w,0.3+0.25*i+0.05*w);
+                obj->InitCollisions();
+            }
+        }
+    }
+
+    //simulates world for numSteps steps, returning the final state.  The
+    //simulation writes the object poses back to the world, so they are
+    //restored afterwards
+    static void Run(RobotWorld& world,int numSteps,std::vector<double>& x) {
+        std::vector<Math3D::RigidTransform> T0(world.rigidObjects.size());
+        for(size_t i=0;i<T0.size();i++)
+            T0[i] = world.rigidObjects[i]->T;
+        {
+            WorldSimulation sim;
+            sim.Init(&world);
+            for(int k=0;k<numSteps;k++)
+                sim.Advance(0.01);
+            x.resize(sim.StateVectorSize());
+            sim.GetStateVector(&x[0]);
+        }
+        for(size_t i=0;i<T0.size();i++) {
+            world.rigidObjects[i]->T = T0[i];
+            world.rigidObjects[i]->w.setZero();
+            world.rigidObjects[i]->v.setZero();
+            world.rigidObjects[i]->UpdateGeometry();
+        }
+    }
+};
+
+TEST_F(testParallelSimulators, testMatchesSerial)
+{
+    const int numSteps = 100;
+    std::vector<double> serial[numWorlds],parallel[numWorlds];
+    for(int w=0;w<numWorlds;w++)
+        Run(worlds[w],numSteps,serial[w]);
+    //the worlds don't share robots or rigid objects, so their simulations
+    //may step at the same time
+    std::vector<std::thread> threads;
+    for(int w=0;w<numWorlds;w++)
+        threads.push_back(std::thread([&,w]() { Run(worlds[w],numSteps,parallel[w]); }));
+    for(size_t i=0;i<threads.size();i++)
+        threads[i].join();
+    for(int w=0;w<numWorlds;w++) {
+        ASSERT_EQ(parallel[w].size(),serial[w].size());
+        for(size_t i=0;i<serial[w].size();i++)
+            ASSERT_EQ(parallel[w][i],serial[w][i]) << "world " << w << " entry " << i;
+    }
+    //the worlds really did differ
+    EXPECT_FALSE(serial[0] == serial[1]);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,104 @@
+#include <Klampt/Modeling/RandomizedSelfCollisions.h>
+#include <gtest/gtest.h>
+#include <math.h>
+
+class testRandomizedSelfCollisions: public ::testing::Test
+{
+public:
+
+protected:
+    Robot robot;
+
+    testRandomizedSelfCollisions()
+    {
+        robot.Load("tests/objects/chain.rob");
+    }
+
+    //the results of the parallel functions for the given settings.  The
+    //independence pass of RandomizedIndependentSelfCollisionPairs is
+    //serial, so it isn't covered.
+    void Run(const RandomizedSelfCollisionSettings& settings,int numSamples,
+             Array2D<bool>& pairs,Array2D<Real>& dmin,Array2D<Real>& dmax) {
+        RandomizedSelfCollisionPairs(robot,pairs,numSamples,settings);
+        RandomizedSelfCollisionDistances(robot,dmin,dmax,numSamples,settings);
+    }
+};
+
+TEST_F(testRandomizedSelfCollisions, testDefaults)
+{
+    RandomizedSelfCollisionSettings settings;
+    //early stopping is opt-in
+    EXPECT_EQ(settings.minCollisionProbability,0);
+}
+
+TEST_F(testRandomizedSelfCollisions, testThreadIndependence)
+{
+    ASSERT_EQ(robot.links.size(),5u);
+    //with and without early stopping
+    for(int stopping=0;stopping<2;stopping++) {
+        RandomizedSelfCollisionSettings settings;
+        settings.seed = 3;
+        if(stopping) settings.minCollisionProbability = 0.05;
+        settings.numThreads = 1;
+        Array2D<bool> pairs1;
+        Array2D<Real> dmin1,dmax1;
+        Run(settings,500,pairs1,dmin1,dmax1);
+        settings.numThreads = 4;
+        Array2D<bool> pairs4;
+        Array2D<Real> dmin4,dmax4;
+        Run(settings,500,pairs4,dmin4,dmax4);
+
+        int numPairs = 0;
+        for(int i=0;i<robot.q.n;i++)
+            for(int j=0;j<robot.q.n;j++) {
+                EXPECT_EQ(pairs1(i,j),pairs4(i,j));
+                EXPECT_EQ(dmin1(i,j),dmin4(i,j));
+                EXPECT_EQ(dmax1(i,j),dmax4(i,j));
+                if(pairs1(i,j)) numPairs++;
+            }
+        //the chain folds onto itself, so some links can collide
+        EXPECT_GT(numPairs,0);
+    }
+}
+
+TEST_F(testRandomizedSelfCollisions, testProbabilityBound)
+{
+    EXPECT_EQ(SelfCollisionProbabilityBound(0,0,0.99),1);
+    EXPECT_EQ(SelfCollisionProbabilityBound(10,10,0.99),1);
+    //(1-p)^n = 1-confidence with no hits
+    EXPECT_NEAR(SelfCollisionProbabilityBound(0,100,0.99),1.0-pow(0.01,0.01),1e-12);
+    //the 99% one-sided bound on 2 of 100 is 0.0814
+    EXPECT_NEAR(SelfCollisionProbabilityBound(2,100,0.99),0.0814,1e-4);
+    //the bound shrinks with more samples and grows with hits and confidence
+    EXPECT_LT(SelfCollisionProbabilityBound(0,200,0.99),SelfCollisionProbabilityBound(0,100,0.99));
+    EXPECT_GT(SelfCollisionProbabilityBound(1,100,0.99),SelfCollisionProbabilityBound(0,100,0.99));
+    EXPECT_GT(SelfCollisionProbabilityBound(0,100,0.999),SelfCollisionProbabilityBound(0,100,0.99));
+    //and holds the observed rate
+    EXPECT_GT(SelfCollisionProbabilityBound(30,100,0.9),0.3);
+}
+
+TEST_F(testRandomizedSelfCollisions, testEarlyStopping)
+{
+    //each pair without a collision is retired after the same number of
+    //samples, so stopping early matches sampling that many
+    RandomizedSelfCollisionSettings settings;
+    settings.seed = 5;
+    settings.numThreads = 3;
+    settings.minCollisionProbability = 0.05;
+    int n = 1;
+    while(SelfCollisionProbabilityBound(0,n,settings.confidence) >= settings.minCollisionProbability) n++;
+    EXPECT_EQ(n,90);
+    Array2D<bool> stopped;
+    RandomizedSelfCollisionPairs(robot,stopped,1000,settings);
+    settings.minCollisionProbability = 0;
+    Array2D<bool> sampled;
+    RandomizedSelfCollisionPairs(robot,sampled,n,settings);
+    for(int i=0;i<robot.q.n;i++)
+        for(int j=0;j<robot.q.n;j++)
+            EXPECT_EQ(stopped(i,j),sampled(i,j));
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
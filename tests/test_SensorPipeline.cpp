@@ -0,0 +1,128 @@
+#include <Klampt/Simulation/WorldSimulation.h>
+#include <Klampt/Simulation/SensorPipeline.h>
+#include <Klampt/Sensing/VisualSensors.h>
+#include <KrisLibrary/meshing/MeshPrimitives.h>
+#include <gtest/gtest.h>
+#include <math.h>
+#include <vector>
+
+//the measurements a sensor holds after a step
+struct Reading
+{
+    double simTime,measurementTime;
+    std::vector<double> values;
+};
+
+class testSensorPipeline: public ::testing::Test
+{
+public:
+
+protected:
+    RobotWorld world;
+    const double dt;
+
+    testSensorPipeline() : dt(0.01)
+    {
+        //the chain robot, and a wall in front of a laser that is fixed in
+        //the world, facing away from the robot
+        world.LoadRobot("tests/objects/chain.rob");
+        Math3D::Box3D box;
+        box.dims.set(0.2,20,2);
+        box.origin.set(6.9,-10,-0.5);
+        box.xbasis.set(1,0,0);
+        box.ybasis.set(0,1,0);
+        box.zbasis.set(0,0,1);
+        Meshing::TriMesh mesh;
+        Meshing::MakeTriMesh(box,mesh);
+        int index = world.AddTerrain("wall",new Terrain());
+        Terrain* t = world.terrains[index].get();
+        *t->geometry.CreateEmpty() = Geometry::AnyCollisionGeometry3D(mesh);
+        t->InitCollisions();
+    }
+
+    std::vector<Reading> Run(bool async,double latency,int numSteps) {
+        WorldSimulation sim;
+        sim.Init(&world);
+        sim.asyncSensors = async;
+        shared_ptr<LaserRangeSensor> laser = make_shared<LaserRangeSensor>();
+        laser->name = "laser";
+        laser->rate = 50;
+        laser->latency = latency;
+        laser->measurementCount = 30;
+        laser->xSweepMagnitude = DtoR(60.0);
+        laser->xSweepPeriod = 0.1;
+        //z forward along +x, with a translation that a 6 digit string
+        //round trip would change
+        laser->Tsensor.R.set(Math3D::Vector3(0,1,0),Math3D::Vector3(0,0,1),Math3D::Vector3(1,0,0));
+        laser->Tsensor.t.set(5.123456789,0.0123456789,0.5);
+        sim.controlSimulators[0].sensors.sensors.push_back(laser);
+        std::vector<Reading> res;
+        for(int i=0;i<numSteps;i++) {
+            sim.Advance(dt);
+            Reading r;
+            r.simTime = sim.time;
+            r.measurementTime = laser->measurementTime;
+            laser->GetMeasurements(r.values);
+            res.push_back(r);
+        }
+        if(async) {
+            EXPECT_TRUE(sim.sensorPipeline != NULL);
+            EXPECT_EQ(sim.sensorPipeline->numDropped,0);
+        }
+        return res;
+    }
+};
+
+TEST_F(testSensorPipeline, testNoLatency)
+{
+    std::vector<Reading> inlineReadings = Run(false,0,30);
+    std::vector<Reading> asyncReadings = Run(true,0,30);
+    ASSERT_EQ(inlineReadings.size(),asyncReadings.size());
+    for(size_t i=0;i<inlineReadings.size();i++) {
+        EXPECT_EQ(asyncReadings[i].measurementTime,inlineReadings[i].measurementTime) << "step " << i;
+        ASSERT_EQ(asyncReadings[i].values.size(),inlineReadings[i].values.size()) << "step " << i;
+        for(size_t j=0;j<inlineReadings[i].values.size();j++)
+            EXPECT_EQ(asyncReadings[i].values[j],inlineReadings[i].values[j]) << "step " << i << " reading " << j;
+    }
+    //every beam hits the wall, within 60 degrees of its normal
+    const std::vector<double>& last = inlineReadings.back().values;
+    ASSERT_EQ(last.size(),30u);
+    for(size_t j=0;j<last.size();j++) {
+        EXPECT_GT(last[j],(6.9-5.123456789)-0.15);
+        EXPECT_LT(last[j],2*(6.9-5.123456789)+0.15);
+    }
+}
+
+TEST_F(testSensorPipeline, testLatency)
+{
+    const double latency = 0.05, period = 1.0/50;
+    std::vector<Reading> inlineReadings = Run(false,latency,40);
+    std::vector<Reading> asyncReadings = Run(true,latency,40);
+    int numDelivered = 0;
+    for(size_t i=0;i<asyncReadings.size();i++) {
+        const Reading& r = asyncReadings[i];
+        if(r.values.empty()) {
+            //nothing is delivered before the first latency has passed
+            EXPECT_LT(r.simTime,latency+period+dt) << "step " << i;
+            continue;
+        }
+        numDelivered++;
+        //delivered at the first step at or after measurementTime + latency
+        EXPECT_GE(r.simTime-r.measurementTime,latency-1e-9) << "step " << i;
+        EXPECT_LT(r.simTime-r.measurementTime,latency+period+dt) << "step " << i;
+        //and it is the measurement that inline simulation took then
+        const Reading* match = NULL;
+        for(size_t j=0;j<inlineReadings.size();j++)
+            if(inlineReadings[j].measurementTime == r.measurementTime) match = &inlineReadings[j];
+        ASSERT_TRUE(match != NULL) << "step " << i;
+        ASSERT_EQ(r.values.size(),match->values.size());
+        for(size_t j=0;j<r.values.size();j++)
+            EXPECT_EQ(r.values[j],match->values[j]) << "step " << i << " reading " << j;
+    }
+    EXPECT_GT(numDelivered,20);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
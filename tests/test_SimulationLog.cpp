@@ -0,0 +1,160 @@
+#include <Klampt/Simulation/SimulationLog.h>
+#include <KrisLibrary/meshing/MeshPrimitives.h>
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+static void AddBox(RobotWorld& world,bool terrain,const Math3D::Vector3& dims)
+{
+    Math3D::Box3D box;
+    box.dims = dims;
+    box.origin = -0.5*dims;
+    box.xbasis.set(1,0,0);
+    box.ybasis.set(0,1,0);
+    box.zbasis.set(0,0,1);
+    Meshing::TriMesh mesh;
+    Meshing::MakeTriMesh(box,mesh);
+    if(terrain) {
+        int index = world.AddTerrain("ground",new Terrain());
+        Terrain* t = world.terrains[index].get();
+        *t->geometry.CreateEmpty() = Geometry::AnyCollisionGeometry3D(mesh);
+        t->InitCollisions();
+    }
+    else {
+        int index = world.AddRigidObject("box",new RigidObject());
+        RigidObject* obj = world.rigidObjects[index].get();
+        *obj->geometry.CreateEmpty() = Geometry::AnyCollisionGeometry3D(mesh);
+        obj->SetMassFromGeometry(0.5);
+        obj->T.R.setRotateZ(0.3);
+        obj->T.t.set(0,0,0.3);
+        obj->InitCollisions();
+    }
+}
+
+class testSimulationLog: public ::testing::Test
+{
+public:
+
+protected:
+    RobotWorld world;
+    WorldSimulation sim;
+    const char* fn;
+    //the simulation's time and state vector after each step
+    std::vector<double> times;
+    std::vector<std::vector<double> > states;
+
+    testSimulationLog() : fn("test_SimulationLog.simlog")
+    {
+        AddBox(world,true,Math3D::Vector3(2,2,0.2));
+        AddBox(world,false,Math3D::Vector3(0.1,0.1,0.1));
+        sim.Init(&world);
+        sim.EnableContactFeedback(world.TerrainID(0),world.RigidObjectID(0));
+    }
+
+    virtual void TearDown() {
+        remove(fn);
+    }
+
+    //runs the box onto the ground, logging every step
+    void Run(SimulationLogWriter& writer,int numSteps,bool close=true) {
+        ASSERT_TRUE(writer.Open(fn,sim));
+        for(int i=0;i<numSteps;i++) {
+            sim.Advance(0.01);
+            ASSERT_TRUE(writer.SaveStep(sim));
+            times.push_back(sim.time);
+            states.push_back(std::vector<double>(sim.StateVectorSize()));
+            sim.GetStateVector(&states.back()[0]);
+        }
+        if(close) ASSERT_TRUE(writer.Close());
+    }
+
+    void CheckFrames(SimulationLogReader& reader,double tol) {
+        ASSERT_EQ(reader.NumFrames(),(int)states.size());
+        SimulationLogFrame frame;
+        for(size_t i=0;i<states.size();i++) {
+            ASSERT_TRUE(reader.GetFrame((int)i,frame));
+            ASSERT_EQ(frame.state.size(),states[i].size());
+            EXPECT_NEAR(frame.time,times[i],tol);
+            for(size_t j=0;j<states[i].size();j++) {
+                if(tol == 0) EXPECT_EQ(frame.state[j],states[i][j]);
+                else EXPECT_NEAR(frame.state[j],states[i][j],tol);
+            }
+        }
+    }
+};
+
+TEST_F(testSimulationLog, testLossless)
+{
+    SimulationLogWriter writer;
+    writer.framesPerChunk = 16;
+    Run(writer,100);
+    SimulationLogReader reader;
+    ASSERT_TRUE(reader.Open(fn));
+    CheckFrames(reader,0);
+
+    //the box lands within a second, so the last frame has ground contacts
+    SimulationLogFrame frame;
+    ASSERT_TRUE(reader.GetFrame(reader.NumFrames()-1,frame));
+    ASSERT_EQ(frame.contacts.size(),1u);
+    int id1 = frame.contacts[0].id1, id2 = frame.contacts[0].id2;
+    EXPECT_EQ(std::min(id1,id2),std::min(world.TerrainID(0),world.RigidObjectID(0)));
+    EXPECT_EQ(std::max(id1,id2),std::max(world.TerrainID(0),world.RigidObjectID(0)));
+    EXPECT_GT(frame.contacts[0].values.size(),0u);
+    EXPECT_EQ(frame.contacts[0].values.size()%9,0u);
+}
+
+TEST_F(testSimulationLog, testQuantized)
+{
+    SimulationLogWriter writer;
+    writer.quantum = 1e-6;
+    writer.framesPerChunk = 16;
+    Run(writer,100);
+    SimulationLogReader reader;
+    ASSERT_TRUE(reader.Open(fn));
+    //quantization errors must not accumulate over the deltas
+    CheckFrames(reader,0.5e-6+1e-12);
+}
+
+TEST_F(testSimulationLog, testSeekAndApply)
+{
+    SimulationLogWriter writer;
+    writer.framesPerChunk = 16;
+    Run(writer,50);
+    SimulationLogReader reader;
+    ASSERT_TRUE(reader.Open(fn));
+    EXPECT_EQ(reader.FindFrame(times[20]),20);
+    EXPECT_EQ(reader.FindFrame(times[20]+0.005),20);
+    EXPECT_EQ(reader.FindFrame(0),0);
+    EXPECT_EQ(reader.FindFrame(times.back()+1),49);
+
+    SimulationLogFrame frame;
+    ASSERT_TRUE(reader.GetFrame(20,frame));
+    ASSERT_TRUE(reader.Apply(frame,sim));
+    EXPECT_EQ(sim.time,times[20]);
+    std::vector<double> x(sim.StateVectorSize());
+    sim.GetStateVector(&x[0]);
+    EXPECT_TRUE(x == states[20]);
+}
+
+TEST_F(testSimulationLog, testUnclosed)
+{
+    //without an index, the reader recovers the flushed chunks
+    {
+        SimulationLogWriter writer;
+        writer.framesPerChunk = 16;
+        Run(writer,40,false);
+        fflush(NULL);
+        SimulationLogReader reader;
+        ASSERT_TRUE(reader.Open(fn));
+        EXPECT_EQ(reader.NumFrames(),32);
+        SimulationLogFrame frame;
+        ASSERT_TRUE(reader.GetFrame(31,frame));
+        EXPECT_TRUE(frame.state == states[31]);
+    }
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
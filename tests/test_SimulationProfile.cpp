@@ -0,0 +1,105 @@
+#include <Klampt/Simulation/WorldSimulation.h>
+#include <KrisLibrary/meshing/MeshPrimitives.h>
+#include <gtest/gtest.h>
+
+static Meshing::TriMesh MakeBox(const Math3D::Vector3& dims)
+{
+    Math3D::Box3D box;
+    box.dims = dims;
+    box.origin = -0.5*dims;
+    box.xbasis.set(1,0,0);
+    box.ybasis.set(0,1,0);
+    box.zbasis.set(0,0,1);
+    Meshing::TriMesh mesh;
+    Meshing::MakeTriMesh(box,mesh);
+    return mesh;
+}
+
+class testSimulationProfile: public ::testing::Test
+{
+public:
+
+protected:
+    RobotWorld world;
+    WorldSimulation sim;
+
+    testSimulationProfile()
+    {
+        //the ground's top is at z=0.1, and the box rests on it at z=0.2
+        int index = world.AddTerrain("ground",new Terrain());
+        Terrain* t = world.terrains[index].get();
+        *t->geometry.CreateEmpty() = Geometry::AnyCollisionGeometry3D(MakeBox(Math3D::Vector3(2,2,0.2)));
+        t->InitCollisions();
+        index = world.AddRigidObject("box",new RigidObject());
+        RigidObject* obj = world.rigidObjects[index].get();
+        *obj->geometry.CreateEmpty() = Geometry::AnyCollisionGeometry3D(MakeBox(Math3D::Vector3(0.2,0.2,0.2)));
+        obj->SetMassFromGeometry(0.5);
+        obj->T.t.set(0,0,0.205);
+        obj->InitCollisions();
+        sim.simStep = 0.001;
+        sim.Init(&world);
+    }
+};
+
+TEST_F(testSimulationProfile, testCounters)
+{
+    //nothing is recorded unless profiling is on
+    sim.Advance(0.01);
+    EXPECT_EQ(sim.profile.numSteps,0);
+    EXPECT_EQ(sim.profile.totalTime,0.0);
+
+    sim.profiling = true;
+    for(int k=0;k<20;k++)
+        sim.Advance(0.01);
+    //each Advance call starts a new profile
+    const SimulationProfile& p = sim.profile;
+    EXPECT_EQ(p.numSteps,10);
+    EXPECT_EQ(p.numRollbacks,0);
+    EXPECT_GE(p.numCollisionChecks,10);
+    EXPECT_GE(p.numCollisionPairs,size_t(10));
+    //the resting box touches the ground on every step
+    EXPECT_GE(p.numContacts,size_t(10));
+    EXPECT_GE(p.numPreclusterContacts,p.numContacts);
+    EXPECT_GT(p.totalTime,0.0);
+    EXPECT_GE(p.collisionTime,0.0);
+    EXPECT_GE(p.clusterTime,0.0);
+    EXPECT_GT(p.dynamicsTime,0.0);
+    EXPECT_LE(p.collisionTime+p.dynamicsTime,p.totalTime);
+
+    sim.profiling = false;
+    sim.Advance(0.01);
+    //the last profile is kept
+    EXPECT_EQ(sim.profile.numSteps,10);
+}
+
+TEST_F(testSimulationProfile, testSteadyStateAllocations)
+{
+    sim.profiling = true;
+    sim.Advance(0.01);
+    //the first contacts grow the storage
+    EXPECT_GT(sim.profile.numAllocations,size_t(0));
+    for(int k=0;k<20;k++)
+        sim.Advance(0.01);
+    //once the box has settled, the storage is reused
+    for(int k=0;k<10;k++) {
+        sim.Advance(0.01);
+        EXPECT_GT(sim.profile.numContacts,size_t(0));
+        EXPECT_EQ(sim.profile.numAllocations,size_t(0)) << "step " << k;
+        EXPECT_EQ(sim.odesim.numContactAllocations,size_t(0)) << "step " << k;
+    }
+}
+
+TEST_F(testSimulationProfile, testKinematic)
+{
+    sim.profiling = true;
+    sim.kinematicSimulation = true;
+    sim.Advance(0.01);
+    EXPECT_EQ(sim.profile.numSteps,1);
+    EXPECT_EQ(sim.profile.numCollisionChecks,0);
+    EXPECT_EQ(sim.profile.dynamicsTime,0.0);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,130 @@
+#include <Klampt/Simulation/BatchSimulator.h>
+#include <KrisLibrary/meshing/MeshPrimitives.h>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+static void AddBox(RobotWorld& world,bool terrain,const Math3D::Vector3& dims,const Math3D::Vector3& pos,double angle)
+{
+    Math3D::Box3D box;
+    box.dims = dims;
+    box.origin = -0.5*dims;
+    box.xbasis.set(1,0,0);
+    box.ybasis.set(0,1,0);
+    box.zbasis.set(0,0,1);
+    Meshing::TriMesh mesh;
+    Meshing::MakeTriMesh(box,mesh);
+    if(terrain) {
+        int index = world.AddTerrain("ground",new Terrain());
+        Terrain* t = world.terrains[index].get();
+        *t->geometry.CreateEmpty() = Geometry::AnyCollisionGeometry3D(mesh);
+        t->InitCollisions();
+    }
+    else {
+        int index = world.AddRigidObject("box",new RigidObject());
+        RigidObject* obj = world.rigidObjects[index].get();
+        *obj->geometry.CreateEmpty() = Geometry::AnyCollisionGeometry3D(mesh);
+        obj->SetMassFromGeometry(0.5);
+        obj->T.R.setRotateZ(angle);
+        obj->T.t = pos;
+        obj->InitCollisions();
+    }
+}
+
+class testSimulationReplay: public ::testing::Test
+{
+public:
+
+protected:
+    RobotWorld world;
+    ODESimulatorSettings settings;
+    const double dt;
+    //the state written after the first steps, and the checksums of that
+    //state and of each step after it
+    std::string saved;
+    std::vector<uint64_t> sums;
+
+    testSimulationReplay() : dt(0.01)
+    {
+        //a box dropped onto a box resting on the ground, so that the run
+        //has contacts, adaptive time stepping rollbacks, and sleeping
+        AddBox(world,true,Math3D::Vector3(2,2,0.2),Math3D::Vector3(0,0,0),0);
+        AddBox(world,false,Math3D::Vector3(0.2,0.2,0.2),Math3D::Vector3(0,0,0.2),0);
+        AddBox(world,false,Math3D::Vector3(0.1,0.1,0.1),Math3D::Vector3(0.02,0,0.6),0.3);
+        settings.deterministic = true;
+        settings.sleeping = true;
+        settings.sleepTime = 0.1;
+    }
+
+    void Init(WorldSimulation& sim) {
+        sim.odesim.GetSettings() = settings;
+        sim.Init(&world);
+        sim.checksums = true;
+    }
+
+    //returns the checksums of numSteps steps from the current state,
+    //starting with the current state's
+    std::vector<uint64_t> Run(WorldSimulation& sim,int numSteps) {
+        std::vector<uint64_t> res(1,sim.StateChecksum());
+        for(int i=0;i<numSteps;i++) {
+            sim.Advance(dt);
+            res.push_back(sim.stateChecksum);
+        }
+        return res;
+    }
+
+    virtual void SetUp() {
+        WorldSimulation sim;
+        Init(sim);
+        Run(sim,20);
+        ASSERT_TRUE(sim.WriteState(saved));
+        sums = Run(sim,60);
+    }
+};
+
+TEST_F(testSimulationReplay, testRestoreSameSimulator)
+{
+    WorldSimulation sim;
+    Init(sim);
+    Run(sim,45);
+    ASSERT_TRUE(sim.ReadState(saved));
+    std::vector<uint64_t> replay = Run(sim,60);
+    ASSERT_EQ(replay.size(),sums.size());
+    for(size_t i=0;i<sums.size();i++)
+        EXPECT_EQ(replay[i],sums[i]) << "step " << i;
+}
+
+TEST_F(testSimulationReplay, testRestoreNewSimulator)
+{
+    WorldSimulation sim;
+    Init(sim);
+    ASSERT_TRUE(sim.ReadState(saved));
+    std::vector<uint64_t> replay = Run(sim,60);
+    ASSERT_EQ(replay.size(),sums.size());
+    for(size_t i=0;i<sums.size();i++)
+        EXPECT_EQ(replay[i],sums[i]) << "step " << i;
+}
+
+TEST_F(testSimulationReplay, testBatchRollouts)
+{
+    BatchSimulator batch;
+    batch.settings = settings;
+    batch.simStep = WorldSimulation().simStep;
+    batch.initialState = saved;
+    batch.checksums = true;
+    batch.Init(&world,2);
+    std::vector<BatchRolloutCondition> rollouts(3);
+    BatchSimulationTrace trace;
+    ASSERT_TRUE(batch.Run(rollouts,60*dt,dt,trace));
+    ASSERT_EQ(trace.numSamples,(int)sums.size());
+    for(int r=0;r<trace.numRollouts;r++) {
+        EXPECT_EQ(trace.lengths[r],trace.numSamples);
+        for(int k=0;k<trace.numSamples;k++)
+            EXPECT_EQ(trace.checksums[r*trace.numSamples+k],sums[k]) << "rollout " << r << " sample " << k;
+    }
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,114 @@
+#include <Klampt/Simulation/WorldSimulation.h>
+#include <KrisLibrary/meshing/MeshPrimitives.h>
+#include <gtest/gtest.h>
+#include <vector>
+
+static Meshing::TriMesh MakeBox(const Math3D::Vector3& dims)
+{
+    Math3D::Box3D box;
+    box.dims = dims;
+    box.origin = -0.5*dims;
+    box.xbasis.set(1,0,0);
+    box.ybasis.set(0,1,0);
+    box.zbasis.set(0,0,1);
+    Meshing::TriMesh mesh;
+    Meshing::MakeTriMesh(box,mesh);
+    return mesh;
+}
+
+class testSimulationSnapshot: public ::testing::Test
+{
+public:
+
+protected:
+    RobotWorld world;
+    WorldSimulation sim;
+
+    testSimulationSnapshot()
+    {
+        //the chain robot swinging under gravity, and a box tumbling onto the
+        //ground next to it
+        world.LoadRobot("tests/objects/chain.rob");
+        int index = world.AddTerrain("ground",new Terrain());
+        Terrain* t = world.terrains[index].get();
+        //the ground's top is at z=-0.4
+        Meshing::TriMesh ground = MakeBox(Math3D::Vector3(2,2,0.2));
+        Math3D::Matrix4 M;
+        M.setIdentity();
+        M(0,3) = 1;
+        M(2,3) = -0.5;
+        ground.Transform(M);
+        *t->geometry.CreateEmpty() = Geometry::AnyCollisionGeometry3D(ground);
+        t->InitCollisions();
+        index = world.AddRigidObject("box",new RigidObject());
+        RigidObject* obj = world.rigidObjects[index].get();
+        *obj->geometry.CreateEmpty() = Geometry::AnyCollisionGeometry3D(MakeBox(Math3D::Vector3(0.2,0.2,0.2)));
+        obj->SetMassFromGeometry(0.5);
+        obj->T.R.setRotateX(0.4);
+        obj->T.t.set(1,0,-0.2);
+        obj->w.set(1,2,0);
+        obj->InitCollisions();
+        sim.Init(&world);
+        Config q(world.robots[0]->q.n,0.3);
+        sim.odesim.robot(0)->SetConfig(q);
+    }
+
+    std::vector<double> Get() {
+        std::vector<double> x(sim.StateVectorSize());
+        sim.GetStateVector(&x[0]);
+        return x;
+    }
+
+    void Step(int numSteps) {
+        for(int k=0;k<numSteps;k++)
+            sim.odesim.Step(0.001);
+    }
+};
+
+TEST_F(testSimulationSnapshot, testRestore)
+{
+    Step(20);
+    std::vector<double> x0 = Get();
+    ODEStateSnapshot snapshot;
+    sim.odesim.SaveSnapshot(snapshot);
+    ASSERT_TRUE(snapshot.valid);
+    //5 links and the box
+    EXPECT_EQ(snapshot.bodies.size(),6u);
+    EXPECT_EQ(snapshot.data.size(),6u*ODEStateSnapshot::BodySize);
+
+    Step(50);
+    std::vector<double> x1 = Get();
+    EXPECT_FALSE(x1 == x0);
+    sim.odesim.RestoreSnapshot(snapshot);
+    EXPECT_TRUE(Get() == x0);
+
+    //stepping again from the snapshot retraces the same trajectory
+    Step(50);
+    EXPECT_TRUE(Get() == x1);
+
+    //the storage is reused by later saves
+    const double* data = &snapshot.data[0];
+    sim.odesim.SaveSnapshot(snapshot);
+    EXPECT_EQ(&snapshot.data[0],data);
+}
+
+TEST_F(testSimulationSnapshot, testAdaptiveTimeStepping)
+{
+    //a box thrown hard at the ground
+    sim.odesim.GetSettings().adaptiveTimeStepping = true;
+    sim.odesim.object(0)->SetVelocity(Math3D::Vector3(0.0),Math3D::Vector3(0,0,-20));
+    sim.profiling = true;
+    for(int k=0;k<20;k++) {
+        sim.Advance(0.01);
+        EXPECT_NE(sim.odesim.GetStatus(),ODESimulator::StatusUnstable) << "step " << k;
+    }
+    //the box ends up on the ground, not through it
+    Math3D::RigidTransform T;
+    sim.odesim.object(0)->GetTransform(T);
+    EXPECT_GT(T.t.z,-0.5);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
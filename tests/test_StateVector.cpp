@@ -0,0 +1,128 @@
+#include <Klampt/Simulation/WorldSimulation.h>
+#include <KrisLibrary/meshing/MeshPrimitives.h>
+#include <gtest/gtest.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+class testStateVector: public ::testing::Test
+{
+public:
+
+protected:
+    RobotWorld world;
+    WorldSimulation sim;
+
+    testStateVector()
+    {
+        //the chain robot and a box dropped next to it
+        world.LoadRobot("tests/objects/chain.rob");
+        Math3D::Box3D box;
+        box.dims.set(0.1,0.1,0.1);
+        box.origin.set(-0.05,-0.05,-0.05);
+        box.xbasis.set(1,0,0);
+        box.ybasis.set(0,1,0);
+        box.zbasis.set(0,0,1);
+        Meshing::TriMesh mesh;
+        Meshing::MakeTriMesh(box,mesh);
+        int index = world.AddRigidObject("box",new RigidObject());
+        RigidObject* obj = world.rigidObjects[index].get();
+        *obj->geometry.CreateEmpty() = Geometry::AnyCollisionGeometry3D(mesh);
+        obj->SetMassFromGeometry(0.5);
+        obj->T.R.setRotateZ(0.3);
+        obj->T.t.set(1,0,0.5);
+        obj->InitCollisions();
+        sim.Init(&world);
+    }
+
+    std::vector<double> Get() {
+        std::vector<double> x(sim.StateVectorSize());
+        sim.GetStateVector(&x[0]);
+        return x;
+    }
+
+    //holds each joint of the robot at q
+    void SetPID(double q) {
+        RobotMotorCommand& command = sim.controlSimulators[0].command;
+        for(size_t i=0;i<command.actuators.size();i++)
+            command.actuators[i].SetPID(q);
+    }
+};
+
+TEST_F(testStateVector, testLayout)
+{
+    ASSERT_EQ(world.robots.size(),1u);
+    EXPECT_EQ(sim.StateVectorSize(),2*5+18);
+    std::vector<StateVectorBlock> blocks;
+    sim.GetStateVectorLayout(blocks);
+    ASSERT_EQ(blocks.size(),6u);
+    int offset = 0;
+    for(size_t i=0;i<blocks.size();i++) {
+        EXPECT_EQ(blocks[i].offset,offset);
+        offset += blocks[i].size;
+    }
+    EXPECT_EQ(offset,sim.StateVectorSize());
+}
+
+TEST_F(testStateVector, testRoundTrip)
+{
+    SetPID(0.2);
+    for(int i=0;i<10;i++)
+        sim.Advance(0.01);
+    std::vector<double> x = Get();
+    //reading twice into the same buffer gives the same state
+    std::vector<double> x2 = x;
+    sim.GetStateVector(&x2[0]);
+    EXPECT_TRUE(x == x2);
+
+    for(int i=0;i<5;i++)
+        sim.Advance(0.01);
+    std::vector<double> moved = Get();
+    sim.SetStateVector(&x[0]);
+    std::vector<double> y = Get();
+    ASSERT_EQ(y.size(),x.size());
+    double change = 0;
+    for(size_t i=0;i<x.size();i++) {
+        EXPECT_NEAR(y[i],x[i],1e-6) << "entry " << i;
+        change = std::max(change,fabs(moved[i]-x[i]));
+    }
+    //the box was falling, so the round trip restored something
+    EXPECT_GT(change,1e-3);
+    //and the robot model takes the restored configuration
+    for(int i=0;i<world.robots[0]->q.n;i++)
+        EXPECT_NEAR(world.robots[0]->q(i),x[i],1e-6);
+}
+
+TEST_F(testStateVector, testKinematic)
+{
+    sim.kinematicSimulation = true;
+    SetPID(0.3);
+    sim.Advance(0.01);
+    std::vector<double> x = Get();
+    for(int i=0;i<5;i++)
+        EXPECT_EQ(x[i],0.3);
+    //reading the state doesn't write the ODE bodies
+    Config q;
+    sim.odesim.robot(0)->GetConfig(q);
+    EXPECT_NEAR(q(0),0,1e-6);
+    sim.SyncKinematicRobots();
+    sim.odesim.robot(0)->GetConfig(q);
+    for(int i=0;i<5;i++)
+        EXPECT_NEAR(q(i),0.3,1e-6);
+    std::vector<double> y = Get();
+    for(size_t i=0;i<x.size();i++)
+        EXPECT_NEAR(y[i],x[i],1e-6) << "entry " << i;
+
+    //round trip while kinematic
+    x[2] = -0.4;
+    sim.SetStateVector(&x[0]);
+    EXPECT_EQ(world.robots[0]->q(2),-0.4);
+    y = Get();
+    for(size_t i=0;i<x.size();i++)
+        EXPECT_NEAR(y[i],x[i],1e-6) << "entry " << i;
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
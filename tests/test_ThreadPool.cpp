@@ -0,0 +1,73 @@
+#include <Klampt/Modeling/ThreadPool.h>
+#include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+class testThreadPool: public ::testing::Test
+{
+public:
+
+protected:
+    ThreadPool pool;
+
+    testThreadPool() : pool(4)
+    {
+    }
+};
+
+TEST_F(testThreadPool, testParallelFor)
+{
+    ASSERT_EQ(pool.NumThreads(),4);
+    std::vector<std::atomic<int> > counts(1000);
+    for(size_t i=0;i<counts.size();i++) counts[i] = 0;
+    pool.ParallelFor((int)counts.size(),[&](int i,int thread) {
+        counts[i]++;
+    },7);
+    for(size_t i=0;i<counts.size();i++)
+        EXPECT_EQ(counts[i].load(),1) << "index " << i;
+}
+
+TEST_F(testThreadPool, testNestedSerial)
+{
+    //a nested loop on the same pool would deadlock if it weren't run
+    //serially on the calling thread
+    const int n = 16, m = 8;
+    std::vector<std::atomic<int> > counts(n*m);
+    for(size_t i=0;i<counts.size();i++) counts[i] = 0;
+    std::atomic<int> errors(0);
+    pool.ParallelFor(n,[&](int i,int thread) {
+        std::thread::id outer = std::this_thread::get_id();
+        pool.ParallelFor(m,[&](int j,int innerThread) {
+            if(std::this_thread::get_id() != outer || innerThread != 0) errors++;
+            counts[i*m+j]++;
+        });
+    });
+    EXPECT_EQ(errors.load(),0);
+    for(size_t i=0;i<counts.size();i++)
+        EXPECT_EQ(counts[i].load(),1) << "index " << i;
+
+    //the pool is still usable in parallel afterwards
+    std::atomic<int> total(0);
+    pool.ParallelFor(100,[&](int i,int thread) { total += i; });
+    EXPECT_EQ(total.load(),4950);
+}
+
+TEST_F(testThreadPool, testSingleThread)
+{
+    ThreadPool serial(1);
+    EXPECT_EQ(serial.NumThreads(),1);
+    std::vector<int> order;
+    serial.ParallelFor(5,[&](int i,int thread) {
+        EXPECT_EQ(thread,0);
+        order.push_back(i);
+    });
+    ASSERT_EQ(order.size(),5u);
+    for(int i=0;i<5;i++)
+        EXPECT_EQ(order[i],i);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
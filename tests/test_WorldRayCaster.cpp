@@ -0,0 +1,153 @@
+#include <Klampt/Modeling/World.h>
+#include <Klampt/Modeling/WorldRayCaster.h>
+#include <KrisLibrary/meshing/MeshPrimitives.h>
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+static Meshing::TriMesh MakeBox(const Math3D::Vector3& dims)
+{
+    Math3D::Box3D box;
+    box.dims = dims;
+    box.origin = -0.5*dims;
+    box.xbasis.set(1,0,0);
+    box.ybasis.set(0,1,0);
+    box.zbasis.set(0,0,1);
+    Meshing::TriMesh mesh;
+    Meshing::MakeTriMesh(box,mesh);
+    return mesh;
+}
+
+class testWorldRayCaster: public ::testing::Test
+{
+public:
+
+protected:
+    RobotWorld world;
+    std::vector<Math3D::Ray3D> rays;
+
+    testWorldRayCaster()
+    {
+        std::mt19937 rng(1234);
+        std::uniform_real_distribution<double> u(-1,1);
+        //the chain robot in a bent configuration
+        world.LoadRobot("tests/objects/chain.rob");
+        Robot* robot = world.robots[0].get();
+        Config q = robot->q;
+        for(int i=0;i<q.n;i++) q(i) = 0.5*u(rng);
+        robot->UpdateConfig(q);
+        //a grid of boxes around it, each rotated differently, half of them
+        //terrains and half rigid objects
+        int k = 0;
+        for(int i=-2;i<=2;i++) {
+            for(int j=-2;j<=2;j++,k++) {
+                if(i==0 && j==0) continue;
+                Math3D::RigidTransform T;
+                T.R.setRotateZ(3*u(rng));
+                T.t.set(2*i+0.3*u(rng),2*j+0.3*u(rng),0.5*u(rng));
+                Meshing::TriMesh mesh = MakeBox(Math3D::Vector3(0.5+0.3*u(rng),0.5+0.3*u(rng),0.5+0.3*u(rng)));
+                if(k%2 == 0) {
+                    int index = world.AddTerrain("box",new Terrain());
+                    Terrain* t = world.terrains[index].get();
+                    Math3D::Matrix4 M;
+                    T.get(M);
+                    mesh.Transform(M);
+                    *t->geometry.CreateEmpty() = Geometry::AnyCollisionGeometry3D(mesh);
+                    t->InitCollisions();
+                }
+                else {
+                    int index = world.AddRigidObject("box",new RigidObject());
+                    RigidObject* obj = world.rigidObjects[index].get();
+                    *obj->geometry.CreateEmpty() = Geometry::AnyCollisionGeometry3D(mesh);
+                    obj->T = T;
+                    obj->InitCollisions();
+                    obj->UpdateGeometry();
+                }
+            }
+        }
+        //rays from a sphere around the scene toward random points in it,
+        //and some that miss everything
+        for(int i=0;i<2000;i++) {
+            Math3D::Ray3D r;
+            r.source.set(u(rng),u(rng),u(rng));
+            r.source.inplaceNormalize();
+            r.source *= 8;
+            Math3D::Vector3 target(5*u(rng),5*u(rng),u(rng));
+            if(i%10 == 0) target = r.source*2;
+            r.direction = target - r.source;
+            r.direction.inplaceNormalize();
+            rays.push_back(r);
+        }
+    }
+};
+
+TEST_F(testWorldRayCaster, testMatchesWorld)
+{
+    WorldRayCaster caster;
+    caster.Build(world);
+    EXPECT_EQ(caster.NumBodies(),(int)(world.robots[0]->links.size()+world.terrains.size()+world.rigidObjects.size()));
+    int numHits = 0;
+    for(size_t i=0;i<rays.size();i++) {
+        Math3D::Vector3 pt;
+        int expected = world.RayCast(rays[i],pt);
+        Real dist;
+        int id = caster.RayCast(rays[i],dist);
+        ASSERT_EQ(id,expected) << "ray " << i;
+        if(id < 0) continue;
+        numHits++;
+        Math3D::Vector3 hit = rays[i].source + dist*rays[i].direction;
+        EXPECT_NEAR(hit.distance(pt),0,1e-8) << "ray " << i;
+        //a maximum distance short of the hit misses
+        EXPECT_EQ(caster.RayCast(rays[i],dist,dist*0.5),-1) << "ray " << i;
+    }
+    EXPECT_GT(numHits,(int)rays.size()/4);
+    EXPECT_LT(numHits,(int)rays.size());
+}
+
+TEST_F(testWorldRayCaster, testIgnore)
+{
+    std::vector<int> ignore;
+    ignore.push_back(world.RobotID(0));
+    for(size_t i=0;i<world.robots[0]->links.size();i++)
+        ignore.push_back(world.RobotLinkID(0,i));
+    ignore.push_back(world.TerrainID(0));
+    ignore.push_back(world.RigidObjectID(1));
+    WorldRayCaster caster;
+    caster.Build(world,ignore);
+    for(size_t i=0;i<rays.size();i++) {
+        Math3D::Vector3 pt;
+        int expected = world.RayCastIgnore(rays[i],ignore,pt);
+        Real dist;
+        ASSERT_EQ(caster.RayCast(rays[i],dist),expected) << "ray " << i;
+    }
+}
+
+TEST_F(testWorldRayCaster, testBatch)
+{
+    WorldRayCaster caster;
+    caster.Build(world);
+    std::vector<int> ids;
+    std::vector<Real> dists;
+    caster.RayCast(rays,ids,dists);
+    ASSERT_EQ(ids.size(),rays.size());
+    ASSERT_EQ(dists.size(),rays.size());
+    for(size_t i=0;i<rays.size();i++) {
+        Real dist;
+        EXPECT_EQ(ids[i],caster.RayCast(rays[i],dist));
+        if(ids[i] >= 0) EXPECT_EQ(dists[i],dist);
+    }
+    //threading doesn't change the results
+    caster.numThreads = 4;
+    caster.grainSize = 16;
+    std::vector<int> ids2;
+    std::vector<Real> dists2;
+    caster.RayCast(rays,ids2,dists2);
+    EXPECT_TRUE(ids2 == ids);
+    for(size_t i=0;i<rays.size();i++)
+        if(ids[i] >= 0) EXPECT_EQ(dists2[i],dists[i]);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,90 @@
+import gc
+import unittest
+from klampt import *
+from klampt.math import so3
+from klampt.model import sensing
+from klampt.model.create import primitives
+try:
+    import numpy as np
+except ImportError:
+    np = None
+
+@unittest.skipIf(np is None,"numpy is not available")
+class cameraBuffersTest(unittest.TestCase):
+
+    def setUp(self):
+        self.world = WorldModel()
+        self.world.loadRobot('tests/objects/chain.rob')
+        #a 1m box straddling the optical axis, 1.5m in front of the camera,
+        #away from the robot
+        primitives.box(1,1,1,center=(0,5,2),world=self.world,name='box')
+        self.sim = Simulator(self.world)
+        self.camera = SimRobotSensor(self.sim.controller(0),"camera","CameraSensor")
+        #a camera in world coordinates, looking along +z
+        sensing.set_sensor_xform(self.camera,(so3.identity(),[0,5,0]),link=-1)
+        self.camera.setSetting("useGLFramebuffers","0")
+        self.camera.setSetting("rgb","1")
+        self.camera.setSetting("depth","1")
+        self.camera.setSetting("segmentation","1")
+        self.camera.setSetting("xres","32")
+        self.camera.setSetting("yres","24")
+        self.sim.simulate(0.01)
+
+    def buffers(self):
+        return (self.camera.getColorImageBuffer(),self.camera.getDepthImageBuffer(),self.camera.getSegmentationImageBuffer())
+
+    def test_layout(self):
+        rgb,depth,seg = self.buffers()
+        self.assertEqual(rgb.shape,(24,32,3))
+        self.assertEqual(rgb.format,'B')
+        self.assertEqual(depth.shape,(24,32))
+        self.assertEqual(depth.format,'f')
+        self.assertEqual(seg.shape,(24,32))
+        self.assertEqual(seg.format,'i')
+        for view in (rgb,depth,seg):
+            self.assertTrue(view.readonly)
+            self.assertTrue(view.c_contiguous)
+        #numpy wraps the views without copying
+        a = np.asarray(depth)
+        self.assertTrue(np.shares_memory(a,np.asarray(depth)))
+        #the box is in the middle of the image, and the background is empty
+        self.assertAlmostEqual(float(a[12,16]),1.5,places=3)
+        self.assertEqual(int(np.asarray(seg)[12,16]),self.world.terrain(0).getID())
+        self.assertEqual(int(np.asarray(seg)[0,0]),-1)
+
+    def test_later_steps(self):
+        views = self.buffers()
+        copies = [np.array(v) for v in views]
+        #look away from the box, so the images change
+        sensing.set_sensor_xform(self.camera,(so3.rotation([1,0,0],2.0),[0,5,0]),link=-1)
+        self.sim.simulate(0.01)
+        for v,c in zip(views,copies):
+            self.assertTrue(np.array_equal(np.asarray(v),c))
+        self.assertFalse(np.array_equal(np.asarray(self.camera.getSegmentationImageBuffer()),copies[2]))
+
+    def test_resolution_change(self):
+        views = self.buffers()
+        copies = [np.array(v) for v in views]
+        self.camera.setSetting("xres","320")
+        self.camera.setSetting("yres","240")
+        self.sim.simulate(0.01)
+        self.assertEqual(self.camera.getDepthImageBuffer().shape,(240,320))
+        for v,c in zip(views,copies):
+            self.assertEqual(v.shape,c.shape)
+            self.assertTrue(np.array_equal(np.asarray(v),c))
+
+    def test_simulator_destroyed(self):
+        views = self.buffers()
+        copies = [np.array(v) for v in views]
+        arrays = [np.asarray(v) for v in views]
+        del views
+        del self.camera
+        del self.sim
+        del self.world
+        gc.collect()
+        #the arrays keep their views, and the views keep their memory
+        for a,c in zip(arrays,copies):
+            self.assertTrue(np.array_equal(a,c))
+
+if __name__ == '__main__':
+    unittest.main()